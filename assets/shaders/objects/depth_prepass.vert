@@ -1,17 +1,33 @@
 #version 430
 
 layout(location = 0) in vec3 in_position;
-layout(location = 4) in mat4 in_model_mat;
+layout(location = 4) in uint in_instance;
 
-uniform mat4 u_view_mat;
-uniform mat4 u_projection_mat;
+struct InstanceAttributes {
+	mat4 transform;
+};
+
+// indexed by the instance index, see `loader::GraphicsData`
+layout(std430, binding = 4) readonly buffer InstanceBlock {
+	InstanceAttributes u_instances[];
+};
+
+layout(std140, binding = 0) uniform CameraBlock {
+	mat4 u_view_mat;
+	mat4 u_projection_mat;
+	vec3 u_camera_pos;
+	float u_near_plane;
+};
 
 out gl_PerVertex {
 	vec4 gl_Position;
 };
+// the depth prepass and the main pass have to compute the exact same depth
+invariant gl_Position;
 
 void main() {
-	vec4 position_ws = in_model_mat * vec4(in_position, 1.0);
+	mat4 model_mat = u_instances[in_instance].transform;
+	vec4 position_ws = model_mat * vec4(in_position, 1.0);
 	vec4 position_vs = u_view_mat * position_ws;
 	vec4 position_cs = u_projection_mat * position_vs;
 	gl_Position = position_cs;
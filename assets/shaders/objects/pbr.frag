@@ -25,17 +25,29 @@ layout(binding = 5) uniform sampler2D u_ibl_brdf_lut;
 
 layout(binding = 6) uniform sampler2DArrayShadow u_shadow_map;
 
-uniform vec3 u_camera_pos;
+layout(std140, binding = 0) uniform CameraBlock {
+    mat4 u_view_mat;
+    mat4 u_projection_mat;
+    vec3 u_camera_pos;
+    float u_near_plane;
+};
+
+layout(std140, binding = 1) uniform SunBlock {
+    vec3 u_light_dir[LIGHT_COUNT];
+    vec3 u_light_radiance[LIGHT_COUNT];
+};
+
+layout(std140, binding = 2) uniform ShadowBlock {
+    mat4 u_shadow_view_mat[SHADOW_CASCADE_COUNT];
+    mat4 u_shadow_projection_mat[SHADOW_CASCADE_COUNT];
+    vec4 u_shadow_splits; // one per cascade
+};
+
 uniform vec3 u_albedo_fac;
 uniform vec3 u_occlusion_metallic_roughness_fac;
 uniform float u_normal_fac;
-uniform mat4 u_view_mat;
 
 uniform float u_shadow_depth_bias;
-uniform float u_shadow_splits[SHADOW_CASCADE_COUNT];
-
-uniform vec3 u_light_dir[LIGHT_COUNT];
-uniform vec3 u_light_radiance[LIGHT_COUNT];
 
 const float PI = 3.14159265359;
 
@@ -6,7 +6,16 @@ layout(location = 0) in vec3 in_position;
 layout(location = 1) in vec3 in_normal;
 layout(location = 2) in vec4 in_tangent;
 layout(location = 3) in vec2 in_uv;
-layout(location = 4) in mat4 in_model_mat;
+layout(location = 4) in uint in_instance;
+
+struct InstanceAttributes {
+	mat4 transform;
+};
+
+// indexed by the instance index, see `loader::GraphicsData`
+layout(std430, binding = 4) readonly buffer InstanceBlock {
+	InstanceAttributes u_instances[];
+};
 
 layout(location = 0) out vec3 out_position_ws; // world space
 layout(location = 1) out vec3 out_position_vs; // world space
@@ -15,17 +24,27 @@ layout(location = 3) out mat3 out_tbn; // uses location 2-4 because of mat3
 layout(location = 6) out vec3 out_shadow_position[SHADOW_CASCADE_COUNT]; // shadow ndc space
 layout(location = 10) out vec3 out_shadow_direction;
 
-uniform mat4 u_view_mat;
-uniform mat4 u_projection_mat;
+layout(std140, binding = 0) uniform CameraBlock {
+	mat4 u_view_mat;
+	mat4 u_projection_mat;
+	vec3 u_camera_pos;
+	float u_near_plane;
+};
+
+layout(std140, binding = 2) uniform ShadowBlock {
+	mat4 u_shadow_view_mat[SHADOW_CASCADE_COUNT];
+	mat4 u_shadow_projection_mat[SHADOW_CASCADE_COUNT];
+	vec4 u_shadow_splits; // one per cascade
+};
 
 layout(binding = 6) uniform sampler2DArrayShadow u_shadow_map;
-uniform mat4 u_shadow_view_mat[SHADOW_CASCADE_COUNT];
-uniform mat4 u_shadow_projection_mat[SHADOW_CASCADE_COUNT];
 uniform float u_shadow_normal_bias;
 
 out gl_PerVertex {
 	vec4 gl_Position;
 };
+// the depth prepass and the main pass have to compute the exact same depth
+invariant gl_Position;
 
 vec3 shadowSamplePosition(in mat4 view, in mat4 projection, vec3 position, vec3 normal, vec3 direction, float texel_size) {
 	vec4 shadow_ws = vec4(position, 1.0);
@@ -49,7 +68,8 @@ vec3 shadowSamplePosition(in mat4 view, in mat4 projection, vec3 position, vec3
 
 
 void main() {
-	vec4 position_ws = in_model_mat * vec4(in_position, 1.0);
+	mat4 model_mat = u_instances[in_instance].transform;
+	vec4 position_ws = model_mat * vec4(in_position, 1.0);
 	vec4 position_vs = u_view_mat * position_ws;
 	vec4 position_cs = u_projection_mat * position_vs;
 	gl_Position = position_cs;
@@ -58,7 +78,7 @@ void main() {
 	out_position_ws = position_ws.xyz;
 	out_uv = in_uv;
 	// NOTE: Non uniform scaling not supported!
-	mat3 normal_matrix = mat3(in_model_mat);
+	mat3 normal_matrix = mat3(model_mat);
 	vec3 T = normalize(normal_matrix * in_tangent.xyz);
 	vec3 N = normalize(normal_matrix * in_normal);
 	vec3 bitangent = cross(in_normal, in_tangent.xyz) * in_tangent.w;
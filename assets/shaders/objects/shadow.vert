@@ -1,12 +1,33 @@
 #version 430
+// replaced with a define by the `ShadowMapRenderer` to render all cascades at once
+#undef LAYERED
+#ifdef LAYERED
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_layer : enable
+#endif
 
+const int SHADOW_CASCADE_COUNT = 4;
 
 layout(location = 0) in vec3 in_position;
 layout(location = 1) in vec3 in_normal;
-layout(location = 4) in mat4 in_model_mat;
+layout(location = 4) in uint in_instance;
 
-uniform mat4 u_view_mat;
-uniform mat4 u_projection_mat;
+struct InstanceAttributes {
+	mat4 transform;
+};
+
+// indexed by the instance index, see `loader::GraphicsData`
+layout(std430, binding = 4) readonly buffer InstanceBlock {
+	InstanceAttributes u_instances[];
+};
+
+layout(std140, binding = 2) uniform ShadowBlock {
+	mat4 u_shadow_view_mat[SHADOW_CASCADE_COUNT];
+	mat4 u_shadow_projection_mat[SHADOW_CASCADE_COUNT];
+	vec4 u_shadow_splits; // one per cascade
+};
+
+uniform int u_cascade;
 uniform float u_size_bias;
 
 out gl_PerVertex {
@@ -14,5 +35,15 @@ out gl_PerVertex {
 };
 
 void main() {
-	gl_Position = u_projection_mat * u_view_mat * in_model_mat * vec4(in_position - in_normal * u_size_bias, 1.0);
+#ifdef LAYERED
+	// the culling packs the cascade into the upper two bits, see `InstanceCuller::cullShadows`
+	uint attributes = in_instance & 0x3fffffffu;
+	int cascade = int(in_instance >> 30);
+	gl_Layer = cascade;
+#else
+	uint attributes = in_instance;
+	int cascade = u_cascade;
+#endif
+	mat4 model_mat = u_instances[attributes].transform;
+	gl_Position = u_shadow_projection_mat[cascade] * u_shadow_view_mat[cascade] * model_mat * vec4(in_position - in_normal * u_size_bias, 1.0);
 }
\ No newline at end of file
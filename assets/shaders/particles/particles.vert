@@ -12,18 +12,29 @@ struct Particle {
     int emitter;
 };
 
+// Has to match `EmitterShaderValues` in ParticleSystem.cpp
+struct Emitter {
+    // segment index, segment length, material slot or -1 when the particles are not drawn
+    ivec4 index_length;
+    vec4 gravity;
+    // 1f emissivity, 1f stretching
+    vec4 emissivity_stretching;
+};
+
 layout(std430, binding = 0) readonly restrict buffer Particles {
     Particle particles[];
 };
 
+layout(std430, binding = 3) readonly restrict buffer Emitters {
+    Emitter emitters[];
+};
+
 layout(location = 0) in vec2 in_position;
+// index of a live particle, written by the update pass
+layout(location = 1) in uint in_particle;
 
 uniform mat4 u_projection_mat;
 uniform mat4 u_view_mat;
-uniform int u_base_index;
-
-uniform float u_emissivity;
-uniform float u_stretching;
 layout(binding = 1) uniform sampler1DArray u_tint;
 layout(binding = 2) uniform sampler2D u_scale;
 
@@ -39,9 +50,8 @@ const float PI = 3.14159265359;
 const float DEG_TO_RAD = PI / 180.0;
 
 void main() {
-    // could also use version 460 and gl_BaseInstance
-    int index = gl_InstanceID + u_base_index;
-    Particle particle = particles[index];
+    Particle particle = particles[in_particle];
+    Emitter emitter = emitters[particle.emitter];
     float life_frac = 1.0 - particle.size_life.z / particle.size_life.w;
     float rand = particle.drag_gravity_rand.z;
 
@@ -54,7 +64,7 @@ void main() {
     
     // stretching
     vec3 view_velocity = mat3(u_view_mat) * particle.velocity_revolutions.xyz;
-    local_position += dot(normalize(view_velocity.xy), local_position) * view_velocity.xy * u_stretching;
+    local_position += dot(normalize(view_velocity.xy), local_position) * view_velocity.xy * emitter.emissivity_stretching.y;
 
 	vec4 view_position = u_view_mat * vec4(particle.position_rotation.xyz, 1.0);
 
@@ -67,10 +77,5 @@ void main() {
 
     vec2 tint_uv = vec2(life_frac, rand * textureSize(u_tint, 0).y);
 	out_tint = texture(u_tint, tint_uv).rgb;
-    out_emission = u_emissivity;
-
-	if(particle.size_life.z <= 0.0) {
-		// place particle outside the clip space to skip the fragment shader
-		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
-	}
+    out_emission = emitter.emissivity_stretching.x;
 }
\ No newline at end of file
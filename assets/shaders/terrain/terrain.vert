@@ -1,8 +1,11 @@
 #version 450
 layout(location = 0) in vec2 in_position;
 layout(location = 1) in vec2 in_texture_coord;
+// the shadow cascade for layered rendering, zero otherwise
+layout(location = 2) in uint in_layer;
 
 layout(location = 0) out vec2 out_texture_coord;
+layout(location = 1) out uint out_layer;
 
 uniform vec3 u_position;
 
@@ -14,6 +17,7 @@ out gl_PerVertex
 void main()
 {
     out_texture_coord = in_texture_coord;
+    out_layer = in_layer;
     gl_Position = vec4(vec3(in_position.x, 0.0, in_position.y) + u_position, 1);
 }
 
@@ -13,17 +13,23 @@ layout(location = 4) in float in_crest;
 layout(location = 0) out vec4 out_color;
 layout(location = 1) out vec2 out_normal;
 
-uniform vec3 u_camera_pos;
-uniform float u_near_plane;
+layout(std140, binding = 0) uniform CameraBlock {
+    mat4 u_view_mat;
+    mat4 u_projection_mat;
+    vec3 u_camera_pos;
+    float u_near_plane;
+};
+
+layout(std140, binding = 1) uniform SunBlock {
+    vec3 u_light_dir[LIGHT_COUNT];
+    vec3 u_light_radiance[LIGHT_COUNT];
+};
 
 layout(binding = 2) uniform sampler2D u_depth_tex;
 layout(binding = 4) uniform samplerCube u_ibl_diffuse;
 layout(binding = 5) uniform samplerCube u_ibl_specualr;
 layout(binding = 6) uniform sampler2D u_ibl_brdf_lut;
 
-uniform vec3 u_light_dir[LIGHT_COUNT];
-uniform vec3 u_light_radiance[LIGHT_COUNT];
-
 const float PI = 3.14159265359;
 
 // Octahedral Normal Packing
@@ -8,6 +8,7 @@
 #include "../Debug/Direct.h"
 #include "../Debug/ImGuiBackend.h"
 #include "../GL/Framebuffer.h"
+#include "../GL/Upload.h"
 #include "../Game.h"
 #include "../Input.h"
 #include "../Loader/Environment.h"
@@ -17,6 +18,8 @@
 #include "../Particles/ParticleSystem.h"
 #include "../Physics/Physics.h"
 #include "../Renderer/DepthPrepassRenderer.h"
+#include "../Renderer/FrameUniforms.h"
+#include "../Renderer/InstanceCuller.h"
 #include "../Renderer/MaterialBatchRenderer.h"
 #include "../Renderer/SkyRenderer.h"
 #include "../Renderer/TerrainRenderer.h"
@@ -51,6 +54,8 @@ MainController::MainController(Game &game)
 }
 
 MainController::~MainController() {
+    // queued uploads write into the textures and buffers that are deleted here
+    gl::uploads->finish();
     JPH::BodyInterface &physics = game.physics->interface();
     if (sceneData != nullptr) {
         for (loader::PhysicsInstance &instance : sceneData->physics.instances) {
@@ -76,10 +81,15 @@ void MainController::load() {
                     .scale = "assets/textures/particle/fire_scale.png",
                 });
 
+    // the driver compiles the shaders while the assets are loading
+    materialBatchRenderer = std::make_unique<MaterialBatchRenderer>();
+    skyRenderer = std::make_unique<SkyRenderer>();
+    waterTRenderer = std::make_unique<WaterRenderer>();
     shadowRenderer = std::make_unique<ShadowMapRenderer>();
     terrainRenderer = std::make_unique<TerrainRenderer>();
     depthPrepassRenderer = std::make_unique<DepthPrepassRenderer>();
-    csm = std::make_unique<CSM>(2048, 1.0f / 30.0f);
+    csm = std::make_unique<CSM>(2048);
+    frameUniforms = std::make_unique<FrameUniforms>();
 
     game.audio->assets->bgm.pause();
     game.audio->assets->bgm.seek(0);
@@ -91,13 +101,10 @@ bool MainController::useHdr() {
 
 void MainController::applyLoadResult_() {
     LOG_INFO("Finished loading");
-    MainControllerLoader::Data data = loader->result();
+    MainControllerLoader::Data &data = loader->result();
     JPH::BodyInterface &physics = game.physics->interface();
 
-    materialBatchRenderer = std::make_unique<MaterialBatchRenderer>();
     iblEnv = std::make_unique<loader::Environment>(*data.environment, *data.environmentDiffuse, *data.environmentSpecular, *data.iblBrdfLut);
-    skyRenderer = std::make_unique<SkyRenderer>();
-    waterTRenderer = std::make_unique<WaterRenderer>();
     if (terrain != nullptr) {
         physics.RemoveBody(terrain->physicsBody()->GetID());
         terrain->destroyPhysicsBody(physics);
@@ -107,20 +114,21 @@ void MainController::applyLoadResult_() {
     water = std::make_unique<loader::Water>(*data.water, 4096.0f * 4, 40.0f, glm::vec3(0, 40, 0), 40);
     physics.AddBody(terrain->physicsBody()->GetID(), JPH::EActivation::DontActivate);
 
-    if (!data.gltf) return;
+    if (!data.scene) return;
 
     // Should only ever be called once per instance
 
-    LOG_INFO("Creating scene from gltf data");
+    LOG_INFO("Creating scene");
     fader->fade(1.0f, 0.0f, 0.3f);
     startScreen->open();
 
-    sceneData = std::unique_ptr<loader::SceneData>(loader::scene(*data.gltf));
+    sceneData = std::unique_ptr<loader::SceneData>(loader::scene(*data.scene));
     for (loader::PhysicsInstance &instance : sceneData->physics.instances) {
         JPH::BodyID id = physics.CreateAndAddBody(instance.settings, JPH::EActivation::DontActivate);
         if (!instance.id.IsInvalid()) PANIC("Instance already has a physics body id");
         instance.id = id;
     }
+    instanceCuller = std::make_unique<InstanceCuller>(sceneData->graphics);
 
     scene::NodeEntityFactory factory;
     scene::registerEntityTypes(factory);
@@ -153,7 +161,7 @@ void MainController::applyLoadResult_() {
         .speed = player_spawn.prop("speed", 5.0f),
         .boostMeter = 1.0,
     };
-    raceManager = RaceManager(character, data.gltf->scenes[data.gltf->defaultScene].name, spawn);
+    raceManager = RaceManager(character, sceneData->name, spawn);
     raceManager.loadCheckpoints(first_checkpoint.entity<CheckpointEntity>());
 
     character->respawn();
@@ -171,6 +179,9 @@ void MainController::update() {
         return;
     } else if (loader->isDone()) {
         applyLoadResult_();
+        // the loading screen stays open until the textures and meshes are uploaded
+        loader->awaitUploads();
+        if (loader->isLoading()) return;
     }
 
     // pausing
@@ -214,8 +225,9 @@ void MainController::update() {
 
     // Update entities
     scene->callEntityUpdate(time_delta);
+    scene->updateTransforms();
 
-    game.particles->update(time_delta);
+    game.particles->update(time_delta, *game.camera);
 
     if (raceManager.hasEnded() && !scoreScreen->opened()) {
         ScoreEntry score = raceManager.score();
@@ -249,25 +261,33 @@ void MainController::render() {
     }
 
     game.camera->updateViewMatrix();
+    frameUniforms->update(*game.camera, game.debugSettings.rendering.sun);
+    frameUniforms->bind();
+    // the draws of this frame use a snapshot of the instance attributes
+    sceneData->graphics.upload();
 
     if (game.debugSettings.entity.debugDrawEnabled) {
         for (auto &&ent : scene->entities) ent->debugDraw();
     }
 
-    if (csm->update(*game.camera, game.debugSettings.rendering.sun.direction(), game.input->timeDelta())) {
-        shadowRenderer->render(*csm, *game.camera, sceneData->graphics, *terrain);
+    if (csm->update(*game.camera, game.debugSettings.rendering.sun.direction())) {
+        frameUniforms->updateShadows(*csm);
+        instanceCuller->cullShadows(*csm, shadowRenderer->layered());
+        shadowRenderer->render(*csm, *game.camera, *instanceCuller, *terrain);
     }
 
     game.hdrFramebuffer().bind(GL_DRAW_FRAMEBUFFER);
+    instanceCuller->cull(*game.camera, *game.depthPyramid);
     // Depth prepass
-    // Does not work! Because model matrix update is unsynchronized.
-    // game.hdrFramebuffer().bindTargets({});
-    // depthPrepassRenderer->render(*game.camera, sceneData->graphics, *terrain);
+    if (game.debugSettings.rendering.depthPrepass) {
+        game.hdrFramebuffer().bindTargets({});
+        depthPrepassRenderer->render(*game.camera, *instanceCuller, *terrain);
+    }
 
     game.hdrFramebuffer().bindTargets({0, 1});
-    terrainRenderer->render(*game.camera, *terrain, *csm, *iblEnv, game.debugSettings.rendering.sun);
-    materialBatchRenderer->render(*game.camera, sceneData->graphics, *csm, *iblEnv, game.debugSettings.rendering.sun);
-    waterTRenderer->render(*game.camera, *water, *iblEnv, game.debugSettings.rendering.sun, game.hdrFramebuffer().getTexture(GL_DEPTH_ATTACHMENT));
+    terrainRenderer->render(*game.camera, *terrain, *csm, *iblEnv);
+    materialBatchRenderer->render(*game.camera, sceneData->graphics, *instanceCuller, *csm, *iblEnv);
+    waterTRenderer->render(*game.camera, *water, *iblEnv, game.hdrFramebuffer().getTexture(GL_DEPTH_ATTACHMENT));
     game.hdrFramebuffer().bindTargets({0});
     game.particles->draw(*game.camera);
     skyRenderer->render(*game.camera, *iblEnv);
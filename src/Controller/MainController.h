@@ -22,6 +22,8 @@ class FreeCamEntity;
 class Music;
 class WaterRenderer;
 class CSM;
+class FrameUniforms;
+class InstanceCuller;
 namespace loader {
 class SceneData;
 class Terrain;
@@ -44,12 +46,14 @@ class MainController : public AbstractController {
     std::unique_ptr<DepthPrepassRenderer> depthPrepassRenderer;
 
     std::unique_ptr<loader::SceneData> sceneData;
+    std::unique_ptr<InstanceCuller> instanceCuller;
     std::unique_ptr<scene::Scene> scene;
     std::unique_ptr<loader::Environment> iblEnv;
     std::unique_ptr<loader::Terrain> terrain;
     std::unique_ptr<loader::Water> water;
     std::unique_ptr<MainControllerLoader> loader;
     std::unique_ptr<CSM> csm;
+    std::unique_ptr<FrameUniforms> frameUniforms;
 
     std::unique_ptr<ScoreScreen> scoreScreen;
     std::unique_ptr<StartScreen> startScreen;
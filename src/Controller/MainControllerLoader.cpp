@@ -3,6 +3,8 @@
 
 #include <functional>
 
+#include "../GL/Shader.h"
+#include "../GL/Upload.h"
 #include "../Loader/Environment.h"
 #include "../Loader/Gltf.h"
 #include "../Loader/Terrain.h"
@@ -13,72 +15,109 @@ MainControllerLoader::MainControllerLoader() {
     screen_ = std::make_unique<LoadingScreen>();
 }
 
-void MainControllerLoader::queueOperations_(TaskPool<Data>& pool, bool load_gltf) {
-    if (load_gltf) {
-        pool.add([](Data& out) {
-            out.gltf = std::make_unique<tinygltf::Model>(
-                loader::gltf("assets/models/test_course.glb"));
+jobs::JobHandle MainControllerLoader::queueJobs_(jobs::JobSystem& jobs, std::shared_ptr<Data> out, bool load_scene) {
+    const jobs::Priority priority = jobs::Priority::Low;
+    std::vector<jobs::JobHandle> handles;
+    auto add = [&](auto&& job) {
+        handles.push_back(jobs.submit(std::move(job), {}, priority));
+    };
+
+    if (load_scene) {
+        add([out]() {
+            out->scene = loader::sceneSource(
+                "assets/models/test_course.glb",
+                "ascent_data/test_course.ascent_scene");
         });
     }
 
-    pool.add([](Data& out) {
-        out.environment = std::unique_ptr<loader::EnvironmentImage>(
+    add([out]() {
+        out->environment = std::unique_ptr<loader::EnvironmentImage>(
             loader::environment("assets/textures/skybox/kloofendal.iblenv"));
     });
 
-    pool.add([](Data& out) {
-        out.environmentDiffuse = std::unique_ptr<loader::EnvironmentImage>(
+    add([out]() {
+        out->environmentDiffuse = std::unique_ptr<loader::EnvironmentImage>(
             loader::environment("assets/textures/skybox/kloofendal_diffuse.iblenv"));
     });
 
-    pool.add([](Data& out) {
-        out.environmentSpecular = std::unique_ptr<loader::EnvironmentImage>(
+    add([out]() {
+        out->environmentSpecular = std::unique_ptr<loader::EnvironmentImage>(
             loader::environment("assets/textures/skybox/kloofendal_specular.iblenv"));
     });
 
-    pool.add([](Data& out) {
-        out.iblBrdfLut = std::unique_ptr<loader::FloatImage>(
+    add([out]() {
+        out->iblBrdfLut = std::unique_ptr<loader::FloatImage>(
             loader::floatImage("assets/textures/ibl_brdf_lut.f32"));
     });
 
-    pool.add([](Data& out) {
-        out.terrain = std::make_unique<loader::TerrainData>(
-            loader::TerrainData::Files{
-                .albedo = "assets/textures/terrain_albedo.dds",
-                .height = "assets/textures/terrain_height.png",
-                .occlusion = "assets/textures/terrain_ao.png",
-                .normal = "assets/textures/terrain_normal.png",
-            });
-    });
-    pool.add([](Data& out) {
-        out.water = std::make_unique<loader::WaterData>(
+    // the terrain queues its own jobs, so that the collision is built while the textures are decoded
+    auto terrain = loader::TerrainData::load(
+        jobs,
+        loader::TerrainData::Files{
+            .albedo = "assets/textures/terrain_albedo.dds",
+            .height = "assets/textures/terrain_height.png",
+            .occlusion = "assets/textures/terrain_ao.png",
+            .normal = "assets/textures/terrain_normal.png",
+        });
+    handles.push_back(jobs.submit([out, terrain]() { out->terrain = terrain.get(); }, {terrain}, priority));
+
+    add([out]() {
+        out->water = std::make_unique<loader::WaterData>(
             loader::WaterData::Files{.height = "assets/textures/water_displace.png"});
     });
+
+    return jobs.all(handles, priority);
 }
 
 void MainControllerLoader::load() {
-    taskPool_ = std::make_unique<TaskPool<Data>>();
-    queueOperations_(*taskPool_, firstTime_);
+    // uploads may still read from the previous result
+    gl::uploads->finish();
+    uploading_ = false;
+
+    data_ = std::make_shared<Data>();
+    task_ = queueJobs_(*jobs::pool, data_, firstTime_);
     loading_ = true;
     if (firstTime_) {
-        screen_->open(taskPool_.get());
-        taskPool_->runAsync();
+        screen_->open();
     } else {
-        taskPool_->runSync();
+        // the main thread helps with loading
+        task_.wait();
     }
     firstTime_ = false;
 }
 
+void MainControllerLoader::update() {
+    // the shaders are checked once the driver is done, so that doesn't block either
+    if (uploading_ && gl::uploads->idle() && gl::ShaderProgram::allCompiled()) {
+        uploading_ = false;
+        data_.reset();
+        gl::ShaderProgram::finishAll();
+        screen_->close();
+    }
+    // isLoading is called multiple times per frame, but it must always return the same value;
+    loading_ = (task_.valid() && !task_.isDone()) || uploading_;
+}
+
 void MainControllerLoader::draw() {
-    if (taskPool_ == nullptr) {
+    if (!task_.valid() && !uploading_) {
         return;
     }
     screen_->draw();
 }
 
-MainControllerLoader::Data MainControllerLoader::result() {
-    Data data = std::move(taskPool_->result());
-    taskPool_.reset();
-    screen_->close();
-    return data;
-}
\ No newline at end of file
+MainControllerLoader::Data &MainControllerLoader::result() {
+    task_.wait();
+    task_ = {};
+    return *data_;
+}
+
+void MainControllerLoader::awaitUploads() {
+    if (screen_->opened()) {
+        uploading_ = true;
+        loading_ = true;
+        return;
+    }
+    gl::uploads->finish();
+    gl::ShaderProgram::finishAll();
+    data_.reset();
+}
@@ -1,7 +1,7 @@
 #pragma once
 
 #include "../UI/Screens/Loading.h"
-#include "../Util/TaskPool.h"
+#include "../Util/Jobs.h"
 
 #pragma region ForwardDecl
 namespace loader {
@@ -9,11 +9,8 @@ class EnvironmentImage;
 struct FloatImage;
 struct TerrainData;
 struct WaterData;
+struct SceneSource;
 }  // namespace loader
-namespace tinygltf {
-class Model;
-class LoadingScreen;
-}  // namespace tinygltf
 
 #pragma endregion
 
@@ -25,18 +22,22 @@ class MainControllerLoader {
         std::unique_ptr<loader::EnvironmentImage> environmentDiffuse;
         std::unique_ptr<loader::FloatImage> iblBrdfLut;
 
-        std::unique_ptr<const tinygltf::Model> gltf;
-        std::unique_ptr<loader::TerrainData> terrain;
+        std::unique_ptr<loader::SceneSource> scene;
+        std::shared_ptr<loader::TerrainData> terrain;
         std::unique_ptr<loader::WaterData> water;
     };
 
    private:
     bool firstTime_ = true;
-    std::unique_ptr<TaskPool<Data>> taskPool_;
+    std::shared_ptr<Data> data_;
+    // done once all loading jobs are done
+    jobs::JobHandle task_;
     std::unique_ptr<LoadingScreen> screen_;
     bool loading_ = false;
+    // the result is applied, but its gpu uploads are still queued or its shaders are compiling
+    bool uploading_ = false;
 
-    static void queueOperations_(TaskPool<Data>& pool, bool load_gltf);
+    static jobs::JobHandle queueJobs_(jobs::JobSystem& jobs, std::shared_ptr<Data> out, bool load_scene);
 
    public:
     MainControllerLoader();
@@ -44,23 +45,28 @@ class MainControllerLoader {
 
     void load();
 
-    void update() {
-        // isLoading is called multiple times per frame, but it must always return the same value;
-        loading_ = taskPool_ != nullptr && !taskPool_->isFinished();
-    }
+    void update();
 
     bool isLoading() {
         return loading_;
     }
 
     bool isDone() {
-        return !loading_ && taskPool_ != nullptr;
+        return !loading_ && task_.valid();
     }
 
     void draw();
 
     /**
-     * Returns the result and releases the task
+     * Returns the result and releases the task.
+     * The result stays alive until `awaitUploads` is done, uploads may read from it.
+     * Rethrows the exception of a failed loading job.
+     */
+    Data &result();
+
+    /**
+     * Keep loading until the uploads queued from the result are done and all shaders are compiled.
+     * The first load keeps the loading screen open, reloads wait for the gpu.
      */
-    Data result();
+    void awaitUploads();
 };
\ No newline at end of file
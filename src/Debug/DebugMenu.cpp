@@ -8,9 +8,11 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include "../GL/StateManager.h"
 #include "../Game.h"
 #include "../Input.h"
 #include "../Particles/ParticleSystem.h"
+#include "../Physics/Benchmark.h"
 #include "../Physics/Physics.h"
 #include "Direct.h"
 #include "Settings.h"
@@ -61,6 +63,29 @@ void DebugMenu::drawDebugWindow_() {
         if (Checkbox("Debug Draw", &debug_draw_enabled)) {
             physics.setDebugDrawEnabled(debug_draw_enabled);
         }
+
+        // Compares single threaded and multithreaded stepping on the loaded course, this freezes the game for a while
+        if (Button("Benchmark")) {
+            state.physics.benchmark = ph::benchmark(physics, game.camera->position, {0, 250, 1000, 4000}, 300);
+        }
+        if (!state.physics.benchmark.empty() && BeginTable("benchmark", 4)) {
+            TableSetupColumn("Bodies");
+            TableSetupColumn("Threads");
+            TableSetupColumn("Avg ms");
+            TableSetupColumn("Max ms");
+            TableHeadersRow();
+            for (auto&& result : state.physics.benchmark) {
+                TableNextColumn();
+                Text("%u", result.bodies);
+                TableNextColumn();
+                Text("%s", result.multithreaded ? "multi" : "single");
+                TableNextColumn();
+                Text("%.2f", result.average);
+                TableNextColumn();
+                Text("%.2f", result.max);
+            }
+            EndTable();
+        }
         Unindent();
         PopID();
     }
@@ -79,6 +104,10 @@ void DebugMenu::drawDebugWindow_() {
         PushID("rendering");
         Indent();
         Checkbox("Normal Mapping", &settings.rendering.normalMapsEnabled);
+        Checkbox("Depth Prepass", &settings.rendering.depthPrepass);
+        Checkbox("Frustum Culling", &settings.rendering.culling.enabled);
+        Checkbox("GPU Culling", &settings.rendering.culling.gpu);
+        Checkbox("Occlusion Culling", &settings.rendering.culling.occlusion);
 
         if (CollapsingHeader("Bloom")) {
             SliderFloat("Factor", &settings.rendering.bloom.factor, 0.0f, 1.0f);
@@ -139,6 +168,9 @@ void DebugMenu::drawDebugWindow_() {
         if (CollapsingHeader("Shadow")) {
             PushID("shadow");
             Checkbox("Debug Draw", &settings.rendering.shadow.debugDrawEnabled);
+            Checkbox("Layered", &settings.rendering.shadow.layered);
+            Checkbox("Incremental Updates", &settings.rendering.shadow.incremental);
+            Checkbox("Static Cache", &settings.rendering.shadow.staticCache);
             SliderFloat("Split Lambda", &settings.rendering.shadow.cascadeSplitLambda, 0.0, 1.0);
             DragFloat("Normal Bias", &settings.rendering.shadow.normalBias);
             SliderFloat("Size Bias", &settings.rendering.shadow.sizeBias, -300, 300);
@@ -210,6 +242,8 @@ void DebugMenu::drawPerformanceWindow_() {
 
     auto draw_list = GetWindowDrawList();
     Text("%4d fps", frameTimes.current <= 0.00001f ? 0 : (int)(1.0f / frameTimes.current));
+    const gl::StateStats& state_stats = gl::manager->frameStats();
+    Text("%4d state changes, %d skipped", state_stats.issued, state_stats.skipped);
     frameTimes.single[frameTimes.singleIndex] = frameTimes.current * 1000;
     frameTimes.singleIndex = (frameTimes.singleIndex + 1) % frameTimes.single.size();
     auto sixty_fps_line_point = GetCursorScreenPos() + ImVec2{0, 48};
@@ -274,6 +308,7 @@ void DebugMenu::drawParticlesWindow_() {
 
     // Misc
     LabelText("Reserved", "%d/%d", particles.reserved(), particles.capacity());
+    Checkbox("LOD", &particles.lod);
 
     auto format_system_name = [](ParticleEmitter& emitter) {
         glm::vec3 pos = emitter.settings().position;
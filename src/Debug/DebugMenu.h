@@ -2,6 +2,9 @@
 
 #include <array>
 #include <string>
+#include <vector>
+
+#include "../Physics/Benchmark.h"
 
 // Not actually a screen
 class DebugMenu {
@@ -31,6 +34,9 @@ class DebugMenu {
         struct Particles {
             int selected = -1;
         } particles;
+        struct Physics {
+            std::vector<ph::BenchmarkResult> benchmark;
+        } physics;
     } state;
 
     void drawDebugWindow_();
@@ -34,6 +34,12 @@ glm::vec3 perpendicular(glm::vec3 v) {
     return glm::cross(v, e);
 }
 
+// Drawn slightly in front of the geometry
+static const gl::PipelineState PIPELINE_STATE = {
+    .capabilities = gl::capabilityBits({gl::Capability::DepthTest, gl::Capability::PolygonOffsetFill}),
+    .polygonOffset = {-1, -1, 0},
+};
+
 DirectBuffer::DirectBuffer() {
     shader_ = new gl::ShaderPipeline(
         {new gl::ShaderProgram("assets/shaders/direct.vert"),
@@ -356,10 +362,7 @@ void DirectBuffer::render(glm::mat4 view_proj_mat, glm::vec3 camera_pos) {
     shader_->bind();
     shader_->vertexStage()->setUniform("u_view_projection_mat", view_proj_mat);
     shader_->fragmentStage()->setUniform("u_camera_position", camera_pos);
-    gl::manager->setEnabled({gl::Capability::DepthTest, gl::Capability::PolygonOffsetFill});
-    gl::manager->depthFunc(gl::DepthFunc::GreaterOrEqual);
-    gl::manager->depthMask(true);
-    gl::manager->polygonOffset(-1, -1);
+    gl::manager->apply(PIPELINE_STATE);
     glDrawArrays(GL_TRIANGLES, 0, data_.size() / 9);
 
     clear();
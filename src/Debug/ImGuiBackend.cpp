@@ -14,6 +14,14 @@ static ImGuiKey mapGlfwKey(int key);
 
 namespace ui {
 
+static const gl::PipelineState PIPELINE_STATE = {
+    .capabilities = gl::capabilityBits({gl::Capability::Blend, gl::Capability::ScissorTest}),
+    .blendSrcRgb = gl::BlendFactor::SrcAlpha,
+    .blendDstRgb = gl::BlendFactor::OneMinusSrcAlpha,
+    .blendSrcAlpha = gl::BlendFactor::One,
+    .blendDstAlpha = gl::BlendFactor::OneMinusSrcAlpha,
+};
+
 ImGuiBackend::ImGuiBackend() {
     if (ImGui::GetCurrentContext() == nullptr)
         PANIC("No ImGui Context");
@@ -119,9 +127,7 @@ void ImGuiBackend::render() {
     ImDrawData* draw_data = ImGui::GetDrawData();
 
     gl::pushDebugGroup("ImGui::Draw");
-    gl::manager->setEnabled({gl::Capability::Blend, gl::Capability::ScissorTest});
-    gl::manager->blendEquation(gl::BlendEquation::FuncAdd);
-    gl::manager->blendFuncSeparate(gl::BlendFactor::SrcAlpha, gl::BlendFactor::OneMinusSrcAlpha, gl::BlendFactor::One, gl::BlendFactor::OneMinusSrcAlpha);
+    gl::manager->apply(PIPELINE_STATE);
 
     vao_->bind();
     shader_->bind();
@@ -10,6 +10,16 @@ struct DebugSettings {
     };
     struct Rendering {
         bool normalMapsEnabled = true;
+        // render the depth before shading
+        bool depthPrepass = true;
+
+        struct Culling {
+            bool enabled = true;
+            // cull on the gpu instead of the cpu, only the gpu supports occlusion culling
+            bool gpu = false;
+            // test against the depth pyramid of the previous frame, only used by gpu culling
+            bool occlusion = true;
+        } culling;
 
         struct Bloom {
             float factor = 1.0f;
@@ -53,6 +63,12 @@ struct DebugSettings {
 
         struct Shadow {
             bool debugDrawEnabled = false;
+            // render all cascades in one pass, if the driver supports it
+            bool layered = true;
+            // update the far cascades in turns and only move cascades when needed
+            bool incremental = true;
+            // keep the terrain of each cascade until the cascade moves
+            bool staticCache = true;
             float cascadeSplitLambda = 0.75f;
             float normalBias = 300.0f;
             float sizeBias = 5.0f;
@@ -10,4 +10,5 @@ class ShaderPipeline;
 class Texture;
 class Sampler;
 class Sync;
+class Staging;
 }  // namespace gl
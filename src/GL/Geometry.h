@@ -77,6 +77,12 @@ class Buffer : public GLObject {
         glUnmapNamedBuffer(id_);
         isMapped_ = false;
     }
+
+    // Make writes to a range of a buffer mapped with `GL_MAP_FLUSH_EXPLICIT_BIT` visible
+    // [Reference](https://registry.khronos.org/OpenGL-Refpages/gl4/html/glFlushMappedBufferRange.xhtml)
+    void flushRange(size_t offset, size_t length) {
+        glFlushMappedNamedBufferRange(id_, offset, length);
+    }
 };
 
 // References:
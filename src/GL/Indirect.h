@@ -13,4 +13,14 @@ struct DrawElementsIndirectCommand {
     uint32_t baseInstance;
 };
 
+// [Reference](https://registry.khronos.org/OpenGL-Refpages/gl4/html/glDrawArraysIndirect.xhtml#:~:text=packed%20into%20a%20structure)
+struct DrawArraysIndirectCommand {
+    // The vertex count
+    uint32_t count;
+    uint32_t instanceCount;
+    // The first vertex in the vbo
+    uint32_t first;
+    uint32_t baseInstance;
+};
+
 }  // namespace gl
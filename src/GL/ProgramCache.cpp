@@ -0,0 +1,141 @@
+#include "ProgramCache.h"
+
+#include <xxhash.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+
+#include "../Loader/Loader.h"
+#include "../Util/Log.h"
+#include "StateManager.h"
+
+namespace gl {
+
+const uint32_t PROGRAM_CACHE_MAGIC_NUMBER = 0x5badc0de;
+
+// force tight packing
+#pragma pack(push, 1)
+struct ProgramCacheHeader {
+    uint32_t check;
+    GLenum format;
+    // detects hash collisions of the file name
+    uint64_t key;
+};
+#pragma pack(pop)
+
+ProgramCache::ProgramCache(std::string directory) : directory_(directory) {
+    driver_ = manager->environment().driver;
+
+    GLint format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    formats_.resize(format_count);
+    if (format_count > 0) {
+        glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats_.data());
+    }
+    if (formats_.empty()) {
+        LOG_INFO("Program binaries are not supported, the shader cache is disabled");
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(directory_, error);
+    if (error) {
+        LOG_WARN("Could not create shader cache directory '" << directory_ << "': " << error.message());
+        formats_.clear();
+    }
+}
+
+ProgramCache::~ProgramCache() {
+    if (hits_ + misses_ > 0) {
+        LOG_INFO("Shader cache: " << hits_ << " hits, " << misses_ << " misses");
+    }
+}
+
+std::string ProgramCache::filename_(uint64_t key) const {
+    return std::format("{}/{:016x}.bin", directory_, key);
+}
+
+uint64_t ProgramCache::key(const std::string &source, GLenum stage) const {
+    // the stage seeds the source hash, which in turn seeds the driver hash
+    uint64_t hash = XXH64(source.data(), source.size(), stage);
+    return XXH64(driver_.data(), driver_.size(), hash);
+}
+
+GLuint ProgramCache::load(uint64_t key) {
+    if (!enabled()) return 0;
+
+    std::string filename = filename_(key);
+    if (!std::filesystem::exists(filename)) {
+        misses_++;
+        return 0;
+    }
+
+    auto file = loader::file(filename);
+    ProgramCacheHeader header = {};
+    if (file->size() > sizeof(header)) {
+        std::memcpy(&header, file->data(), sizeof(header));
+    }
+    // an unsupported format would cause a gl error
+    bool supported = std::find(formats_.begin(), formats_.end(), static_cast<GLint>(header.format)) != formats_.end();
+    if (header.check != PROGRAM_CACHE_MAGIC_NUMBER || header.key != key || !supported) {
+        LOG_DEBUG("Ignoring invalid shader cache entry: " << filename);
+        misses_++;
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramParameteri(program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+    glProgramBinary(program, header.format, file->data() + sizeof(header), static_cast<GLsizei>(file->size() - sizeof(header)));
+
+    GLint ok;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (ok == GL_FALSE) {
+        // e.g. after a driver update
+        LOG_DEBUG("Driver rejected cached program binary: " << filename);
+        glDeleteProgram(program);
+        misses_++;
+        return 0;
+    }
+
+    hits_++;
+    return program;
+}
+
+void ProgramCache::store(uint64_t key, GLuint program) {
+    if (!enabled()) return;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<uint8_t> data(sizeof(ProgramCacheHeader) + length);
+    ProgramCacheHeader header = {.check = PROGRAM_CACHE_MAGIC_NUMBER, .format = 0, .key = key};
+    glGetProgramBinary(program, length, nullptr, &header.format, data.data() + sizeof(header));
+    std::memcpy(data.data(), &header, sizeof(header));
+
+    // write to a temporary file first, so a crash never leaves a partial entry
+    std::string filename = filename_(key);
+    std::string temp_filename = filename + ".tmp";
+    std::ofstream file(temp_filename, std::ios::binary);
+    if (!file.is_open()) {
+        LOG_WARN("Error opening file: " + temp_filename);
+        return;
+    }
+    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+    file.close();
+    if (file.fail()) {
+        LOG_WARN("Error writing shader cache entry: " + temp_filename);
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_filename, filename, error);
+    if (error) {
+        LOG_WARN("Error writing shader cache entry: " + filename);
+    }
+}
+
+}  // namespace gl
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Object.h"
+
+namespace gl {
+
+/**
+ * Stores linked program binaries on disk, so the shaders don't have to be compiled again on the next start.
+ * Entries are keyed by the final source, the stage and the driver.
+ * The driver may still reject a binary, the program is compiled normally then.
+ *
+ * References:
+ * - [Wiki](https://www.khronos.org/opengl/wiki/Shader_Compilation#Binary_upload)
+ * - [Reference](https://registry.khronos.org/OpenGL-Refpages/gl4/html/glProgramBinary.xhtml)
+ */
+class ProgramCache {
+   private:
+    std::string directory_;
+    std::string driver_;
+    // binary formats supported by the driver, the cache is disabled if there are none
+    std::vector<GLint> formats_;
+    int hits_ = 0;
+    int misses_ = 0;
+
+    std::string filename_(uint64_t key) const;
+
+   public:
+    ProgramCache(std::string directory);
+    ~ProgramCache();
+
+    ProgramCache(ProgramCache const &) = delete;
+    ProgramCache &operator=(ProgramCache const &) = delete;
+
+    bool enabled() const {
+        return !formats_.empty();
+    }
+
+    // @returns the key of a program with the given source and stage
+    uint64_t key(const std::string &source, GLenum stage) const;
+
+    // @returns a new linked separable program or `0` if there is no usable entry
+    GLuint load(uint64_t key);
+
+    // Store the binary of a linked program. Failures are only logged.
+    void store(uint64_t key, GLuint program);
+};
+
+// Created by the game once the data directory exists, programs are compiled without it before that
+inline std::unique_ptr<ProgramCache> programCache;
+
+}  // namespace gl
@@ -1,7 +1,10 @@
 #include "Shader.h"
 
+#include <algorithm>
+
 #include "../Loader/Loader.h"
 #include "../Util/Log.h"
+#include "ProgramCache.h"
 #include "StateManager.h"
 
 namespace gl {
@@ -15,6 +18,17 @@ std::string readProgramInfoLog(GLuint id) {
     return log;
 }
 
+std::string readShaderInfoLog(GLuint id) {
+    GLint logLength;
+    glGetShaderiv(id, GL_INFO_LOG_LENGTH, &logLength);
+
+    std::string log(logLength + 1, '\0');
+    glGetShaderInfoLog(id, logLength, nullptr, &log[0]);
+    return log;
+}
+
+std::vector<ShaderProgram*> ShaderProgram::pending_;
+
 ShaderProgram::ShaderProgram(std::string source, GLenum stage, std::map<std::string, std::string> substitutions)
     : GLObject(GL_PROGRAM),
       sourceOriginal_(source),
@@ -48,6 +62,11 @@ ShaderProgram::ShaderProgram(std::string filename, std::map<std::string, std::st
 }
 
 ShaderProgram::~ShaderProgram() {
+    std::erase(pending_, this);
+    if (shader_ != 0) {
+        glDeleteShader(shader_);
+        shader_ = 0;
+    }
     if (id_ != 0) {
         glDeleteProgram(id_);
         untrack_();
@@ -76,37 +95,99 @@ void ShaderProgram::compile(std::map<std::string, std::string> substitutions) {
         }
     }
 
-    const char* cSource = source.c_str();
-    GLuint id = glCreateShaderProgramv(stage_, 1, &cSource);
+    cacheKey_ = 0;
+    GLuint id = 0;
+    if (programCache != nullptr) {
+        cacheKey_ = programCache->key(source, stage_);
+        id = programCache->load(cacheKey_);
+    }
+
+    if (id == 0) {
+        // Does the same as glCreateShaderProgramv, but doesn't wait for the driver and the binary can be retrieved for the cache.
+        // With parallel shader compilation the driver compiles and links on its own threads.
+        const char* cSource = source.c_str();
+        shader_ = glCreateShader(stage_);
+        glShaderSource(shader_, 1, &cSource, nullptr);
+        glCompileShader(shader_);
+
+        id = glCreateProgram();
+        glProgramParameteri(id, GL_PROGRAM_SEPARABLE, GL_TRUE);
+        glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glAttachShader(id, shader_);
+        glLinkProgram(id);
+    }
+
+    id_ = id;
+    track_();
+    sourceModified_ = source;
+    uniformLocations_.clear();
+    isPending_ = true;
+    pending_.push_back(this);
+}
+
+bool ShaderProgram::isPending() const {
+    return isPending_;
+}
+
+bool ShaderProgram::isCompiled() const {
+    if (!isPending_ || !manager->environment().features.parallelShaderCompile) return true;
+    GLint done;
+    glGetProgramiv(id_, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
+
+void ShaderProgram::finish() {
+    if (!isPending_) return;
+    isPending_ = false;
+    std::erase(pending_, this);
+
     GLint ok;
-    glGetProgramiv(id, GL_LINK_STATUS, &ok);
+    glGetProgramiv(id_, GL_LINK_STATUS, &ok);
     if (ok == GL_FALSE) {
-        std::string log = readProgramInfoLog(id);
+        std::string log = readProgramInfoLog(id_);
+        if (shader_ != 0) log = readShaderInfoLog(shader_) + log;
         PANIC("Failed to link shader, log: " + log);
     }
-    glValidateProgram(id);
-    glGetProgramiv(id, GL_VALIDATE_STATUS, &ok);
+    if (shader_ != 0) {
+        glDetachShader(id_, shader_);
+        glDeleteShader(shader_);
+        shader_ = 0;
+        if (programCache != nullptr) {
+            programCache->store(cacheKey_, id_);
+        }
+    }
+
+    glValidateProgram(id_);
+    glGetProgramiv(id_, GL_VALIDATE_STATUS, &ok);
     if (ok == GL_FALSE) {
-        std::string log = readProgramInfoLog(id);
+        std::string log = readProgramInfoLog(id_);
         PANIC("Failed to validate shader, log: " + log);
     }
+}
 
-    id_ = id;
-    track_();
-    sourceModified_ = source;
-    uniformLocations_.clear();
+bool ShaderProgram::allCompiled() {
+    return std::all_of(pending_.begin(), pending_.end(), [](ShaderProgram* program) { return program->isCompiled(); });
 }
 
-GLint ShaderProgram::getUniformLocation(const std::string& name) {
-    if (uniformLocations_.count(name) > 0) {
-        return uniformLocations_[name];
+void ShaderProgram::finishAll() {
+    // finish removes the program from the list
+    while (!pending_.empty()) {
+        pending_.back()->finish();
     }
+}
+
+GLint ShaderProgram::getUniformLocation(UniformName name) {
+    auto it = uniformLocations_.find(name.hash);
+    if (it != uniformLocations_.end()) {
+        return it->second;
+    }
+    finish();
 
-    GLint location = glGetUniformLocation(id_, name.c_str());
-    uniformLocations_[name] = location;
+    GLint location = glGetUniformLocation(id_, name.name);
+    uniformLocations_[name.hash] = location;
 
     if (location == -1) {
-        LOG_WARN("Could not get location of " << name);
+        LOG_WARN("Could not get location of " << name.name);
     }
 
     return location;
@@ -157,7 +238,7 @@ void setProgramUniform(GLuint prog, GLint location, const glm::mat4 value) {
 }
 
 template <typename T>
-void ShaderProgram::setUniform(const std::string& name, T value) {
+void ShaderProgram::setUniform(UniformName name, T value) {
     GLint location = getUniformLocation(name);
     if (location == -1) {
         return;
@@ -165,20 +246,20 @@ void ShaderProgram::setUniform(const std::string& name, T value) {
     setProgramUniform(id_, location, std::forward<T>(value));
 }
 
-template void ShaderProgram::setUniform<int>(const std::string& name, int value);
-template void ShaderProgram::setUniform<unsigned int>(const std::string& name, unsigned int value);
-template void ShaderProgram::setUniform<float>(const std::string& name, float value);
-template void ShaderProgram::setUniform<glm::ivec2>(const std::string& name, glm::ivec2 value);
-template void ShaderProgram::setUniform<glm::vec2>(const std::string& name, glm::vec2 value);
-template void ShaderProgram::setUniform<glm::ivec3>(const std::string& name, glm::ivec3 value);
-template void ShaderProgram::setUniform<glm::vec3>(const std::string& name, glm::vec3 value);
-template void ShaderProgram::setUniform<glm::ivec4>(const std::string& name, glm::ivec4 value);
-template void ShaderProgram::setUniform<glm::vec4>(const std::string& name, glm::vec4 value);
-template void ShaderProgram::setUniform<glm::mat3>(const std::string& name, glm::mat3 value);
-template void ShaderProgram::setUniform<glm::mat4>(const std::string& name, glm::mat4 value);
+template void ShaderProgram::setUniform<int>(UniformName name, int value);
+template void ShaderProgram::setUniform<unsigned int>(UniformName name, unsigned int value);
+template void ShaderProgram::setUniform<float>(UniformName name, float value);
+template void ShaderProgram::setUniform<glm::ivec2>(UniformName name, glm::ivec2 value);
+template void ShaderProgram::setUniform<glm::vec2>(UniformName name, glm::vec2 value);
+template void ShaderProgram::setUniform<glm::ivec3>(UniformName name, glm::ivec3 value);
+template void ShaderProgram::setUniform<glm::vec3>(UniformName name, glm::vec3 value);
+template void ShaderProgram::setUniform<glm::ivec4>(UniformName name, glm::ivec4 value);
+template void ShaderProgram::setUniform<glm::vec4>(UniformName name, glm::vec4 value);
+template void ShaderProgram::setUniform<glm::mat3>(UniformName name, glm::mat3 value);
+template void ShaderProgram::setUniform<glm::mat4>(UniformName name, glm::mat4 value);
 
 template <typename T>
-void ShaderProgram::setUniformIndexed(const std::string& name, int index, T value) {
+void ShaderProgram::setUniformIndexed(UniformName name, int index, T value) {
     GLint location = getUniformLocation(name);
     if (location == -1) {
         return;
@@ -186,13 +267,13 @@ void ShaderProgram::setUniformIndexed(const std::string& name, int index, T valu
     setProgramUniform(id_, location + index, std::forward<T>(value));
 }
 
-template void ShaderProgram::setUniformIndexed<int>(const std::string& name, int index, int value);
-template void ShaderProgram::setUniformIndexed<float>(const std::string& name, int index, float value);
-template void ShaderProgram::setUniformIndexed<glm::vec2>(const std::string& name, int index, glm::vec2 value);
-template void ShaderProgram::setUniformIndexed<glm::vec3>(const std::string& name, int index, glm::vec3 value);
-template void ShaderProgram::setUniformIndexed<glm::vec4>(const std::string& name, int index, glm::vec4 value);
-template void ShaderProgram::setUniformIndexed<glm::mat3>(const std::string& name, int index, glm::mat3 value);
-template void ShaderProgram::setUniformIndexed<glm::mat4>(const std::string& name, int index, glm::mat4 value);
+template void ShaderProgram::setUniformIndexed<int>(UniformName name, int index, int value);
+template void ShaderProgram::setUniformIndexed<float>(UniformName name, int index, float value);
+template void ShaderProgram::setUniformIndexed<glm::vec2>(UniformName name, int index, glm::vec2 value);
+template void ShaderProgram::setUniformIndexed<glm::vec3>(UniformName name, int index, glm::vec3 value);
+template void ShaderProgram::setUniformIndexed<glm::vec4>(UniformName name, int index, glm::vec4 value);
+template void ShaderProgram::setUniformIndexed<glm::mat3>(UniformName name, int index, glm::mat3 value);
+template void ShaderProgram::setUniformIndexed<glm::mat4>(UniformName name, int index, glm::mat4 value);
 
 GLenum shaderStageToBit(GLenum stage) {
     switch (stage) {
@@ -240,6 +321,14 @@ ShaderPipeline::~ShaderPipeline() {
 }
 
 void ShaderPipeline::bind() const {
+    if (unattachedStages_ != 0) {
+        for (ShaderProgram* program : {vertStage_, tessCtrlStage_, tessEvalStage_, geomStage_, fragStage_, compStage_}) {
+            if (program == nullptr || (unattachedStages_ & shaderStageToBit(program->stage())) == 0) continue;
+            program->finish();
+            glUseProgramStages(id_, shaderStageToBit(program->stage()), program->id());
+        }
+        unattachedStages_ = 0;
+    }
     manager->bindProgramPipeline(id_);
 }
 
@@ -286,8 +375,14 @@ void ShaderPipeline::attach(const std::initializer_list<ShaderProgram*> programs
 }
 
 void ShaderPipeline::attach(ShaderProgram* program) {
-    glUseProgramStages(id_, shaderStageToBit(program->stage()), program->id());
     getRef_(program->stage()) = program;
+    // attaching needs the link status, so pending programs are attached on the first bind
+    if (program->isPending()) {
+        unattachedStages_ |= shaderStageToBit(program->stage());
+        return;
+    }
+    unattachedStages_ &= ~shaderStageToBit(program->stage());
+    glUseProgramStages(id_, shaderStageToBit(program->stage()), program->id());
 }
 
 void ShaderPipeline::own(const std::initializer_list<ShaderProgram*> programs) {
@@ -305,13 +400,14 @@ void ShaderPipeline::reAttach(GLenum stage) {
     if (program == nullptr) {
         glUseProgramStages(id_, shaderStageToBit(stage), 0);
     } else {
-        glUseProgramStages(id_, shaderStageToBit(stage), program->id());
+        attach(program);
     }
 }
 
 void ShaderPipeline::detach(GLenum stage) {
     glUseProgramStages(id_, shaderStageToBit(stage), 0);
     getRef_(stage) = nullptr;
+    unattachedStages_ &= ~shaderStageToBit(stage);
 }
 
 ShaderProgram* ShaderPipeline::get(GLenum stage) const {
@@ -2,21 +2,46 @@
 #include <glm/glm.hpp>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "Object.h"
 
 namespace gl {
 
+/**
+ * A uniform name that is hashed at compile time, so looking up its location doesn't construct or compare strings.
+ * String literals convert to it implicitly, e.g. `setUniform("u_view_mat", view)`.
+ * [Reference](http://www.isthe.com/chongo/tech/comp/fnv/index.html#FNV-1a)
+ */
+struct UniformName {
+    const char* name;
+    uint64_t hash;
+
+    consteval UniformName(const char* name) : name(name), hash(14695981039346656037ull) {
+        for (const char* c = name; *c != '\0'; c++) {
+            hash = (hash ^ static_cast<uint8_t>(*c)) * 1099511628211ull;
+        }
+    }
+};
+
 // References:
 // https://www.khronos.org/opengl/wiki/Shader
 // https://www.khronos.org/opengl/wiki/GLSL_Object
 class ShaderProgram : public GLObject {
    private:
-    std::map<std::string, int32_t> uniformLocations_;
+    // programs with an unchecked link status
+    static std::vector<ShaderProgram*> pending_;
+
+    // keyed by `UniformName::hash`
+    std::unordered_map<uint64_t, int32_t> uniformLocations_;
     std::string sourceOriginal_ = "";
     std::string sourceModified_ = "";
     GLenum stage_ = 0;
+    // the shader object until the link status is checked, `0` if the program was loaded from the cache
+    GLuint shader_ = 0;
+    uint64_t cacheKey_ = 0;
+    bool isPending_ = false;
 
    public:
     // Load and compile the given source code.
@@ -35,22 +60,39 @@ class ShaderProgram : public GLObject {
 
     // Compiles the shader source code with the provided string substituions.
     // Useful to set certain values or enable code at compile time.
+    // Does not wait for the driver, the link status is checked by `finish`.
     // References:
     // - https://registry.khronos.org/OpenGL-Refpages/gl4/html/glCreateShaderProgram.xhtml
     // - https://registry.khronos.org/OpenGL-Refpages/gl4/html/glValidateProgram.xhtml
     void compile(std::map<std::string, std::string> substitutions = {});
 
+    // @returns `true` until `finish` has checked the link status
+    bool isPending() const;
+
+    // @returns `true` when the driver is done compiling and `finish` won't block. Always `true` without parallel shader compilation.
+    // [Reference](https://registry.khronos.org/OpenGL/extensions/KHR/KHR_parallel_shader_compile.txt)
+    bool isCompiled() const;
+
+    // Waits for the driver and checks the link status. Called on first use.
+    void finish();
+
+    // @returns `true` when all pending programs are compiled, see `isCompiled`
+    static bool allCompiled();
+
+    // Calls `finish` on all pending programs
+    static void finishAll();
+
     // Get the uniform location index given its name. Uses caching.
     // [Reference](https://registry.khronos.org/OpenGL-Refpages/gl4/html/glGetUniformLocation.xhtml)
-    GLint getUniformLocation(const std::string& name);
+    GLint getUniformLocation(UniformName name);
 
     // [Reference](https://registry.khronos.org/OpenGL-Refpages/gl4/html/glUniform.xhtml)
     template <typename T>
-    void setUniform(const std::string& name, T value);
+    void setUniform(UniformName name, T value);
 
     // [Reference](https://registry.khronos.org/OpenGL-Refpages/gl4/html/glUniform.xhtml)
     template <typename T>
-    void setUniformIndexed(const std::string& name, int index, T value);
+    void setUniformIndexed(UniformName name, int index, T value);
 };
 
 // References:
@@ -64,6 +106,8 @@ class ShaderPipeline : public GLObject {
     ShaderProgram* fragStage_ = nullptr;
     ShaderProgram* compStage_ = nullptr;
     std::vector<ShaderProgram*> ownedPrograms_;
+    // stages of pending programs, they are attached on the first bind
+    mutable GLbitfield unattachedStages_ = 0;
 
     ShaderProgram*& getRef_(GLenum stage);
 
@@ -78,6 +122,7 @@ class ShaderPipeline : public GLObject {
 
     void setDebugLabel(const std::string& label) override;
 
+    // Finishes and attaches pending programs first, see `ShaderProgram::finish`
     void bind() const;
 
     // @returns the vertex shader
@@ -1,6 +1,7 @@
 #include "StateManager.h"
 
 #include <algorithm>
+#include <bit>
 
 #include "Util.h"
 
@@ -21,13 +22,23 @@ Environment createEnvironment() {
         vendor = VENDOR_UNKNOWN;
     }
 
+    std::string driver = reinterpret_cast<const char*>(glGetString(GL_VENDOR));
+    driver += "\n" + std::string(reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+    driver += "\n" + std::string(reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+
     Features features;
     std::vector<float> anisotropy(1);  // Assuming gl.h doesn't define GetFloatv
     glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, anisotropy.data());
     features.maxTextureMaxAnisotropy = anisotropy[0];
+    features.parallelShaderCompile = GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+    features.indirectParameters = GLEW_ARB_indirect_parameters;
+    features.vertexShaderLayer = GLEW_ARB_shader_viewport_layer_array || GLEW_AMD_vertex_shader_layer;
+    features.tessellationShaderLayer = GLEW_ARB_shader_viewport_layer_array;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &features.shaderStorageBufferOffsetAlignment);
 
     return Environment{
         .vendor = vendor,
+        .driver = driver,
         .useIntelTextureBindingFix = vendor == VENDOR_INTEL,
         .useIntelCubemapDsaFix = vendor == VENDOR_INTEL,
         .features = features};
@@ -59,86 +70,124 @@ std::vector<std::pair<GLenum, GLuint>> StateManager::Tracker::tracked() {
 }
 #endif
 
-StateManager::StateManager(Environment env) : caps(),
-                                              textureUnits(32, 0),
+StateManager::StateManager(Environment env) : textureUnits(32, 0),
                                               samplerUnits(32, 0),
                                               intelTextureBindingTargets() {
     this->env = env;
 }
 
+void StateManager::applyCapabilities(uint32_t caps) {
+    // only toggle the capabilities that differ
+    uint32_t changed = enabledCaps ^ caps;
+    stats.skipped += static_cast<int>(CAPABILITIES.size()) - std::popcount(changed);
+    for (size_t i = 0; i < CAPABILITIES.size(); i++) {
+        uint32_t bit = 1u << i;
+        if ((changed & bit) == 0) continue;
+        if (caps & bit) {
+            glEnable(static_cast<GLenum>(CAPABILITIES[i]));
+        } else {
+            glDisable(static_cast<GLenum>(CAPABILITIES[i]));
+        }
+        stats.issued++;
+    }
+    enabledCaps = caps;
+}
+
+void StateManager::apply(const PipelineState& state) {
+    applyCapabilities(state.capabilities);
+
+    if (enabledCaps & capabilityBit(Capability::DepthTest)) {
+        depthFunc(state.depthFunc);
+    }
+    // the depth mask also affects clears
+    depthMask(state.depthMask);
+    if (enabledCaps & capabilityBit(Capability::CullFace)) {
+        cull(state.cullFace);
+    }
+    if (enabledCaps & capabilityBit(Capability::Blend)) {
+        blendEquationSeparate(state.blendEquationRgb, state.blendEquationAlpha);
+        blendFuncSeparate(state.blendSrcRgb, state.blendDstRgb, state.blendSrcAlpha, state.blendDstAlpha);
+    }
+    if (enabledCaps & capabilityBit(Capability::PolygonOffsetFill)) {
+        auto [factor, units, clamp] = state.polygonOffset;
+        if (clamp == 0) {
+            polygonOffset(factor, units);
+        } else {
+            polygonOffsetClamp(factor, units, clamp);
+        }
+    }
+    colorMask(state.colorMask & 1, state.colorMask & 2, state.colorMask & 4, state.colorMask & 8);
+}
+
 void StateManager::enable(Capability cap) {
-    if (caps.count(cap) && caps.at(cap)) {
+    uint32_t bit = capabilityBit(cap);
+    if (enabledCaps & bit) {
+        stats.skipped++;
         return;
     }
 
     glEnable(static_cast<GLenum>(cap));
-    caps[cap] = true;
+    stats.issued++;
+    enabledCaps |= bit;
 }
 
 void StateManager::setEnabled(const std::vector<Capability>& caps) {
-    std::unordered_map<Capability, bool> diff;
-
-    // Assume all disabled
-    for (const auto& [capability, enabled] : this->caps) {
-        if (enabled) {
-            diff[capability] = false;
-        }
-    }
-
-    // enable provided
+    uint32_t bits = 0;
     for (Capability cap : caps) {
-        if (!diff[cap] || !this->caps[cap]) {
-            diff[cap] = true;
-        }
+        bits |= capabilityBit(cap);
     }
 
-    // Enable or disable capabilities based on the diff map
-    for (const auto& [capability, enable] : diff) {
-        if (enable) {
-            this->enable(capability);
-        } else {
-            this->disable(capability);
-        }
-    }
+    applyCapabilities(bits);
 }
 
 void StateManager::disable(Capability cap) {
-    if (caps.count(cap) && !caps.at(cap)) {
+    uint32_t bit = capabilityBit(cap);
+    if ((enabledCaps & bit) == 0) {
+        stats.skipped++;
         return;
     }
 
     glDisable(static_cast<GLenum>(cap));
-    caps[cap] = false;
+    stats.issued++;
+    enabledCaps &= ~bit;
 }
 
 void StateManager::cull(GLenum face) {
     if (cullFaceMask == face) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glCullFace(face);
     cullFaceMask = face;
 }
 
 void StateManager::cullFront() {
     if (cullFaceMask == GL_FRONT) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glCullFace(GL_FRONT);
     cullFaceMask = GL_FRONT;
 }
 
 void StateManager::cullBack() {
     if (cullFaceMask == GL_BACK) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glCullFace(GL_BACK);
     cullFaceMask = GL_BACK;
 }
 
 void StateManager::blendFunc(BlendFactor sfactor, BlendFactor dfactor) {
     if (blendAlphaFactorSrc == sfactor && blendRgbFactorSrc == sfactor && blendAlphaFactorDst == dfactor && blendRgbFactorDst == dfactor) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glBlendFunc(static_cast<GLenum>(sfactor), static_cast<GLenum>(dfactor));
     blendAlphaFactorSrc = blendRgbFactorSrc = sfactor;
     blendAlphaFactorDst = blendRgbFactorDst = dfactor;
@@ -146,8 +195,10 @@ void StateManager::blendFunc(BlendFactor sfactor, BlendFactor dfactor) {
 
 void StateManager::blendFuncSeparate(BlendFactor srcRgb, BlendFactor dstRgb, BlendFactor srcAlpha, BlendFactor dstAlpha) {
     if (blendAlphaFactorSrc == srcAlpha && blendRgbFactorSrc == srcRgb && blendAlphaFactorDst == dstAlpha && blendRgbFactorDst == dstRgb) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glBlendFuncSeparate(static_cast<GLenum>(srcRgb), static_cast<GLenum>(dstRgb), static_cast<GLenum>(srcAlpha), static_cast<GLenum>(dstAlpha));
     blendAlphaFactorSrc = srcAlpha;
     blendRgbFactorSrc = srcRgb;
@@ -157,8 +208,10 @@ void StateManager::blendFuncSeparate(BlendFactor srcRgb, BlendFactor dstRgb, Ble
 
 void StateManager::blendEquation(BlendEquation mode) {
     if (blendEquationAlpha == mode && blendEquationRgb == mode) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glBlendEquation(static_cast<GLenum>(mode));
     blendEquationAlpha = mode;
     blendEquationRgb = mode;
@@ -166,8 +219,10 @@ void StateManager::blendEquation(BlendEquation mode) {
 
 void StateManager::blendEquationSeparate(BlendEquation modeRGB, BlendEquation modeAlpha) {
     if (blendEquationAlpha == modeAlpha && blendEquationRgb == modeRGB) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glBlendEquationSeparate(static_cast<GLenum>(modeRGB), static_cast<GLenum>(modeAlpha));
     blendEquationAlpha = modeAlpha;
     blendEquationRgb = modeRGB;
@@ -176,9 +231,11 @@ void StateManager::blendEquationSeparate(BlendEquation modeRGB, BlendEquation mo
 void StateManager::stencilFunc(StencilFunc fn, int32_t ref, uint32_t mask) {
     if (stencilFrontFuncFn == fn && stencilFrontFuncRef == ref && stencilFrontFuncMask == mask &&
         stencilBackFuncFn == fn && stencilBackFuncRef == ref && stencilBackFuncMask == mask) {
+        stats.skipped++;
         return;
     }
 
+    stats.issued++;
     glStencilFunc(static_cast<GLenum>(fn), ref, mask);
 
     stencilFrontFuncFn = fn;
@@ -191,9 +248,11 @@ void StateManager::stencilFunc(StencilFunc fn, int32_t ref, uint32_t mask) {
 
 void StateManager::stencilFuncFront(StencilFunc fn, int32_t ref, uint32_t mask) {
     if (stencilFrontFuncFn == fn && stencilFrontFuncRef == ref && stencilFrontFuncMask == mask) {
+        stats.skipped++;
         return;
     }
 
+    stats.issued++;
     glStencilFuncSeparate(GL_FRONT, static_cast<GLenum>(fn), ref, mask);
 
     stencilFrontFuncFn = fn;
@@ -203,9 +262,11 @@ void StateManager::stencilFuncFront(StencilFunc fn, int32_t ref, uint32_t mask)
 
 void StateManager::stencilFuncBack(StencilFunc fn, int32_t ref, uint32_t mask) {
     if (stencilBackFuncFn == fn && stencilBackFuncRef == ref && stencilBackFuncMask == mask) {
+        stats.skipped++;
         return;
     }
 
+    stats.issued++;
     glStencilFuncSeparate(GL_BACK, static_cast<GLenum>(fn), ref, mask);
 
     stencilBackFuncFn = fn;
@@ -216,8 +277,10 @@ void StateManager::stencilFuncBack(StencilFunc fn, int32_t ref, uint32_t mask) {
 void StateManager::stencilOp(StencilOp sfail, StencilOp dpfail, StencilOp dppass) {
     if (sfail == stencilFrontOpSfail && dpfail == stencilFrontOpDpfail && dppass == stencilFrontOpDppass &&
         sfail == stencilBackOpSfail && dpfail == stencilBackOpDpfail && dppass == stencilBackOpDppass) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glStencilOp(static_cast<GLenum>(sfail), static_cast<GLenum>(dpfail), static_cast<GLenum>(dppass));
     stencilFrontOpSfail = sfail;
     stencilFrontOpDpfail = dpfail;
@@ -229,8 +292,10 @@ void StateManager::stencilOp(StencilOp sfail, StencilOp dpfail, StencilOp dppass
 
 void StateManager::stencilOpFront(StencilOp sfail, StencilOp dpfail, StencilOp dppass) {
     if (sfail == stencilFrontOpSfail && dpfail == stencilFrontOpDpfail && dppass == stencilFrontOpDppass) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glStencilOpSeparate(GL_FRONT, static_cast<GLenum>(sfail), static_cast<GLenum>(dpfail), static_cast<GLenum>(dppass));
     stencilFrontOpSfail = sfail;
     stencilFrontOpDpfail = dpfail;
@@ -239,8 +304,10 @@ void StateManager::stencilOpFront(StencilOp sfail, StencilOp dpfail, StencilOp d
 
 void StateManager::stencilOpBack(StencilOp sfail, StencilOp dpfail, StencilOp dppass) {
     if (sfail == stencilBackOpSfail && dpfail == stencilBackOpDpfail && dppass == stencilBackOpDppass) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glStencilOpSeparate(GL_BACK, static_cast<GLenum>(sfail), static_cast<GLenum>(dpfail), static_cast<GLenum>(dppass));
     stencilBackOpSfail = sfail;
     stencilBackOpDpfail = dpfail;
@@ -249,8 +316,10 @@ void StateManager::stencilOpBack(StencilOp sfail, StencilOp dpfail, StencilOp dp
 
 void StateManager::stencilMask(uint32_t mask) {
     if (stencilFrontMask == mask && stencilBackMask == mask) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glStencilMask(mask);
     stencilFrontMask = mask;
     stencilBackMask = mask;
@@ -258,32 +327,40 @@ void StateManager::stencilMask(uint32_t mask) {
 
 void StateManager::stencilMaskFront(uint32_t mask) {
     if (stencilFrontMask == mask) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glStencilMaskSeparate(GL_FRONT, mask);
     stencilFrontMask = mask;
 }
 
 void StateManager::stencilMaskBack(uint32_t mask) {
     if (stencilBackMask == mask) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glStencilMaskSeparate(GL_BACK, mask);
     stencilBackMask = mask;
 }
 
 void StateManager::depthFunc(DepthFunc fn) {
     if (depthFuncFn == fn) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glDepthFunc(static_cast<GLenum>(fn));
     depthFuncFn = fn;
 }
 
 void StateManager::depthMask(bool flag) {
     if (depthWriteMask == flag) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glDepthMask(flag);
     depthWriteMask = flag;
 }
@@ -300,14 +377,20 @@ void StateManager::polygonMode(GLenum face, GLenum mode) {
     } else if (face == GL_BACK && polygonModeBack != mode) {
         glPolygonMode(face, mode);
         polygonModeBack = mode;
+    } else {
+        stats.skipped++;
+        return;
     }
+    stats.issued++;
 }
 
 void StateManager::polygonOffset(float factor, float units) {
     if (polygonOffsets[0] == factor && polygonOffsets[1] == units &&
         polygonOffsets[2] == 0) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glPolygonOffset(factor, units);
     polygonOffsets = {factor, units, 0};
 }
@@ -315,12 +398,30 @@ void StateManager::polygonOffset(float factor, float units) {
 void StateManager::polygonOffsetClamp(float factor, float units, float clamp) {
     if (polygonOffsets[0] == factor && polygonOffsets[1] == units &&
         polygonOffsets[2] == clamp) {
+        stats.skipped++;
         return;
     }
+    stats.issued++;
     glPolygonOffsetClamp(factor, units, clamp);
     polygonOffsets = {factor, units, clamp};
 }
 
+void StateManager::colorMask(bool r, bool g, bool b, bool a) {
+    uint8_t mask = (r ? 1 : 0) | (g ? 2 : 0) | (b ? 4 : 0) | (a ? 8 : 0);
+    if (colorWriteMask == mask) {
+        stats.skipped++;
+        return;
+    }
+    stats.issued++;
+    glColorMask(r, g, b, a);
+    colorWriteMask = mask;
+}
+
+void StateManager::beginFrame() {
+    lastFrameStats = stats;
+    stats = {};
+}
+
 void StateManager::bindTextureUnit(int unit, GLuint texture) {
     if (textureUnits[unit] == texture) {
         return;
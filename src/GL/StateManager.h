@@ -5,6 +5,7 @@
 #include <GL/glew.h>
 
 #include <array>
+#include <initializer_list>
 #include <map>
 #include <memory>
 #include <set>
@@ -96,17 +97,94 @@ enum class DepthFunc : GLenum {
     Always = GL_ALWAYS
 };
 
+// All values of `Capability`, the index is the bit in a capability mask
+inline constexpr std::array<Capability, 7> CAPABILITIES = {
+    Capability::DepthTest,
+    Capability::Blend,
+    Capability::StencilTest,
+    Capability::ScissorTest,
+    Capability::CullFace,
+    Capability::DepthClamp,
+    Capability::PolygonOffsetFill,
+};
+
+// @returns the bit of the capability in a capability mask
+constexpr uint32_t capabilityBit(Capability cap) {
+    for (size_t i = 0; i < CAPABILITIES.size(); i++) {
+        if (CAPABILITIES[i] == cap) return 1u << i;
+    }
+    return 0;
+}
+
+// @returns a capability mask with the given capabilities
+constexpr uint32_t capabilityBits(std::initializer_list<Capability> caps) {
+    uint32_t bits = 0;
+    for (Capability cap : caps) {
+        bits |= capabilityBit(cap);
+    }
+    return bits;
+}
+
+/**
+ * The fixed function state of a draw call. Renderers create it once and apply it with `StateManager::apply`.
+ * Values that belong to a disabled capability are ignored, e.g. the blend factors without `Capability::Blend`.
+ * The defaults match the reversed depth range used by all renderers.
+ */
+struct PipelineState {
+    // enabled capabilities, all others are disabled. See `capabilityBits`
+    uint32_t capabilities = 0;
+    DepthFunc depthFunc = DepthFunc::GreaterOrEqual;
+    // `true` enables writing to the depth buffer
+    bool depthMask = true;
+    // `GL_FRONT` or `GL_BACK`
+    GLenum cullFace = GL_BACK;
+    BlendEquation blendEquationRgb = BlendEquation::FuncAdd;
+    BlendEquation blendEquationAlpha = BlendEquation::FuncAdd;
+    BlendFactor blendSrcRgb = BlendFactor::One;
+    BlendFactor blendDstRgb = BlendFactor::Zero;
+    BlendFactor blendSrcAlpha = BlendFactor::One;
+    BlendFactor blendDstAlpha = BlendFactor::Zero;
+    // factor, units and clamp. A clamp of `0` disables clamping
+    std::array<float, 3> polygonOffset = {0, 0, 0};
+    // one bit per channel, `r = 1, g = 2, b = 4, a = 8`
+    uint8_t colorMask = 0b1111;
+};
+
+// Counts the pipeline state changes, see `StateManager::frameStats`
+struct StateStats {
+    // gl calls that were issued
+    int issued = 0;
+    // calls that were skipped, because the state was already set
+    int skipped = 0;
+};
+
 // info about certain features that the system supports
 struct Features {
     // the maximum level of anisotropic filtering
     // https://www.khronos.org/opengl/wiki/Sampler_Object#Anisotropic_filtering
     float maxTextureMaxAnisotropy;
+    // the driver compiles shaders on its own threads, and their status can be polled
+    // https://registry.khronos.org/OpenGL/extensions/KHR/KHR_parallel_shader_compile.txt
+    bool parallelShaderCompile;
+    // the draw count of multi draw indirect commands can be read from a buffer
+    // https://registry.khronos.org/OpenGL/extensions/ARB/ARB_indirect_parameters.txt
+    bool indirectParameters;
+    // gl_Layer can be written in vertex shaders, to render to all layers of a layered framebuffer at once
+    // https://registry.khronos.org/OpenGL/extensions/ARB/ARB_shader_viewport_layer_array.txt
+    // https://registry.khronos.org/OpenGL/extensions/AMD/AMD_vertex_shader_layer.txt
+    bool vertexShaderLayer;
+    // gl_Layer can also be written in tessellation evaluation shaders, only ARB_shader_viewport_layer_array allows this
+    bool tessellationShaderLayer;
+    // the offset of a shader storage buffer range binding has to be a multiple of this
+    int shaderStorageBufferOffsetAlignment;
 };
 
 // See https://doc.magnum.graphics/magnum/opengl-workarounds.html as a reference for workarounds
 struct Environment {
     // The gpu vendor. One of intel, nvidia, ati or unknown
     std::string vendor;
+    // The vendor, renderer and version strings, they identify the driver
+    std::string driver;
     // enables a fix for intel's buggy drivers
     bool useIntelTextureBindingFix;
     // enables a fix for intel's buggy drivers
@@ -170,6 +248,9 @@ class StateManager {
 #endif
     }
 
+    // Applies the pipeline state, only the difference to the current state is issued
+    void apply(const PipelineState& state);
+
     // [Reference](https://registry.khronos.org/OpenGL-Refpages/gl4/html/glEnable.xhtml)
     void enable(Capability cap);
     // Sets the provided capabilities to enabled, all others will be disabled
@@ -227,6 +308,13 @@ class StateManager {
     void polygonOffset(float factor, float units);
     // [Reference](https://registry.khronos.org/OpenGL/extensions/EXT/EXT_polygon_offset_clamp.txt)
     void polygonOffsetClamp(float factor, float units, float clamp);
+    // [Reference](https://registry.khronos.org/OpenGL-Refpages/gl4/html/glColorMask.xhtml)
+    void colorMask(bool r, bool g, bool b, bool a);
+
+    // Call at the start of every frame, makes the stats of the last frame available
+    void beginFrame();
+    // @returns the state changes of the last frame
+    const StateStats& frameStats() const { return lastFrameStats; }
 
     // [Reference](https://registry.khronos.org/OpenGL-Refpages/gl4/html/glActiveTexture.xhtml)
     void activeTexture(int unit);
@@ -290,7 +378,14 @@ class StateManager {
    private:
     Environment env = {};
 
-    std::map<Capability, bool> caps;
+    // GL defaults are assumed for the initial state, all capabilities are disabled
+    uint32_t enabledCaps = 0;
+
+    StateStats stats = {};
+    StateStats lastFrameStats = {};
+
+    // Enables the capabilities in the mask and disables all others
+    void applyCapabilities(uint32_t caps);
 
     std::vector<GLuint> textureUnits;
     std::vector<GLuint> samplerUnits;
@@ -316,40 +411,41 @@ class StateManager {
     std::array<int, 4> viewportRect = {};
     std::array<int, 4> scissorRect = {};
 
-    BlendFactor blendRgbFactorSrc;
-    BlendFactor blendAlphaFactorSrc;
-    BlendFactor blendRgbFactorDst;
-    BlendFactor blendAlphaFactorDst;
-    BlendEquation blendEquationRgb;
-    BlendEquation blendEquationAlpha;
-
-    StencilFunc stencilFrontFuncFn;
-    StencilFunc stencilBackFuncFn;
-    uint32_t stencilFrontFuncMask;
-    uint32_t stencilBackFuncMask;
-    int32_t stencilFrontFuncRef;
-    int32_t stencilBackFuncRef;
-
-    StencilOp stencilFrontOpSfail;
-    StencilOp stencilFrontOpDpfail;
-    StencilOp stencilFrontOpDppass;
-    StencilOp stencilBackOpSfail;
-    StencilOp stencilBackOpDpfail;
-    StencilOp stencilBackOpDppass;
-
-    uint32_t stencilFrontMask;
-    uint32_t stencilBackMask;
-
-    DepthFunc depthFuncFn;
-    bool depthWriteMask;
-    uint32_t cullFaceMask;
-
-    std::array<float, 4> clearColorRgba;
-
-    std::array<float, 3> polygonOffsets;
-
-    GLenum polygonModeFront;
-    GLenum polygonModeBack;
+    BlendFactor blendRgbFactorSrc = BlendFactor::One;
+    BlendFactor blendAlphaFactorSrc = BlendFactor::One;
+    BlendFactor blendRgbFactorDst = BlendFactor::Zero;
+    BlendFactor blendAlphaFactorDst = BlendFactor::Zero;
+    BlendEquation blendEquationRgb = BlendEquation::FuncAdd;
+    BlendEquation blendEquationAlpha = BlendEquation::FuncAdd;
+
+    StencilFunc stencilFrontFuncFn = StencilFunc::Always;
+    StencilFunc stencilBackFuncFn = StencilFunc::Always;
+    uint32_t stencilFrontFuncMask = 0xffffffff;
+    uint32_t stencilBackFuncMask = 0xffffffff;
+    int32_t stencilFrontFuncRef = 0;
+    int32_t stencilBackFuncRef = 0;
+
+    StencilOp stencilFrontOpSfail = StencilOp::Keep;
+    StencilOp stencilFrontOpDpfail = StencilOp::Keep;
+    StencilOp stencilFrontOpDppass = StencilOp::Keep;
+    StencilOp stencilBackOpSfail = StencilOp::Keep;
+    StencilOp stencilBackOpDpfail = StencilOp::Keep;
+    StencilOp stencilBackOpDppass = StencilOp::Keep;
+
+    uint32_t stencilFrontMask = 0xffffffff;
+    uint32_t stencilBackMask = 0xffffffff;
+
+    DepthFunc depthFuncFn = DepthFunc::Less;
+    bool depthWriteMask = true;
+    uint32_t cullFaceMask = GL_BACK;
+    uint8_t colorWriteMask = 0b1111;
+
+    std::array<float, 4> clearColorRgba = {0, 0, 0, 0};
+
+    std::array<float, 3> polygonOffsets = {0, 0, 0};
+
+    GLenum polygonModeFront = GL_FILL;
+    GLenum polygonModeBack = GL_FILL;
 
    public:
     const Environment& environment() const {
@@ -0,0 +1,274 @@
+#include "Upload.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#include "../Util/Log.h"
+#include "Geometry.h"
+#include "Texture.h"
+
+namespace gl {
+
+// Alignment of staging regions, this satisfies any texel and compressed block alignment
+const size_t STAGING_ALIGNMENT = 256;
+// Client memory is uploaded in chunks of this size, so large uploads can be spread over multiple frames
+const size_t UPLOAD_CHUNK_SIZE = 4 * 1024 * 1024;
+
+static size_t alignUp(size_t value, size_t alignment);
+
+static size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+Staging::Staging(UploadQueue *queue, uint64_t start, std::span<uint8_t> data) : queue_(queue), start_(start), data_(data) {}
+
+Staging::~Staging() {
+    queue_->release_(start_);
+}
+
+size_t Staging::offset() const {
+    return data_.data() - queue_->mapped_;
+}
+
+UploadQueue::UploadQueue(size_t capacity) : capacity_(capacity) {
+    ring_ = new Buffer();
+    ring_->setDebugLabel("upload/staging");
+    ring_->allocateEmpty(capacity_, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+    mapped_ = ring_->mapRange<uint8_t>(GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+}
+
+UploadQueue::~UploadQueue() {
+    for (auto &&batch : inFlight_) {
+        while (!batch.fence.clientWait()) {
+        }
+    }
+    inFlight_.clear();
+    pending_.clear();
+    delete ring_;
+}
+
+std::shared_ptr<Staging> UploadQueue::stage(size_t size) {
+    // Large regions would block the ring for too long
+    if (size == 0 || size > capacity_ / 4) return nullptr;
+
+    std::lock_guard<std::mutex> lock(ringMutex_);
+    uint64_t start = alignUp(head_, STAGING_ALIGNMENT);
+    // Regions never wrap around the end of the ring
+    if (start % capacity_ + size > capacity_) {
+        start = alignUp(start, capacity_);
+    }
+    if (start + size - tail_ > capacity_) return nullptr;
+
+    if (allocations_.empty()) tail_ = start;
+    allocations_.push_back({.start = start, .released = false});
+    head_ = start + size;
+
+    std::span<uint8_t> data(mapped_ + start % capacity_, size);
+    return std::make_shared<Staging>(this, start, data);
+}
+
+void UploadQueue::release_(uint64_t start) {
+    std::lock_guard<std::mutex> lock(ringMutex_);
+    for (auto &&allocation : allocations_) {
+        if (allocation.start == start) {
+            allocation.released = true;
+            break;
+        }
+    }
+    // Regions are mostly released in order, only the oldest ones can be reused
+    while (!allocations_.empty() && allocations_.front().released) {
+        allocations_.pop_front();
+    }
+    tail_ = allocations_.empty() ? head_ : allocations_.front().start;
+}
+
+void UploadQueue::push_(Command &&command) {
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    pending_.push_back(std::move(command));
+}
+
+void UploadQueue::upload(const TextureUpload &upload, std::shared_ptr<Staging> staging, std::function<void()> callback) {
+    size_t size = staging->data().size();
+    push_({.texture = upload, .staging = std::move(staging), .size = size, .callback = std::move(callback)});
+}
+
+void UploadQueue::upload(const TextureUpload &upload, const void *data, size_t size, std::shared_ptr<const void> owner, std::function<void()> callback) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    uint32_t rows = upload.size.y;
+    bool split = upload.compressedFormat == 0 && upload.texture->dimensions() == 2 && rows > 1 && size % rows == 0 && size > UPLOAD_CHUNK_SIZE;
+    if (!split) {
+        push_({.texture = upload, .data = data, .size = size, .owner = std::move(owner), .callback = std::move(callback)});
+        return;
+    }
+
+    // Split into bands of rows, the mipmaps are generated after the last one
+    size_t stride = size / rows;
+    uint32_t band = std::max<uint32_t>(1, static_cast<uint32_t>(UPLOAD_CHUNK_SIZE / stride));
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    for (uint32_t row = 0; row < rows; row += band) {
+        uint32_t count = std::min(band, rows - row);
+        bool last = row + count == rows;
+
+        TextureUpload part = upload;
+        part.offset.y += row;
+        part.size.y = count;
+        part.mipmap = last && upload.mipmap;
+
+        Command command = {.texture = part, .data = bytes + row * stride, .size = count * stride, .owner = owner};
+        if (last) command.callback = std::move(callback);
+        pending_.push_back(std::move(command));
+    }
+}
+
+void UploadQueue::upload(Buffer &buffer, size_t offset, std::shared_ptr<Staging> staging, std::function<void()> callback) {
+    size_t size = staging->data().size();
+    push_({.buffer = &buffer, .bufferOffset = offset, .staging = std::move(staging), .size = size, .callback = std::move(callback)});
+}
+
+void UploadQueue::upload(Buffer &buffer, size_t offset, const void *data, size_t size, std::shared_ptr<const void> owner, std::function<void()> callback) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    for (size_t chunk = 0; chunk < size; chunk += UPLOAD_CHUNK_SIZE) {
+        size_t count = std::min(UPLOAD_CHUNK_SIZE, size - chunk);
+        Command command = {.buffer = &buffer, .bufferOffset = offset + chunk, .data = bytes + chunk, .size = count, .owner = owner};
+        if (chunk + count == size) command.callback = std::move(callback);
+        pending_.push_back(std::move(command));
+    }
+}
+
+void UploadQueue::then(std::function<void()> callback) {
+    push_({.callback = std::move(callback)});
+}
+
+void UploadQueue::copyTexture_(const TextureUpload &upload, const void *pixels, size_t size) {
+    GLuint id = upload.texture->id();
+    glm::uvec3 o = upload.offset;
+    glm::uvec3 s = upload.size;
+    if (upload.compressedFormat != 0) {
+        switch (upload.texture->dimensions()) {
+            case 1:
+                glCompressedTextureSubImage1D(id, upload.level, o.x, s.x, upload.compressedFormat, size, pixels);
+                break;
+            case 2:
+                glCompressedTextureSubImage2D(id, upload.level, o.x, o.y, s.x, s.y, upload.compressedFormat, size, pixels);
+                break;
+            case 3:
+                glCompressedTextureSubImage3D(id, upload.level, o.x, o.y, o.z, s.x, s.y, s.z, upload.compressedFormat, size, pixels);
+                break;
+        }
+    } else {
+        switch (upload.texture->dimensions()) {
+            case 1:
+                glTextureSubImage1D(id, upload.level, o.x, s.x, upload.format, upload.type, pixels);
+                break;
+            case 2:
+                glTextureSubImage2D(id, upload.level, o.x, o.y, s.x, s.y, upload.format, upload.type, pixels);
+                break;
+            case 3:
+                glTextureSubImage3D(id, upload.level, o.x, o.y, o.z, s.x, s.y, s.z, upload.format, upload.type, pixels);
+                break;
+        }
+    }
+
+    if (upload.mipmap) {
+        upload.texture->generateMipmap();
+    }
+}
+
+void UploadQueue::execute_(Command &command, Batch &batch) {
+    if (command.callback) {
+        batch.callbacks.push_back(std::move(command.callback));
+    }
+    if (command.texture.texture == nullptr && command.buffer == nullptr) return;
+
+    // Client memory is copied into the ring if there is space, otherwise it is uploaded directly
+    std::shared_ptr<Staging> staging = std::move(command.staging);
+    if (!staging && command.data != nullptr) {
+        staging = stage(command.size);
+        if (staging) {
+            std::memcpy(staging->data().data(), command.data, command.size);
+        }
+    }
+
+    if (command.buffer != nullptr) {
+        if (staging) {
+            glCopyNamedBufferSubData(ring_->id(), command.buffer->id(), staging->offset(), command.bufferOffset, command.size);
+        } else {
+            command.buffer->write(command.bufferOffset, command.data, command.size);
+        }
+    } else if (staging) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring_->id());
+        // with a bound unpack buffer, the pointer is an offset into it
+        copyTexture_(command.texture, reinterpret_cast<const void *>(staging->offset()), command.size);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else {
+        copyTexture_(command.texture, command.data, command.size);
+    }
+
+    if (staging) batch.staging.push_back(std::move(staging));
+    if (command.owner) batch.owners.push_back(std::move(command.owner));
+}
+
+bool UploadQueue::retire_(Batch &batch, uint64_t timeout) {
+    if (!batch.fence.clientWait(timeout)) return false;
+
+    batch.staging.clear();
+    batch.owners.clear();
+    for (auto &&callback : batch.callbacks) {
+        callback();
+    }
+    return true;
+}
+
+void UploadQueue::process(float budget, int max_copies) {
+    auto start = std::chrono::steady_clock::now();
+
+    // Batches are issued in order, so they also complete in order
+    while (!inFlight_.empty() && retire_(inFlight_.front(), 0)) {
+        inFlight_.pop_front();
+    }
+
+    Batch batch = {};
+    int copies = 0;
+    while (copies < max_copies) {
+        Command command;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            if (pending_.empty()) break;
+            command = std::move(pending_.front());
+            pending_.pop_front();
+        }
+        execute_(command, batch);
+        copies++;
+
+        float elapsed = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed >= budget) break;
+    }
+
+    if (copies == 0) return;
+    batch.fence.fence();
+    inFlight_.push_back(std::move(batch));
+}
+
+void UploadQueue::finish() {
+    // Callbacks may queue more uploads
+    while (!idle()) {
+        process(INFINITY, INT_MAX);
+        while (!inFlight_.empty()) {
+            while (!retire_(inFlight_.front(), 1000000000)) {
+                LOG_WARN("Waiting for uploads to finish");
+            }
+            inFlight_.pop_front();
+        }
+    }
+}
+
+bool UploadQueue::idle() {
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    return pending_.empty() && inFlight_.empty();
+}
+
+}  // namespace gl
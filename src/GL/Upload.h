@@ -0,0 +1,191 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <glm/glm.hpp>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "Object.h"
+#include "Sync.h"
+
+namespace gl {
+
+class Buffer;
+class Texture;
+class UploadQueue;
+
+/**
+ * A region of the staging ring. It can be filled on any thread.
+ * The region is returned to the ring once the last reference is gone, uploads keep a reference until the gpu is done.
+ */
+class Staging {
+   private:
+    UploadQueue *queue_;
+    uint64_t start_;
+    std::span<uint8_t> data_;
+
+   public:
+    Staging(UploadQueue *queue, uint64_t start, std::span<uint8_t> data);
+    ~Staging();
+
+    Staging(Staging const &) = delete;
+    Staging &operator=(Staging const &) = delete;
+
+    std::span<uint8_t> data() const {
+        return data_;
+    }
+
+    // @returns the byte offset in the staging buffer
+    size_t offset() const;
+};
+
+// The destination of a texture upload
+struct TextureUpload {
+    Texture *texture = nullptr;
+    int level = 0;
+    glm::uvec3 offset = {0, 0, 0};
+    glm::uvec3 size = {1, 1, 1};
+    // format and type of uncompressed data, see `Texture::load`
+    GLenum format = GL_RGBA;
+    GLenum type = GL_UNSIGNED_BYTE;
+    // the compressed internal format, `0` for uncompressed data
+    GLenum compressedFormat = 0;
+    // generate the mipmaps after the upload
+    bool mipmap = false;
+};
+
+/**
+ * Streams texture and buffer data to the gpu over multiple frames.
+ *
+ * The data is copied from a persistently mapped pixel unpack buffer, the staging ring.
+ * Loader threads can fill staging memory directly, see `stage`. Other data is copied into the ring when the upload is issued.
+ * `process` issues the queued copies on the main thread within a time budget.
+ * Every batch of copies is followed by a fence, callbacks are called once it has signaled.
+ *
+ * References:
+ * - [Wiki](https://www.khronos.org/opengl/wiki/Pixel_Buffer_Object)
+ * - [Wiki](https://www.khronos.org/opengl/wiki/Buffer_Object_Streaming#Persistent_mapping)
+ */
+class UploadQueue {
+   private:
+    struct Command {
+        TextureUpload texture = {};
+        Buffer *buffer = nullptr;
+        size_t bufferOffset = 0;
+
+        // the data is either staged or in client memory
+        std::shared_ptr<Staging> staging = nullptr;
+        const void *data = nullptr;
+        size_t size = 0;
+        // keeps the client memory alive
+        std::shared_ptr<const void> owner = nullptr;
+
+        std::function<void()> callback = nullptr;
+    };
+
+    struct Batch {
+        Sync fence;
+        std::vector<std::shared_ptr<Staging>> staging;
+        std::vector<std::shared_ptr<const void>> owners;
+        std::vector<std::function<void()>> callbacks;
+    };
+
+    struct Allocation {
+        uint64_t start;
+        bool released;
+    };
+
+    Buffer *ring_ = nullptr;
+    uint8_t *mapped_ = nullptr;
+    size_t capacity_ = 0;
+
+    // guards the ring allocations, staging can be requested and released on any thread
+    std::mutex ringMutex_;
+    // in allocation order, the front is the oldest
+    std::deque<Allocation> allocations_;
+    // positions in the ring, they only ever increase
+    uint64_t head_ = 0;
+    uint64_t tail_ = 0;
+
+    std::mutex queueMutex_;
+    std::deque<Command> pending_;
+    // only accessed on the main thread
+    std::deque<Batch> inFlight_;
+
+    void release_(uint64_t start);
+
+    void push_(Command &&command);
+
+    void execute_(Command &command, Batch &batch);
+
+    void copyTexture_(const TextureUpload &upload, const void *pixels, size_t size);
+
+    // @returns `true` if the batch is done
+    bool retire_(Batch &batch, uint64_t timeout);
+
+    friend class Staging;
+
+   public:
+    UploadQueue(UploadQueue const &) = delete;
+    UploadQueue &operator=(UploadQueue const &) = delete;
+
+    // @param capacity size of the staging ring in bytes
+    UploadQueue(size_t capacity);
+    // Waits for the gpu, but does not call the remaining callbacks
+    ~UploadQueue();
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    /**
+     * Reserve staging memory. Thread safe and never blocks.
+     * @returns `nullptr` when the ring is full or `size` is too large, the data must be uploaded from client memory then.
+     */
+    std::shared_ptr<Staging> stage(size_t size);
+
+    // Queue a texture upload from staging memory. Thread safe.
+    void upload(const TextureUpload &upload, std::shared_ptr<Staging> staging, std::function<void()> callback = {});
+
+    /**
+     * Queue a texture upload from client memory. Thread safe.
+     * Large uncompressed 2D uploads are split into bands of rows, so they can be spread over multiple frames.
+     * @param owner keeps `data` alive until the upload is done, otherwise `data` must stay valid until then
+     */
+    void upload(const TextureUpload &upload, const void *data, size_t size, std::shared_ptr<const void> owner = {}, std::function<void()> callback = {});
+
+    // Queue a buffer upload from staging memory. Thread safe.
+    void upload(Buffer &buffer, size_t offset, std::shared_ptr<Staging> staging, std::function<void()> callback = {});
+
+    /**
+     * Queue a buffer upload from client memory, it is split into chunks. Thread safe.
+     * The buffer must have been allocated with `GL_DYNAMIC_STORAGE_BIT`, in case the ring is full.
+     * @param owner keeps `data` alive until the upload is done, otherwise `data` must stay valid until then
+     */
+    void upload(Buffer &buffer, size_t offset, const void *data, size_t size, std::shared_ptr<const void> owner = {}, std::function<void()> callback = {});
+
+    // Call `callback` on the main thread once all uploads that were queued before are done
+    void then(std::function<void()> callback);
+
+    /**
+     * Issue queued copies until the budget is used up, at least one copy is issued.
+     * Calls the callbacks of all batches that are done. Main thread only.
+     * @param budget time budget in milliseconds
+     * @param max_copies the maximum number of copies that are issued
+     */
+    void process(float budget, int max_copies);
+
+    // Issue all queued copies and wait until the gpu is done. Main thread only.
+    void finish();
+
+    // @returns `true` when nothing is queued or in flight
+    bool idle();
+};
+
+// Created by `initializeOpenGL`
+inline std::unique_ptr<UploadQueue> uploads;
+
+}  // namespace gl
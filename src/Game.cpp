@@ -12,8 +12,10 @@
 #include "Debug/Direct.h"
 #include "Debug/ImGuiBackend.h"
 #include "GL/Framebuffer.h"
+#include "GL/ProgramCache.h"
 #include "GL/StateManager.h"
 #include "GL/Texture.h"
+#include "GL/Upload.h"
 #include "Input.h"
 #include "Loader/Loader.h"
 #include "Particles/ParticleSystem.h"
@@ -22,6 +24,7 @@
 #include "Renderer/DebugRenderer.h"
 #include "Renderer/FinalFinalizationRenderer.h"
 #include "Renderer/FinalizationRenderer.h"
+#include "Renderer/DepthPyramid.h"
 #include "Renderer/GtaoRenderer.h"
 #include "Renderer/LensEffectsRenderer.h"
 #include "Renderer/MotionBlurRenderer.h"
@@ -34,6 +37,11 @@
 #include "Util/Log.h"
 #include "Window.h"
 
+// Only depth test, so the clears and the first renderers start from a known state
+static const gl::PipelineState CLEAR_PIPELINE_STATE = {
+    .capabilities = gl::capabilityBits({gl::Capability::DepthTest}),
+};
+
 Game &Game::get() {
     if (instance_ == nullptr) PANIC("No instance");
     return *instance_;
@@ -88,13 +96,15 @@ Game::Game(Window &window)
         LOG_INFO("Creating game data directory 'ascent_data'");
         std::filesystem::create_directory("ascent_data");
     }
-
-    // Should be in load, but on reload existing emitters would go away
-    particles = std::make_unique<ParticleSystem>(10000);
+    gl::programCache = std::make_unique<gl::ProgramCache>("ascent_data/shader_cache");
 
     scores = std::make_unique<ScoreManager>("ascent_data/scores.ini");
     settings.load();
     settings.save();
+    loader::setIoBackend(loader::parseIoBackend(settings.get().ioBackend));
+
+    // Should be in load, but on reload existing emitters would go away
+    particles = std::make_unique<ParticleSystem>(10000, parseParticleBackend(settings.get().particleBackend));
 
     audio = std::make_unique<Audio>();
     audio->loadAssets();
@@ -174,6 +184,8 @@ void Game::resize(int width, int height) {
         bloomRenderer_->setViewport(width, height);
     if (lensEffectsRenderer_ != nullptr)
         lensEffectsRenderer_->setViewport(width, height);
+    if (depthPyramid != nullptr)
+        depthPyramid->setViewport(width, height);
     if (gtaoRenderer_ != nullptr)
         gtaoRenderer_->setViewport(width, height);
     if (motionBlurRenderer_ != nullptr)
@@ -206,6 +218,8 @@ void Game::load() {
     bloomRenderer_->setViewport(window.size.x, window.size.y);
     lensEffectsRenderer_ = std::make_unique<LensEffectsRenderer>();
     lensEffectsRenderer_->setViewport(window.size.x, window.size.y);
+    depthPyramid = std::make_unique<DepthPyramid>();
+    depthPyramid->setViewport(window.size.x, window.size.y);
     gtaoRenderer_ = std::make_unique<GtaoRenderer>();
     gtaoRenderer_->setViewport(window.size.x, window.size.y);
     debugRenderer_ = std::make_unique<DebugRenderer>();
@@ -308,13 +322,14 @@ void Game::update_() {
 }
 
 void Game::render_() {
+    gl::manager->beginFrame();
+
+    // Stream queued uploads, before anything uses them this frame
+    gl::uploads->process(settings.get().uploadBudget, 64);
+
     // Clear buffer
     gl::manager->setViewport(0, 0, window.size.x, window.size.y);
-    gl::manager->disable(gl::Capability::ScissorTest);
-    gl::manager->disable(gl::Capability::StencilTest);
-    gl::manager->enable(gl::Capability::DepthTest);
-    gl::manager->depthMask(true);
-    gl::manager->depthFunc(gl::DepthFunc::GreaterOrEqual);
+    gl::manager->apply(CLEAR_PIPELINE_STATE);
 
     if (controller->useHdr()) {
         hdrFramebuffer_->bind(GL_DRAW_FRAMEBUFFER);
@@ -329,9 +344,18 @@ void Game::render_() {
     controller->render();
 
     if (controller->useHdr()) {
+        // The pyramid is only built when it is read, occlusion culling uses it in the next frame
+        auto &culling = debugSettings.rendering.culling;
+        bool occlusion_culling = culling.enabled && culling.gpu && culling.occlusion;
+        bool gtao = debugSettings.rendering.ao.enabled && settings.get().gtao;
+        if (occlusion_culling || gtao) {
+            depthPyramid->build(*camera, *hdrFramebuffer_->getTexture(GL_DEPTH_ATTACHMENT));
+        } else {
+            depthPyramid->invalidate();
+        }
         bloomRenderer_->render(hdrFramebuffer_->getTexture(0));
         lensEffectsRenderer_->render(bloomRenderer_->downLevel(0), bloomRenderer_->downLevel(1));
-        gtaoRenderer_->render(*camera, *hdrFramebuffer_->getTexture(GL_DEPTH_ATTACHMENT), *hdrFramebuffer_->getTexture(1));
+        gtaoRenderer_->render(*camera, depthPyramid->texture(), *hdrFramebuffer_->getTexture(1));
         sdrFramebuffer_->bind(GL_DRAW_FRAMEBUFFER);
         gl::manager->setEnabled({});
         finalizationRenderer_->render(
@@ -20,6 +20,7 @@ class FinalizationRenderer;
 class FinalFinalizationRenderer;
 class MotionBlurRenderer;
 class GtaoRenderer;
+class DepthPyramid;
 class DebugRenderer;
 class BloomRenderer;
 class LensEffectsRenderer;
@@ -86,6 +87,8 @@ class Game {
     std::unique_ptr<Camera> camera;
     std::unique_ptr<DirectBuffer> directDraw;
     std::unique_ptr<ParticleSystem> particles;
+    // built from the hdr depth at the end of each frame, so during rendering it holds the previous frame
+    std::unique_ptr<DepthPyramid> depthPyramid;
     std::unique_ptr<Audio> audio;
 
     std::unique_ptr<AbstractController> controller;
@@ -12,36 +12,45 @@
 namespace loader {
 
 /**
- * An Image Based Lighting Environment
+ * An Image Based Lighting Environment.
+ * The texels are stored in the format of the file, see `IblEnv.h`.
+ * RGBE texels are decoded on the gpu when uploaded, the other formats are uploaded directly.
  */
 class EnvironmentImage {
    private:
     std::vector<int> sizes_;
-    std::vector<float> data_;
+    std::vector<uint8_t> data_;
     std::vector<std::pair<int32_t, int32_t>> dataByLevel_;
     std::vector<std::array<std::pair<int32_t, int32_t>, 6>> dataByFace_;
 
    public:
+    // one of the `IBLENV_FORMAT_*` constants
+    const uint32_t format;
     const int32_t levels;
     const int32_t baseSize;
 
-    EnvironmentImage(std::vector<float> data, int32_t size, int32_t levels);
+    EnvironmentImage(std::vector<uint8_t> &&data, uint32_t format, int32_t size, int32_t levels);
     ~EnvironmentImage();
 
-    std::vector<float> &all() {
+    std::vector<uint8_t> &all() {
         return data_;
     }
 
-    std::span<float> face(int level, int face) {
+    std::span<uint8_t> face(int level, int face) {
         auto range = dataByFace_[level][face];
         return std::span{data_.begin() + range.first, static_cast<size_t>(range.second)};
     }
 
-    std::span<float> level(int level) {
+    std::span<uint8_t> level(int level) {
         auto range = dataByLevel_[level];
         return std::span{data_.begin() + range.first, static_cast<size_t>(range.second)};
     }
 
+    // @returns the index of the first texel of the level. Only valid for 4 byte formats.
+    int32_t texelOffset(int level) {
+        return dataByLevel_[level].first / 4;
+    }
+
     int size(int level) {
         return sizes_[level];
     }
@@ -59,8 +68,27 @@ struct FloatImage {
 
 EnvironmentImage *environment(std::string filename);
 
+/**
+ * Decode the RGBE texels of an environment to RGB floats on the cpu.
+ * This is the reference implementation of the gpu decode done by `Environment`.
+ */
+std::vector<float> decodeEnvironment(EnvironmentImage &image);
+
+/**
+ * Expand all levels of the RGBE environment `filename` on the gpu like `Environment` and compare the bits of the
+ * 16-bit floats to `decodeEnvironment`, rounded to nearest even. Needs an OpenGL context.
+ * Values of 65520 and above are expected to become infinity.
+ * @returns the number of values that differ
+ */
+size_t testRgbeDecode(const std::string &filename);
+
 FloatImage *floatImage(std::string filename);
 
+/**
+ * The gpu textures of an Image Based Lighting Environment.
+ * RGBE texels are uploaded as is and expanded to 16-bit floats by a compute shader,
+ * RGB9E5 and BC6H texels are uploaded directly.
+ */
 class Environment {
     gl::Texture *sky_;
     gl::Texture *diffuse_;
@@ -1,10 +1,12 @@
 #include "../Environment.h"
 //
 
-#include <fstream>
+#include <cstring>
+#include <span>
 #include <vector>
 
 #include "../../Util/Log.h"
+#include "../Loader.h"
 
 const uint32_t F32_MAGIC_NUMBER = 0x6d16837d;
 const uint32_t F32_VERSION_1_002_001 = 1002001;
@@ -22,24 +24,23 @@ struct FloatImageHeader {
 };
 #pragma pack(pop)
 
-std::vector<uint8_t> decompressLz4Frames(std::vector<uint8_t>& input);
-loader::FloatImage* decodeF32(std::ifstream& input);
+loader::FloatImage* decodeF32(std::span<const uint8_t> input);
 
 namespace loader {
 FloatImage* floatImage(std::string filename) {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.is_open()) {
-        PANIC("Error opening file: " + filename);
-    }
-    return decodeF32(file);
+    return decodeF32(file(filename)->span());
 }
 }  // namespace loader
 
-loader::FloatImage* decodeF32(std::ifstream& input) {
+loader::FloatImage* decodeF32(std::span<const uint8_t> input) {
     FloatImageHeader header;
-    input.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (input.size() < sizeof(header)) {
+        PANIC("Expected F32 header");
+    }
+    std::memcpy(&header, input.data(), sizeof(header));
+    input = input.subspan(sizeof(header));
 
-    if (input.fail() || header.check != F32_MAGIC_NUMBER) {
+    if (header.check != F32_MAGIC_NUMBER) {
         PANIC("Expected F32 header");
     }
 
@@ -52,15 +53,13 @@ loader::FloatImage* decodeF32(std::ifstream& input) {
     }
 
     size_t expected_floats = header.width * header.height * header.channels;
-    auto result = new loader::FloatImage(header.width, header.height, header.channels);
-    result->data.resize(expected_floats);
-
-    input.read(reinterpret_cast<char*>(result->data.data()), result->data.size() * 4);
-
-    size_t bytes_read = static_cast<size_t>(input.gcount());
-    if (bytes_read != 4 * expected_floats) {
+    if (input.size() < 4 * expected_floats) {
         PANIC("Expected " + std::to_string(expected_floats) + " floats");
     }
 
+    auto result = new loader::FloatImage(header.width, header.height, header.channels);
+    result->data.resize(expected_floats);
+    std::memcpy(result->data.data(), input.data(), 4 * expected_floats);
+
     return result;
 }
@@ -1,94 +1,154 @@
 #include "../Environment.h"
 //
 
+#include <algorithm>
+#include <bit>
 #include <cmath>
 #include <cstdint>
 #include <cstring>
-#include <fstream>
 #include <vector>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RGBE_USE_SSE2
+#endif
+
+#include "../../Util/Jobs.h"
 #include "../../Util/Log.h"
+#include "../Loader.h"
+#include "IblEnv.h"
 #include "LZ4.h"
 
-const uint32_t IBLENV_MAGIC_NUMBER = 0x78b85411;
-const uint32_t IBLENV_VERSION_1_002_000 = 1002000;
-const uint32_t IBLENV_COMPRESSION_NONE = 0;
-const uint32_t IBLENV_COMPRESSION_LZ4 = 2;
-
-struct IblEnvHeader {
-    uint32_t check;
-    uint32_t version;
-    uint32_t compression;
-    uint32_t size;
-    uint32_t levels;
+// faces larger than this are split into multiple decode ranges
+const size_t RGBE_RANGE_MAX_PIXELS = 64 * 1024;
+
+// A range of pixels that is decoded in one piece. Ranges never cross faces.
+struct RgbeRange {
+    size_t offset;
+    size_t count;
 };
 
-size_t decodeRgbeChunk(std::vector<uint8_t>& src, std::vector<float>& dst);
+void decodeRgbe(std::span<const uint8_t> src, std::span<float> dst);
+
+loader::EnvironmentImage* decodeIblEnv(std::span<const uint8_t> input);
 
-loader::EnvironmentImage* decodeIblEnv(std::istream& input);
+IblEnvHeader readIblEnvHeader(std::span<const uint8_t>& input);
 
-uint32_t calcCubeMapPixels(uint32_t size, uint32_t levels);
+std::vector<RgbeRange> calcRgbeRanges(uint32_t size, uint32_t levels);
 
 namespace loader {
 EnvironmentImage* environment(std::string filename) {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.is_open()) {
-        PANIC("Error opening file: " + filename);
-    }
-    return decodeIblEnv(file);
+    return decodeIblEnv(file(filename)->span());
 }
 }  // namespace loader
 
-loader::EnvironmentImage* decodeIblEnv(std::istream& input) {
-    IblEnvHeader header;
-    input.read(reinterpret_cast<char*>(&header), sizeof(header));
+loader::EnvironmentImage* decodeIblEnv(std::span<const uint8_t> input) {
+    IblEnvHeader header = readIblEnvHeader(input);
 
-    if (input.fail() || header.check != IBLENV_MAGIC_NUMBER) {
-        PANIC("Expected environment header");
-    }
-
-    if (header.version != IBLENV_VERSION_1_002_000) {
-        PANIC("loader::Environment version unsupported");
-    }
-
-    uint32_t pixel_count = calcCubeMapPixels(header.size, header.levels);
-    std::vector<uint8_t> rgbe_data;
+    // The data is used as is, RGBE is decoded on the gpu and the other formats are supported natively
+    std::vector<uint8_t> data(calcIblEnvBytes(header.format, header.size, header.levels));
 
     if (header.compression == IBLENV_COMPRESSION_NONE) {
-        rgbe_data.resize(pixel_count * 4);
-        input.read(reinterpret_cast<char*>(rgbe_data.data()), rgbe_data.size());
-        if (input.gcount() != pixel_count * 4) {
-            PANIC("Expected " + std::to_string(pixel_count) + " encoded pixels");
+        if (input.size() < data.size()) {
+            PANIC("Expected " + std::to_string(data.size()) + " bytes of environment data");
         }
+        std::memcpy(data.data(), input.data(), data.size());
     } else if (header.compression == IBLENV_COMPRESSION_LZ4) {
-        rgbe_data = decompressLz4Frames(input);
-        if (rgbe_data.size() != pixel_count * 4) {
-            PANIC("Expected " + std::to_string(pixel_count) + " encoded pixels");
+        size_t decompressed = decompressLz4Frames(input, data, nullptr);
+        if (decompressed != data.size()) {
+            PANIC("Expected " + std::to_string(data.size()) + " bytes of environment data");
         }
     } else {
         PANIC("loader::Environment compression method unsupported");
     }
 
-    std::vector<float> result;
-    result.resize(pixel_count * 3);
-    size_t decoded = decodeRgbeChunk(rgbe_data, result);
-    if (decoded != pixel_count * 3) {
-        PANIC("Did not decode as many RGBE pixels as expected");
+    return new loader::EnvironmentImage(std::move(data), header.format, header.size, header.levels);
+}
+
+// Read and validate the header, advances the input past it
+IblEnvHeader readIblEnvHeader(std::span<const uint8_t>& input) {
+    IblEnvHeader header = {};
+    if (input.size() < IBLENV_HEADER_1_002_000_SIZE) {
+        PANIC("Expected environment header");
+    }
+    std::memcpy(&header, input.data(), IBLENV_HEADER_1_002_000_SIZE);
+
+    if (header.check != IBLENV_MAGIC_NUMBER) {
+        PANIC("Expected environment header");
+    }
+
+    if (header.version == IBLENV_VERSION_1_002_000) {
+        header.format = IBLENV_FORMAT_RGBE;
+        input = input.subspan(IBLENV_HEADER_1_002_000_SIZE);
+    } else if (header.version == IBLENV_VERSION_1_003_000) {
+        if (input.size() < IBLENV_HEADER_1_003_000_SIZE) {
+            PANIC("Expected environment header");
+        }
+        std::memcpy(&header, input.data(), IBLENV_HEADER_1_003_000_SIZE);
+        input = input.subspan(IBLENV_HEADER_1_003_000_SIZE);
+    } else {
+        PANIC("loader::Environment version unsupported");
     }
 
-    return new loader::EnvironmentImage(result, header.size, header.levels);
+    if (header.format != IBLENV_FORMAT_RGBE && header.format != IBLENV_FORMAT_RGB9E5 && header.format != IBLENV_FORMAT_BC6H) {
+        PANIC("loader::Environment format unsupported");
+    }
+
+    if (header.size == 0 || header.size > 16384) {
+        PANIC("loader::Environment size " + std::to_string(header.size) + " invalid");
+    }
+
+    uint32_t max_levels = std::bit_width(header.size);
+    if (header.levels == 0 || header.levels > max_levels) {
+        PANIC("loader::Environment level count " + std::to_string(header.levels) + " invalid");
+    }
+
+    return header;
 }
 
-uint32_t calcCubeMapPixels(uint32_t size, uint32_t levels) {
-    uint32_t sum = size * size * 6;
-    for (uint32_t i = 1; i < levels; i++) {
-        size /= 2;
-        sum += size * size * 6;
+namespace loader {
+std::vector<float> decodeEnvironment(EnvironmentImage& image) {
+    if (image.format != IBLENV_FORMAT_RGBE) {
+        PANIC("Only RGBE environments can be decoded");
+    }
+    std::span<const uint8_t> src = image.all();
+    std::vector<float> result(src.size() / 4 * 3);
+    std::span<float> dst = result;
+    std::vector<RgbeRange> ranges = calcRgbeRanges(image.baseSize, image.levels);
+    jobs::pool->parallelFor(ranges.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const RgbeRange& range = ranges[i];
+            decodeRgbe(src.subspan(range.offset * 4, range.count * 4), dst.subspan(range.offset * 3, range.count * 3));
+        }
+    });
+    return result;
+}
+}  // namespace loader
+
+std::vector<RgbeRange> calcRgbeRanges(uint32_t size, uint32_t levels) {
+    std::vector<RgbeRange> ranges;
+    size_t offset = 0;
+    // same iteration as calcIblEnvBytes
+    for (uint32_t i = 0; i < levels; i++) {
+        size_t face_pixels = static_cast<size_t>(size) * size;
+        if (face_pixels == 0) {
+            break;
+        }
+        size_t range_count = (face_pixels + RGBE_RANGE_MAX_PIXELS - 1) / RGBE_RANGE_MAX_PIXELS;
+        size_t range_pixels = face_pixels / range_count;
+        for (int face = 0; face < 6; face++) {
+            for (size_t r = 0; r < range_count; r++) {
+                size_t count = r == range_count - 1 ? face_pixels - r * range_pixels : range_pixels;
+                ranges.push_back({.offset = offset + r * range_pixels, .count = count});
+            }
+            offset += face_pixels;
+        }
         if (size == 1) {
             break;
         }
+        size /= 2;
     }
-    return sum;
+    return ranges;
 }
 
 // https://github.com/JuliaMath/openlibm/blob/12f5ffcc990e16f4120d4bf607185243f5affcb8/src/math_private.h#L161C1-L161C1
@@ -111,9 +171,8 @@ static inline float fast_ldexpf(float a, int pw2) {
     return (fl.value);
 }
 
-size_t decodeRgbeChunk(std::vector<uint8_t>& src, std::vector<float>& dst) {
-    size_t n = 0;
-    for (uint32_t i = 0, j = 0; i < src.size(); i += 4, j += 3) {
+static void decodeRgbeScalar(const uint8_t* src, float* dst, size_t count) {
+    for (size_t i = 0, j = 0; i < count * 4; i += 4, j += 3) {
         uint8_t r = src[i + 0];
         uint8_t g = src[i + 1];
         uint8_t b = src[i + 2];
@@ -123,17 +182,68 @@ size_t decodeRgbeChunk(std::vector<uint8_t>& src, std::vector<float>& dst) {
             dst[j + 0] = 0.0;
             dst[j + 1] = 0.0;
             dst[j + 2] = 0.0;
-            n += 3;
             continue;
         }
 
-        float f = fast_ldexpf(1.0, (int)(e) - (128 + 8));
+        // fast_ldexpf only works for normal results, exponents up to 9 give a denormal scale
+        float f = e > 9 ? fast_ldexpf(1.0, (int)(e) - (128 + 8)) : std::ldexp(1.0f, (int)(e) - (128 + 8));
 
         dst[j + 0] = (float)(r)*f;
         dst[j + 1] = (float)(g)*f;
         dst[j + 2] = (float)(b)*f;
-        n += 3;
     }
+}
 
-    return n;
+#ifdef RGBE_USE_SSE2
+// Decodes 4 pixels per iteration. SSE2 is part of x86-64, so no runtime detection is required.
+// Each pixel is stored as 4 floats, the 4th is overwritten by the next pixel.
+// For this reason the last pixel is always decoded by the scalar version.
+// Small exponents give denormal results, exactly like ldexp, the scalar version and the gpu.
+static size_t decodeRgbeSse2(const uint8_t* src, float* dst, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi32(1);
+    // 2^-8 and 2^-9 as float bits
+    const __m128i low_scale_bits = _mm_set1_epi32((127 - 8) << 23);
+    const __m128i low_scale_step = _mm_set1_epi32(1 << 23);
+    size_t i = 0;
+    for (; i + 4 < count; i += 4) {
+        __m128i rgbe = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+
+        // scale = 2^(e - 128 - 8), which is denormal for e <= 9 and can't be built from the exponent bits directly.
+        // It is split into 2^-8 * 2^(e - 128), both normal. The first product is exact, so only the second one rounds.
+        // For e = 1 the second factor would be denormal too, so it becomes 2^-9 * 2^-126 instead.
+        __m128i exponent = _mm_srli_epi32(rgbe, 24);
+        __m128i is_zero = _mm_cmpeq_epi32(exponent, zero);
+        __m128i is_one = _mm_cmpeq_epi32(exponent, one);
+        // max(e, 2) - 1 is the exponent field of 2^(max(e, 2) - 128)
+        __m128i high_field = _mm_sub_epi32(_mm_add_epi32(exponent, _mm_and_si128(is_one, one)), one);
+        __m128 high_scale = _mm_castsi128_ps(_mm_andnot_si128(is_zero, _mm_slli_epi32(high_field, 23)));
+        __m128 low_scale = _mm_castsi128_ps(_mm_sub_epi32(low_scale_bits, _mm_and_si128(is_one, low_scale_step)));
+
+        __m128i lo = _mm_unpacklo_epi8(rgbe, zero);
+        __m128i hi = _mm_unpackhi_epi8(rgbe, zero);
+        __m128 p0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+        __m128 p1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+        __m128 p2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+        __m128 p3 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+
+#define RGBE_SCALE(p, n) _mm_mul_ps(_mm_mul_ps(p, _mm_shuffle_ps(low_scale, low_scale, _MM_SHUFFLE(n, n, n, n))), _mm_shuffle_ps(high_scale, high_scale, _MM_SHUFFLE(n, n, n, n)))
+        float* out = dst + i * 3;
+        _mm_storeu_ps(out + 0, RGBE_SCALE(p0, 0));
+        _mm_storeu_ps(out + 3, RGBE_SCALE(p1, 1));
+        _mm_storeu_ps(out + 6, RGBE_SCALE(p2, 2));
+        _mm_storeu_ps(out + 9, RGBE_SCALE(p3, 3));
+#undef RGBE_SCALE
+    }
+    return i;
+}
+#endif
+
+void decodeRgbe(std::span<const uint8_t> src, std::span<float> dst) {
+    size_t count = std::min(src.size() / 4, dst.size() / 3);
+    size_t decoded = 0;
+#ifdef RGBE_USE_SSE2
+    decoded = decodeRgbeSse2(src.data(), dst.data(), count);
+#endif
+    decodeRgbeScalar(src.data() + decoded * 4, dst.data() + decoded * 3, count - decoded);
 }
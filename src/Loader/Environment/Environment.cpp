@@ -1,36 +1,26 @@
 #include "../Environment.h"
 
-#include "../../GL/Texture.h"
+#include <bit>
+#include <cmath>
+#include <memory>
 
-std::pair<int32_t, int32_t> calcCubeMapOffset(int32_t size, int32_t level) {
-    int32_t start = 0, end = 0;
-    for (int32_t i = 0; i <= level; i++) {
-        int32_t len = size * size * 6;
-        end += len;
-        start = end - len;
-        size /= 2;
-        if (size == 0) {
-            break;
-        }
-    }
-    return std::make_pair(start, end);
-}
+#include "../../GL/Geometry.h"
+#include "../../GL/Shader.h"
+#include "../../GL/Texture.h"
+#include "../../Util/Log.h"
+#include "IblEnv.h"
 
 namespace loader {
-EnvironmentImage::EnvironmentImage(std::vector<float> data, int32_t size, int32_t levels) : levels(levels), baseSize(size) {
+EnvironmentImage::EnvironmentImage(std::vector<uint8_t>&& data, uint32_t format, int32_t size, int32_t levels) : data_(std::move(data)), format(format), levels(levels), baseSize(size) {
     dataByLevel_.resize(levels);
     dataByFace_.resize(levels);
     sizes_.resize(levels);
     int32_t lvl_size = size;
-
-    std::span<float> data_span = std::span{data};
+    int32_t offset = 0;
 
     for (int lvl = 0; lvl < levels; lvl++) {
-        int32_t offset, end;
-        std::tie(offset, end) = calcCubeMapOffset(size, lvl);
-        offset *= 3;
-        end *= 3;
-        int32_t stride = lvl_size * lvl_size * 3;
+        int32_t stride = static_cast<int32_t>(calcIblEnvFaceBytes(format, lvl_size));
+        int32_t end = offset + stride * 6;
 
         dataByFace_[lvl] = {
             std::make_pair(offset + 0 * stride, stride),
@@ -43,14 +33,117 @@ EnvironmentImage::EnvironmentImage(std::vector<float> data, int32_t size, int32_
         dataByLevel_[lvl] = std::make_pair(offset, end - offset);
         sizes_[lvl] = lvl_size;
         lvl_size /= 2;
+        offset = end;
     }
-
-    this->data_ = data;
 }
 
 EnvironmentImage::~EnvironmentImage() {
 }
 
+// Upload the RGBE texels to a staging buffer and expand them into the cubemap levels on the gpu
+void uploadRgbe(gl::ShaderPipeline& shader, EnvironmentImage& image, gl::Texture& texture, int levels) {
+    gl::Buffer staging;
+    staging.setDebugLabel("environment/rgbe_staging");
+    staging.allocate(image.all().data(), image.all().size(), 0);
+
+    shader.bind();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, staging.id());
+    for (int lvl = 0; lvl < levels; lvl++) {
+        int size = image.size(lvl);
+        shader.get(GL_COMPUTE_SHADER)->setUniform("u_offset", static_cast<unsigned int>(image.texelOffset(lvl)));
+        shader.get(GL_COMPUTE_SHADER)->setUniform("u_size", size);
+        glBindImageTexture(0, texture.id(), lvl, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        glDispatchCompute((size + 7) / 8, (size + 7) / 8, 6);
+    }
+    // the staging buffer can be deleted right away, the driver keeps it alive until the dispatches are done.
+    // The texels are sampled, but may also be read back with glGetTextureImage.
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
+
+
+/**
+ * Create a cubemap texture from the first `levels` levels of the image.
+ * @param rgbe_shader the rgbe decode shader, created when it is first needed and owned by the caller
+ */
+gl::Texture* createCubemap(std::unique_ptr<gl::ShaderPipeline>& rgbe_shader, EnvironmentImage& image, int levels, const std::string& label) {
+    gl::Texture* texture = new gl::Texture(GL_TEXTURE_CUBE_MAP);
+    texture->setDebugLabel(label);
+
+    if (image.format == IBLENV_FORMAT_RGBE) {
+        if (rgbe_shader == nullptr) {
+            rgbe_shader.reset(new gl::ShaderPipeline({new gl::ShaderProgram("assets/shaders/rgbe_decode.comp")}));
+            rgbe_shader->setDebugLabel("environment/rgbe_shader");
+        }
+        // Note: image load / store does not support three component formats, so RGBA is used
+        texture->allocate(levels, GL_RGBA16F, image.baseSize, image.baseSize);
+        uploadRgbe(*rgbe_shader, image, *texture, levels);
+    } else if (image.format == IBLENV_FORMAT_RGB9E5) {
+        texture->allocate(levels, GL_RGB9_E5, image.baseSize, image.baseSize);
+        for (int lvl = 0; lvl < levels; lvl++) {
+            texture->load(lvl, image.size(lvl), image.size(lvl), 6, GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV, image.level(lvl).data());
+        }
+    } else if (image.format == IBLENV_FORMAT_BC6H) {
+        texture->allocate(levels, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, image.baseSize, image.baseSize);
+        for (int lvl = 0; lvl < levels; lvl++) {
+            std::span<uint8_t> data = image.level(lvl);
+            texture->loadCompressed(lvl, image.size(lvl), image.size(lvl), 6, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, data.size(), data.data());
+        }
+    } else {
+        PANIC("loader::Environment format unsupported");
+    }
+
+    return texture;
+}
+
+// Round to the nearest 16-bit float with ties to even, like the conversion when storing to a RGBA16F image
+static uint16_t roundToHalf(float value) {
+    uint32_t bits = std::bit_cast<uint32_t>(value);
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    bits &= 0x7fffffff;
+    // nan and infinity
+    if (bits >= 0x7f800000) return sign | 0x7c00 | (bits > 0x7f800000 ? 0x200 : 0);
+    // 65520 and above round to infinity
+    if (bits >= 0x477ff000) return sign | 0x7c00;
+    // below 2^-14 the result is denormal, its unit is 2^-24. The scaling is exact and nearbyint rounds ties to even.
+    if (bits < 0x38800000) {
+        return sign | static_cast<uint16_t>(std::nearbyint(std::bit_cast<float>(bits) * 0x1p24f));
+    }
+    // round the mantissa to 10 bits, a carry correctly moves into the exponent
+    bits += 0xfff + ((bits >> 13) & 1);
+    return sign | static_cast<uint16_t>((bits >> 13) - ((127 - 15) << 10));
+}
+
+size_t testRgbeDecode(const std::string& filename) {
+    std::unique_ptr<EnvironmentImage> image(environment(filename));
+    if (image->format != IBLENV_FORMAT_RGBE) {
+        PANIC("Only RGBE environments can be tested");
+    }
+
+    std::unique_ptr<gl::ShaderPipeline> rgbe_shader;
+    std::unique_ptr<gl::Texture> texture(createCubemap(rgbe_shader, *image, image->levels, "environment/rgbe_test"));
+    std::vector<float> cpu = decodeEnvironment(*image);
+
+    size_t mismatches = 0;
+    for (int lvl = 0; lvl < image->levels; lvl++) {
+        size_t count = static_cast<size_t>(image->size(lvl)) * image->size(lvl) * 6;
+        std::vector<uint16_t> gpu(count * 4);
+        glGetTextureImage(texture->id(), lvl, GL_RGBA, GL_HALF_FLOAT, static_cast<GLsizei>(gpu.size() * sizeof(uint16_t)), gpu.data());
+
+        const float* expected = cpu.data() + static_cast<size_t>(image->texelOffset(lvl)) * 3;
+        for (size_t i = 0; i < count; i++) {
+            for (int c = 0; c < 3; c++) {
+                uint16_t expected_bits = roundToHalf(expected[i * 3 + c]);
+                if (gpu[i * 4 + c] == expected_bits) continue;
+                if (mismatches++ < 10) {
+                    LOG_WARN("Level " << lvl << " texel " << i << " channel " << c << ": gpu 0x" << std::hex << gpu[i * 4 + c] << ", cpu 0x" << expected_bits << std::dec);
+                }
+            }
+        }
+    }
+    LOG_INFO("Compared the rgbe decode of '" << filename << "', " << mismatches << " values differ");
+    return mismatches;
+}
+
 Environment::Environment(
     loader::EnvironmentImage& sky,
     loader::EnvironmentImage& env_diffuse,
@@ -66,27 +159,18 @@ Environment::Environment(
     cubemapSampler_->wrapMode(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
     cubemapSampler_->filterMode(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
 
-    diffuse_ = new gl::Texture(GL_TEXTURE_CUBE_MAP);
-    diffuse_->setDebugLabel("environment/diffuse");
-    diffuse_->allocate(1, GL_RGB16F, env_diffuse.baseSize, env_diffuse.baseSize);
-    diffuse_->load(0, env_diffuse.baseSize, env_diffuse.baseSize, 6, GL_RGB, GL_FLOAT, env_diffuse.all().data());
+    // owned here, so it is deleted even if an upload fails
+    std::unique_ptr<gl::ShaderPipeline> rgbe_shader;
 
-    specular_ = new gl::Texture(GL_TEXTURE_CUBE_MAP);
-    specular_->setDebugLabel("environment/diffuse");
-    specular_->allocate(env_specular.levels, GL_RGB16F, env_specular.baseSize, env_specular.baseSize);
-    for (int lvl = 0; lvl < env_specular.levels; lvl++) {
-        specular_->load(lvl, env_specular.size(lvl), env_specular.size(lvl), 6, GL_RGB, GL_FLOAT, env_specular.level(lvl).data());
-    }
+    diffuse_ = createCubemap(rgbe_shader, env_diffuse, 1, "environment/diffuse");
+    specular_ = createCubemap(rgbe_shader, env_specular, env_specular.levels, "environment/specular");
 
     brdfLut_ = new gl::Texture(GL_TEXTURE_2D);
     brdfLut_->setDebugLabel("environment/brdf_lut");
     brdfLut_->allocate(1, GL_RG32F, brdf_lut.width, brdf_lut.height);
     brdfLut_->load(0, brdf_lut.width, brdf_lut.height, GL_RG, GL_FLOAT, brdf_lut.data.data());
 
-    sky_ = new gl::Texture(GL_TEXTURE_CUBE_MAP);
-    sky_->setDebugLabel("environment/sky");
-    sky_->allocate(1, GL_RGB16F, sky.baseSize, sky.baseSize);
-    sky_->load(0, sky.baseSize, sky.baseSize, 6, GL_RGB, GL_FLOAT, sky.all().data());
+    sky_ = createCubemap(rgbe_shader, sky, 1, "environment/sky");
 }
 
 Environment::~Environment() {
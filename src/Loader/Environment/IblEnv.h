@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The layout of the .iblenv format, shared by the loader and the `iblenc` tool.
+// The file starts with a header, followed by the (optionally LZ4 compressed) cubemap levels.
+// Each level contains six faces in the order +X, -X, +Y, -Y, +Z, -Z.
+
+const uint32_t IBLENV_MAGIC_NUMBER = 0x78b85411;
+// RGBE texels, the header has no format field
+const uint32_t IBLENV_VERSION_1_002_000 = 1002000;
+// Adds the format field
+const uint32_t IBLENV_VERSION_1_003_000 = 1003000;
+
+const uint32_t IBLENV_COMPRESSION_NONE = 0;
+const uint32_t IBLENV_COMPRESSION_LZ4 = 2;
+
+const uint32_t IBLENV_FORMAT_RGBE = 0;
+// Matches GL_RGB9_E5, 4 bytes per texel
+const uint32_t IBLENV_FORMAT_RGB9E5 = 1;
+// Matches GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, 16 bytes per 4x4 block
+const uint32_t IBLENV_FORMAT_BC6H = 2;
+
+struct IblEnvHeader {
+    uint32_t check;
+    uint32_t version;
+    uint32_t compression;
+    uint32_t size;
+    uint32_t levels;
+    // only present in version 1.003.000
+    uint32_t format;
+};
+
+const size_t IBLENV_HEADER_1_002_000_SIZE = offsetof(IblEnvHeader, format);
+const size_t IBLENV_HEADER_1_003_000_SIZE = sizeof(IblEnvHeader);
+
+// @returns the size of one face in bytes
+inline size_t calcIblEnvFaceBytes(uint32_t format, uint32_t size) {
+    if (format == IBLENV_FORMAT_BC6H) {
+        size_t blocks = (size + 3) / 4;
+        return blocks * blocks * 16;
+    }
+    return static_cast<size_t>(size) * size * 4;
+}
+
+// @returns the size of all levels in bytes
+inline size_t calcIblEnvBytes(uint32_t format, uint32_t size, uint32_t levels) {
+    size_t sum = 0;
+    for (uint32_t i = 0; i < levels && size > 0; i++) {
+        sum += calcIblEnvFaceBytes(format, size) * 6;
+        size /= 2;
+    }
+    return sum;
+}
@@ -1,6 +1,15 @@
 #pragma once
 
-#include <istream>
-#include <vector>
+#include <cstdint>
+#include <functional>
+#include <span>
 
-std::vector<uint8_t> decompressLz4Frames(std::istream& input);
\ No newline at end of file
+/**
+ * Decompress LZ4 frames directly into a preallocated buffer.
+ *
+ * @param input the compressed frames
+ * @param output the buffer to decompress into, must be large enough for the entire output
+ * @param progress called with the total number of decompressed bytes, whenever more output is available. May be empty.
+ * @returns the number of decompressed bytes
+ */
+size_t decompressLz4Frames(std::span<const uint8_t> input, std::span<uint8_t> output, const std::function<void(size_t)>& progress);
@@ -1,46 +1,49 @@
-
 #include <lz4frame.h>
 
-#include <array>
-#include <istream>
-#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <span>
 
 #include "../../Util/Log.h"
 
 // Reference: https://gist.github.com/t-mat/c47868a00c60f93682d8
-std::vector<uint8_t> decompressLz4Frames(std::istream& input) {
+size_t decompressLz4Frames(std::span<const uint8_t> input, std::span<uint8_t> output, const std::function<void(size_t)>& progress) {
     LZ4F_dctx* dctx;
     size_t const dctx_status = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
     if (LZ4F_isError(dctx_status)) {
         PANIC("LZ4F_dctx creation error: " + std::string(LZ4F_getErrorName(dctx_status)));
     }
 
-    std::array<uint8_t, 64 * 1024> src_buffer;
-    std::array<uint8_t, 256 * 1024> dst_buffer;
-    std::vector<uint8_t> output;
-
-    while (!input.eof()) {
-        input.read(reinterpret_cast<char*>(&src_buffer), src_buffer.size());
-        size_t src_size = static_cast<size_t>(input.gcount());
-        size_t src_offset = 0;
-
-        while (src_offset < src_size) {
-            uint8_t* src_ptr = &src_buffer[src_offset];
-            size_t dst_size = dst_buffer.size();
-            size_t src_remain = src_size - src_offset;
-            size_t result = LZ4F_decompress(dctx, &dst_buffer, &dst_size, src_ptr, &src_remain, nullptr);
-            if (LZ4F_isError(result)) {
-                PANIC("LZ4F_decompress error: " + std::string(LZ4F_getErrorName(result)));
-            }
+    // The input is fed in small chunks, so that the progress is reported while decompressing.
+    // The output is written directly into the final buffer, there is no intermediate copy.
+    // A new frame starts automatically once the previous one has ended.
+    const size_t src_chunk_size = 64 * 1024;
+    size_t src_offset = 0;
+    size_t dst_offset = 0;
+    while (src_offset < input.size()) {
+        size_t src_size = std::min(src_chunk_size, input.size() - src_offset);
+        size_t dst_size = output.size() - dst_offset;
+        size_t result = LZ4F_decompress(dctx, output.data() + dst_offset, &dst_size, input.data() + src_offset, &src_size, nullptr);
+        if (LZ4F_isError(result)) {
+            LZ4F_freeDecompressionContext(dctx);
+            PANIC("LZ4F_decompress error: " + std::string(LZ4F_getErrorName(result)));
+        }
 
-            output.insert(output.end(), dst_buffer.begin(), dst_buffer.begin() + dst_size);
-            src_offset += src_remain;
+        src_offset += src_size;
+        dst_offset += dst_size;
+        if (dst_size > 0) {
+            if (progress) progress(dst_offset);
+        }
 
-            if (result == 0) break;
+        // no progress can only happen when the output is full
+        if (src_size == 0 && dst_size == 0) {
+            LZ4F_freeDecompressionContext(dctx);
+            PANIC("LZ4F_decompress error: output is larger than expected");
         }
     }
 
     LZ4F_freeDecompressionContext(dctx);
 
-    return output;
-}
\ No newline at end of file
+    return dst_offset;
+}
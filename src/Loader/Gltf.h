@@ -5,6 +5,7 @@
 
 #include <algorithm>
 #include <any>
+#include <array>
 #include <fstream>
 #include <functional>
 #include <glm/gtc/type_ptr.hpp>
@@ -30,6 +31,9 @@ namespace gltf = tinygltf;
 
 namespace loader {
 
+class SceneCache;
+class SceneCacheWriter;
+
 /**
  * A material determines how an object looks by defining PBR parameters
  * like color and roughness.
@@ -98,12 +102,15 @@ struct Mesh {
     uint32_t totalElementCount = 0;
     // the sum of all section vertex counts
     uint32_t totalVertexCount = 0;
+    // object space bounding box of all sections
+    glm::vec3 boundsMin = glm::vec3(0);
+    glm::vec3 boundsMax = glm::vec3(0);
 };
 
 /**
  * Per graphics instance attributes.
  * Currently only the mesh's transform.
- * Accessible by the vertex shader.
+ * Accessible by the vertex shader as a shader storage buffer, indexed by the instance index attribute.
  */
 struct InstanceAttributes {
     // the object to world transformation matrix
@@ -140,22 +147,55 @@ struct MaterialBatch {
  * Contains all the graphics instances and their related data.
  */
 class GraphicsData {
+   public:
+    // The instance attributes buffer has a slice for each frame that the gpu may still be reading
+    static inline constexpr int FRAME_COUNT = 3;
+
    private:
     std::unique_ptr<gl::VertexArray> vao_;
     std::unique_ptr<gl::Buffer> drawCommands_;
+    // `FRAME_COUNT` slices of the instance attributes, one of them is written each frame
+    std::unique_ptr<gl::Buffer> instanceAttributes_;
+    // The instance index vertex attribute, owned by the vao. Contains `0..n` for the unculled draw commands.
+    gl::Buffer *instanceIndices_;
 
     /**
      * Pointer into the persistently mapped, instance attributes buffer.
-     * Can only be written to, not read.
+     * Can only be written to, not read. Writes have to be flushed.
      */
     InstanceAttributes *instanceAttributesData_ = nullptr;
+    // the slice used by this frame's draws
+    int slice_ = 0;
+    // signaled when the gpu is done with the draws of each slice
+    std::array<std::unique_ptr<gl::Sync>, FRAME_COUNT> sliceSyncs_;
+    // The instance attributes as seen by the cpu, all changes are written here and uploaded by `upload`
+    std::vector<InstanceAttributes> attributes_;
+    // The instance attributes changed in each of the last frames.
+    // A slice was last written `FRAME_COUNT` frames ago, so it is missing all of them.
+    std::array<std::vector<int32_t>, FRAME_COUNT> dirty_;
+    int dirtyList_ = 0;
+    // the frame in which each instance attributes was last added to a dirty list
+    std::vector<uint32_t> dirtyFrames_;
+    uint32_t frame_ = 1;
+    // reused by `upload`
+    std::vector<int32_t> uploadIndices_;
+    // Instance attributes which were changed since the last `clearMoved`, without duplicates
+    std::vector<int32_t> moved_;
+    std::vector<uint8_t> movedFlags_;
 
    public:
+    // Binding point of the instance attributes shader storage buffer
+    static inline constexpr int INSTANCE_ATTRIBUTES_BINDING = 4;
+    // Vertex buffer binding index of the instance indices
+    static inline constexpr int INSTANCE_INDEX_BUFFER = 4;
+
     std::vector<Instance> instances;
     std::vector<Material> materials;
     const Material &defaultMaterial;
     std::vector<Mesh> meshes;
     std::vector<MaterialBatch> batches;
+    // The draw commands referenced by the batches, used to build culled commands
+    std::vector<gl::DrawElementsIndirectCommand> commands;
 
     GraphicsData(GraphicsData const &) = delete;
     GraphicsData &operator=(GraphicsData const &) = delete;
@@ -167,18 +207,57 @@ class GraphicsData {
         int32_t default_material,
         std::vector<Mesh> &&meshes,
         std::vector<MaterialBatch> &&batches,
+        std::vector<gl::DrawElementsIndirectCommand> &&commands,
+        std::vector<InstanceAttributes> &&attributes,
         gl::VertexArray *vao,
         gl::Buffer *instance_attributes,
+        gl::Buffer *instance_indices,
         gl::Buffer *draw_commands);
 
     ~GraphicsData();
 
-    // bind the vao and draw commands
+    // bind the vao, draw commands and instance attributes
     void bind() const;
 
+    /**
+     * Bind the vao and instance attributes with different draw commands.
+     * @param commands the draw commands, their base instance is an index into `instance_indices`
+     * @param instance_indices the instance attribute index of each drawn instance
+     */
+    void bind(const gl::Buffer &commands, const gl::Buffer &instance_indices) const;
+
     uint32_t commandCount() const;
 
-    InstanceAttributes *attributes(int32_t index) const;
+    // @returns the size of one slice of the instance attributes buffer in bytes, a multiple of the storage buffer offset alignment
+    static size_t attributesSliceSize(size_t attribute_count);
+
+    /**
+     * Start a new frame. Waits until the gpu is done with the oldest slice of the instance attributes,
+     * then copies the ranges that changed since it was last written into it.
+     * The draws of the frame see this snapshot, no matter what is changed afterwards.
+     */
+    void upload();
+
+    // Bind this frame's slice of the instance attributes shader storage buffer
+    void bindAttributes() const;
+
+    const InstanceAttributes &attributes(int32_t index) const {
+        return attributes_[index];
+    }
+
+    int32_t attributeCount() const {
+        return static_cast<int32_t>(attributes_.size());
+    }
+
+    // Set the transform of the instance attributes with the given index, it is uploaded with the next `upload`
+    void setTransform(int32_t index, const glm::mat4 &transform);
+
+    // @returns the indices of all instance attributes that were changed since the last call to `clearMoved`
+    const std::vector<int32_t> &moved() const {
+        return moved_;
+    }
+
+    void clearMoved();
 };
 
 // Definition of physics trigger (sensor) action.
@@ -320,19 +399,56 @@ const gltf::Model gltf(const std::string filename);
  * Load graphics instances from the gltf model.
  * @param model the gltf model
  * @param nodes the loaded node hierarchy
+ * @param cache if not null, the loaded graphics will be written to it
  */
-GraphicsData loadGraphics(const gltf::Model &model, std::map<std::string, loader::Node> &nodes);
+GraphicsData loadGraphics(const gltf::Model &model, std::map<std::string, loader::Node> &nodes, SceneCacheWriter *cache = nullptr);
 
 /**
  * Load physics instances from the gltf model.
  * @param model the gltf model
  * @param nodes the loaded node hierarchy
+ * @param cache if not null, the loaded physics will be written to it
  */
-PhysicsData loadPhysics(const gltf::Model &model, std::map<std::string, loader::Node> &nodes);
+PhysicsData loadPhysics(const gltf::Model &model, std::map<std::string, loader::Node> &nodes, SceneCacheWriter *cache = nullptr);
 
 std::map<std::string, loader::Node> loadNodeTree(const gltf::Model &model);
 
-SceneData *scene(const gltf::Model &model);
+SceneData *scene(const gltf::Model &model, SceneCacheWriter *cache = nullptr);
+
+/**
+ * Everything required to create a scene.
+ * Creating a scene is split into two steps: `sceneSource` does the file io and parsing and can run on a worker thread,
+ * `scene` does the OpenGL uploads and must run on the main thread.
+ */
+struct SceneSource {
+    // path of the gltf file
+    std::string filename = "";
+    // path of the baked scene cache
+    std::string cacheFilename = "";
+    // content hash of the gltf file
+    uint64_t hash = 0;
+    // the memory mapped scene cache, null if it is missing or outdated
+    std::unique_ptr<SceneCache> cache;
+    // the parsed gltf file, only loaded if there is no valid scene cache
+    std::unique_ptr<const gltf::Model> model;
+
+    SceneSource();
+    ~SceneSource();
+};
+
+/**
+ * Open the baked scene cache of a gltf file or parse the gltf file if the cache is outdated.
+ * @param filename path of the gltf file
+ * @param cache_filename path of the baked scene cache (`.ascent_scene`)
+ */
+std::unique_ptr<SceneSource> sceneSource(const std::string &filename, const std::string &cache_filename);
+
+/**
+ * Create a scene from the baked scene cache.
+ * If there is none, the scene is loaded from the gltf model and then baked.
+ * The textures and meshes are streamed by `gl::uploads`, the source must stay alive until the uploads are done.
+ */
+SceneData *scene(const SceneSource &source);
 
 namespace util {
 
@@ -0,0 +1,583 @@
+#include "Cache.h"
+
+#include <Jolt/Core/StreamIn.h>
+#include <Jolt/Core/StreamOut.h>
+#include <xxhash.h>
+
+#include <cstring>
+#include <filesystem>
+#include <typeinfo>
+
+#include "../../GL/Texture.h"
+#include "../../Util/Log.h"
+#include "Graphics/Graphics.h"
+#include "Physics/Physics.h"
+
+const uint32_t SCENE_CACHE_MAGIC_NUMBER = 0x5ce7ac4e;
+// 1.1.0: material textures store their mip chain
+// 1.2.0: meshes store their bounds
+const uint32_t SCENE_CACHE_VERSION_1_002_000 = 1002000;
+
+// force tight packing
+#pragma pack(push, 1)
+struct SceneCacheHeader {
+    uint32_t check;
+    uint32_t version;
+    // content hash of the gltf file
+    uint64_t sourceHash;
+    // length of the entire file in bytes, used to detect truncated files
+    uint64_t length;
+    uint8_t unused[8];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(SceneCacheHeader) % 16 == 0, "header must keep the 16 byte alignment of the data");
+// These are stored as is, any change to them requires a new version
+static_assert(sizeof(loader::Section) == 24);
+static_assert(sizeof(loader::InstanceAttributes) == 64);
+static_assert(sizeof(gl::DrawElementsIndirectCommand) == 20);
+
+// Type of a node property value, see `jsonPropertyAsAny`
+enum class PropertyType : uint8_t {
+    None,
+    Bool,
+    Int,
+    Float,
+    String,
+};
+
+// Reads the scene cache sequentially, in the same order as it was written by `SceneCacheWriter`
+class SceneCacheReader {
+   private:
+    std::span<const uint8_t> data_;
+    size_t offset_ = 0;
+
+    void check_(size_t length) {
+        if (length > data_.size() - offset_) {
+            PANIC("Scene cache is corrupt");
+        }
+    }
+
+   public:
+    SceneCacheReader(std::span<const uint8_t> data, size_t offset) : data_(data), offset_(offset) {}
+
+    template <typename T>
+    T read() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        check_(sizeof(T));
+        T result;
+        std::memcpy(&result, data_.data() + offset_, sizeof(T));
+        offset_ += sizeof(T);
+        return result;
+    }
+
+    std::string readString() {
+        uint32_t length = read<uint32_t>();
+        check_(length);
+        std::string result(reinterpret_cast<const char *>(data_.data() + offset_), length);
+        offset_ += length;
+        return result;
+    }
+
+    // @returns a view into the mapped memory
+    template <typename T>
+    std::span<const T> readArray() {
+        uint64_t count = read<uint64_t>();
+        offset_ = std::min((offset_ + 15) & ~size_t(15), data_.size());
+        if (count > (data_.size() - offset_) / sizeof(T)) {
+            PANIC("Scene cache is corrupt");
+        }
+        std::span<const T> result(reinterpret_cast<const T *>(data_.data() + offset_), count);
+        offset_ += count * sizeof(T);
+        return result;
+    }
+};
+
+// Jolt output stream that appends to a byte vector
+class CacheStreamOut : public JPH::StreamOut {
+   private:
+    std::vector<uint8_t> &data_;
+
+   public:
+    CacheStreamOut(std::vector<uint8_t> &data) : data_(data) {}
+
+    void WriteBytes(const void *inData, size_t inNumBytes) override {
+        const uint8_t *bytes = static_cast<const uint8_t *>(inData);
+        data_.insert(data_.end(), bytes, bytes + inNumBytes);
+    }
+
+    bool IsFailed() const override {
+        return false;
+    }
+};
+
+// Jolt input stream that reads from the mapped memory
+class CacheStreamIn : public JPH::StreamIn {
+   private:
+    std::span<const uint8_t> data_;
+    size_t offset_ = 0;
+    bool failed_ = false;
+
+   public:
+    CacheStreamIn(std::span<const uint8_t> data) : data_(data) {}
+
+    void ReadBytes(void *outData, size_t inNumBytes) override {
+        if (inNumBytes > data_.size() - offset_) {
+            failed_ = true;
+            std::memset(outData, 0, inNumBytes);
+            return;
+        }
+        std::memcpy(outData, data_.data() + offset_, inNumBytes);
+        offset_ += inNumBytes;
+    }
+
+    bool IsEOF() const override {
+        return offset_ >= data_.size();
+    }
+
+    bool IsFailed() const override {
+        return failed_;
+    }
+};
+
+namespace loader {
+
+SceneSource::SceneSource() = default;
+
+SceneSource::~SceneSource() = default;
+
+SceneCacheWriter::SceneCacheWriter(uint64_t hash) : hash_(hash) {
+    // the header is filled in when saving
+    data_.resize(sizeof(SceneCacheHeader));
+}
+
+void SceneCacheWriter::write_(const void *data, size_t length) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    data_.insert(data_.end(), bytes, bytes + length);
+}
+
+void SceneCacheWriter::writeString_(const std::string &value) {
+    write_<uint32_t>(static_cast<uint32_t>(value.size()));
+    write_(value.data(), value.size());
+}
+
+void SceneCacheWriter::align_() {
+    data_.resize((data_.size() + 15) & ~size_t(15), 0);
+}
+
+void SceneCacheWriter::writeGraphics(const GraphicsLoadingContext &context) {
+    LOG_DEBUG("Writing graphics to scene cache");
+
+    write_<uint32_t>(static_cast<uint32_t>(context.materials.size()));
+    write_<int32_t>(context.defaultMaterial);
+    for (size_t i = 0; i < context.materials.size(); i++) {
+        const Material &material = context.materials[i];
+        writeString_(material.name);
+        write_(material.albedoFactor);
+        write_(material.metallicRoughnessFactor);
+        write_(material.normalFactor);
+        for (const TextureSource &texture : context.materialTextures[i]) {
+            write_<uint32_t>(texture.width);
+            write_<uint32_t>(texture.height);
+            write_<uint32_t>(texture.format);
+            write_<uint32_t>(texture.internalFormat);
+            write_<uint32_t>(texture.levels);
+            writeArray_(texture.pixels, texture.pixels == nullptr ? 0 : texture.length);
+        }
+    }
+
+    write_<uint32_t>(static_cast<uint32_t>(context.meshes.size()));
+    for (const Mesh &mesh : context.meshes) {
+        writeString_(mesh.name);
+        writeArray_(mesh.sections);
+        writeArray_(mesh.instances);
+        write_(mesh.totalElementCount);
+        write_(mesh.totalVertexCount);
+        write_(mesh.boundsMin);
+        write_(mesh.boundsMax);
+    }
+
+    write_<uint32_t>(static_cast<uint32_t>(context.instances.size()));
+    for (const Instance &instance : context.instances) {
+        writeString_(instance.name);
+        write_(instance.attributes);
+        write_(instance.mesh);
+    }
+
+    write_<uint32_t>(static_cast<uint32_t>(context.batches.size()));
+    for (const MaterialBatch &batch : context.batches) {
+        write_(batch.material);
+        write_<uint64_t>(reinterpret_cast<uintptr_t>(batch.commandOffset));
+        write_(batch.commandCount);
+    }
+
+    writeArray_(context.positions);
+    writeArray_(context.normals);
+    writeArray_(context.tangents);
+    writeArray_(context.uvs);
+    writeArray_(context.elements);
+    writeArray_(context.attributes);
+    writeArray_(context.drawCommands);
+}
+
+void SceneCacheWriter::writePhysics(const PhysicsLoadingContext &context) {
+    LOG_DEBUG("Writing physics to scene cache");
+
+    write_<uint32_t>(static_cast<uint32_t>(context.instances.size()));
+    for (const PhysicsInstance &instance : context.instances) {
+        writeString_(instance.name);
+        write_<uint8_t>(instance.isTrigger);
+        writeString_(instance.trigger.action);
+        writeString_(instance.trigger.argument);
+    }
+
+    // Jolt serializes the bodies including their shapes. This also stores the already built mesh shapes.
+    // Shapes shared between bodies are only written once.
+    std::vector<uint8_t> bodies;
+    CacheStreamOut stream(bodies);
+    JPH::BodyCreationSettings::ShapeToIDMap shape_map;
+    JPH::BodyCreationSettings::MaterialToIDMap material_map;
+    JPH::BodyCreationSettings::GroupFilterToIDMap group_filter_map;
+    for (const PhysicsInstance &instance : context.instances) {
+        instance.settings.SaveWithChildren(stream, &shape_map, &material_map, &group_filter_map);
+    }
+    writeArray_(bodies);
+}
+
+void SceneCacheWriter::writeNodes(const std::string &name, const std::map<std::string, loader::Node> &nodes) {
+    LOG_DEBUG("Writing nodes to scene cache");
+
+    writeString_(name);
+    write_<uint32_t>(static_cast<uint32_t>(nodes.size()));
+    for (auto &&[key, node] : nodes) {
+        writeString_(node.name);
+        write_(node.graphics);
+        write_(node.physics);
+        write_<uint32_t>(static_cast<uint32_t>(node.children.size()));
+        for (const std::string &child : node.children) {
+            writeString_(child);
+        }
+        writeString_(node.parent);
+        write_(node.initialTransform);
+        write_(node.initialPosition);
+        write_(node.initialScale);
+        write_(node.initialOrientation);
+        writeString_(node.entityClass);
+
+        write_<uint32_t>(static_cast<uint32_t>(node.properties.size()));
+        for (auto &&[property, value] : node.properties) {
+            writeString_(property);
+            if (value.type() == typeid(bool)) {
+                write_(PropertyType::Bool);
+                write_<uint8_t>(std::any_cast<bool>(value));
+            } else if (value.type() == typeid(int)) {
+                write_(PropertyType::Int);
+                write_<int32_t>(std::any_cast<int>(value));
+            } else if (value.type() == typeid(float)) {
+                write_(PropertyType::Float);
+                write_(std::any_cast<float>(value));
+            } else if (value.type() == typeid(std::string)) {
+                write_(PropertyType::String);
+                writeString_(std::any_cast<std::string>(value));
+            } else {
+                write_(PropertyType::None);
+            }
+        }
+
+        write_<uint32_t>(static_cast<uint32_t>(node.tags.size()));
+        for (const std::string &tag : node.tags) {
+            writeString_(tag);
+        }
+        write_<uint8_t>(node.isKinematic);
+        write_<uint8_t>(node.isDynamic);
+    }
+}
+
+void SceneCacheWriter::save(const std::string &filename) {
+    SceneCacheHeader header = {
+        .check = SCENE_CACHE_MAGIC_NUMBER,
+        .version = SCENE_CACHE_VERSION_1_002_000,
+        .sourceHash = hash_,
+        .length = data_.size(),
+        .unused = {},
+    };
+    std::memcpy(data_.data(), &header, sizeof(header));
+
+    LOG_INFO("Writing scene cache: " + filename);
+    std::string temp_filename = filename + ".tmp";
+    std::ofstream file(temp_filename, std::ios::binary);
+    if (!file.is_open()) {
+        LOG_WARN("Error opening file: " + temp_filename);
+        return;
+    }
+    file.write(reinterpret_cast<const char *>(data_.data()), data_.size());
+    file.close();
+    if (file.fail()) {
+        LOG_WARN("Error writing scene cache: " + temp_filename);
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_filename, filename, error);
+    if (error) {
+        LOG_WARN("Error writing scene cache: " + error.message());
+    }
+}
+
+std::unique_ptr<SceneCache> openSceneCache(const std::string &filename, uint64_t hash) {
+    if (!std::filesystem::exists(filename)) {
+        LOG_INFO("No scene cache found at " + filename);
+        return nullptr;
+    }
+
+    auto file = std::make_unique<MappedFile>(filename);
+    SceneCacheHeader header = {};
+    if (file->size() >= sizeof(header)) {
+        std::memcpy(&header, file->data(), sizeof(header));
+    }
+
+    if (header.check != SCENE_CACHE_MAGIC_NUMBER) {
+        LOG_WARN("Expected scene cache header: " + filename);
+        return nullptr;
+    }
+    if (header.version != SCENE_CACHE_VERSION_1_002_000) {
+        LOG_INFO("Scene cache version outdated: " + filename);
+        return nullptr;
+    }
+    if (header.length != file->size()) {
+        LOG_WARN("Scene cache is truncated: " + filename);
+        return nullptr;
+    }
+    if (header.sourceHash != hash) {
+        LOG_INFO("Scene cache is outdated: " + filename);
+        return nullptr;
+    }
+
+    return std::make_unique<SceneCache>(std::move(file));
+}
+
+TextureSource readTextureSource(SceneCacheReader &reader) {
+    TextureSource result;
+    result.width = reader.read<uint32_t>();
+    result.height = reader.read<uint32_t>();
+    result.format = reader.read<uint32_t>();
+    result.internalFormat = reader.read<uint32_t>();
+    result.levels = reader.read<uint32_t>();
+    std::span<const uint8_t> pixels = reader.readArray<uint8_t>();
+    result.pixels = pixels.empty() ? nullptr : pixels.data();
+    result.length = pixels.size();
+    return result;
+}
+
+GraphicsData readGraphics(SceneCacheReader &reader) {
+    LOG_DEBUG("Loading scene cache graphics");
+
+    uint32_t material_count = reader.read<uint32_t>();
+    int32_t default_material = reader.read<int32_t>();
+    std::vector<Material> materials;
+    materials.reserve(material_count);
+    for (uint32_t i = 0; i < material_count; i++) {
+        Material &material = materials.emplace_back();
+        material.name = reader.readString();
+        material.albedoFactor = reader.read<glm::vec3>();
+        material.metallicRoughnessFactor = reader.read<glm::vec2>();
+        material.normalFactor = reader.read<float>();
+        TextureSource albedo = readTextureSource(reader);
+        TextureSource orm = readTextureSource(reader);
+        TextureSource normal = readTextureSource(reader);
+
+        if (static_cast<int32_t>(i) == default_material) {
+            initDefaultMaterial(material);
+            continue;
+        }
+
+        material.albedo = createTexture(albedo);
+        if (material.albedo != nullptr) material.albedo->setDebugLabel("gltf/texture/albedo");
+        material.occlusionMetallicRoughness = createTexture(orm);
+        if (material.occlusionMetallicRoughness != nullptr) material.occlusionMetallicRoughness->setDebugLabel("gltf/texture/orm");
+        material.normal = createTexture(normal);
+        if (material.normal != nullptr) material.normal->setDebugLabel("gltf/texture/normal");
+    }
+
+    uint32_t mesh_count = reader.read<uint32_t>();
+    std::vector<Mesh> meshes;
+    meshes.reserve(mesh_count);
+    for (uint32_t i = 0; i < mesh_count; i++) {
+        Mesh &mesh = meshes.emplace_back();
+        mesh.name = reader.readString();
+        std::span<const Section> sections = reader.readArray<Section>();
+        mesh.sections.assign(sections.begin(), sections.end());
+        std::span<const int32_t> instances = reader.readArray<int32_t>();
+        mesh.instances.assign(instances.begin(), instances.end());
+        mesh.totalElementCount = reader.read<uint32_t>();
+        mesh.totalVertexCount = reader.read<uint32_t>();
+        mesh.boundsMin = reader.read<glm::vec3>();
+        mesh.boundsMax = reader.read<glm::vec3>();
+    }
+
+    uint32_t instance_count = reader.read<uint32_t>();
+    std::vector<Instance> instances;
+    instances.reserve(instance_count);
+    for (uint32_t i = 0; i < instance_count; i++) {
+        Instance &instance = instances.emplace_back();
+        instance.name = reader.readString();
+        instance.attributes = reader.read<int32_t>();
+        instance.mesh = reader.read<int32_t>();
+    }
+
+    uint32_t batch_count = reader.read<uint32_t>();
+    std::vector<MaterialBatch> batches;
+    batches.reserve(batch_count);
+    for (uint32_t i = 0; i < batch_count; i++) {
+        MaterialBatch &batch = batches.emplace_back();
+        batch.material = reader.read<int32_t>();
+        // the offset is stored as a byte offset, opengl requires it as a pointer
+        batch.commandOffset = reinterpret_cast<gl::DrawElementsIndirectCommand *>(static_cast<uintptr_t>(reader.read<uint64_t>()));
+        batch.commandCount = reader.read<uint32_t>();
+    }
+
+    // these are uploaded directly from the mapped memory
+    GraphicsStreams streams = {};
+    streams.positions = reader.readArray<glm::vec3>();
+    streams.normals = reader.readArray<glm::vec3>();
+    streams.tangents = reader.readArray<glm::vec4>();
+    streams.uvs = reader.readArray<glm::vec2>();
+    streams.elements = reader.readArray<uint16_t>();
+    streams.attributes = reader.readArray<InstanceAttributes>();
+    streams.commands = reader.readArray<gl::DrawElementsIndirectCommand>();
+
+    return createGraphicsData(
+        streams,
+        std::move(instances),
+        std::move(materials),
+        default_material,
+        std::move(meshes),
+        std::move(batches));
+}
+
+PhysicsData readPhysics(SceneCacheReader &reader) {
+    LOG_DEBUG("Loading scene cache physics");
+
+    uint32_t instance_count = reader.read<uint32_t>();
+    std::vector<PhysicsInstance> instances;
+    instances.reserve(instance_count);
+    for (uint32_t i = 0; i < instance_count; i++) {
+        PhysicsInstance &instance = instances.emplace_back();
+        instance.name = reader.readString();
+        instance.isTrigger = reader.read<uint8_t>() != 0;
+        instance.trigger.action = reader.readString();
+        instance.trigger.argument = reader.readString();
+    }
+
+    CacheStreamIn stream(reader.readArray<uint8_t>());
+    JPH::BodyCreationSettings::IDToShapeMap shape_map;
+    JPH::BodyCreationSettings::IDToMaterialMap material_map;
+    JPH::BodyCreationSettings::IDToGroupFilterMap group_filter_map;
+    for (uint32_t i = 0; i < instance_count; i++) {
+        auto result = JPH::BodyCreationSettings::RestoreWithChildren(stream, shape_map, material_map, group_filter_map);
+        if (result.HasError())
+            PANIC("Failed to restore physics body: " + static_cast<std::string>(result.GetError()));
+        instances[i].settings = result.Get();
+        instances[i].settings.mUserData = i;
+    }
+
+    return PhysicsData(instances);
+}
+
+std::map<std::string, loader::Node> readNodes(SceneCacheReader &reader) {
+    LOG_DEBUG("Loading scene cache nodes");
+
+    std::map<std::string, loader::Node> nodes;
+    uint32_t node_count = reader.read<uint32_t>();
+    for (uint32_t i = 0; i < node_count; i++) {
+        Node node;
+        node.name = reader.readString();
+        node.graphics = reader.read<int32_t>();
+        node.physics = reader.read<int32_t>();
+        uint32_t child_count = reader.read<uint32_t>();
+        node.children.reserve(child_count);
+        for (uint32_t j = 0; j < child_count; j++) {
+            node.children.push_back(reader.readString());
+        }
+        node.parent = reader.readString();
+        node.initialTransform = reader.read<glm::mat4>();
+        node.initialPosition = reader.read<glm::vec3>();
+        node.initialScale = reader.read<glm::vec3>();
+        node.initialOrientation = reader.read<glm::quat>();
+        node.entityClass = reader.readString();
+
+        uint32_t property_count = reader.read<uint32_t>();
+        for (uint32_t j = 0; j < property_count; j++) {
+            std::string property = reader.readString();
+            switch (reader.read<PropertyType>()) {
+                case PropertyType::Bool:
+                    node.properties[property] = reader.read<uint8_t>() != 0;
+                    break;
+                case PropertyType::Int:
+                    node.properties[property] = static_cast<int>(reader.read<int32_t>());
+                    break;
+                case PropertyType::Float:
+                    node.properties[property] = reader.read<float>();
+                    break;
+                case PropertyType::String:
+                    node.properties[property] = reader.readString();
+                    break;
+                default:
+                    node.properties[property] = std::any();
+                    break;
+            }
+        }
+
+        uint32_t tag_count = reader.read<uint32_t>();
+        node.tags.reserve(tag_count);
+        for (uint32_t j = 0; j < tag_count; j++) {
+            node.tags.push_back(reader.readString());
+        }
+        node.isKinematic = reader.read<uint8_t>() != 0;
+        node.isDynamic = reader.read<uint8_t>() != 0;
+
+        std::string name = node.name;
+        nodes[name] = std::move(node);
+    }
+    return nodes;
+}
+
+SceneData *scene(const SceneCache &cache) {
+    SceneCacheReader reader(cache.data(), sizeof(SceneCacheHeader));
+    GraphicsData graphics = readGraphics(reader);
+    PhysicsData physics = readPhysics(reader);
+    std::string name = reader.readString();
+    std::map<std::string, loader::Node> nodes = readNodes(reader);
+    return new SceneData(name, std::move(graphics), std::move(physics), std::move(nodes));
+}
+
+std::unique_ptr<SceneSource> sceneSource(const std::string &filename, const std::string &cache_filename) {
+    auto result = std::make_unique<SceneSource>();
+    result->filename = filename;
+    result->cacheFilename = cache_filename;
+
+    {
+        auto data = loader::file(filename);
+        result->hash = XXH64(data->data(), data->size(), 0);
+    }
+
+    result->cache = openSceneCache(cache_filename, result->hash);
+    if (result->cache == nullptr) {
+        result->model = std::make_unique<const gltf::Model>(loader::gltf(filename));
+    }
+    return result;
+}
+
+SceneData *scene(const SceneSource &source) {
+    if (source.cache != nullptr) {
+        LOG_INFO("Loading scene cache: " + source.cacheFilename);
+        return scene(*source.cache);
+    }
+
+    SceneCacheWriter writer(source.hash);
+    SceneData *result = scene(*source.model, &writer);
+    writer.save(source.cacheFilename);
+    return result;
+}
+
+}  // namespace loader
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <span>
+
+#include "../Gltf.h"
+
+// A baked scene cache (`.ascent_scene`) contains everything that is loaded from a gltf file,
+// already laid out the way it will be uploaded. It is memory mapped, so loading it is mostly page faults.
+// The cache is validated by a content hash of the gltf file and is rebaked whenever the gltf file changes.
+
+namespace loader {
+
+class GraphicsLoadingContext;
+class PhysicsLoadingContext;
+
+/**
+ * A memory mapped scene cache file.
+ * Only contains a cache that has a valid header and matches the hash of its gltf file.
+ */
+class SceneCache {
+   private:
+    std::unique_ptr<MappedFile> file_;
+
+   public:
+    SceneCache(std::unique_ptr<MappedFile> file) : file_(std::move(file)) {}
+
+    // @returns the entire file, including the header
+    std::span<const uint8_t> data() const {
+        return {file_->data(), file_->size()};
+    }
+};
+
+/**
+ * Collects the loaded scene data and writes it to a scene cache file.
+ * The graphics and physics have to be written before the nodes, since they set the node's graphics and physics indices.
+ */
+class SceneCacheWriter {
+   private:
+    std::vector<uint8_t> data_;
+    uint64_t hash_ = 0;
+
+    void write_(const void *data, size_t length);
+
+    template <typename T>
+    void write_(const T &value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write_(&value, sizeof(T));
+    }
+
+    void writeString_(const std::string &value);
+
+    template <typename T>
+    void writeArray_(const T *values, size_t count) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write_<uint64_t>(count);
+        align_();
+        write_(values, count * sizeof(T));
+    }
+
+    template <typename T>
+    void writeArray_(const std::vector<T> &values) {
+        writeArray_(values.data(), values.size());
+    }
+
+    // pad to 16 bytes, so that the arrays can be used directly from the mapped memory
+    void align_();
+
+   public:
+    // @param hash the content hash of the gltf file
+    SceneCacheWriter(uint64_t hash);
+
+    void writeGraphics(const GraphicsLoadingContext &context);
+
+    void writePhysics(const PhysicsLoadingContext &context);
+
+    void writeNodes(const std::string &name, const std::map<std::string, loader::Node> &nodes);
+
+    /**
+     * Write the cache to a file.
+     * The file is first written to a temporary file and then renamed, so a crash never leaves a partial cache.
+     * Failing to write the cache is not an error.
+     */
+    void save(const std::string &filename);
+};
+
+/**
+ * Open and validate a scene cache file.
+ * @param filename the path of the cache file
+ * @param hash the content hash of the gltf file
+ * @returns the cache, or nullptr if it is missing, corrupt or outdated
+ */
+std::unique_ptr<SceneCache> openSceneCache(const std::string &filename, uint64_t hash);
+
+/**
+ * Create a scene from a scene cache.
+ */
+SceneData *scene(const SceneCache &cache);
+
+}  // namespace loader
@@ -3,14 +3,126 @@
 #define TINYGLTF_IMPLEMENTATION
 #include <tiny_gltf.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
 #include "../../GL/Geometry.h"
+#include "../../GL/StateManager.h"
+#include "../../GL/Sync.h"
 #include "../../GL/Texture.h"
+#include "../../Util/Jobs.h"
 #include "../../Util/Log.h"
+#include "Cache.h"
+#include "Graphics/Graphics.h"
 
 namespace gltf = tinygltf;
 
 namespace loader {
 
+static bool recordImageData(gltf::Image *image, const int image_idx, std::string *err, std::string *warn, int req_width, int req_height, const unsigned char *bytes, int size, void *user_data);
+
+static void decodeImages(gltf::Model &model);
+
+static void decodeImage(gltf::Image &image, bool srgb);
+
+static void generateMipChain(std::vector<uint8_t> &pixels, uint32_t width, uint32_t height, uint32_t channels, bool srgb);
+
+// Keeps the encoded image, it is decoded later together with all other images, see `decodeImages`
+static bool recordImageData(gltf::Image *image, const int image_idx, std::string *err, std::string *warn, int req_width, int req_height, const unsigned char *bytes, int size, void *user_data) {
+    image->image.assign(bytes, bytes + size);
+    // marks the image as encoded
+    image->width = -1;
+    image->height = -1;
+    return true;
+}
+
+static void decodeImages(gltf::Model &model) {
+    // albedo textures are stored in srgb, their mipmaps have to be averaged in linear space
+    std::vector<bool> srgb(model.images.size(), false);
+    for (const gltf::Material &material : model.materials) {
+        int texture = material.pbrMetallicRoughness.baseColorTexture.index;
+        if (texture < 0 || model.textures[texture].source < 0) continue;
+        srgb[model.textures[texture].source] = true;
+    }
+
+    jobs::pool->parallelFor(
+        model.images.size(), 1,
+        [&model, &srgb](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                decodeImage(model.images[i], srgb[i]);
+            }
+        },
+        jobs::Priority::Low);
+}
+
+static void decodeImage(gltf::Image &image, bool srgb) {
+    if (image.width >= 0 || image.image.empty()) return;
+
+    int w, h, n;
+    // always decode to 8-bit rgba, like the default tinygltf loader
+    uint8_t *pixels = stbi_load_from_memory(image.image.data(), static_cast<int>(image.image.size()), &w, &h, &n, 4);
+    if (pixels == nullptr) {
+        PANIC("Error loading gltf image: " + image.name + ", reason: " + stbi_failure_reason());
+    }
+
+    image.width = w;
+    image.height = h;
+    image.component = 4;
+    image.bits = 8;
+    image.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+    image.image.assign(pixels, pixels + static_cast<size_t>(w) * h * 4);
+    stbi_image_free(pixels);
+
+    generateMipChain(image.image, w, h, 4, srgb);
+}
+
+// Appends all mip levels to the level 0 `pixels` using a 2x2 box filter
+static void generateMipChain(std::vector<uint8_t> &pixels, uint32_t width, uint32_t height, uint32_t channels, bool srgb) {
+    float to_linear[256];
+    for (int i = 0; i < 256; i++) {
+        float c = i / 255.0f;
+        to_linear[i] = srgb ? (c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f)) : c;
+    }
+    auto to_byte = [srgb](float c) {
+        if (srgb) c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+        return static_cast<uint8_t>(std::clamp(c * 255.0f + 0.5f, 0.0f, 255.0f));
+    };
+
+    pixels.reserve(mipChainLength(width, height, channels));
+    size_t source = 0;
+    for (uint32_t level = 1; level < mipLevelCount(width, height); level++) {
+        uint32_t src_w = std::max(width >> (level - 1), 1u), src_h = std::max(height >> (level - 1), 1u);
+        uint32_t dst_w = std::max(width >> level, 1u), dst_h = std::max(height >> level, 1u);
+        size_t target = pixels.size();
+        pixels.resize(target + static_cast<size_t>(dst_w) * dst_h * channels);
+
+        for (uint32_t y = 0; y < dst_h; y++) {
+            uint32_t y0 = std::min(y * 2, src_h - 1), y1 = std::min(y * 2 + 1, src_h - 1);
+            for (uint32_t x = 0; x < dst_w; x++) {
+                uint32_t x0 = std::min(x * 2, src_w - 1), x1 = std::min(x * 2 + 1, src_w - 1);
+                const uint8_t *samples[4] = {
+                    &pixels[source + (y0 * src_w + x0) * channels],
+                    &pixels[source + (y0 * src_w + x1) * channels],
+                    &pixels[source + (y1 * src_w + x0) * channels],
+                    &pixels[source + (y1 * src_w + x1) * channels],
+                };
+                uint8_t *out = &pixels[target + (y * dst_w + x) * channels];
+                for (uint32_t c = 0; c < channels; c++) {
+                    // alpha is always linear
+                    bool linear = c == 3 || !srgb;
+                    float sum = 0;
+                    for (const uint8_t *sample : samples) {
+                        sum += linear ? sample[c] / 255.0f : to_linear[sample[c]];
+                    }
+                    out[c] = linear ? static_cast<uint8_t>(std::clamp(sum / 4.0f * 255.0f + 0.5f, 0.0f, 255.0f)) : to_byte(sum / 4.0f);
+                }
+            }
+        }
+        source = target;
+    }
+}
+
 Material::~Material() {
     delete albedo;
     delete occlusionMetallicRoughness;
@@ -19,6 +131,8 @@ Material::~Material() {
 
 const gltf::Model gltf(const std::string filename) {
     gltf::TinyGLTF loader;
+    // the images are decoded in parallel once the whole file is parsed
+    loader.SetImageLoader(recordImageData, nullptr);
     gltf::Model model;
     std::string err;
     std::string warn;
@@ -28,7 +142,8 @@ const gltf::Model gltf(const std::string filename) {
     std::string ext = filename.substr(filename.find_last_of("."));
     bool ok = false;
     if (ext == ".glb") {
-        ok = loader.LoadBinaryFromFile(&model, &err, &warn, filename);
+        auto data = loader::file(filename);
+        ok = loader.LoadBinaryFromMemory(&model, &err, &warn, data->data(), static_cast<unsigned int>(data->size()), gltf::GetBaseDir(filename));
     } else if (ext == ".gltf") {
         ok = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
     } else {
@@ -46,6 +161,8 @@ const gltf::Model gltf(const std::string filename) {
     if (!ok) {
         PANIC("Failed to load glTF: " + filename);
     }
+
+    decodeImages(model);
     return model;
 }
 
@@ -55,17 +172,35 @@ GraphicsData::GraphicsData(
     int32_t default_material,
     std::vector<Mesh> &&meshes,
     std::vector<MaterialBatch> &&batches,
+    std::vector<gl::DrawElementsIndirectCommand> &&commands,
+    std::vector<InstanceAttributes> &&attributes,
     gl::VertexArray *vao,
     gl::Buffer *instance_attributes,
+    gl::Buffer *instance_indices,
     gl::Buffer *draw_commands)
     : instances(std::move(instances)),
       materials(std::move(materials)),
       defaultMaterial(this->materials[default_material]),
       meshes(std::move(meshes)),
       batches(std::move(batches)),
+      commands(std::move(commands)),
       vao_(vao),
-      drawCommands_(draw_commands) {
-    instanceAttributesData_ = instance_attributes->mapRange<InstanceAttributes>(GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+      drawCommands_(draw_commands),
+      instanceAttributes_(instance_attributes),
+      instanceIndices_(instance_indices),
+      attributes_(std::move(attributes)) {
+    instanceAttributesData_ = instance_attributes->mapRange<InstanceAttributes>(GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+    movedFlags_.resize(attributes_.size(), 0);
+    dirtyFrames_.resize(attributes_.size(), 0);
+
+    // every slice starts with the loaded attributes
+    size_t slice_size = attributesSliceSize(attributes_.size());
+    for (int i = 0; i < FRAME_COUNT; i++) {
+        sliceSyncs_[i] = std::make_unique<gl::Sync>();
+        std::memcpy(reinterpret_cast<uint8_t *>(instanceAttributesData_) + i * slice_size, attributes_.data(), attributes_.size() * sizeof(InstanceAttributes));
+    }
+    instance_attributes->flushRange(0, instance_attributes->size());
+    glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
 }
 
 GraphicsData::~GraphicsData() = default;
@@ -75,23 +210,96 @@ uint32_t GraphicsData::commandCount() const {
 }
 
 void GraphicsData::bind() const {
+    bind(*drawCommands_, *instanceIndices_);
+}
+
+void GraphicsData::bind(const gl::Buffer &commands, const gl::Buffer &instance_indices) const {
+    vao_->reBindBuffer(INSTANCE_INDEX_BUFFER, instance_indices);
     vao_->bind();
-    drawCommands_->bind(GL_DRAW_INDIRECT_BUFFER);
+    commands.bind(GL_DRAW_INDIRECT_BUFFER);
+    bindAttributes();
+}
+
+size_t GraphicsData::attributesSliceSize(size_t attribute_count) {
+    // The slices are bound as shader storage buffer ranges, their offset has to be aligned
+    size_t alignment = std::max(gl::manager->environment().features.shaderStorageBufferOffsetAlignment, 1);
+    size_t size = std::max<size_t>(attribute_count, 1) * sizeof(InstanceAttributes);
+    return (size + alignment - 1) / alignment * alignment;
 }
 
-InstanceAttributes *GraphicsData::attributes(int32_t index) const {
-    return &instanceAttributesData_[index];
+void GraphicsData::bindAttributes() const {
+    size_t slice_size = attributesSliceSize(attributes_.size());
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, INSTANCE_ATTRIBUTES_BINDING, instanceAttributes_->id(), slice_ * slice_size, slice_size);
+}
+
+void GraphicsData::upload() {
+    // the previous slice is in use until the gpu is done with the commands issued so far
+    sliceSyncs_[slice_]->fence();
+    slice_ = (slice_ + 1) % FRAME_COUNT;
+    if (!sliceSyncs_[slice_]->clientWait()) {
+        LOG_WARN("Timed out waiting for the instance attributes of frame " << frame_);
+    }
+
+    uploadIndices_.clear();
+    for (const std::vector<int32_t> &dirty : dirty_) {
+        uploadIndices_.insert(uploadIndices_.end(), dirty.begin(), dirty.end());
+    }
+    std::sort(uploadIndices_.begin(), uploadIndices_.end());
+
+    // Copy continuous runs of changed attributes at once, the duplicates of the dirty lists are skipped
+    size_t slice_offset = slice_ * attributesSliceSize(attributes_.size());
+    InstanceAttributes *slice = reinterpret_cast<InstanceAttributes *>(reinterpret_cast<uint8_t *>(instanceAttributesData_) + slice_offset);
+    size_t i = 0;
+    while (i < uploadIndices_.size()) {
+        int32_t first = uploadIndices_[i];
+        int32_t last = first;
+        while (i < uploadIndices_.size() && uploadIndices_[i] <= last + 1) {
+            last = uploadIndices_[i];
+            i++;
+        }
+        size_t count = last - first + 1;
+        std::memcpy(slice + first, attributes_.data() + first, count * sizeof(InstanceAttributes));
+        instanceAttributes_->flushRange(slice_offset + first * sizeof(InstanceAttributes), count * sizeof(InstanceAttributes));
+    }
+    if (!uploadIndices_.empty()) glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+
+    // The oldest list was uploaded to every slice now, it is reused for the next frame
+    dirtyList_ = (dirtyList_ + 1) % FRAME_COUNT;
+    dirty_[dirtyList_].clear();
+    frame_++;
+}
+
+void GraphicsData::setTransform(int32_t index, const glm::mat4 &transform) {
+    attributes_[index].transform = transform;
+    if (dirtyFrames_[index] != frame_) {
+        dirtyFrames_[index] = frame_;
+        dirty_[dirtyList_].push_back(index);
+    }
+
+    if (movedFlags_[index]) return;
+    movedFlags_[index] = 1;
+    moved_.push_back(index);
+}
+
+void GraphicsData::clearMoved() {
+    for (int32_t index : moved_) {
+        movedFlags_[index] = 0;
+    }
+    moved_.clear();
 }
 
 PhysicsData::PhysicsData(std::vector<PhysicsInstance> &instances) : instances(std::move(instances)) {}
 
 PhysicsData::~PhysicsData() = default;
 
-SceneData *scene(const gltf::Model &model) {
+SceneData *scene(const gltf::Model &model, SceneCacheWriter *cache) {
     std::map<std::string, loader::Node> nodes = loadNodeTree(model);
-    GraphicsData g = loadGraphics(model, nodes);
-    PhysicsData ph = loadPhysics(model, nodes);
+    GraphicsData g = loadGraphics(model, nodes, cache);
+    PhysicsData ph = loadPhysics(model, nodes, cache);
     std::string name = model.scenes[model.defaultScene].name;
+    if (cache != nullptr) {
+        cache->writeNodes(name, nodes);
+    }
     return new SceneData(name, std::move(g), std::move(ph), std::move(nodes));
 }
 
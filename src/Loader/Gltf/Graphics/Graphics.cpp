@@ -1,72 +1,109 @@
 
 #include "Graphics.h"
 
+#include <numeric>
+
 #include "../../../GL/Geometry.h"
+#include "../../../GL/Upload.h"
 #include "../../../Util/Log.h"
+#include "../Cache.h"
 
 namespace gltf = tinygltf;
 
 namespace loader {
 
-void createVertexBuffers(GraphicsLoadingContext &context) {
+template <typename T>
+static void allocateStream(gl::Buffer &buffer, std::span<const T> stream, const std::shared_ptr<const void> &owner);
+
+template <typename T>
+static void allocateStream(gl::Buffer &buffer, std::span<const T> stream, const std::shared_ptr<const void> &owner) {
+    // dynamic storage, so the upload queue can write directly when its staging ring is full
+    buffer.allocateEmpty(stream.size_bytes(), GL_DYNAMIC_STORAGE_BIT);
+    gl::uploads->upload(buffer, 0, stream.data(), stream.size_bytes(), owner);
+}
+
+gl::VertexArray *createVertexArray(const GraphicsStreams &streams) {
     LOG_DEBUG("Creating vertex buffers");
     // For performance all mesh sections are concatenated into a single, large, immutable buffer
-
-    uint32_t vertex_count = context.totalVertexCount;
-    uint32_t element_count = context.totalElementCount;
+    // The data is streamed by the upload queue
+    gl::VertexArray *vao = new gl::VertexArray();
+    vao->setDebugLabel("gltf/vao");
 
     // positions
     auto position_buffer = new gl::Buffer();
-    context.position = position_buffer;
     position_buffer->setDebugLabel("gltf/vbo/position");
-    position_buffer->allocateEmpty(vertex_count * sizeof(glm::vec3), GL_DYNAMIC_STORAGE_BIT);
+    allocateStream(*position_buffer, streams.positions, streams.owner);
 
-    context.vao->layout(0, 0, 3, GL_FLOAT, GL_FALSE, 0);
-    context.vao->bindBuffer(0, *position_buffer, 0, sizeof(glm::vec3));
-    context.vao->own(position_buffer);
+    vao->layout(0, 0, 3, GL_FLOAT, GL_FALSE, 0);
+    vao->bindBuffer(0, *position_buffer, 0, sizeof(glm::vec3));
+    vao->own(position_buffer);
 
     // normals
     auto normal_buffer = new gl::Buffer();
-    context.normal = normal_buffer;
     normal_buffer->setDebugLabel("gltf/vbo/normal");
-    normal_buffer->allocateEmpty(vertex_count * sizeof(glm::vec3), GL_DYNAMIC_STORAGE_BIT);
+    allocateStream(*normal_buffer, streams.normals, streams.owner);
 
-    context.vao->layout(1, 1, 3, GL_FLOAT, GL_FALSE, 0);
-    context.vao->bindBuffer(1, *normal_buffer, 0, sizeof(glm::vec3));
-    context.vao->own(normal_buffer);
+    vao->layout(1, 1, 3, GL_FLOAT, GL_FALSE, 0);
+    vao->bindBuffer(1, *normal_buffer, 0, sizeof(glm::vec3));
+    vao->own(normal_buffer);
 
     // tangents
     auto tangent_buffer = new gl::Buffer();
-    context.tangent = tangent_buffer;
     tangent_buffer->setDebugLabel("gltf/vbo/tangent");
-    tangent_buffer->allocateEmpty(vertex_count * sizeof(glm::vec4), GL_DYNAMIC_STORAGE_BIT);
+    allocateStream(*tangent_buffer, streams.tangents, streams.owner);
 
-    context.vao->layout(2, 2, 4, GL_FLOAT, GL_FALSE, 0);
-    context.vao->bindBuffer(2, *tangent_buffer, 0, sizeof(glm::vec4));
-    context.vao->own(tangent_buffer);
+    vao->layout(2, 2, 4, GL_FLOAT, GL_FALSE, 0);
+    vao->bindBuffer(2, *tangent_buffer, 0, sizeof(glm::vec4));
+    vao->own(tangent_buffer);
 
     // uvs
     auto uv_buffer = new gl::Buffer();
-    context.uv = uv_buffer;
     uv_buffer->setDebugLabel("gltf/vbo/uv");
-    uv_buffer->allocateEmpty(vertex_count * sizeof(glm::vec2), GL_DYNAMIC_STORAGE_BIT);
+    allocateStream(*uv_buffer, streams.uvs, streams.owner);
 
-    context.vao->layout(3, 3, 2, GL_FLOAT, GL_FALSE, 0);
-    context.vao->bindBuffer(3, *uv_buffer, 0, sizeof(glm::vec2));
-    context.vao->own(uv_buffer);
+    vao->layout(3, 3, 2, GL_FLOAT, GL_FALSE, 0);
+    vao->bindBuffer(3, *uv_buffer, 0, sizeof(glm::vec2));
+    vao->own(uv_buffer);
 
     // element indices
     auto element_buffer = new gl::Buffer();
-    context.element = element_buffer;
     element_buffer->setDebugLabel("gltf/ebo");
-    element_buffer->allocateEmpty(element_count * sizeof(uint16_t), GL_DYNAMIC_STORAGE_BIT);
+    allocateStream(*element_buffer, streams.elements, streams.owner);
 
-    context.vao->bindElementBuffer(*element_buffer);
-    context.vao->own(element_buffer);
+    vao->bindElementBuffer(*element_buffer);
+    vao->own(element_buffer);
+
+    return vao;
 }
 
-void createInstanceAttributesBuffer(GraphicsLoadingContext &context) {
+gl::Buffer *createInstanceAttributesBuffer(const GraphicsStreams &streams) {
     LOG_DEBUG("Creating instance attributes");
+    gl::Buffer *buffer = new gl::Buffer();
+    buffer->setDebugLabel("gltf/ssbo/instance_attributes");
+    // One slice per buffered frame, `GraphicsData` fills them and synchronizes the writes
+    size_t size = GraphicsData::FRAME_COUNT * GraphicsData::attributesSliceSize(streams.attributes.size());
+    buffer->allocateEmpty(size, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT);
+    return buffer;
+}
+
+gl::Buffer *createInstanceIndexBuffer(gl::VertexArray *vao, const GraphicsStreams &streams) {
+    // The vertex shader reads the instance attributes at this index.
+    // The unculled draw commands use the attribute index as their base instance, so the indices are just `0..n`.
+    std::vector<uint32_t> indices(streams.attributes.size());
+    std::iota(indices.begin(), indices.end(), 0);
+
+    gl::Buffer *buffer = new gl::Buffer();
+    buffer->setDebugLabel("gltf/vbo/instance_index");
+    buffer->allocate(indices.data(), indices.size() * sizeof(uint32_t), 0);
+
+    vao->layoutI(GraphicsData::INSTANCE_INDEX_BUFFER, 4, 1, GL_UNSIGNED_INT, 0);
+    vao->attribDivisor(GraphicsData::INSTANCE_INDEX_BUFFER, 1);
+    vao->bindBuffer(GraphicsData::INSTANCE_INDEX_BUFFER, *buffer, 0, sizeof(uint32_t));
+    vao->own(buffer);
+    return buffer;
+}
+
+void sortInstanceAttributes(GraphicsLoadingContext &context) {
     // Sorting the attributes ensures (I think) that the draw command base instance and count work properly
     int32_t attrib_index = 0;
     std::vector<InstanceAttributes> sorted_attributes;
@@ -81,21 +118,13 @@ void createInstanceAttributesBuffer(GraphicsLoadingContext &context) {
         }
     }
     context.attributes = std::move(sorted_attributes);
+}
 
-    context.instanceAttributes = new gl::Buffer();
-    context.instanceAttributes->setDebugLabel("gltf/vbo/instance_attributes");
-    // FIXME: mapped buffer doesn't use synchronization. This *could* cause issues.
-    context.instanceAttributes->allocate(context.attributes.data(), context.attributes.size() * sizeof(InstanceAttributes), GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
-
-    // instance attribute layout
-    // 4 attributes for the 4 columns of the transformation matrix
-    context.vao->layout(4, 4, 4, GL_FLOAT, GL_FALSE, 0 * sizeof(glm::vec4));
-    context.vao->layout(4, 5, 4, GL_FLOAT, GL_FALSE, 1 * sizeof(glm::vec4));
-    context.vao->layout(4, 6, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4));
-    context.vao->layout(4, 7, 4, GL_FLOAT, GL_FALSE, 3 * sizeof(glm::vec4));
-    context.vao->attribDivisor(4, 1);
-    context.vao->bindBuffer(4, *context.instanceAttributes, 0, sizeof(InstanceAttributes));
-    context.vao->own(context.instanceAttributes);
+// Append `length` bytes of gltf data to `stream`
+template <typename T>
+void appendStream(std::vector<T> &stream, const void *data, size_t length) {
+    const T *begin = static_cast<const T *>(data);
+    stream.insert(stream.end(), begin, begin + length / sizeof(T));
 }
 
 void createBatches(GraphicsLoadingContext &context) {
@@ -106,17 +135,23 @@ void createBatches(GraphicsLoadingContext &context) {
         return a.material < b.material;
     });
 
+    context.positions.reserve(context.totalVertexCount);
+    context.normals.reserve(context.totalVertexCount);
+    context.tangents.reserve(context.totalVertexCount);
+    context.uvs.reserve(context.totalVertexCount);
+    context.elements.reserve(context.totalElementCount);
+
     int32_t base_vertex = 0;
     uint32_t base_index = 0;
     int32_t batch_material_index = std::numeric_limits<int32_t>::max();  // just some value to mark the start
-    std::vector<gl::DrawElementsIndirectCommand> draw_commands;
+    std::vector<gl::DrawElementsIndirectCommand> &draw_commands = context.drawCommands;
     MaterialBatch batch = {};
     for (auto &&chunk : context.chunks) {
-        context.position->write(base_vertex * sizeof(glm::vec3), chunk.positionPtr, chunk.positionLength);
-        context.normal->write(base_vertex * sizeof(glm::vec3), chunk.normalPtr, chunk.normalLength);
-        context.tangent->write(base_vertex * sizeof(glm::vec4), chunk.tangentPtr, chunk.tangentLength);
-        context.uv->write(base_vertex * sizeof(glm::vec2), chunk.texcoordPtr, chunk.texcoordLength);
-        context.element->write(base_index * chunk.indexSize, chunk.indexPtr, chunk.indexLength);
+        appendStream(context.positions, chunk.positionPtr, chunk.positionLength);
+        appendStream(context.normals, chunk.normalPtr, chunk.normalLength);
+        appendStream(context.tangents, chunk.tangentPtr, chunk.tangentLength);
+        appendStream(context.uvs, chunk.texcoordPtr, chunk.texcoordLength);
+        appendStream(context.elements, chunk.indexPtr, chunk.indexLength);
 
         Mesh &mesh = context.meshes[chunk.mesh];
         Section &section = mesh.sections[chunk.section];
@@ -163,15 +198,12 @@ void createBatches(GraphicsLoadingContext &context) {
     // push final one
     if (batch.commandCount != 0)
         context.batches.emplace_back(batch);
-
-    context.drawCommands = new gl::Buffer();
-    context.drawCommands->setDebugLabel("gltf/command_buffer");
-    context.drawCommands->allocate(draw_commands.data(), draw_commands.size() * sizeof(gl::DrawElementsIndirectCommand), 0);
 }
 
 void loadMaterials(GraphicsLoadingContext &context) {
     LOG_DEBUG("Loading materials");
     context.materials.reserve(context.model.materials.size() + 1);
+    context.materialTextures.reserve(context.model.materials.size() + 1);
 
     for (const gltf::Material &gltf_material : context.model.materials) {
         loadMaterial(context, gltf_material);
@@ -220,8 +252,39 @@ void loadInstances(GraphicsLoadingContext &context, const gltf::Scene &scene) {
     });
 }
 
-GraphicsData loadGraphics(const gltf::Model &model, std::map<std::string, loader::Node> &nodes) {
-    GraphicsLoadingContext context(model, nodes);
+GraphicsData createGraphicsData(
+    const GraphicsStreams &streams,
+    std::vector<Instance> &&instances,
+    std::vector<Material> &&materials,
+    int32_t default_material,
+    std::vector<Mesh> &&meshes,
+    std::vector<MaterialBatch> &&batches) {
+    gl::VertexArray *vao = createVertexArray(streams);
+    gl::Buffer *instance_attributes = createInstanceAttributesBuffer(streams);
+    gl::Buffer *instance_indices = createInstanceIndexBuffer(vao, streams);
+
+    gl::Buffer *draw_commands = new gl::Buffer();
+    draw_commands->setDebugLabel("gltf/command_buffer");
+    allocateStream(*draw_commands, streams.commands, streams.owner);
+
+    return GraphicsData(
+        std::move(instances),
+        std::move(materials),
+        default_material,
+        std::move(meshes),
+        std::move(batches),
+        std::vector<gl::DrawElementsIndirectCommand>(streams.commands.begin(), streams.commands.end()),
+        std::vector<InstanceAttributes>(streams.attributes.begin(), streams.attributes.end()),
+        vao,
+        instance_attributes,
+        instance_indices,
+        draw_commands);
+}
+
+GraphicsData loadGraphics(const gltf::Model &model, std::map<std::string, loader::Node> &nodes, SceneCacheWriter *cache) {
+    // the streams are uploaded after this returns, so the context must outlive it
+    auto owner = std::make_shared<GraphicsLoadingContext>(model, nodes);
+    GraphicsLoadingContext &context = *owner;
 
     LOG_DEBUG("Loading GLTF graphics");
 
@@ -231,24 +294,24 @@ GraphicsData loadGraphics(const gltf::Model &model, std::map<std::string, loader
     const gltf::Scene &scene = context.model.scenes[context.model.defaultScene];
     loadInstances(context, scene);
 
-    context.vao = new gl::VertexArray();
-    context.vao->setDebugLabel("gltf/vao");
-    createVertexBuffers(context);
-    createInstanceAttributesBuffer(context);
-
+    sortInstanceAttributes(context);
     createBatches(context);
 
-    LOG_DEBUG("Finished loading GLTF graphics");
+    if (cache != nullptr) {
+        cache->writeGraphics(context);
+    }
 
-    GraphicsData result(
+    GraphicsStreams streams = context.streams();
+    streams.owner = owner;
+    GraphicsData result = createGraphicsData(
+        streams,
         std::move(context.instances),
         std::move(context.materials),
         context.defaultMaterial,
         std::move(context.meshes),
-        std::move(context.batches),
-        context.vao,
-        context.instanceAttributes,
-        context.drawCommands);
+        std::move(context.batches));
+
+    LOG_DEBUG("Finished loading GLTF graphics");
     return result;
 }
 
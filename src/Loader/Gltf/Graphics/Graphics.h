@@ -1,9 +1,53 @@
 #pragma once
 
+#include <array>
+#include <span>
+
 #include "../../Gltf.h"
 
 namespace loader {
 
+/**
+ * The pixel data of a material texture.
+ * The pixels either point into the gltf data or into a memory mapped scene cache.
+ */
+struct TextureSource {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // the format of the pixel data (GL_RED, GL_RG, GL_RGB or GL_RGBA)
+    GLenum format = 0;
+    // the format of the texture
+    GLenum internalFormat = 0;
+    // pointer to the 8-bit pixel data, nullptr if there is no texture
+    const uint8_t *pixels = nullptr;
+    // the length of the pixel data in bytes
+    size_t length = 0;
+    // the number of mip levels in the pixel data, stored one after the other. `1` if the mipmaps have to be generated.
+    uint32_t levels = 1;
+};
+
+// @returns the number of levels in a full mip chain
+uint32_t mipLevelCount(uint32_t width, uint32_t height);
+
+// @returns the length in bytes of a full mip chain with 8-bit channels
+size_t mipChainLength(uint32_t width, uint32_t height, uint32_t channels);
+
+/**
+ * Views of the vertex, index, instance and command data of all graphics meshes.
+ * All chunks are concatenated in batch order, so each can be uploaded with a single call.
+ */
+struct GraphicsStreams {
+    std::span<const glm::vec3> positions;
+    std::span<const glm::vec3> normals;
+    std::span<const glm::vec4> tangents;
+    std::span<const glm::vec2> uvs;
+    std::span<const uint16_t> elements;
+    std::span<const InstanceAttributes> attributes;
+    std::span<const gl::DrawElementsIndirectCommand> commands;
+    // keeps the views alive until they are uploaded, empty if they point into the scene source
+    std::shared_ptr<const void> owner;
+};
+
 /**
  * A chunk is a part of mesh with the same material.
  * It contains pointers and ranges into the gltf data,
@@ -59,6 +103,11 @@ class GraphicsLoadingContext {
 
     // all of the loaded materials
     std::vector<Material> materials;
+    /**
+     * The texture sources of each material in the order albedo, occlusionMetallicRoughness, normal.
+     * This is a 1:1 relation with `materials`. Kept for baking the scene cache.
+     */
+    std::vector<std::array<TextureSource, 3>> materialTextures;
     // index of the default material in the `materials` vector.
     int32_t defaultMaterial = -1;
 
@@ -89,23 +138,19 @@ class GraphicsLoadingContext {
 
     // all of the batches
     std::vector<MaterialBatch> batches;
-
-    // the vao that references all graphics mesh data for rendering
-    gl::VertexArray *vao = nullptr;
-    // the vertex position buffer owen by the vao
-    gl::Buffer *position = nullptr;
-    // the vertex normal buffer owen by the vao
-    gl::Buffer *normal = nullptr;
-    // the vertex tangent buffer owen by the vao
-    gl::Buffer *tangent = nullptr;
-    // the vertex uv texture coordinate buffer owen by the vao
-    gl::Buffer *uv = nullptr;
-    // the element index buffer owen by the vao
-    gl::Buffer *element = nullptr;
-    // the per instance attributes buffer owen by the vao
-    gl::Buffer *instanceAttributes = nullptr;
-    // the buffer containing the commands for indirect rendering
-    gl::Buffer *drawCommands = nullptr;
+    // the commands for indirect rendering, referenced by the batches
+    std::vector<gl::DrawElementsIndirectCommand> drawCommands;
+
+    // the vertex positions of all chunks, concatenated in batch order
+    std::vector<glm::vec3> positions;
+    // the vertex normals of all chunks, concatenated in batch order
+    std::vector<glm::vec3> normals;
+    // the vertex tangents of all chunks, concatenated in batch order
+    std::vector<glm::vec4> tangents;
+    // the vertex uv texture coordinates of all chunks, concatenated in batch order
+    std::vector<glm::vec2> uvs;
+    // the element indices of all chunks, concatenated in batch order
+    std::vector<uint16_t> elements;
 
     GraphicsLoadingContext(const gltf::Model &model, std::map<std::string, loader::Node> &nodes) : model(model), nodes(nodes) {
     }
@@ -150,6 +195,19 @@ class GraphicsLoadingContext {
     void addMeshIndex(int32_t index) {
         meshIndexMap.push_back(index);
     }
+
+    // returns views of all the data that is uploaded to the gpu
+    GraphicsStreams streams() const {
+        return {
+            .positions = positions,
+            .normals = normals,
+            .tangents = tangents,
+            .uvs = uvs,
+            .elements = elements,
+            .attributes = attributes,
+            .commands = drawCommands,
+        };
+    }
 };
 
 /**
@@ -162,9 +220,32 @@ Material &loadMaterial(GraphicsLoadingContext &context, const gltf::Material &ma
  */
 Material &loadDefaultMaterial(GraphicsLoadingContext &context);
 
+/**
+ * Initialize `material` as the default / fallback material.
+ */
+void initDefaultMaterial(Material &material);
+
+/**
+ * Create a texture from its source pixels. The pixels are uploaded by `gl::uploads`, they must stay valid until then.
+ * @return the texture or nullptr if the source has no pixels
+ */
+gl::Texture *createTexture(const TextureSource &source);
+
 /**
  * Load a gltf mesh used for rendering
  */
 Mesh &loadMesh(GraphicsLoadingContext &context, const gltf::Mesh &mesh);
 
+/**
+ * Upload the streams and create the graphics data from them.
+ * Used by both, the gltf and the scene cache, loading paths.
+ */
+GraphicsData createGraphicsData(
+    const GraphicsStreams &streams,
+    std::vector<Instance> &&instances,
+    std::vector<Material> &&materials,
+    int32_t default_material,
+    std::vector<Mesh> &&meshes,
+    std::vector<MaterialBatch> &&batches);
+
 }  // namespace loader
@@ -1,26 +1,60 @@
 #include "Graphics.h"
 
+#include <algorithm>
+
 // later
 #include "../../../GL/Texture.h"
+#include "../../../GL/Upload.h"
 #include "../../../Util/Log.h"
 
 namespace gltf = tinygltf;
 
 namespace loader {
 
-gl::Texture *loadTexture(GraphicsLoadingContext &context, const gltf::TextureInfo &texture_info, GLenum internalFormat) {
+static uint32_t formatChannels(GLenum format);
+
+static uint32_t formatChannels(GLenum format) {
+    switch (format) {
+        case GL_RED:
+            return 1;
+        case GL_RG:
+            return 2;
+        case GL_RGB:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+uint32_t mipLevelCount(uint32_t width, uint32_t height) {
+    uint32_t levels = 1;
+    while ((width | height) >> levels) {
+        levels++;
+    }
+    return levels;
+}
+
+size_t mipChainLength(uint32_t width, uint32_t height, uint32_t channels) {
+    size_t length = 0;
+    for (uint32_t level = 0; level < mipLevelCount(width, height); level++) {
+        length += static_cast<size_t>(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * channels;
+    }
+    return length;
+}
+
+TextureSource loadTextureSource(GraphicsLoadingContext &context, const gltf::TextureInfo &texture_info, GLenum internalFormat) {
     if (texture_info.index < 0) {
-        return nullptr;
+        return {};
     }
     if (texture_info.texCoord != 0) {
         LOG_WARN("only texCoord=0 is supported");
-        return nullptr;
+        return {};
     }
     const gltf::Texture &texture = context.model.textures[texture_info.index];
     const gltf::Image &image = context.model.images[texture.source];
     if (image.bits != 8) {
         LOG_WARN("only 8-bit images are supported");
-        return nullptr;
+        return {};
     }
 
     GLenum format;
@@ -36,10 +70,57 @@ gl::Texture *loadTexture(GraphicsLoadingContext &context, const gltf::TextureInf
         PANIC("Invalid image components")
     }
 
+    // the mip chain is generated when the image is decoded, see `loader::gltf`
+    uint32_t width = static_cast<uint32_t>(image.width);
+    uint32_t height = static_cast<uint32_t>(image.height);
+    bool has_mips = image.image.size() == mipChainLength(width, height, image.component);
+    return {
+        .width = width,
+        .height = height,
+        .format = format,
+        .internalFormat = internalFormat,
+        .pixels = image.image.data(),
+        .length = image.image.size(),
+        .levels = has_mips ? mipLevelCount(width, height) : 1,
+    };
+}
+
+gl::Texture *createTexture(const TextureSource &source) {
+    if (source.pixels == nullptr) {
+        return nullptr;
+    }
+
     gl::Texture *result = new gl::Texture(GL_TEXTURE_2D);
-    result->allocate(0, internalFormat, image.width, image.height, 1);
-    result->load(0, image.width, image.height, 1, format, GL_UNSIGNED_BYTE, image.image.data());
-    result->generateMipmap();
+    result->allocate(0, source.internalFormat, source.width, source.height, 1);
+    if (source.levels <= 1) {
+        gl::TextureUpload upload = {
+            .texture = result,
+            .size = {source.width, source.height, 1},
+            .format = source.format,
+            .type = GL_UNSIGNED_BYTE,
+            .mipmap = true,
+        };
+        gl::uploads->upload(upload, source.pixels, source.length);
+        return result;
+    }
+
+    // upload the precomputed mip chain level by level
+    uint32_t channels = formatChannels(source.format);
+    const uint8_t *pixels = source.pixels;
+    for (uint32_t level = 0; level < source.levels; level++) {
+        uint32_t width = std::max(source.width >> level, 1u);
+        uint32_t height = std::max(source.height >> level, 1u);
+        size_t length = static_cast<size_t>(width) * height * channels;
+        gl::TextureUpload upload = {
+            .texture = result,
+            .level = static_cast<int>(level),
+            .size = {width, height, 1},
+            .format = source.format,
+            .type = GL_UNSIGNED_BYTE,
+        };
+        gl::uploads->upload(upload, pixels, length);
+        pixels += length;
+    }
     return result;
 }
 
@@ -53,21 +134,25 @@ Material &loadMaterial(GraphicsLoadingContext &context, const gltf::Material &ma
     };
     result.normalFactor = static_cast<float>(material.normalTexture.scale);
 
-    result.albedo = loadTexture(context, material.pbrMetallicRoughness.baseColorTexture, GL_SRGB8_ALPHA8);
-    if (result.albedo != nullptr) result.albedo->setDebugLabel("gltf/texture/albedo");
-    result.occlusionMetallicRoughness = loadTexture(context, material.pbrMetallicRoughness.metallicRoughnessTexture, GL_RGB8);
-    if (result.occlusionMetallicRoughness != nullptr) result.occlusionMetallicRoughness->setDebugLabel("gltf/texture/orm");
     gltf::TextureInfo normal_info = {};
     normal_info.index = material.normalTexture.index;
     normal_info.texCoord = material.normalTexture.texCoord;
-    result.normal = loadTexture(context, normal_info, GL_RGB8);
+    std::array<TextureSource, 3> &sources = context.materialTextures.emplace_back();
+    sources[0] = loadTextureSource(context, material.pbrMetallicRoughness.baseColorTexture, GL_SRGB8_ALPHA8);
+    sources[1] = loadTextureSource(context, material.pbrMetallicRoughness.metallicRoughnessTexture, GL_RGB8);
+    sources[2] = loadTextureSource(context, normal_info, GL_RGB8);
+
+    result.albedo = createTexture(sources[0]);
+    if (result.albedo != nullptr) result.albedo->setDebugLabel("gltf/texture/albedo");
+    result.occlusionMetallicRoughness = createTexture(sources[1]);
+    if (result.occlusionMetallicRoughness != nullptr) result.occlusionMetallicRoughness->setDebugLabel("gltf/texture/orm");
+    result.normal = createTexture(sources[2]);
     if (result.normal != nullptr) result.normal->setDebugLabel("gltf/texture/normal");
 
     return result;
 }
 
-Material &loadDefaultMaterial(GraphicsLoadingContext &context) {
-    Material &result = context.newMaterial();
+void initDefaultMaterial(Material &result) {
     result.name = "Default";
     result.albedoFactor = glm::vec4(1.0f);
     result.metallicRoughnessFactor = glm::vec2(0.0f, 1.0f);
@@ -78,6 +163,13 @@ Material &loadDefaultMaterial(GraphicsLoadingContext &context) {
     result.occlusionMetallicRoughness->setDebugLabel("gltf/texture/default_orm");
     result.normal = loader::texture("assets/textures/default_normal.png");
     result.normal->setDebugLabel("gltf/texture/default_normal");
+}
+
+Material &loadDefaultMaterial(GraphicsLoadingContext &context) {
+    Material &result = context.newMaterial();
+    initDefaultMaterial(result);
+    // the default material has no gltf textures
+    context.materialTextures.emplace_back();
 
     context.defaultMaterial = context.materials.size() - 1;
 
@@ -19,6 +19,8 @@ Mesh &loadMesh(GraphicsLoadingContext &context, const gltf::Mesh &mesh) {
     LOG_DEBUG("Loading mesh '" + mesh.name + "'");
 
     uint32_t total_vertex_count = 0, total_element_count = 0, chunk_count = 0;
+    glm::vec3 bounds_min = glm::vec3(INFINITY);
+    glm::vec3 bounds_max = glm::vec3(-INFINITY);
     for (const gltf::Primitive &primitive : mesh.primitives) {
         if (primitive.mode != TINYGLTF_MODE_TRIANGLES) {
             LOG_WARN("Unsupported primitive mode " << std::to_string(primitive.mode));
@@ -154,6 +156,20 @@ Mesh &loadMesh(GraphicsLoadingContext &context, const gltf::Mesh &mesh) {
         chunk.vertexCount = vertex_count;
         chunk.material = primitive.material;
 
+        if (position_access.minValues.size() == 3 && position_access.maxValues.size() == 3) {
+            const auto &min = position_access.minValues;
+            const auto &max = position_access.maxValues;
+            bounds_min = glm::min(bounds_min, glm::vec3(min[0], min[1], min[2]));
+            bounds_max = glm::max(bounds_max, glm::vec3(max[0], max[1], max[2]));
+        } else {
+            // required by the spec, but not every exporter writes them
+            const glm::vec3 *positions = static_cast<const glm::vec3 *>(chunk.positionPtr);
+            for (uint32_t i = 0; i < vertex_count; i++) {
+                bounds_min = glm::min(bounds_min, positions[i]);
+                bounds_max = glm::max(bounds_max, positions[i]);
+            }
+        }
+
         chunk_count++;
         total_element_count += element_count;
         total_vertex_count += vertex_count;
@@ -161,6 +177,9 @@ Mesh &loadMesh(GraphicsLoadingContext &context, const gltf::Mesh &mesh) {
 
     if (total_vertex_count == 0 || total_element_count == 0) {
         LOG_WARN("Mesh has no valid vertices. TODO: handle error");
+    } else {
+        result.boundsMin = bounds_min;
+        result.boundsMax = bounds_max;
     }
 
     // The vector must not grow / shrink, so it is initialized to the correct size
@@ -3,6 +3,7 @@
 #include "../../../Physics/Physics.h"
 #include "../../../Physics/Shapes.h"
 #include "../../../Util/Log.h"
+#include "../Cache.h"
 
 namespace loader {
 
@@ -139,7 +140,7 @@ void loadInstances(PhysicsLoadingContext &context, const gltf::Scene &scene) {
     });
 }
 
-PhysicsData loadPhysics(const gltf::Model &model, std::map<std::string, loader::Node> &nodes) {
+PhysicsData loadPhysics(const gltf::Model &model, std::map<std::string, loader::Node> &nodes, SceneCacheWriter *cache) {
     PhysicsLoadingContext context(model, nodes);
     LOG_DEBUG("Loading GLTF physics");
 
@@ -148,6 +149,10 @@ PhysicsData loadPhysics(const gltf::Model &model, std::map<std::string, loader::
     const gltf::Scene &scene = context.model.scenes[context.model.defaultScene];
     loadInstances(context, scene);
 
+    if (cache != nullptr) {
+        cache->writePhysics(context);
+    }
+
     LOG_DEBUG("Finished loading GLTF physics");
 
     PhysicsData result = {
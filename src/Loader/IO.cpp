@@ -0,0 +1,88 @@
+#include "Loader.h"
+
+// After
+#include <atomic>
+
+#include "../Util/Log.h"
+
+namespace loader {
+
+// Implemented in Uring.cpp
+bool uringSupported();
+std::vector<std::shared_ptr<const FileData>> readUring(const std::vector<std::string> &filenames);
+
+static std::atomic<IoBackend> currentBackend = IoBackend::Mapped;
+
+FileData::FileData(std::unique_ptr<MappedFile> mapped) : mapped_(std::move(mapped)) {
+    data_ = {mapped_->data(), mapped_->size()};
+}
+
+FileData::FileData(std::vector<uint8_t> &&owned) : owned_(std::move(owned)) {
+    data_ = owned_;
+}
+
+FileData::~FileData() = default;
+
+void setIoBackend(IoBackend backend) {
+    if (backend == IoBackend::Uring && !uringSupported()) {
+        LOG_WARN("io_uring is not supported, using memory mapped io instead");
+        backend = IoBackend::Mapped;
+    }
+    currentBackend.store(backend);
+}
+
+IoBackend ioBackend() {
+    return currentBackend.load();
+}
+
+IoBackend parseIoBackend(std::string name) {
+    if (name == "stream") return IoBackend::Stream;
+    if (name == "mapped") return IoBackend::Mapped;
+    if (name == "uring") return IoBackend::Uring;
+    LOG_WARN("Unknown io backend '" + name + "', using 'mapped'");
+    return IoBackend::Mapped;
+}
+
+std::shared_ptr<const FileData> readStream(const std::string &filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        PANIC("Error opening file: " + filename);
+    }
+
+    file.seekg(0, std::ios::end);
+    std::streampos size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    std::vector<uint8_t> data(static_cast<size_t>(size));
+    file.read(reinterpret_cast<char *>(data.data()), data.size());
+    if (file.fail()) {
+        PANIC("Error reading file: " + filename);
+    }
+    return std::make_shared<const FileData>(std::move(data));
+}
+
+std::shared_ptr<const FileData> file(std::string filename) {
+    return files({filename})[0];
+}
+
+std::vector<std::shared_ptr<const FileData>> files(const std::vector<std::string> &filenames) {
+    IoBackend backend = ioBackend();
+    if (backend == IoBackend::Uring) {
+        // each thread has its own ring, a thread that couldn't create one uses mapped io
+        if (uringSupported()) return readUring(filenames);
+        backend = IoBackend::Mapped;
+    }
+
+    std::vector<std::shared_ptr<const FileData>> result;
+    result.reserve(filenames.size());
+    for (auto &&filename : filenames) {
+        if (backend == IoBackend::Stream) {
+            result.push_back(readStream(filename));
+        } else {
+            result.push_back(std::make_shared<const FileData>(std::make_unique<MappedFile>(filename)));
+        }
+    }
+    return result;
+}
+
+}  // namespace loader
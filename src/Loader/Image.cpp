@@ -9,16 +9,21 @@
 #include <stb_image.h>
 #include <stb_image_write.h>
 
+#include <cstring>
+
 #include "../GL/Texture.h"
+#include "../GL/Upload.h"
 #include "../Util/Log.h"
 
 namespace loader {
 
 loader::Image image(std::string filename) {
-    std::vector<uint8_t> data = binary(filename);
+    return image(*file(filename), filename);
+}
 
+loader::Image image(const FileData &file, std::string filename) {
     int w, h, n;
-    uint8_t *image = stbi_load_from_memory(data.data(), data.size(), &w, &h, &n, 4);
+    uint8_t *image = stbi_load_from_memory(file.data(), static_cast<int>(file.size()), &w, &h, &n, 4);
     if (image == nullptr) {
         PANIC("Error loading image: " + filename + ", reason: " + stbi_failure_reason());
     }
@@ -28,7 +33,7 @@ loader::Image image(std::string filename) {
         .height = h,
         .channels = 4,
         .length = static_cast<size_t>(w * h * 4),
-        .data = std::shared_ptr<uint8_t>(image),
+        .data = std::shared_ptr<uint8_t>(image, stbi_image_free),
     };
 }
 
@@ -44,12 +49,32 @@ gl::Texture *texture(loader::Image &img, TextureParameters params) {
             PANIC("Invalid texture params");
     }
     texture->allocate(params.mipmap ? 0 : 1, params.internalFormat, img.width, img.height, 1);
+    if (img.staging != nullptr) {
+        gl::TextureUpload upload = {
+            .texture = texture,
+            .size = {img.width, img.height, 1},
+            .format = params.fileFormat,
+            .type = params.dataType,
+            .mipmap = params.mipmap,
+        };
+        gl::uploads->upload(upload, std::move(img.staging));
+        return texture;
+    }
     texture->load(0, img.width, img.height, 1, params.fileFormat, params.dataType, img.data.get());
     if (params.mipmap)
         texture->generateMipmap();
     return texture;
 }
 
+void stage(loader::Image &img) {
+    if (gl::uploads == nullptr || img.data == nullptr) return;
+    img.staging = gl::uploads->stage(img.length);
+    if (img.staging == nullptr) return;
+
+    std::memcpy(img.staging->data().data(), img.data.get(), img.length);
+    img.data.reset();
+}
+
 gl::Texture *texture(std::string filename, TextureParameters params) {
     loader::Image img = image(filename);
     return texture(img, params);
@@ -3,7 +3,9 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "../GL/Declarations.h"
@@ -16,6 +18,8 @@ struct Image {
     int channels = 4;
     size_t length = 0;
     std::shared_ptr<uint8_t> data;
+    // set instead of `data` when the pixels have been staged for upload, see `stage`
+    std::shared_ptr<gl::Staging> staging;
 };
 
 typedef std::vector<std::vector<std::string>> CSV;
@@ -30,10 +34,112 @@ std::ifstream stream(std::string filename);
 
 std::vector<uint8_t> binary(std::string filename);
 
+/**
+ * A read-only memory mapping of an entire file.
+ * The file stays mapped until the object is destroyed.
+ */
+class MappedFile {
+   private:
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void *file_ = nullptr;
+    void *mapping_ = nullptr;
+#else
+    int file_ = -1;
+#endif
+
+   public:
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+
+    MappedFile(std::string filename);
+    ~MappedFile();
+
+    const uint8_t *data() const {
+        return data_;
+    }
+
+    // @returns the size of the file in bytes
+    size_t size() const {
+        return size_;
+    }
+};
+
+/**
+ * The contents of an entire file, read through the current io backend.
+ * Depending on the backend the bytes are either memory mapped or owned. Either way they are read-only.
+ */
+class FileData {
+   private:
+    std::unique_ptr<MappedFile> mapped_;
+    std::vector<uint8_t> owned_;
+    std::span<const uint8_t> data_;
+
+   public:
+    FileData(FileData const &) = delete;
+    FileData &operator=(FileData const &) = delete;
+
+    FileData(std::unique_ptr<MappedFile> mapped);
+    FileData(std::vector<uint8_t> &&owned);
+    ~FileData();
+
+    const uint8_t *data() const {
+        return data_.data();
+    }
+
+    // @returns the size of the file in bytes
+    size_t size() const {
+        return data_.size();
+    }
+
+    std::span<const uint8_t> span() const {
+        return data_;
+    }
+
+    std::string_view view() const {
+        return {reinterpret_cast<const char *>(data_.data()), data_.size()};
+    }
+};
+
+enum class IoBackend {
+    // std::ifstream, copies the file into memory
+    Stream,
+    // read-only memory mapping, the file is never copied
+    Mapped,
+    // io_uring, linux only. Files are split into chunks and all chunks of a batch are in flight at once.
+    Uring,
+};
+
+/**
+ * Set the backend used by all file reads. Unsupported backends fall back to `IoBackend::Mapped`.
+ * Should be set before any loading starts.
+ */
+void setIoBackend(IoBackend backend);
+
+IoBackend ioBackend();
+
+// @returns the backend with the name `stream`, `mapped` or `uring`
+IoBackend parseIoBackend(std::string name);
+
+// Read an entire file through the current io backend
+std::shared_ptr<const FileData> file(std::string filename);
+
+// Read multiple files at once. The uring backend keeps all of them in flight together.
+std::vector<std::shared_ptr<const FileData>> files(const std::vector<std::string> &filenames);
+
 loader::Image image(std::string filename);
 
+loader::Image image(const FileData &file, std::string filename);
+
 void writeImage(std::string filename, loader::Image image);
 
+/**
+ * Move the pixels into staging memory of `gl::uploads`, so the texture is uploaded without blocking the main thread.
+ * Keeps the pixels in `data` when there is no space. Can be called from loading jobs.
+ */
+void stage(loader::Image &image);
+
 typedef unsigned int GLenum;
 
 struct TextureParameters {
@@ -46,6 +152,7 @@ struct TextureParameters {
 
 gl::Texture *texture(std::string filename, TextureParameters params = {});
 
+// Staged images are uploaded by `gl::uploads`, the others immediately
 gl::Texture *texture(loader::Image &image, TextureParameters params = {});
 
 }  // namespace loader
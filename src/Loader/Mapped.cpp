@@ -0,0 +1,88 @@
+#include "Loader.h"
+
+// After
+#include "../Util/Log.h"
+
+#ifdef _WIN32
+#include <windows.h>
+
+namespace loader {
+
+MappedFile::MappedFile(std::string filename) {
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        PANIC("Error opening file: " + filename);
+    }
+    file_ = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        PANIC("Error reading file size: " + filename);
+    }
+    size_ = static_cast<size_t>(size.QuadPart);
+    // empty files cannot be mapped
+    if (size_ == 0) return;
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(file);
+        PANIC("Error mapping file: " + filename);
+    }
+    mapping_ = mapping;
+
+    data_ = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (data_ == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        PANIC("Error mapping file: " + filename);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) UnmapViewOfFile(data_);
+    if (mapping_ != nullptr) CloseHandle(mapping_);
+    if (file_ != nullptr) CloseHandle(file_);
+}
+
+}  // namespace loader
+
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace loader {
+
+MappedFile::MappedFile(std::string filename) {
+    file_ = open(filename.c_str(), O_RDONLY);
+    if (file_ < 0) {
+        PANIC("Error opening file: " + filename);
+    }
+
+    struct stat info;
+    if (fstat(file_, &info) != 0) {
+        close(file_);
+        PANIC("Error reading file size: " + filename);
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    // empty files cannot be mapped
+    if (size_ == 0) return;
+
+    void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file_, 0);
+    if (data == MAP_FAILED) {
+        close(file_);
+        PANIC("Error mapping file: " + filename);
+    }
+    data_ = static_cast<const uint8_t *>(data);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) munmap(const_cast<uint8_t *>(data_), size_);
+    if (file_ >= 0) close(file_);
+}
+
+}  // namespace loader
+
+#endif
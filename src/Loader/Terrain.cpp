@@ -4,39 +4,118 @@
 #include <Jolt/Physics/Collision/Shape/HeightFieldShape.h>
 #include <stb_image.h>
 
+#include <algorithm>
+#include <array>
 #include <dds_image/dds.hpp>
+#include <glm/gtc/type_precision.hpp>
+#include <numeric>
 #include <vector>
 
 #include "../GL/Geometry.h"
 #include "../GL/Texture.h"
+#include "../GL/Upload.h"
 #include "../Loader/Loader.h"
 #include "../Physics/Physics.h"
 #include "../Util/Log.h"
 
 namespace loader {
 
-TerrainData::TerrainData(TerrainData::Files files) {
-    std::vector<uint8_t> height_raw = loader::binary(files.height);
+static TerrainHeightmap decodeHeightmap(const FileData &file);
+
+static TerrainCollision buildCollision(const TerrainHeightmap &height);
+
+static std::shared_ptr<dds::Image> readAlbedo(const FileData &file);
+
+static std::vector<TerrainPatchBounds> buildPatchBounds(const TerrainHeightmap &height, glm::vec2 dimensions, float height_scale, glm::vec3 origin, int subdivisions);
+
+// The tessellation shaders sample the height map at a lod of up to 6, which covers 2^6 texels
+static const int HEIGHT_LOD_TEXELS = 64;
+
+static TerrainHeightmap decodeHeightmap(const FileData &file) {
     int w, h, ch;
-    auto height_pixels = stbi_load_16_from_memory(height_raw.data(), height_raw.size(), &w, &h, &ch, 1);
+    auto height_pixels = stbi_load_16_from_memory(file.data(), static_cast<int>(file.size()), &w, &h, &ch, 1);
     if (height_pixels == nullptr) {
         PANIC("Error loading 16pbc grayscale heightmap image");
     }
-    height = TerrainHeightmap{
+    return TerrainHeightmap{
         .width = w,
         .height = h,
-        .data = std::shared_ptr<uint16_t>(height_pixels),
+        .data = std::shared_ptr<uint16_t>(height_pixels, stbi_image_free),
     };
+}
 
-    dds::Image *albedo_dds = new dds::Image();
-    albedo_dds->data = loader::binary(files.albedo);
-    auto dds_read_result = dds::readImage(albedo_dds->data.data(), albedo_dds->data.size(), albedo_dds);
+static TerrainCollision buildCollision(const TerrainHeightmap &height) {
+    const int collision_subsample = 16;
+    TerrainCollision collision;
+    collision.count = std::max(height.width / collision_subsample, height.height / collision_subsample);
+    // jolt heightmap collision must be square
+    collision.samples.reserve(collision.count * collision.count);
+    for (int y = 0; y < collision.count; y++) {
+        for (int x = 0; x < collision.count; x++) {
+            float sample_height = JPH::HeightFieldShapeConstants::cNoCollisionValue;
+            int ix = x * collision_subsample, iy = y * collision_subsample;
+
+            if (ix < height.width && iy < height.height) {
+                int index = ix + iy * height.width;
+                uint16_t sample = *(height.data.get() + index);
+                sample_height = (float)sample / 0xffff;
+            }
+
+            collision.samples.push_back(sample_height);
+        }
+    }
+    return collision;
+}
+
+static std::shared_ptr<dds::Image> readAlbedo(const FileData &file) {
+    auto albedo = std::make_shared<dds::Image>();
+    // dds only reads from the pointer, the mipmaps reference the file's memory
+    auto dds_read_result = dds::readImage(const_cast<uint8_t *>(file.data()), file.size(), albedo.get());
     if (dds_read_result != dds::ReadResult::Success) {
-        PANIC("Failed to read terrain heightmap dds");
+        PANIC("Failed to read terrain albedo dds");
     }
-    albedo = std::shared_ptr<dds::Image>(albedo_dds);
-    normal = loader::image(files.normal);
-    occlusion = loader::image(files.occlusion);
+    return albedo;
+}
+
+TerrainData::TerrainData() = default;
+
+jobs::Future<std::shared_ptr<TerrainData>> TerrainData::load(jobs::JobSystem &jobs, TerrainData::Files files) {
+    auto result = std::make_shared<TerrainData>();
+    const jobs::Priority priority = jobs::Priority::Low;
+
+    // read all files at once, so they can be in flight together
+    auto read = jobs.submit(
+        [files]() { return loader::files({files.height, files.albedo, files.normal, files.occlusion}); },
+        {}, priority);
+
+    auto height = jobs.submit(
+        [result, read]() { result->height = decodeHeightmap(*read.get()[0]); },
+        {read}, priority);
+    auto collision = jobs.submit(
+        [result]() { result->collision = buildCollision(result->height); },
+        {height}, priority);
+
+    auto albedo = jobs.submit(
+        [result, read]() {
+            result->albedoFile = read.get()[1];
+            result->albedo = readAlbedo(*result->albedoFile);
+        },
+        {read}, priority);
+    // the decoded pixels go straight into staging memory
+    auto normal = jobs.submit(
+        [result, read, filename = files.normal]() {
+            result->normal = loader::image(*read.get()[2], filename);
+            loader::stage(result->normal);
+        },
+        {read}, priority);
+    auto occlusion = jobs.submit(
+        [result, read, filename = files.occlusion]() {
+            result->occlusion = loader::image(*read.get()[3], filename);
+            loader::stage(result->occlusion);
+        },
+        {read}, priority);
+
+    return jobs.submit([result]() { return result; }, {collision, albedo, normal, occlusion}, priority);
 }
 
 TerrainData::~TerrainData() = default;
@@ -48,8 +127,15 @@ Terrain::Terrain(TerrainData &data, float size, float heightScale, glm::vec3 ori
     height_ = new gl::Texture(GL_TEXTURE_2D);
     height_->setDebugLabel("terrain/height");
     height_->allocate(0, GL_R16, data.height.width, data.height.height);
-    height_->load(0, data.height.width, data.height.height, GL_RED, GL_UNSIGNED_SHORT, data.height.data.get());
-    height_->generateMipmap();
+    gl::TextureUpload height_upload = {
+        .texture = height_,
+        .size = {data.height.width, data.height.height, 1},
+        .format = GL_RED,
+        .type = GL_UNSIGNED_SHORT,
+        .mipmap = true,
+    };
+    size_t height_size = static_cast<size_t>(data.height.width) * data.height.height * sizeof(uint16_t);
+    gl::uploads->upload(height_upload, data.height.data.get(), height_size, data.height.data);
 
     albedo_ = new gl::Texture(GL_TEXTURE_2D);
     albedo_->setDebugLabel("terrain/albedo");
@@ -61,7 +147,14 @@ Terrain::Terrain(TerrainData &data, float size, float heightScale, glm::vec3 ori
         int width = data.albedo->width >> mip;
         int height = data.albedo->height >> mip;
 
-        albedo_->loadCompressed(mip, width, height, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, mip_data.size_bytes(), mip_data.data());
+        gl::TextureUpload mip_upload = {
+            .texture = albedo_,
+            .level = static_cast<int>(mip),
+            .size = {width, height, 1},
+            .compressedFormat = GL_COMPRESSED_SRGB_S3TC_DXT1_EXT,
+        };
+        // the mipmaps point into the dds file
+        gl::uploads->upload(mip_upload, mip_data.data(), mip_data.size_bytes(), data.albedoFile);
     }
 
     normal_ = loader::texture(data.normal, loader::TextureParameters{.mipmap = true, .srgb = false, .internalFormat = GL_RGB8_SNORM});
@@ -105,33 +198,13 @@ Terrain::Terrain(TerrainData &data, float size, float heightScale, glm::vec3 ori
         }
     }
 
-    const int collision_subsample = 16;
-    std::vector<float> collision_samples;
-    int collision_samples_count = std::max(data.height.width / collision_subsample, data.height.height / collision_subsample);
-    // jolt heightmap collision must be square
-    collision_samples.reserve(collision_samples_count * collision_samples_count);
-    for (int y = 0; y < collision_samples_count; y++) {
-        for (int x = 0; x < collision_samples_count; x++) {
-            float height = JPH::HeightFieldShapeConstants::cNoCollisionValue;
-            int ix = x * collision_subsample, iy = y * collision_subsample;
-
-            if (ix < data.height.width || iy < data.height.height) {
-                int index = ix + iy * data.height.width;
-                // Warning: OOB access may be possible, this is not secure at all!
-                uint16_t sample = *(data.height.data.get() + index);
-                height = (float)sample / 0xffff;
-            }
-
-            collision_samples.push_back(height);
-        }
-    }
-
-    JPH::Vec3 collision_scale = {JPH::Vec3(dimensions.x / collision_samples_count, heightScale, dimensions.y / collision_samples_count)};
+    const TerrainCollision &collision = data.collision;
+    JPH::Vec3 collision_scale = {JPH::Vec3(dimensions.x / collision.count, heightScale, dimensions.y / collision.count)};
     heightFieldShape_ = new JPH::HeightFieldShapeSettings(
-        collision_samples.data(),
+        collision.samples.data(),
         JPH::Vec3{-dimensions.x / 2.0f, 0, -dimensions.y / 2.0f},
         collision_scale,
-        collision_samples_count);
+        collision.count);
 
     vao_ = new gl::VertexArray();
     vao_->setDebugLabel("terrain/vao");
@@ -144,6 +217,65 @@ Terrain::Terrain(TerrainData &data, float size, float heightScale, glm::vec3 ori
 
     vao_->bindBuffer(0, *vbo, 0, sizeof(Vertex));
     vao_->own(vbo);  // vao will delete the vbo
+
+    // The layer attribute of each instance is its index, so a draw selects its layer with the base instance
+    std::array<uint32_t, MAX_LAYERS> layers;
+    std::iota(layers.begin(), layers.end(), 0);
+    gl::Buffer *layer_buffer = new gl::Buffer();
+    layer_buffer->setDebugLabel("terrain/layers");
+    layer_buffer->allocate(layers.data(), sizeof(layers), 0);
+    vao_->layoutI(1, 2, 1, GL_UNSIGNED_INT, 0);
+    vao_->attribDivisor(1, 1);
+    vao_->bindBuffer(1, *layer_buffer, 0, sizeof(uint32_t));
+    vao_->own(layer_buffer);
+
+    patchBounds_ = buildPatchBounds(data.height, dimensions, heightScale, origin, subdivisions);
+}
+
+static std::vector<TerrainPatchBounds> buildPatchBounds(const TerrainHeightmap &height, glm::vec2 dimensions, float height_scale, glm::vec3 origin, int subdivisions) {
+    // the height range of the texels below each patch
+    std::vector<glm::u16vec2> ranges(subdivisions * subdivisions, glm::u16vec2(UINT16_MAX, 0));
+    const uint16_t *texels = height.data.get();
+    for (int v = 0; v < height.height; v++) {
+        int y = std::min(v * subdivisions / height.height, subdivisions - 1);
+        for (int u = 0; u < height.width; u++) {
+            int x = std::min(u * subdivisions / height.width, subdivisions - 1);
+            uint16_t texel = texels[v * height.width + u];
+            glm::u16vec2 &range = ranges[y * subdivisions + x];
+            range.x = std::min(range.x, texel);
+            range.y = std::max(range.y, texel);
+        }
+    }
+
+    // The lower mip levels blend in the heights of neighboring patches
+    int patch_texels = std::max(std::min(height.width, height.height) / subdivisions, 1);
+    int margin = (HEIGHT_LOD_TEXELS + patch_texels - 1) / patch_texels;
+
+    std::vector<TerrainPatchBounds> bounds;
+    bounds.reserve(subdivisions * subdivisions);
+    glm::vec2 fraction = {1.0 / subdivisions, 1.0 / subdivisions};
+    for (int y = 0; y < subdivisions; y++) {
+        for (int x = 0; x < subdivisions; x++) {
+            glm::u16vec2 range = {UINT16_MAX, 0};
+            for (int ny = std::max(y - margin, 0); ny <= std::min(y + margin, subdivisions - 1); ny++) {
+                for (int nx = std::max(x - margin, 0); nx <= std::min(x + margin, subdivisions - 1); nx++) {
+                    range.x = std::min(range.x, ranges[ny * subdivisions + nx].x);
+                    range.y = std::max(range.y, ranges[ny * subdivisions + nx].y);
+                }
+            }
+
+            // the same as the vertices, the patch's y axis is the world's z axis
+            glm::vec2 min = dimensions * glm::vec2{x, y} * fraction - dimensions / 2.0f;
+            glm::vec2 max = dimensions * glm::vec2{x + 1, y + 1} * fraction - dimensions / 2.0f;
+            float min_height = static_cast<float>(range.x) / UINT16_MAX * height_scale;
+            float max_height = static_cast<float>(range.y) / UINT16_MAX * height_scale;
+            bounds.push_back({
+                .min = origin + glm::vec3(min.x, min_height, min.y),
+                .max = origin + glm::vec3(max.x, max_height, max.y),
+            });
+        }
+    }
+    return bounds;
 }
 
 Terrain::~Terrain() {
@@ -3,7 +3,9 @@
 #include <glm/glm.hpp>
 #include <memory>
 #include <string>
+#include <vector>
 
+#include "../Util/Jobs.h"
 #include "Loader.h"
 
 #pragma region ForwardDecl
@@ -27,6 +29,18 @@ struct TerrainHeightmap {
     std::shared_ptr<uint16_t> data;
 };
 
+// The world space bounds of a terrain patch
+struct TerrainPatchBounds {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+struct TerrainCollision {
+    // normalized heights, jolt heightmap collision must be square
+    std::vector<float> samples;
+    int count = 0;
+};
+
 struct TerrainData {
     struct Files {
         std::string albedo;
@@ -35,13 +49,23 @@ struct TerrainData {
         std::string normal;
     };
 
+    // the mipmaps borrow the memory of `albedoFile`
     std::shared_ptr<dds::Image> albedo;
+    std::shared_ptr<const loader::FileData> albedoFile;
     loader::Image occlusion;
     loader::Image normal;
     loader::TerrainHeightmap height;
+    // subsampled from the height map
+    loader::TerrainCollision collision;
 
-    TerrainData(Files files);
+    TerrainData();
     ~TerrainData();
+
+    /**
+     * Queue the jobs that load the terrain.
+     * The textures are decoded in parallel and the collision is built as soon as the height map is decoded.
+     */
+    static jobs::Future<std::shared_ptr<TerrainData>> load(jobs::JobSystem& jobs, Files files);
 };
 
 class Terrain {
@@ -57,8 +81,13 @@ class Terrain {
 
     JPH::HeightFieldShapeSettings* heightFieldShape_;
     std::unique_ptr<JPH::Body> body_;
+    // one per patch, in the order of the patches' vertices
+    std::vector<TerrainPatchBounds> patchBounds_;
 
    public:
+    // the number of layers that a layered draw can select with its base instance
+    static inline constexpr int MAX_LAYERS = 8;
+
     Terrain(TerrainData& data, float size, float heightScale, glm::vec3 origin, int subdivisions);
     ~Terrain();
 
@@ -86,6 +115,11 @@ class Terrain {
         return 4 * subdivisions_ * subdivisions_;
     }
 
+    // The bounds of the patches, patch `i` is drawn with the vertices `4 * i` to `4 * i + 3`
+    const std::vector<TerrainPatchBounds>& patchBounds() const {
+        return patchBounds_;
+    }
+
     glm::vec3 origin() {
         return origin_;
     }
@@ -0,0 +1,306 @@
+#include "Loader.h"
+
+// After
+#include "../Util/Log.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+
+namespace loader {
+
+// Files are split into reads of at most this size, so that large files also keep the queue busy
+const size_t URING_CHUNK_SIZE = 512 * 1024;
+const unsigned URING_ENTRIES = 64;
+
+/**
+ * A minimal io_uring instance that only supports reads.
+ * Uses the raw system calls, since liburing is not a dependency.
+ * [Reference](https://unixism.net/loti/low_level.html)
+ */
+class Uring {
+   private:
+    int fd_ = -1;
+    bool singleMmap_ = false;
+    void *sqRing_ = nullptr;
+    size_t sqRingSize_ = 0;
+    void *cqRing_ = nullptr;
+    size_t cqRingSize_ = 0;
+    io_uring_sqe *sqes_ = nullptr;
+    size_t sqesSize_ = 0;
+
+    unsigned *sqHead_ = nullptr;
+    unsigned *sqTail_ = nullptr;
+    unsigned *sqMask_ = nullptr;
+    unsigned *sqArray_ = nullptr;
+    unsigned *cqHead_ = nullptr;
+    unsigned *cqTail_ = nullptr;
+    unsigned *cqMask_ = nullptr;
+    io_uring_cqe *cqes_ = nullptr;
+    unsigned entries_ = 0;
+    // queued, but not yet consumed by the kernel
+    unsigned unsubmitted_ = 0;
+
+    void *map_(size_t size, off_t offset) {
+        void *result = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+        return result == MAP_FAILED ? nullptr : result;
+    }
+
+   public:
+    Uring(Uring const &) = delete;
+    Uring &operator=(Uring const &) = delete;
+
+    Uring(unsigned entries) {
+        io_uring_params params = {};
+        fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd_ < 0) return;
+
+        entries_ = params.sq_entries;
+        sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        singleMmap_ = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMmap_) {
+            sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+        }
+
+        sqRing_ = map_(sqRingSize_, IORING_OFF_SQ_RING);
+        cqRing_ = singleMmap_ ? sqRing_ : map_(cqRingSize_, IORING_OFF_CQ_RING);
+        sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe *>(map_(sqesSize_, IORING_OFF_SQES));
+        if (sqRing_ == nullptr || cqRing_ == nullptr || sqes_ == nullptr) {
+            LOG_WARN("Error mapping io_uring: " + std::string(std::strerror(errno)));
+            close(fd_);
+            fd_ = -1;
+            return;
+        }
+
+        uint8_t *sq = static_cast<uint8_t *>(sqRing_);
+        sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sqMask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        uint8_t *cq = static_cast<uint8_t *>(cqRing_);
+        cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cqMask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    }
+
+    ~Uring() {
+        if (sqes_ != nullptr) munmap(sqes_, sqesSize_);
+        if (cqRing_ != nullptr && !singleMmap_) munmap(cqRing_, cqRingSize_);
+        if (sqRing_ != nullptr) munmap(sqRing_, sqRingSize_);
+        if (fd_ >= 0) close(fd_);
+    }
+
+    bool valid() const {
+        return fd_ >= 0;
+    }
+
+    // @returns the maximum number of reads in flight
+    unsigned capacity() const {
+        return entries_;
+    }
+
+    // Queue a read, it is not submitted until `submitAndWait` is called
+    // @returns `false` when the submission queue is full
+    bool queueRead(int fd, void *buffer, unsigned length, uint64_t offset, uint64_t user_data) {
+        unsigned tail = *sqTail_;
+        unsigned head = std::atomic_ref<unsigned>(*sqHead_).load(std::memory_order_acquire);
+        if (tail - head >= entries_) return false;
+
+        unsigned index = tail & *sqMask_;
+        io_uring_sqe &sqe = sqes_[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(buffer);
+        sqe.len = length;
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        sqArray_[index] = index;
+
+        std::atomic_ref<unsigned>(*sqTail_).store(tail + 1, std::memory_order_release);
+        unsubmitted_++;
+        return true;
+    }
+
+    // @returns the number of queued reads that were not consumed by the kernel yet
+    unsigned unsubmitted() const {
+        return unsubmitted_;
+    }
+
+    // Remove the queued reads that were not consumed by the kernel yet, it only reads the queue in `submitAndWait`
+    void discardUnsubmitted() {
+        unsigned tail = *sqTail_;
+        std::atomic_ref<unsigned>(*sqTail_).store(tail - unsubmitted_, std::memory_order_release);
+        unsubmitted_ = 0;
+    }
+
+    // Submit all queued reads and wait until at least one has completed
+    // @returns 0 or a negative errno
+    int submitAndWait() {
+        int result = static_cast<int>(syscall(__NR_io_uring_enter, fd_, unsubmitted_, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+        if (result < 0) return -errno;
+        unsubmitted_ -= std::min(unsubmitted_, static_cast<unsigned>(result));
+        return 0;
+    }
+
+    // Calls `callback(user_data, result)` for every completed read
+    template <typename F>
+    void reap(F &&callback) {
+        unsigned head = *cqHead_;
+        unsigned tail = std::atomic_ref<unsigned>(*cqTail_).load(std::memory_order_acquire);
+        for (; head != tail; head++) {
+            const io_uring_cqe &cqe = cqes_[head & *cqMask_];
+            callback(cqe.user_data, cqe.res);
+        }
+        std::atomic_ref<unsigned>(*cqHead_).store(head, std::memory_order_release);
+    }
+};
+
+// Every loader thread has its own ring
+static Uring &threadRing() {
+    thread_local Uring ring(URING_ENTRIES);
+    // The setup can fail on some threads only, e.g. when the locked memory limit is reached
+    static std::atomic<bool> warned = false;
+    if (!ring.valid() && !warned.exchange(true)) {
+        LOG_WARN("Error creating an io_uring, the threads without one use memory mapped io instead");
+    }
+    return ring;
+}
+
+// @returns whether the calling thread has an io_uring. Other threads may still fail to create theirs.
+bool uringSupported() {
+    return threadRing().valid();
+}
+
+std::vector<std::shared_ptr<const FileData>> readUring(const std::vector<std::string> &filenames) {
+    Uring &ring = threadRing();
+    if (!ring.valid()) {
+        PANIC("io_uring is not supported");
+    }
+
+    struct OpenFile {
+        int fd = -1;
+        std::vector<uint8_t> data;
+        // reads submitted to the kernel that haven't completed
+        int reading = 0;
+
+        ~OpenFile() {
+            if (fd >= 0) close(fd);
+        }
+    };
+    struct Chunk {
+        size_t file;
+        size_t offset;
+        size_t length;
+    };
+
+    std::vector<OpenFile> open_files(filenames.size());
+    std::vector<Chunk> chunks;
+    for (size_t i = 0; i < filenames.size(); i++) {
+        OpenFile &file = open_files[i];
+        file.fd = open(filenames[i].c_str(), O_RDONLY | O_CLOEXEC);
+        if (file.fd < 0) {
+            PANIC("Error opening file: " + filenames[i]);
+        }
+        struct stat info;
+        if (fstat(file.fd, &info) != 0) {
+            PANIC("Error reading file size: " + filenames[i]);
+        }
+        file.data.resize(static_cast<size_t>(info.st_size));
+        for (size_t offset = 0; offset < file.data.size(); offset += URING_CHUNK_SIZE) {
+            chunks.push_back({.file = i, .offset = offset, .length = std::min(URING_CHUNK_SIZE, file.data.size() - offset)});
+        }
+    }
+
+    // Every read has to complete before the buffers may be released, so errors are only raised at the end
+    std::string error;
+    size_t next = 0;
+    unsigned in_flight = 0;
+    // chunks in the queue that the kernel hasn't consumed yet, in queue order
+    std::deque<size_t> unsubmitted;
+    while (next < chunks.size() || in_flight > 0) {
+        while (next < chunks.size() && in_flight < ring.capacity() && error.empty()) {
+            const Chunk &chunk = chunks[next];
+            OpenFile &file = open_files[chunk.file];
+            if (!ring.queueRead(file.fd, file.data.data() + chunk.offset, static_cast<unsigned>(chunk.length), chunk.offset, next)) break;
+            file.reading++;
+            unsubmitted.push_back(next);
+            next++;
+            in_flight++;
+        }
+        if (in_flight == 0) break;
+
+        int result = ring.submitAndWait();
+        if (result < 0 && result != -EINTR && result != -EAGAIN && result != -EBUSY) {
+            // The queued reads are removed, so the next call doesn't submit them with freed buffers
+            ring.discardUnsubmitted();
+            for (size_t index : unsubmitted) {
+                open_files[chunks[index].file].reading--;
+            }
+            // Reads that were submitted could still write to their buffers, so only those are leaked
+            for (auto &&file : open_files) {
+                if (file.reading > 0) new std::vector<uint8_t>(std::move(file.data));
+            }
+            PANIC("Error submitting io_uring reads: " + std::string(std::strerror(-result)));
+        }
+        while (unsubmitted.size() > ring.unsubmitted()) {
+            unsubmitted.pop_front();
+        }
+
+        ring.reap([&](uint64_t index, int32_t bytes) {
+            in_flight--;
+            Chunk chunk = chunks[index];
+            open_files[chunk.file].reading--;
+            if (bytes < 0) {
+                error = "Error reading file: " + filenames[chunk.file] + ", reason: " + std::strerror(-bytes);
+            } else if (bytes == 0) {
+                error = "Unexpected end of file: " + filenames[chunk.file];
+            } else if (static_cast<size_t>(bytes) < chunk.length) {
+                // short reads are continued
+                chunks.push_back({.file = chunk.file, .offset = chunk.offset + bytes, .length = chunk.length - bytes});
+            }
+        });
+    }
+
+    if (!error.empty()) {
+        PANIC(error);
+    }
+
+    std::vector<std::shared_ptr<const FileData>> result;
+    result.reserve(open_files.size());
+    for (auto &&file : open_files) {
+        result.push_back(std::make_shared<const FileData>(std::move(file.data)));
+    }
+    return result;
+}
+
+}  // namespace loader
+
+#else
+
+namespace loader {
+
+bool uringSupported() {
+    return false;
+}
+
+std::vector<std::shared_ptr<const FileData>> readUring(const std::vector<std::string> &filenames) {
+    PANIC("io_uring is not supported");
+}
+
+}  // namespace loader
+
+#endif
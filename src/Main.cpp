@@ -1,8 +1,16 @@
+#include <cctype>
+#include <optional>
 
+#include "GL/ProgramCache.h"
 #include "GL/StateManager.h"
+#include "GL/Upload.h"
 #include "GL/Util.h"
 #include "Game.h"
+#include "Loader/Environment.h"
+#include "Particles/CpuParticleSystem.h"
+#include "Renderer/Culling.h"
 #include "Setup.h"
+#include "Util/Jobs.h"
 #include "Util/Log.h"
 #include "Window.h"
 
@@ -44,8 +52,26 @@ int main(int argc, char** argv) {
     LOG_INFO("Parsing arguments");
     bool enableCompatibilityProfile = false;
     bool enableGlDebug = false;
+    // emitter count and frame count, runs without a window
+    std::optional<std::pair<int, int>> particleBenchmark;
+    std::optional<std::pair<int, int>> cullingBenchmark;
+    // an RGBE environment to compare the gpu and cpu decode of
+    std::optional<std::string> rgbeTest;
     for (int i = 1; i < argc; i++) {
         std::string arg(argv[i]);
+        if (arg == "--particle-benchmark") {
+            particleBenchmark = {64, 600};
+            if (i + 1 < argc && std::isdigit(argv[i + 1][0])) particleBenchmark->first = std::stoi(argv[++i]);
+            if (i + 1 < argc && std::isdigit(argv[i + 1][0])) particleBenchmark->second = std::stoi(argv[++i]);
+        }
+        if (arg == "--culling-benchmark") {
+            cullingBenchmark = {50000, 600};
+            if (i + 1 < argc && std::isdigit(argv[i + 1][0])) cullingBenchmark->first = std::stoi(argv[++i]);
+            if (i + 1 < argc && std::isdigit(argv[i + 1][0])) cullingBenchmark->second = std::stoi(argv[++i]);
+        }
+        if (arg == "--rgbe-test" && i + 1 < argc) {
+            rgbeTest = argv[++i];
+        }
         if (arg == "--enable-compatibility-profile") {
             enableCompatibilityProfile = true;
         }
@@ -59,18 +85,45 @@ int main(int argc, char** argv) {
 #endif
 
     try {
+        jobs::pool = std::make_unique<jobs::JobSystem>();
+        LOG_INFO("Started job system with " << jobs::pool->workerCount() << " workers");
+
+        if (particleBenchmark) {
+            benchmarkCpuParticles(particleBenchmark->first, particleBenchmark->second);
+            jobs::pool.reset();
+            return EXIT_SUCCESS;
+        }
+        if (cullingBenchmark) {
+            benchmarkCulling(cullingBenchmark->first, cullingBenchmark->second);
+            jobs::pool.reset();
+            return EXIT_SUCCESS;
+        }
+
         Window window = createOpenGLContext(enableCompatibilityProfile);
         initializeOpenGL(enableGlDebug);
 
+        if (rgbeTest) {
+            size_t mismatches = loader::testRgbeDecode(*rgbeTest);
+            gl::uploads.reset();
+            gl::programCache.reset();
+            destroyOpenGLContext(window);
+            jobs::pool.reset();
+            return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
         Game* game = new Game(window);
         game->load();
         game->run();
         game->unload();
         delete game;
+        gl::uploads.reset();
+        gl::programCache.reset();
 
         printNotDeletedOpenGLObjects();
 
         destroyOpenGLContext(window);
+
+        jobs::pool.reset();
     } catch (const std::exception& e) {
         std::cerr << "Fatal Error: " << e.what() << std::flush;
         return EXIT_FAILURE;
@@ -0,0 +1,333 @@
+#include "CpuParticleSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+#include "../Util/Jobs.h"
+#include "../Util/Log.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PARTICLES_USE_SSE2
+#endif
+
+static const float PI = 3.14159265359f;
+
+// https://www.pcg-random.org/, the same as in particles_emitter.comp
+static uint32_t pcgHash(uint32_t v) {
+    uint32_t state = v * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+struct PcgRandom {
+    uint32_t state;
+
+    // @returns a random float in [0, 1)
+    float next() {
+        state = pcgHash(state);
+        return static_cast<float>(state) * 2.3283064e-10f;
+    }
+
+    float range(float from, float to) {
+        return from + (to - from) * next();
+    }
+};
+
+// https://blog.selfshadow.com/2011/10/17/perp-vectors/
+static glm::vec3 perpendicular(glm::vec3 v) {
+    glm::vec3 w = glm::vec3(0, -glm::sign(v.y * v.z), 1);
+    return glm::cross(w, v);
+}
+
+void CpuParticleSystem::Particles::resize(size_t size) {
+    for (auto *array : {&x, &y, &z, &rotation, &vx, &vy, &vz, &revolutions, &drag, &gravity, &random, &width, &height, &lifeMax}) {
+        array->resize(size, 0.0f);
+    }
+    // new particles are dead
+    life.resize(size, 0.0f);
+    emitter.resize(size, 0);
+}
+
+void CpuParticleSystem::Particles::move(size_t source, size_t target, size_t length) {
+    // copying forwards is safe while the target is in front of the source
+    for (auto *array : {&x, &y, &z, &rotation, &vx, &vy, &vz, &revolutions, &drag, &gravity, &random, &width, &height, &life, &lifeMax}) {
+        std::copy(array->begin() + source, array->begin() + source + length, array->begin() + target);
+    }
+    std::copy(emitter.begin() + source, emitter.begin() + source + length, emitter.begin() + target);
+}
+
+CpuParticleSystem::CpuParticleSystem(int capacity) : capacity_(capacity), allocator_(capacity) {
+    particles_.resize(capacity_);
+    emitCounts_.fill(0);
+    for (int i = MAX_EMITTERS - 1; i >= 0; i--) {
+        freeEmitterIndices_.push_back(i);
+    }
+}
+
+ParticleEmitter *CpuParticleSystem::add(ParticleSettings settings, std::string material) {
+    if (freeEmitterIndices_.empty()) {
+        PANIC("Maximum count of particle emitters reached");
+    }
+    int index = freeEmitterIndices_.back();
+    freeEmitterIndices_.pop_back();
+
+    int required_length = settings.count.max * (int)ceil(settings.life.max * settings.frequency.max);
+    int segment_index = allocator_.allocate(required_length);
+    if (segment_index < 0 && required_length > 0) {
+        int capacity = capacity_;
+        if (capacity_ - allocator_.reserved() < required_length) {
+            capacity = std::max(2 * capacity_, allocator_.reserved() + required_length);
+        }
+        compact_(capacity);
+        segment_index = allocator_.allocate(required_length);
+    }
+
+    ParticleEmitter::Segment segment(segment_index, required_length);
+    if (segment_index < 0) {
+        segment = ParticleEmitter::Segment(capacity_, 0);
+    }
+    emitterPool_[index] = ParticleEmitter(settings, segment);
+    emitterPool_[index].material = material;
+    emitters_.push_back(&emitterPool_[index]);
+
+    std::vector<uint32_t> &free_stack = freeStacks_[index];
+    free_stack.clear();
+    free_stack.reserve(segment.length);
+    for (uint32_t i = 0; i < (uint32_t)segment.length; i++) {
+        free_stack.push_back(segment.length - i - 1);
+    }
+
+    return &emitterPool_[index];
+}
+
+void CpuParticleSystem::remove(ParticleEmitter *emitter) {
+    if (emitter == nullptr)
+        PANIC("Emitter is nullptr");
+    int index = emitterIndex(emitter);
+    if (index < 0 || static_cast<size_t>(index) >= emitterPool_.size())
+        PANIC("Emitter is not part of this system");
+
+    ParticleEmitter::Segment segment = emitter->segment();
+    std::fill(particles_.life.begin() + segment.index, particles_.life.begin() + segment.index + segment.length, -1.0f);
+    allocator_.free(segment.index, segment.length);
+    freeStacks_[index].clear();
+    freeEmitterIndices_.push_back(index);
+    emitter->enabled = false;
+    emitters_.erase(std::remove(emitters_.begin(), emitters_.end(), emitter), emitters_.end());
+}
+
+void CpuParticleSystem::compact_(int capacity) {
+    std::vector<ParticleEmitter *> emitters;
+    for (ParticleEmitter *emitter : emitters_) {
+        if (emitter->segment_.length > 0) emitters.push_back(emitter);
+    }
+    std::sort(emitters.begin(), emitters.end(), [](ParticleEmitter *a, ParticleEmitter *b) {
+        return a->segment_.index < b->segment_.index;
+    });
+
+    // The segments only move to the front, in order, so they never overwrite one that has not been moved yet.
+    // The free stacks hold indices relative to their segment, so they stay valid.
+    int packed = 0;
+    for (ParticleEmitter *emitter : emitters) {
+        ParticleEmitter::Segment &segment = emitter->segment_;
+        if (segment.index != packed) {
+            particles_.move(segment.index, packed, segment.length);
+        }
+        segment.index = packed;
+        packed += segment.length;
+    }
+    std::fill(particles_.life.begin() + packed, particles_.life.end(), 0.0f);
+    particles_.resize(capacity);
+
+    capacity_ = capacity;
+    allocator_.reset(capacity_, packed);
+}
+
+void CpuParticleSystem::emit_(int emitter_index, int count, uint32_t seed) {
+    ParticleEmitter &emitter = emitterPool_[emitter_index];
+    ParticleSettings &settings = emitter.settings();
+    std::vector<uint32_t> &free_stack = freeStacks_[emitter_index];
+    int offset = emitter.segment().index;
+    Particles &p = particles_;
+
+    glm::vec3 up = glm::normalize(settings.direction);
+    glm::vec3 right = perpendicular(up);
+    glm::vec3 forward = glm::cross(up, right);
+    glm::mat3 rotation_matrix = glm::mat3(right, up, forward);
+
+    for (int n = 0; n < count && !free_stack.empty(); n++) {
+        uint32_t i = offset + free_stack.back();
+        free_stack.pop_back();
+        PcgRandom random = {seed ^ pcgHash(i)};
+
+        float angle_z = random.range(glm::radians(settings.spread.min), glm::radians(settings.spread.max));
+        float angle_y = random.range(0.0f, 2.0f * PI);
+        glm::vec3 direction = glm::vec3(std::sin(angle_z), std::cos(angle_z), 0.0f);
+        direction = glm::vec3(direction.x * std::cos(angle_y), direction.y, direction.x * -std::sin(angle_y));
+        direction = glm::normalize(rotation_matrix * direction);
+
+        p.x[i] = settings.position.x;
+        p.y[i] = settings.position.y;
+        p.z[i] = settings.position.z;
+        p.rotation[i] = random.range(settings.rotation.min, settings.rotation.max);
+        p.life[i] = random.range(settings.life.min, settings.life.max);
+        p.lifeMax[i] = p.life[i];
+        glm::vec3 velocity = direction * random.range(settings.velocity.min, settings.velocity.max);
+        p.vx[i] = velocity.x;
+        p.vy[i] = velocity.y;
+        p.vz[i] = velocity.z;
+        p.revolutions[i] = random.range(settings.revolutions.min / 60.0f, settings.revolutions.max / 60.0f);
+        p.drag[i] = random.range(settings.drag.min, settings.drag.max);
+        p.gravity[i] = random.range(settings.gravityFactor.min, settings.gravityFactor.max);
+        p.random[i] = random.next();
+
+        float scale = random.range(settings.scale.min, settings.scale.max);
+        p.width[i] = settings.size.x * scale;
+        p.height[i] = settings.size.y * scale;
+        p.emitter[i] = emitter_index;
+    }
+}
+
+void CpuParticleSystem::simulate_(int emitter_index, float time_delta) {
+    ParticleEmitter &emitter = emitterPool_[emitter_index];
+    glm::vec3 gravity = emitter.settings().gravity;
+    std::vector<uint32_t> &free_stack = freeStacks_[emitter_index];
+    int begin = emitter.segment().index;
+    int end = begin + emitter.segment().length;
+    Particles &p = particles_;
+    float dt = time_delta;
+
+    // gravity, then drag = p * v^2 / 2 against the velocity, then integrate. Dead particles are left as they are.
+    int i = begin;
+#ifdef PARTICLES_USE_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 dt4 = _mm_set1_ps(dt);
+    const __m128 half_dt = _mm_set1_ps(0.5f * dt);
+    const __m128 gx = _mm_set1_ps(gravity.x * dt), gy = _mm_set1_ps(gravity.y * dt), gz = _mm_set1_ps(gravity.z * dt);
+    auto select = [](__m128 mask, __m128 a, __m128 b) {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    };
+    for (; i + 4 <= end; i += 4) {
+        __m128 life = _mm_loadu_ps(&p.life[i]);
+        __m128 alive = _mm_cmpgt_ps(life, zero);
+        if (_mm_movemask_ps(alive) == 0) continue;
+
+        __m128 gravity_factor = _mm_loadu_ps(&p.gravity[i]);
+        __m128 drag = _mm_mul_ps(_mm_loadu_ps(&p.drag[i]), half_dt);
+        float *velocities[3] = {&p.vx[i], &p.vy[i], &p.vz[i]};
+        float *positions[3] = {&p.x[i], &p.y[i], &p.z[i]};
+        __m128 accelerations[3] = {gx, gy, gz};
+        for (int axis = 0; axis < 3; axis++) {
+            __m128 v = _mm_loadu_ps(velocities[axis]);
+            v = _mm_add_ps(v, _mm_mul_ps(accelerations[axis], gravity_factor));
+            // sign(v) * v^2 = v * |v|
+            v = _mm_sub_ps(v, _mm_mul_ps(drag, _mm_mul_ps(v, _mm_andnot_ps(sign, v))));
+            __m128 position = _mm_add_ps(_mm_loadu_ps(positions[axis]), _mm_mul_ps(v, dt4));
+            _mm_storeu_ps(velocities[axis], select(alive, v, _mm_loadu_ps(velocities[axis])));
+            _mm_storeu_ps(positions[axis], select(alive, position, _mm_loadu_ps(positions[axis])));
+        }
+        __m128 rotation = _mm_loadu_ps(&p.rotation[i]);
+        rotation = select(alive, _mm_add_ps(rotation, _mm_mul_ps(_mm_loadu_ps(&p.revolutions[i]), dt4)), rotation);
+        _mm_storeu_ps(&p.rotation[i], rotation);
+        __m128 new_life = _mm_sub_ps(life, dt4);
+        _mm_storeu_ps(&p.life[i], select(alive, new_life, life));
+
+        int died = _mm_movemask_ps(_mm_and_ps(alive, _mm_cmple_ps(new_life, zero)));
+        for (int lane = 0; lane < 4; lane++) {
+            if (died & (1 << lane)) free_stack.push_back(i + lane - begin);
+        }
+    }
+#endif
+    for (; i < end; i++) {
+        if (p.life[i] <= 0.0f) continue;
+
+        float factor = p.gravity[i] * dt;
+        float drag = p.drag[i] * 0.5f * dt;
+        float *velocities[3] = {&p.vx[i], &p.vy[i], &p.vz[i]};
+        float *positions[3] = {&p.x[i], &p.y[i], &p.z[i]};
+        for (int axis = 0; axis < 3; axis++) {
+            float v = *velocities[axis] + gravity[axis] * factor;
+            v -= drag * v * std::abs(v);
+            *velocities[axis] = v;
+            *positions[axis] += v * dt;
+        }
+        p.rotation[i] += p.revolutions[i] * dt;
+        p.life[i] -= dt;
+
+        if (p.life[i] <= 0.0f) free_stack.push_back(i - begin);
+    }
+}
+
+void CpuParticleSystem::update(float time_delta, std::span<const float> rates) {
+    // `ParticleEmitter::update` uses `rand`, so the counts are determined up front
+    for (ParticleEmitter *emitter : emitters_) {
+        int index = emitterIndex(emitter);
+        float rate = rates.empty() ? 1.0f : rates[index];
+        if (emitter->enabled && rate > 0.0f) {
+            emitter->update(time_delta, rate);
+        } else {
+            emitter->pause(time_delta);
+        }
+        emitCounts_[index] = emitter->intervalCount();
+    }
+    uint32_t seed = static_cast<uint32_t>(rand());
+
+    auto step = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            // all particles of a dormant emitter are dead
+            if (emitters_[i]->dormant()) continue;
+            int index = emitterIndex(emitters_[i]);
+            emit_(index, emitCounts_[index], seed);
+            simulate_(index, time_delta);
+        }
+    };
+    if (jobs::pool != nullptr) {
+        jobs::pool->parallelFor(emitters_.size(), 1, step);
+    } else {
+        step(0, emitters_.size());
+    }
+
+    aliveCount_ = 0;
+    for (ParticleEmitter *emitter : emitters_) {
+        aliveCount_ += aliveCount(emitter);
+    }
+}
+
+void benchmarkCpuParticles(int emitter_count, int frame_count) {
+    emitter_count = std::clamp(emitter_count, 1, CpuParticleSystem::MAX_EMITTERS);
+    const float time_delta = 1.0f / 60.0f;
+
+    ParticleSettings settings = {
+        .frequency = 60,
+        .count = 8,
+        .life = {1.5f, 2.0f},
+        .spread = {0.0f, 45.0f},
+        .gravity = glm::vec3(0.0f, -9.81f, 0.0f),
+        .velocity = {5.0f, 10.0f},
+        .drag = {0.0f, 0.1f},
+        .revolutions = {-30.0f, 30.0f},
+    };
+    int per_emitter = settings.count.max * (int)ceil(settings.life.max * settings.frequency.max);
+    CpuParticleSystem system(emitter_count * per_emitter);
+    for (int i = 0; i < emitter_count; i++) {
+        settings.position = glm::vec3(i, 0, 0);
+        system.add(settings, "");
+    }
+
+    // the particles are counted once per frame they are simulated in
+    uint64_t simulated = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frame_count; frame++) {
+        system.update(time_delta);
+        simulated += system.aliveCount();
+    }
+    float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+    LOG_INFO("Simulated " << emitter_count << " emitters for " << frame_count << " frames in " << seconds * 1000.0f << " ms");
+    LOG_INFO("Particles alive at the end: " << system.aliveCount() << "/" << system.capacity());
+    LOG_INFO("Particles per second: " << static_cast<double>(simulated) / std::max(seconds, 1e-6f));
+}
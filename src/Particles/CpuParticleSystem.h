@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "ParticleSystem.h"
+#include "SegmentAllocator.h"
+
+/**
+ * Simulates the particles on the cpu, for runs without a gpu and as a fallback for weak ones.
+ * Emitting and updating matches `particles_emitter.comp` and `particles.comp`, segments and free stacks work the same way.
+ *
+ * The particles are stored in SoA layout, so the update kernel processes four of them at once with SSE2.
+ * Every emitter only touches its own segment and free stack, so the emitters are simulated in parallel on the job system.
+ */
+class CpuParticleSystem {
+   public:
+    struct Particles {
+        // position and rotation in degrees
+        std::vector<float> x, y, z, rotation;
+        // velocity and rotation speed in degrees per second
+        std::vector<float> vx, vy, vz, revolutions;
+        std::vector<float> drag, gravity, random;
+        std::vector<float> width, height, life, lifeMax;
+        std::vector<int> emitter;
+
+        void resize(size_t size);
+        // Move `[source, source + length)` to `target`, the ranges may overlap if `target < source`
+        void move(size_t source, size_t target, size_t length);
+    };
+
+    static const int MAX_EMITTERS = ParticleSystem::MAX_EMITTERS;
+
+   private:
+    int capacity_;
+    SegmentAllocator allocator_;
+    Particles particles_;
+    std::array<ParticleEmitter, MAX_EMITTERS> emitterPool_;
+    // the free particles of each emitter, relative to its segment. The top is at the back.
+    std::array<std::vector<uint32_t>, MAX_EMITTERS> freeStacks_;
+    // the particles to emit this frame
+    std::array<int, MAX_EMITTERS> emitCounts_;
+    std::vector<ParticleEmitter *> emitters_;
+    std::vector<int> freeEmitterIndices_;
+    int aliveCount_ = 0;
+
+    // Pack the segments of all emitters at the start of the particle arrays, see `ParticleSystem::compact_`
+    void compact_(int capacity);
+    void emit_(int emitter_index, int count, uint32_t seed);
+    void simulate_(int emitter_index, float time_delta);
+
+   public:
+    CpuParticleSystem(int capacity);
+
+    CpuParticleSystem(CpuParticleSystem const &) = delete;
+    CpuParticleSystem &operator=(CpuParticleSystem const &) = delete;
+
+    ParticleEmitter *add(ParticleSettings settings, std::string material);
+
+    void remove(ParticleEmitter *emitter);
+
+    /**
+     * Emit and simulate the particles, dormant emitters are skipped.
+     * @param rates the emission rate of each emitter by its index, all emit at the full rate if empty
+     */
+    void update(float time_delta, std::span<const float> rates = {});
+
+    int capacity() const {
+        return capacity_;
+    }
+
+    int reserved() const {
+        return allocator_.reserved();
+    }
+
+    // The number of alive particles after the last update
+    int aliveCount() const {
+        return aliveCount_;
+    }
+
+    int aliveCount(const ParticleEmitter *emitter) const {
+        int index = emitterIndex(emitter);
+        return emitter->segment().length - static_cast<int>(freeStacks_[index].size());
+    }
+
+    int emitterIndex(const ParticleEmitter *emitter) const {
+        return static_cast<int>(emitter - &emitterPool_[0]);
+    }
+
+    std::vector<ParticleEmitter *> emitters() {
+        return emitters_;
+    }
+
+    const Particles &particles() const {
+        return particles_;
+    }
+};
+
+/**
+ * Step `emitter_count` emitters on the cpu for `frame_count` frames of 1/60 seconds and log the particles per second.
+ * Does not need an OpenGL context.
+ */
+void benchmarkCpuParticles(int emitter_count, int frame_count);
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <numeric>
 
 #include "../GL/Framebuffer.h"
 #include "../GL/Geometry.h"
@@ -9,6 +10,7 @@
 #include "../GL/StateManager.h"
 #include "../GL/Texture.h"
 #include "../Loader/Loader.h"
+#include "CpuParticleSystem.h"
 
 struct Particle {
     // 3f position, 1f rotation
@@ -20,16 +22,108 @@ struct Particle {
     // 2f size, 1f life remaining, 1f life max
     glm::vec4 size_life;
     int emitter;
+    // the std430 array stride is a multiple of the vec4 alignment
+    int padding[3];
 };
+static_assert(sizeof(Particle) == 80);
 
 // integer divide x / y but round up instead of truncate
 #define DIV_CEIL(x, y) ((x + y - 1) / y)
 
+// The segments are compacted once this much of the free space is outside the largest free segment
+// and the largest free segment can't hold the segment of an average emitter
+static const float COMPACT_FRAGMENTATION = 0.5f;
+// The particle buffers never grow beyond this many particles
+static const int MAX_CAPACITY = 1 << 20;
+// Emitters closer than this emit at the full rate, further away the rate falls off with the distance
+static const float LOD_FULL_RATE_DISTANCE = 50.0f;
+static const float LOD_MIN_RATE = 0.1f;
+
+// Has to match `Emitter` in the particle shaders
 struct EmitterShaderValues {
+    // segment index, segment length, material slot or -1 when the particles are not drawn
     glm::ivec4 index_length;
     glm::vec4 gravity;
+    // 1f emissivity, 1f stretching
+    glm::vec4 emissivity_stretching;
+};
+
+// Has to match `Emission` in particles_emitter.comp
+struct Emission {
+    glm::vec4 direction;
+    glm::vec4 position;
+    // 2f spread, 2f velocity
+    glm::vec4 spread_velocity;
+    // 2f life, 2f size
+    glm::vec4 life_size;
+    glm::vec4 rotation_revolutions;
+    // 2f scale, 2f drag
+    glm::vec4 scale_drag;
+    // 2f gravity
+    glm::vec4 gravity;
+    // emitter index, particle count, first workgroup
+    glm::ivec4 index_count_group;
 };
 
+static const gl::PipelineState ADDITIVE_PIPELINE_STATE = {
+    .capabilities = gl::capabilityBits({gl::Capability::DepthTest, gl::Capability::Blend}),
+    .blendSrcRgb = gl::BlendFactor::One,
+    .blendDstRgb = gl::BlendFactor::One,
+    .blendSrcAlpha = gl::BlendFactor::One,
+    .blendDstAlpha = gl::BlendFactor::Zero,
+};
+
+// no blending, the sprites are drawn opaque
+static const gl::PipelineState OPAQUE_PIPELINE_STATE = {
+    .capabilities = gl::capabilityBits({gl::Capability::DepthTest}),
+};
+
+static const gl::PipelineState ALPHA_CLIP_PIPELINE_STATE = {
+    .capabilities = gl::capabilityBits({gl::Capability::DepthTest, gl::Capability::Blend}),
+    .blendSrcRgb = gl::BlendFactor::One,
+    .blendDstRgb = gl::BlendFactor::Zero,
+    .blendSrcAlpha = gl::BlendFactor::One,
+    .blendDstAlpha = gl::BlendFactor::Zero,
+};
+
+static gl::Buffer *createParticleBuffer(int capacity) {
+    gl::Buffer *buffer = new gl::Buffer();
+    buffer->setDebugLabel("particle_system/particle_buffer");
+    // written by the cpu backend
+    buffer->allocateEmpty(sizeof(Particle) * capacity, GL_DYNAMIC_STORAGE_BIT);
+    // zeroed particles are dead
+    glClearNamedBufferData(buffer->id(), GL_R32F, GL_RED, GL_FLOAT, nullptr);
+    return buffer;
+}
+
+static gl::Buffer *createFreeBuffer(int capacity) {
+    gl::Buffer *buffer = new gl::Buffer();
+    buffer->setDebugLabel("particle_system/free_buffer");
+    buffer->allocateEmpty(capacity * sizeof(GLuint), GL_DYNAMIC_STORAGE_BIT);
+    return buffer;
+}
+
+// @param sequential fill it with `0..capacity`, the cpu backend uploads the particles in draw order
+static gl::Buffer *createDrawIndexBuffer(int capacity, bool sequential) {
+    gl::Buffer *buffer = new gl::Buffer();
+    buffer->setDebugLabel("particle_system/draw_index_buffer");
+    if (sequential) {
+        std::vector<GLuint> indices(capacity);
+        std::iota(indices.begin(), indices.end(), 0);
+        buffer->allocate(indices.data(), indices.size() * sizeof(GLuint), 0);
+    } else {
+        buffer->allocateEmpty(capacity * sizeof(GLuint), 0);
+    }
+    return buffer;
+}
+
+ParticleBackend parseParticleBackend(std::string name) {
+    if (name == "gpu") return ParticleBackend::Gpu;
+    if (name == "cpu") return ParticleBackend::Cpu;
+    LOG_WARN("Unknown particle backend '" + name + "', using 'gpu'");
+    return ParticleBackend::Gpu;
+}
+
 void ParticleMaterial::destroy() {
     delete sprite;
     sprite = nullptr;
@@ -39,15 +133,13 @@ void ParticleMaterial::destroy() {
     scale = nullptr;
 }
 
-ParticleSystem::ParticleSystem(int capacity) {
+ParticleSystem::ParticleSystem(int capacity, ParticleBackend backend) : allocator_(capacity) {
     this->capacity_ = capacity;
-    particleBuffer_ = new gl::Buffer();
-    particleBuffer_->setDebugLabel("particle_system/particle_buffer");
-    particleBuffer_->allocateEmpty(sizeof(Particle) * capacity, 0);
-
-    freeBuffer_ = new gl::Buffer();
-    freeBuffer_->setDebugLabel("particle_system/free_buffer");
-    freeBuffer_->allocateEmpty(capacity_ * sizeof(GLuint), GL_DYNAMIC_STORAGE_BIT);
+    if (backend == ParticleBackend::Cpu) {
+        cpu_ = std::make_unique<CpuParticleSystem>(capacity);
+    }
+    particleBuffer_ = createParticleBuffer(capacity_);
+    freeBuffer_ = createFreeBuffer(capacity_);
 
     freeHeadsBuffer_ = new gl::Buffer();
     freeHeadsBuffer_->setDebugLabel("particle_system/free_heads_buffer");
@@ -57,6 +149,26 @@ ParticleSystem::ParticleSystem(int capacity) {
     emitterBuffer_->setDebugLabel("particle_system/emitter_buffer");
     emitterBuffer_->allocateEmpty(MAX_EMITTERS * sizeof(EmitterShaderValues), GL_DYNAMIC_STORAGE_BIT);
 
+    emissionBuffer_ = new gl::Buffer();
+    emissionBuffer_->setDebugLabel("particle_system/emission_buffer");
+    emissionBuffer_->allocateEmpty(MAX_EMITTERS * sizeof(Emission), GL_DYNAMIC_STORAGE_BIT);
+    emissions_.reserve(MAX_EMITTERS);
+
+    updateSegmentBuffer_ = new gl::Buffer();
+    updateSegmentBuffer_->setDebugLabel("particle_system/update_segment_buffer");
+    updateSegmentBuffer_->allocateEmpty(MAX_EMITTERS * sizeof(glm::ivec4), GL_DYNAMIC_STORAGE_BIT);
+    updateSegments_.reserve(MAX_EMITTERS);
+    lodRates_.fill(1.0f);
+
+    drawCommandBuffer_ = new gl::Buffer();
+    drawCommandBuffer_->setDebugLabel("particle_system/draw_command_buffer");
+    drawCommandBuffer_->allocateEmpty(MAX_MATERIALS * sizeof(gl::DrawArraysIndirectCommand), GL_DYNAMIC_STORAGE_BIT);
+
+    drawIndexBuffer_ = createDrawIndexBuffer(capacity_, cpu_ != nullptr);
+
+    emitterMaterials_.fill(-1);
+    emitterValues_.resize(MAX_EMITTERS);
+
     emitShader_ = new gl::ShaderPipeline({
         new gl::ShaderProgram("assets/shaders/particles/particles_emitter.comp"),
     });
@@ -88,6 +200,10 @@ ParticleSystem::ParticleSystem(int capacity) {
     quad_->layout(0, 0, 2, GL_FLOAT, false, 0);
     quad_->bindBuffer(0, *quad_vbo, 0, 2 * 4);
     quad_->own(quad_vbo);
+    // The draw commands' base instance selects the material's range of particle indices
+    quad_->layoutI(1, 1, 1, GL_UNSIGNED_INT, 0);
+    quad_->attribDivisor(1, 1);
+    quad_->bindBuffer(1, *drawIndexBuffer_, 0, sizeof(GLuint));
 
     spriteSampler_ = new gl::Sampler();
     spriteSampler_->setDebugLabel("particle_system/sprite_sampler");
@@ -100,7 +216,6 @@ ParticleSystem::ParticleSystem(int capacity) {
     tableSampler_->filterMode(GL_LINEAR, GL_LINEAR);
     tableSampler_->wrapMode(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, 0);
 
-    segmentation_.push_back(std::make_pair(0, capacity_));
     for (int i = MAX_EMITTERS - 1; i >= 0; i--) {
         freeEmitterIndices_.push_back(i);
     }
@@ -111,6 +226,10 @@ ParticleSystem::~ParticleSystem() {
     delete freeBuffer_;
     delete freeHeadsBuffer_;
     delete emitterBuffer_;
+    delete emissionBuffer_;
+    delete updateSegmentBuffer_;
+    delete drawCommandBuffer_;
+    delete drawIndexBuffer_;
     delete emitShader_;
     delete updateShader_;
     delete drawShader_;
@@ -124,24 +243,9 @@ ParticleSystem::~ParticleSystem() {
     }
 }
 
-struct Emission {
-    glm::vec4 direction;
-    glm::vec2 spread;
-    glm::vec2 velocity;
-    glm::vec2 life;
-    glm::vec3 position;
-    glm::vec4 rotation_revolutions;
-    glm::vec2 size;
-    glm::vec2 scale;
-    glm::vec2 drag;
-    glm::vec2 gravity;
-    int index;
-    int count;
-};
-
-void ParticleEmitter::update(float time_delta) {
+void ParticleEmitter::update(float time_delta, float rate) {
     count_ = 0;
-    timer_ += time_delta;
+    timer_ += time_delta * rate;
     while (timer_ >= interval_) {
         timer_ -= interval_;
         float frequency = 0.0;
@@ -155,96 +259,148 @@ void ParticleEmitter::update(float time_delta) {
         }
         count_ += settings_.count.min;
     }
+    idle_ = count_ > 0 ? 0.0f : idle_ + time_delta;
+}
+
+void ParticleEmitter::pause(float time_delta) {
+    count_ = 0;
+    idle_ += time_delta;
+}
+
+float ParticleEmitter::lodRate(const Frustum &frustum, glm::vec3 camera_position) const {
+    // How far the particles can get from the emitter, drag only slows them down
+    float life = settings_.life.max;
+    float gravity = glm::length(settings_.gravity) * std::max(settings_.gravityFactor.max, 0.0f);
+    float size = std::max(settings_.size.x, settings_.size.y) * settings_.scale.max;
+    float radius = settings_.velocity.max * life + 0.5f * gravity * life * life + size;
+    AABB bounds = {.min = settings_.position - radius, .max = settings_.position + radius};
+    if (!frustum.intersects(bounds)) return 0.0f;
+
+    float distance = glm::distance(camera_position, settings_.position);
+    if (distance <= LOD_FULL_RATE_DISTANCE) return 1.0f;
+    return std::max(LOD_FULL_RATE_DISTANCE / distance, LOD_MIN_RATE);
 }
 
 ParticleEmitter::~ParticleEmitter() = default;
 
-// FIXME: This is very slow to call for each individually
-void ParticleSystem::emit_(Emission &emission) {
+void ParticleSystem::emit_() {
+    if (emissions_.empty()) return;
+
+    // Each emission gets its own workgroups, the shader finds a workgroup's emission with a binary search
+    int group_count = 0;
+    for (Emission &emission : emissions_) {
+        emission.index_count_group.z = group_count;
+        group_count += DIV_CEIL(emission.index_count_group.y, 64);
+    }
+    emissionBuffer_->write(0, emissions_.data(), emissions_.size() * sizeof(Emission));
+
+    emitShader_->bind();
     auto comp = emitShader_->get(GL_COMPUTE_SHADER);
     comp->setUniform("u_random_seed", (unsigned int)rand());
-    comp->setUniform("u_emission.direction", emission.direction);
-    comp->setUniform("u_emission.spread", emission.spread);
-    comp->setUniform("u_emission.velocity", emission.velocity);
-    comp->setUniform("u_emission.life", emission.life);
-    comp->setUniform("u_emission.position", emission.position);
-    comp->setUniform("u_emission.rotation_revolutions", emission.rotation_revolutions);
-    comp->setUniform("u_emission.size", emission.size);
-    comp->setUniform("u_emission.scale", emission.scale);
-    comp->setUniform("u_emission.drag", emission.drag);
-    comp->setUniform("u_emission.gravity", emission.gravity);
-    comp->setUniform("u_emission.index", emission.index);
-    comp->setUniform("u_emission.count", emission.count);
+    comp->setUniform("u_emission_count", static_cast<int>(emissions_.size()));
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffer_->id());
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, freeBuffer_->id());
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, freeHeadsBuffer_->id());
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, emitterBuffer_->id());
-    glDispatchCompute(DIV_CEIL(emission.count, 64), 1, 1);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, emissionBuffer_->id());
+    glDispatchCompute(group_count, 1, 1);
 }
 
-std::pair<int, int> ParticleSystem::allocateSegment_(int length) {
-    std::pair<int, int> *free_segment = nullptr;
-    for (int i = 0; i < segmentation_.size(); i++) {
-        int free = segmentation_[i].second - segmentation_[i].first;
-        if (length <= free) {
-            free_segment = &segmentation_[i];
-            break;
-        }
+void ParticleSystem::compact_(int capacity) {
+    gl::pushDebugGroup("ParticleSystem::compact");
+    std::vector<ParticleEmitter *> emitters;
+    for (ParticleEmitter *emitter : emitters_) {
+        if (emitter->segment_.length > 0) emitters.push_back(emitter);
     }
-    if (free_segment == nullptr) {
-        return std::make_pair(0, 0);
-    }
-    std::pair<int, int> result = std::make_pair(free_segment->first, free_segment->first + length);
-    free_segment->first += length;
-    reserved_ += length;
-    return result;
-}
+    std::sort(emitters.begin(), emitters.end(), [](ParticleEmitter *a, ParticleEmitter *b) {
+        return a->segment_.index < b->segment_.index;
+    });
 
-void ParticleSystem::freeSegment_(int index, int length) {
-    int start = index;
-    int end = index + length;
-    for (int i = 0; i < segmentation_.size(); i++) {
-        auto &segment = segmentation_[i];
-        // extend end of previous
-        if (start == segment.second) {
-            segment.second = end;
-            break;
-        }
-        // extend start of next
-        if (end == segment.first) {
-            segment.first = start;
-            break;
+    // New storage is only needed to grow, otherwise the segments are moved within the current buffers
+    bool grow = capacity != capacity_;
+    gl::Buffer *particle_buffer = grow ? createParticleBuffer(capacity) : particleBuffer_;
+    gl::Buffer *free_buffer = grow ? createFreeBuffer(capacity) : freeBuffer_;
+    // the particles and free stacks were written by shaders
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    // Segments that are already adjacent are copied together.
+    // The free stacks hold indices relative to their segment, so they stay valid.
+    int packed = 0;
+    int run_source = 0, run_target = 0, run_length = 0;
+    auto copy_run = [&]() {
+        if (run_length == 0 || (!grow && run_source == run_target)) return;
+        // The segments only move towards the start, within a buffer the copies must not overlap,
+        // so a run is moved in steps of the distance it moves
+        int step = grow ? run_length : run_source - run_target;
+        for (int offset = 0; offset < run_length; offset += step) {
+            int length = std::min(step, run_length - offset);
+            glCopyNamedBufferSubData(particleBuffer_->id(), particle_buffer->id(), (run_source + offset) * sizeof(Particle), (run_target + offset) * sizeof(Particle), length * sizeof(Particle));
+            glCopyNamedBufferSubData(freeBuffer_->id(), free_buffer->id(), (run_source + offset) * sizeof(GLuint), (run_target + offset) * sizeof(GLuint), length * sizeof(GLuint));
         }
-        // add new segment
-        if (end < segment.first) {
-            segmentation_.insert(segmentation_.begin() + i, std::make_pair(start, end));
-            break;
+    };
+    for (ParticleEmitter *emitter : emitters) {
+        ParticleEmitter::Segment &segment = emitter->segment_;
+        if (run_source + run_length != segment.index) {
+            copy_run();
+            run_source = segment.index;
+            run_target = packed;
+            run_length = 0;
         }
+        run_length += segment.length;
+        segment.index = packed;
+        packed += segment.length;
+    }
+    copy_run();
+
+    if (grow) {
+        delete particleBuffer_;
+        delete freeBuffer_;
+        particleBuffer_ = particle_buffer;
+        freeBuffer_ = free_buffer;
+    } else if (packed < capacity_) {
+        // new segments expect dead particles, but the moved segments left copies behind
+        glClearNamedBufferSubData(particleBuffer_->id(), GL_R32F, packed * sizeof(Particle), (capacity_ - packed) * sizeof(Particle), GL_RED, GL_FLOAT, nullptr);
     }
 
-    // join segments and remove empties
-    std::vector<std::pair<int, int>> filtered;
-    filtered.reserve(segmentation_.size());
-    std::pair<int, int> *active = nullptr;
-    for (int i = 0; i < segmentation_.size(); i++) {
-        auto &curr = segmentation_[i];
-        if (curr.first == curr.second) {
-            // zero length segement
-            continue;
-        }
-        if (active && active->second == curr.first) {
-            // extend previous segement
-            active->second = curr.second;
-        } else {
-            filtered.push_back(curr);
-            active = &filtered.back();
-        }
+    if (grow) {
+        delete drawIndexBuffer_;
+        drawIndexBuffer_ = createDrawIndexBuffer(capacity, false);
+        quad_->reBindBuffer(1, *drawIndexBuffer_);
+    }
+    // the draw indices point to the old positions, nothing is drawn until the next update
+    if (!drawCommands_.empty()) {
+        drawCommandBuffer_->write(0, drawCommands_.data(), drawCommands_.size() * sizeof(gl::DrawArraysIndirectCommand));
     }
-    segmentation_ = filtered;
-    reserved_ -= length;
+
+    capacity_ = capacity;
+    allocator_.reset(capacity_, packed);
+    gl::popDebugGroup();
+}
+
+int ParticleSystem::emitterIndex_(const ParticleEmitter *emitter) const {
+    if (cpu_) return cpu_->emitterIndex(emitter);
+    return static_cast<int>(emitter - &emitterPool_[0]);
+}
+
+int ParticleSystem::capacity() const {
+    return cpu_ ? cpu_->capacity() : capacity_;
+}
+
+int ParticleSystem::reserved() const {
+    return cpu_ ? cpu_->reserved() : allocator_.reserved();
+}
+
+std::vector<ParticleEmitter *> ParticleSystem::emitters() {
+    return cpu_ ? cpu_->emitters() : emitters_;
 }
 
 ParticleEmitter *ParticleSystem::add(ParticleSettings settings, std::string material) {
+    if (cpu_) {
+        ParticleEmitter *emitter = cpu_->add(settings, material);
+        emitterMaterials_[cpu_->emitterIndex(emitter)] = materials_.count(material) != 0 ? materials_.at(material).slot : -1;
+        return emitter;
+    }
+
     if (freeEmitterIndices_.empty()) {
         PANIC("Maximum count of particle emitters reached");
     }
@@ -252,23 +408,30 @@ ParticleEmitter *ParticleSystem::add(ParticleSettings settings, std::string mate
     freeEmitterIndices_.pop_back();
 
     int required_length = settings.count.max * (int)ceil(settings.life.max * settings.frequency.max);
-    ParticleEmitter::Segment segment(allocateSegment_(required_length));
-    if (segment.length == 0) {
+    int segment_index = allocator_.allocate(required_length);
+    if (segment_index < 0 && required_length > 0) {
+        // Either the free space is fragmented or there is not enough of it, grow the buffers in the latter case
+        int capacity = capacity_;
+        if (capacity_ - allocator_.reserved() < required_length) {
+            capacity = std::min(std::max(2 * capacity_, allocator_.reserved() + required_length), MAX_CAPACITY);
+        }
+        compact_(capacity);
+        segment_index = allocator_.allocate(required_length);
+    }
+    if (segment_index < 0) {
         LOG_WARN("Not enough free space for particle emitter");
         emitterPool_[index] = ParticleEmitter(settings, ParticleEmitter::Segment(capacity_, 0));
+        emitterMaterials_[index] = -1;
         emitters_.push_back(&emitterPool_[index]);
         return &emitterPool_[index];
     }
 
+    ParticleEmitter::Segment segment(segment_index, required_length);
     emitterPool_[index] = ParticleEmitter(settings, segment);
     emitterPool_[index].material = material;
     emitters_.push_back(&emitterPool_[index]);
-
-    EmitterShaderValues emitter_values = EmitterShaderValues{
-        .index_length = glm::ivec4(segment.index, segment.length, 0, 0),
-        .gravity = glm::vec4(settings.gravity, 0.0f),
-    };
-    emitterBuffer_->write(index * sizeof(EmitterShaderValues), &emitter_values, sizeof(emitter_values));
+    // resolved again when the material is loaded later
+    emitterMaterials_[index] = materials_.count(material) != 0 ? materials_.at(material).slot : -1;
 
     std::vector<GLuint> free_stack;
     free_stack.reserve(required_length);
@@ -283,6 +446,11 @@ ParticleEmitter *ParticleSystem::add(ParticleSettings settings, std::string mate
 }
 
 void ParticleSystem::remove(ParticleEmitter *emitter) {
+    if (cpu_) {
+        emitterMaterials_[cpu_->emitterIndex(emitter)] = -1;
+        cpu_->remove(emitter);
+        return;
+    }
     if (emitter == nullptr)
         PANIC("Emitter is nullptr");
     size_t index = emitter - &emitterPool_[0];
@@ -291,8 +459,11 @@ void ParticleSystem::remove(ParticleEmitter *emitter) {
 
     // Free segment and bookkeeping
     ParticleEmitter::Segment segment = emitter->segment();
-    freeSegment_(segment.index, segment.length);
+    allocator_.free(segment.index, segment.length);
     freeEmitterIndices_.push_back(index);
+    // a removed emitter must neither emit nor draw into its freed segment
+    emitter->enabled = false;
+    emitterMaterials_[index] = -1;
     emitters_.erase(std::remove(emitters_.begin(), emitters_.end(), emitter), emitters_.end());
 
     resetShader_->bind();
@@ -320,8 +491,12 @@ void ParticleSystem::loadMaterial(std::string name, ParticleMaterialParams param
     scale->allocate(1, GL_RG8, scale_image.width, scale_image.height);
     scale->load(0, scale_image.width, scale_image.height, GL_RGBA, GL_UNSIGNED_BYTE, scale_image.data.get());
 
+    int slot = static_cast<int>(materials_.size());
     if (materials_.count(name) != 0) {
+        slot = materials_.at(name).slot;
         materials_.at(name).destroy();
+    } else if (slot >= MAX_MATERIALS) {
+        PANIC("Maximum count of particle materials reached");
     }
 
     materials_[name] = ParticleMaterial{
@@ -329,92 +504,223 @@ void ParticleSystem::loadMaterial(std::string name, ParticleMaterialParams param
         .sprite = sprite,
         .tint = tint,
         .scale = scale,
+        .slot = slot,
     };
+
+    for (ParticleEmitter *emitter : emitters()) {
+        if (emitter->material != name) continue;
+        emitterMaterials_[emitterIndex_(emitter)] = slot;
+    }
 }
 
-void ParticleSystem::update(float time_delta) {
+void ParticleSystem::update(float time_delta, Camera &camera) {
     gl::pushDebugGroup("ParticleSystem::update");
-    emitShader_->bind();
-    for (int i = 0; i < emitterPool_.size(); i++) {
+    Frustum frustum(camera.viewProjectionMatrix());
+    for (ParticleEmitter *emitter : emitters()) {
+        lodRates_[emitterIndex_(emitter)] = lod ? emitter->lodRate(frustum, camera.position) : 1.0f;
+    }
+
+    if (cpu_) {
+        cpu_->update(time_delta, lodRates_);
+        upload_();
+        gl::popDebugGroup();
+        return;
+    }
+
+    // Compact before the free space gets too fragmented, so `add` rarely has to do it.
+    // Only when an average emitter wouldn't fit anymore, but would fit after compacting, so it doesn't repeat every frame.
+    if (!emitters_.empty() && allocator_.fragmentation() > COMPACT_FRAGMENTATION) {
+        int average_length = allocator_.reserved() / static_cast<int>(emitters_.size());
+        int free = capacity_ - allocator_.reserved();
+        if (allocator_.largestFree() < average_length && free >= average_length) {
+            compact_(capacity_);
+        }
+    }
+
+    emissions_.clear();
+    drawCommands_.assign(materials_.size(), {.count = 4, .instanceCount = 0, .first = 0, .baseInstance = 0});
+    for (size_t i = 0; i < emitterPool_.size(); i++) {
         ParticleEmitter &emitter = emitterPool_[i];
         ParticleSettings &settings = emitter.settings();
+        ParticleEmitter::Segment segment = emitter.segment();
+
+        // The values are rewritten every frame, so changes to the settings apply immediately.
+        // Particles of disabled emitters are still simulated, but not drawn.
+        int material = emitter.enabled ? emitterMaterials_[i] : -1;
+        emitterValues_[i] = {
+            .index_length = glm::ivec4(segment.index, segment.length, material, 0),
+            .gravity = glm::vec4(settings.gravity, 0.0f),
+            .emissivity_stretching = glm::vec4(settings.emissivity, settings.stretching, 0.0f, 0.0f),
+        };
+        // reserve room for the whole segment, for now the base instance holds the length of the material's range
+        if (material >= 0) drawCommands_[material].baseInstance += segment.length;
 
-        if (!emitter.enabled)
+        if (!emitter.enabled) {
+            emitter.pause(time_delta);
             continue;
+        }
 
-        emitter.update(time_delta);
+        if (lodRates_[i] > 0.0f) {
+            emitter.update(time_delta, lodRates_[i]);
+        } else {
+            emitter.pause(time_delta);
+        }
         int count = emitter.intervalCount();
         if (count == 0) continue;
 
-        Emission emission = {
+        emissions_.push_back({
             .direction = glm::vec4(glm::normalize(settings.direction), 0.0),
-            .spread = glm::vec2(glm::radians(settings.spread.min), glm::radians(settings.spread.max)),
-            .velocity = glm::vec2(settings.velocity.min, settings.velocity.max),
-            .life = glm::vec2(settings.life.min, settings.life.max),
-            .position = settings.position,
+            .position = glm::vec4(settings.position, 0.0),
+            .spread_velocity = glm::vec4(glm::radians(settings.spread.min), glm::radians(settings.spread.max), settings.velocity.min, settings.velocity.max),
+            .life_size = glm::vec4(settings.life.min, settings.life.max, settings.size),
             .rotation_revolutions = glm::vec4(settings.rotation.min, settings.rotation.max, settings.revolutions.min / 60.0f, settings.revolutions.max / 60.0f),
-            .size = settings.size,
-            .scale = glm::vec2(settings.scale.min, settings.scale.max),
-            .drag = glm::vec2(settings.drag.min, settings.drag.max),
-            .gravity = glm::vec2(settings.gravityFactor.min, settings.gravityFactor.max),
-            .index = i,
-            .count = count,
-        };
-
-        emit_(emission);
+            .scale_drag = glm::vec4(settings.scale.min, settings.scale.max, settings.drag.min, settings.drag.max),
+            .gravity = glm::vec4(settings.gravityFactor.min, settings.gravityFactor.max, 0.0, 0.0),
+            .index_count_group = glm::ivec4(static_cast<int>(i), count, 0, 0),
+        });
+    }
+    emitterBuffer_->write(0, emitterValues_.data(), emitterValues_.size() * sizeof(EmitterShaderValues));
+
+    // The segments don't overlap, so the ranges of all materials fit into the draw index buffer
+    GLuint first_index = 0;
+    for (gl::DrawArraysIndirectCommand &command : drawCommands_) {
+        GLuint length = command.baseInstance;
+        command.baseInstance = first_index;
+        first_index += length;
     }
+    if (!drawCommands_.empty()) {
+        drawCommandBuffer_->write(0, drawCommands_.data(), drawCommands_.size() * sizeof(gl::DrawArraysIndirectCommand));
+    }
+
+    emit_();
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
+    // Only the segments of emitters that may have live particles are simulated, each with its own workgroups
+    updateSegments_.clear();
+    int group_count = 0;
+    for (ParticleEmitter *emitter : emitters_) {
+        ParticleEmitter::Segment segment = emitter->segment();
+        if (segment.length == 0 || emitter->dormant()) continue;
+        updateSegments_.push_back(glm::ivec4(segment.index, segment.length, group_count, 0));
+        group_count += DIV_CEIL(segment.length, 64);
+    }
+    if (updateSegments_.empty()) {
+        gl::popDebugGroup();
+        return;
+    }
+    updateSegmentBuffer_->write(0, updateSegments_.data(), updateSegments_.size() * sizeof(glm::ivec4));
+
     updateShader_->bind();
     updateShader_->get(GL_COMPUTE_SHADER)->setUniform("u_time_delta", time_delta);
+    updateShader_->get(GL_COMPUTE_SHADER)->setUniform("u_segment_count", static_cast<int>(updateSegments_.size()));
 
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffer_->id());
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, freeBuffer_->id());
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, freeHeadsBuffer_->id());
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, emitterBuffer_->id());
-    glDispatchCompute(DIV_CEIL(capacity_, 64), 1, 1);
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, drawCommandBuffer_->id());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, drawIndexBuffer_->id());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, updateSegmentBuffer_->id());
+    glDispatchCompute(group_count, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
     gl::popDebugGroup();
 }
 
+void ParticleSystem::upload_() {
+    const CpuParticleSystem::Particles &particles = cpu_->particles();
+    if (cpu_->capacity() > capacity_) {
+        capacity_ = cpu_->capacity();
+        delete particleBuffer_;
+        particleBuffer_ = createParticleBuffer(capacity_);
+        delete drawIndexBuffer_;
+        drawIndexBuffer_ = createDrawIndexBuffer(capacity_, true);
+        quad_->reBindBuffer(1, *drawIndexBuffer_);
+    }
+
+    // Count the live particles of each material for the ranges, then pack them in that order
+    std::vector<ParticleEmitter *> emitters = cpu_->emitters();
+    drawCommands_.assign(materials_.size(), {.count = 4, .instanceCount = 0, .first = 0, .baseInstance = 0});
+    for (ParticleEmitter *emitter : emitters) {
+        int index = cpu_->emitterIndex(emitter);
+        ParticleSettings &settings = emitter->settings();
+        int material = emitter->enabled ? emitterMaterials_[index] : -1;
+        emitterValues_[index] = {
+            .index_length = glm::ivec4(emitter->segment().index, emitter->segment().length, material, 0),
+            .gravity = glm::vec4(settings.gravity, 0.0f),
+            .emissivity_stretching = glm::vec4(settings.emissivity, settings.stretching, 0.0f, 0.0f),
+        };
+        if (material >= 0) drawCommands_[material].baseInstance += cpu_->aliveCount(emitter);
+    }
+    GLuint first_index = 0;
+    for (gl::DrawArraysIndirectCommand &command : drawCommands_) {
+        GLuint length = command.baseInstance;
+        command.baseInstance = first_index;
+        first_index += length;
+    }
+
+    uploadParticles_.resize(first_index);
+    for (ParticleEmitter *emitter : emitters) {
+        int material = emitterValues_[cpu_->emitterIndex(emitter)].index_length.z;
+        if (material < 0) continue;
+        gl::DrawArraysIndirectCommand &command = drawCommands_[material];
+        int begin = emitter->segment().index;
+        int end = begin + emitter->segment().length;
+        for (int i = begin; i < end; i++) {
+            if (particles.life[i] <= 0.0f) continue;
+            uploadParticles_[command.baseInstance + command.instanceCount++] = {
+                .position_rotation = glm::vec4(particles.x[i], particles.y[i], particles.z[i], particles.rotation[i]),
+                .velocity_revolutions = glm::vec4(particles.vx[i], particles.vy[i], particles.vz[i], particles.revolutions[i]),
+                .drag_gravity_rand = glm::vec4(particles.drag[i], particles.gravity[i], particles.random[i], 0.0f),
+                .size_life = glm::vec4(particles.width[i], particles.height[i], particles.life[i], particles.lifeMax[i]),
+                .emitter = particles.emitter[i],
+                .padding = {},
+            };
+        }
+    }
+
+    emitterBuffer_->write(0, emitterValues_.data(), emitterValues_.size() * sizeof(EmitterShaderValues));
+    if (!uploadParticles_.empty()) {
+        particleBuffer_->write(0, uploadParticles_.data(), uploadParticles_.size() * sizeof(Particle));
+    }
+    if (!drawCommands_.empty()) {
+        drawCommandBuffer_->write(0, drawCommands_.data(), drawCommands_.size() * sizeof(gl::DrawArraysIndirectCommand));
+    }
+}
+
 void ParticleSystem::draw(Camera &camera) {
     gl::pushDebugGroup("ParticleSystem::draw");
-    gl::manager->setEnabled({gl::Capability::DepthTest, gl::Capability::Blend});
-    gl::manager->depthFunc(gl::DepthFunc::GreaterOrEqual);
-    gl::manager->depthMask(true);
-    gl::manager->blendEquation(gl::BlendEquation::FuncAdd);
-
     drawShader_->bind();
     quad_->bind();
     drawShader_->get(GL_VERTEX_SHADER)->setUniform("u_projection_mat", camera.projectionMatrix());
     drawShader_->get(GL_VERTEX_SHADER)->setUniform("u_view_mat", camera.viewMatrix());
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffer_->id());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, emitterBuffer_->id());
+    drawCommandBuffer_->bind(GL_DRAW_INDIRECT_BUFFER);
 
     spriteSampler_->bind(0);
     tableSampler_->bind(1);
     tableSampler_->bind(2);
 
-    for (auto &&emitter : emitterPool_) {
-        if (!emitter.enabled)
-            continue;
-        if (materials_.count(emitter.material) == 0)
+    for (auto &&entry : materials_) {
+        ParticleMaterial &material = entry.second;
+        // the material was loaded after the last update
+        if (material.slot < 0 || static_cast<size_t>(material.slot) >= drawCommands_.size())
             continue;
-        ParticleMaterial &material = materials_.at(emitter.material);
         switch (material.blending) {
             case ParticleBlending::Additive:
-                gl::manager->blendFuncSeparate(gl::BlendFactor::One, gl::BlendFactor::One, gl::BlendFactor::One, gl::BlendFactor::Zero);
+                gl::manager->apply(ADDITIVE_PIPELINE_STATE);
                 break;
             case ParticleBlending::AlphaClip:
-                gl::manager->blendFuncSeparate(gl::BlendFactor::One, gl::BlendFactor::Zero, gl::BlendFactor::One, gl::BlendFactor::Zero);
+                gl::manager->apply(ALPHA_CLIP_PIPELINE_STATE);
+                break;
+            case ParticleBlending::None:
+                gl::manager->apply(OPAQUE_PIPELINE_STATE);
                 break;
         }
         material.sprite->bind(0);
         material.tint->bind(1);
         material.scale->bind(2);
-        drawShader_->get(GL_VERTEX_SHADER)->setUniform("u_base_index", emitter.segment().index);
-        drawShader_->get(GL_VERTEX_SHADER)->setUniform("u_emissivity", emitter.settings().emissivity);
-        drawShader_->get(GL_VERTEX_SHADER)->setUniform("u_stretching", emitter.settings().stretching);
-        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, emitter.segment().length);
+        glDrawArraysIndirect(GL_TRIANGLE_STRIP, reinterpret_cast<const void *>(material.slot * sizeof(gl::DrawArraysIndirectCommand)));
     }
     gl::popDebugGroup();
 }
\ No newline at end of file
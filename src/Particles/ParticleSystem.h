@@ -3,12 +3,16 @@
 #include <array>
 #include <glm/glm.hpp>
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "../Camera.h"
 #include "../GL/Declarations.h"
+#include "../GL/Indirect.h"
+#include "../Renderer/Culling.h"
+#include "SegmentAllocator.h"
 
 // Referece:
 // https://juandiegomontoya.github.io/particles.html
@@ -32,6 +36,16 @@ struct Range {
     }
 };
 
+enum class ParticleBackend {
+    // compute shaders
+    Gpu,
+    // `CpuParticleSystem`, the particles are uploaded every frame for drawing
+    Cpu,
+};
+
+// @returns the backend with the name `gpu` or `cpu`
+ParticleBackend parseParticleBackend(std::string name);
+
 enum class ParticleBlending {
     None,
     AlphaClip,
@@ -43,6 +57,8 @@ struct ParticleMaterial {
     gl::Texture *sprite = nullptr;
     gl::Texture *tint = nullptr;
     gl::Texture *scale = nullptr;
+    // index of the material's draw command, stays the same when the material is reloaded
+    int slot = -1;
 
     void destroy();
 };
@@ -88,10 +104,16 @@ class ParticleEmitter {
     };
 
    private:
+    // the particle systems move the segment when they compact their particles
+    friend class ParticleSystem;
+    friend class CpuParticleSystem;
+
     Segment segment_ = Segment(-1, 0);
     float timer_ = 0;
     int count_ = 0;
     float interval_ = 0;
+    // the time since the emitter last emitted
+    float idle_ = 0;
     ParticleSettings settings_;
 
    public:
@@ -120,26 +142,69 @@ class ParticleEmitter {
         return count_;
     }
 
+    // Whether all particles of the emitter are dead, because it did not emit for longer than they live
+    bool dormant() const {
+        return idle_ > settings_.life.max;
+    }
+
     ParticleSettings &settings() {
         return settings_;
     }
 
-    void update(float time_delta);
+    /**
+     * Determine the particles to emit this frame.
+     * @param rate scales the emission frequency, see `lodRate`
+     */
+    void update(float time_delta, float rate = 1.0f);
+
+    // Emit nothing this frame
+    void pause(float time_delta);
+
+    /**
+     * @returns the emission rate for the level of detail, it falls off with the distance to the camera.
+     * Zero when no particle can be inside the frustum.
+     */
+    float lodRate(const Frustum &frustum, glm::vec3 camera_position) const;
 };
 
+struct Particle;
 struct Emission;
-
+struct EmitterShaderValues;
+class CpuParticleSystem;
+
+/**
+ * Simulates the particles on the gpu, each emitter has its own segment of the particle buffer.
+ *
+ * The update pass appends the live particles of each material to that material's range of the draw index buffer
+ * and counts them in the material's draw command. So every material is drawn with a single indirect draw
+ * and dead particles are never processed by the vertex shader.
+ *
+ * With the cpu backend the particles are simulated by a `CpuParticleSystem` instead,
+ * its live particles are uploaded in draw order every frame and drawn the same way.
+ *
+ * Emitters far from the camera emit less often and emitters outside of its frustum pause.
+ * The segments of dormant emitters don't have any live particles, so they are not simulated.
+ */
 class ParticleSystem {
    public:
     static const int MAX_EMITTERS = 256;
+    static const int MAX_MATERIALS = 16;
 
    private:
     int capacity_;
-    int reserved_ = 0;
+    SegmentAllocator allocator_;
     gl::Buffer *particleBuffer_;
     gl::Buffer *freeBuffer_;
     gl::Buffer *freeHeadsBuffer_;
     gl::Buffer *emitterBuffer_;
+    // the emissions of a frame, at most one per emitter
+    gl::Buffer *emissionBuffer_;
+    // the segments of the emitters that are not dormant
+    gl::Buffer *updateSegmentBuffer_;
+    // one draw command per material, the instances are counted by the update pass
+    gl::Buffer *drawCommandBuffer_;
+    // the indices of the live particles, grouped by material
+    gl::Buffer *drawIndexBuffer_;
     gl::ShaderPipeline *emitShader_;
     gl::ShaderPipeline *updateShader_;
     gl::ShaderPipeline *drawShader_;
@@ -147,19 +212,45 @@ class ParticleSystem {
     gl::VertexArray *quad_;
     gl::Sampler *spriteSampler_;
     gl::Sampler *tableSampler_;
-    std::vector<std::pair<int, int>> segmentation_;
     std::array<ParticleEmitter, MAX_EMITTERS> emitterPool_;
     std::vector<ParticleEmitter *> emitters_;
     std::vector<int> freeEmitterIndices_;
     std::map<std::string, ParticleMaterial> materials_;
-
-    void emit_(Emission &emission);
-
-    std::pair<int, int> allocateSegment_(int length);
-    void freeSegment_(int index, int length);
+    // the material slot of each emitter or -1
+    std::array<int, MAX_EMITTERS> emitterMaterials_;
+    // the emitter values, rewritten every frame
+    std::vector<EmitterShaderValues> emitterValues_;
+    // the draw commands of each material slot, reset every frame
+    std::vector<gl::DrawArraysIndirectCommand> drawCommands_;
+    // the emissions of the current frame, reused every frame
+    std::vector<Emission> emissions_;
+    // segment index, segment length and first workgroup of each simulated segment, reused every frame
+    std::vector<glm::ivec4> updateSegments_;
+    // the emission rate of each emitter, see `ParticleEmitter::lodRate`
+    std::array<float, MAX_EMITTERS> lodRates_;
+    // only with the cpu backend
+    std::unique_ptr<CpuParticleSystem> cpu_;
+    // the live particles of the cpu backend, grouped by material, reused every frame
+    std::vector<Particle> uploadParticles_;
+
+    // Emit the particles of all emissions with a single dispatch
+    void emit_();
+
+    // Upload the live particles of the cpu backend with their draw commands
+    void upload_();
+
+    int emitterIndex_(const ParticleEmitter *emitter) const;
+
+    /**
+     * Move the segments of all emitters to the start of the particle buffers, which removes the gaps between them.
+     * The particles and free stacks are copied on the gpu, the emitter values are rewritten by the next `update`.
+     * The segments are moved within the current buffers, new buffers are only created when the capacity changes.
+     * @param capacity the capacity of the buffers, at least the reserved size
+     */
+    void compact_(int capacity);
 
    public:
-    ParticleSystem(int capacity);
+    ParticleSystem(int capacity, ParticleBackend backend = ParticleBackend::Gpu);
 
     ~ParticleSystem();
 
@@ -169,21 +260,18 @@ class ParticleSystem {
 
     void loadMaterial(std::string name, ParticleMaterialParams params);
 
-    void update(float time_delta);
+    // lower the emission rate with the distance to the camera and pause emitters outside of its frustum
+    bool lod = true;
+
+    void update(float time_delta, Camera &camera);
 
     void draw(Camera &camera);
 
-    int capacity() const {
-        return capacity_;
-    }
+    int capacity() const;
 
-    int reserved() const {
-        return reserved_;
-    }
+    int reserved() const;
 
-    std::vector<ParticleEmitter *> emitters() {
-        return emitters_;
-    }
+    std::vector<ParticleEmitter *> emitters();
 
     std::map<std::string, ParticleMaterial> &materials() {
         return materials_;
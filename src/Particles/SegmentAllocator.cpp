@@ -0,0 +1,68 @@
+#include "SegmentAllocator.h"
+
+SegmentAllocator::SegmentAllocator(int capacity) {
+    reset(capacity, 0);
+}
+
+void SegmentAllocator::insertFree_(int start, int length) {
+    freeByStart_[start] = length;
+    freeByLength_.insert({length, start});
+}
+
+void SegmentAllocator::eraseFree_(int start, int length) {
+    freeByStart_.erase(start);
+    freeByLength_.erase({length, start});
+}
+
+int SegmentAllocator::allocate(int length) {
+    if (length <= 0) return -1;
+
+    // the smallest free segment with at least `length`, the lowest start wins ties
+    auto it = freeByLength_.lower_bound({length, 0});
+    if (it == freeByLength_.end()) return -1;
+
+    auto [free_length, start] = *it;
+    eraseFree_(start, free_length);
+    if (free_length > length) {
+        insertFree_(start + length, free_length - length);
+    }
+    reserved_ += length;
+    return start;
+}
+
+void SegmentAllocator::free(int start, int length) {
+    if (length <= 0) return;
+    reserved_ -= length;
+
+    // merge with the next free segment
+    auto next = freeByStart_.find(start + length);
+    if (next != freeByStart_.end()) {
+        int next_length = next->second;
+        eraseFree_(start + length, next_length);
+        length += next_length;
+    }
+
+    // merge with the previous free segment
+    auto prev = freeByStart_.lower_bound(start);
+    if (prev != freeByStart_.begin()) {
+        prev--;
+        auto [prev_start, prev_length] = *prev;
+        if (prev_start + prev_length == start) {
+            eraseFree_(prev_start, prev_length);
+            start = prev_start;
+            length += prev_length;
+        }
+    }
+
+    insertFree_(start, length);
+}
+
+void SegmentAllocator::reset(int capacity, int reserved) {
+    capacity_ = capacity;
+    reserved_ = reserved;
+    freeByStart_.clear();
+    freeByLength_.clear();
+    if (capacity > reserved) {
+        insertFree_(reserved, capacity - reserved);
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <utility>
+
+/**
+ * Allocates segments of a linear range, like the particle buffer.
+ * The free segments are kept ordered by their start, to merge them with their neighbors,
+ * and by their length, to find the best fitting one. So allocating and freeing take O(log n).
+ * Unlike TLSF the search is exact instead of using size classes, there are few enough segments for that.
+ *
+ * References:
+ * - [TLSF](http://www.gii.upv.es/tlsf/files/papers/ecrts04_tlsf.pdf)
+ */
+class SegmentAllocator {
+   private:
+    int capacity_ = 0;
+    int reserved_ = 0;
+    // start -> length
+    std::map<int, int> freeByStart_;
+    // (length, start), ordered by length first
+    std::set<std::pair<int, int>> freeByLength_;
+
+    void insertFree_(int start, int length);
+    void eraseFree_(int start, int length);
+
+   public:
+    SegmentAllocator() = default;
+    SegmentAllocator(int capacity);
+
+    /**
+     * Allocate a segment from the smallest free segment that is large enough.
+     * @returns the start of the segment or -1 if no free segment is large enough
+     */
+    int allocate(int length);
+
+    // Free a segment and merge it with its free neighbors
+    void free(int start, int length);
+
+    /**
+     * Forget all segments and reserve `[0, reserved)`, used after the segments have been packed.
+     * @param capacity the new capacity, can be larger than before
+     */
+    void reset(int capacity, int reserved);
+
+    int capacity() const {
+        return capacity_;
+    }
+
+    int reserved() const {
+        return reserved_;
+    }
+
+    // @returns the length of the largest free segment
+    int largestFree() const {
+        return freeByLength_.empty() ? 0 : freeByLength_.rbegin()->first;
+    }
+
+    /**
+     * @returns how much of the free space is not part of the largest free segment, from 0 to 1.
+     * Zero means that all free space is in one segment.
+     */
+    float fragmentation() const {
+        int free = capacity_ - reserved_;
+        return free == 0 ? 0.0f : 1.0f - static_cast<float>(largestFree()) / static_cast<float>(free);
+    }
+};
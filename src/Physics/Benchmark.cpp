@@ -0,0 +1,92 @@
+#include "Benchmark.h"
+
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/Body/BodyLock.h>
+#include <Jolt/Physics/Collision/Shape/BoxShape.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+
+#include "../Util/Log.h"
+#include "Physics.h"
+
+namespace ph {
+
+static void copyStaticBodies(JPH::PhysicsSystem &source, JPH::PhysicsSystem &target);
+
+static BenchmarkResult runBenchmark(const Physics &physics, glm::vec3 center, uint32_t body_count, int steps, bool multithreaded);
+
+static void copyStaticBodies(JPH::PhysicsSystem &source, JPH::PhysicsSystem &target) {
+    JPH::BodyIDVector ids;
+    source.GetBodies(ids);
+
+    JPH::BodyInterface &interface = target.GetBodyInterfaceNoLock();
+    for (JPH::BodyID id : ids) {
+        JPH::BodyLockRead lock(source.GetBodyLockInterface(), id);
+        if (!lock.Succeeded() || !lock.GetBody().IsStatic()) continue;
+        // shapes are immutable, so both systems can share them
+        interface.CreateAndAddBody(lock.GetBody().GetBodyCreationSettings(), JPH::EActivation::DontActivate);
+    }
+}
+
+static BenchmarkResult runBenchmark(const Physics &physics, glm::vec3 center, uint32_t body_count, int steps, bool multithreaded) {
+    PhysicsSetupConfig config = {};
+    config.multithreaded = multithreaded;
+    config.maxBodies = physics.system->GetNumBodies() + body_count;
+    config.maxBodyPairs = std::max(config.maxBodyPairs, body_count * 8);
+    config.maxContactConstraints = std::max(config.maxContactConstraints, body_count * 8);
+
+    std::unique_ptr<JPH::PhysicsSystem> system(physics.createSystem(config));
+    std::unique_ptr<JPH::JobSystem> job_system(Physics::createJobSystem(config));
+    JPH::TempAllocatorImpl temp_allocator(32 * 1024 * 1024);
+
+    copyStaticBodies(*physics.system, *system);
+
+    // stack crates in a square grid above the center, so they pile up on the course
+    JPH::BodyInterface &interface = system->GetBodyInterfaceNoLock();
+    JPH::RefConst<JPH::Shape> crate = new JPH::BoxShape(JPH::Vec3::sReplicate(0.5f));
+    const float spacing = 1.5f;
+    uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(body_count) / 4.0f)));
+    side = std::max(side, 1u);
+    for (uint32_t i = 0; i < body_count; i++) {
+        uint32_t x = i % side;
+        uint32_t z = (i / side) % side;
+        uint32_t y = i / (side * side);
+        glm::vec3 offset = {(x - side / 2.0f) * spacing, 5.0f + y * spacing, (z - side / 2.0f) * spacing};
+        glm::vec3 position = center + offset;
+        JPH::BodyCreationSettings settings(crate, convert(position), JPH::Quat::sIdentity(), JPH::EMotionType::Dynamic, Layers::MOVING);
+        interface.CreateAndAddBody(settings, JPH::EActivation::Activate);
+    }
+    system->OptimizeBroadPhase();
+
+    BenchmarkResult result = {.bodies = body_count, .multithreaded = multithreaded};
+    double total = 0;
+    for (int i = 0; i < steps; i++) {
+        auto start = std::chrono::steady_clock::now();
+        system->Update(Physics::UPDATE_INTERVAL, 2, &temp_allocator, job_system.get());
+        auto end = std::chrono::steady_clock::now();
+
+        float duration = std::chrono::duration<float, std::milli>(end - start).count();
+        total += duration;
+        result.max = std::max(result.max, duration);
+    }
+    result.average = static_cast<float>(total / std::max(steps, 1));
+    return result;
+}
+
+std::vector<BenchmarkResult> benchmark(const Physics &physics, glm::vec3 center, const std::vector<uint32_t> &body_counts, int steps) {
+    std::vector<BenchmarkResult> results;
+    for (uint32_t body_count : body_counts) {
+        for (bool multithreaded : {false, true}) {
+            BenchmarkResult result = runBenchmark(physics, center, body_count, steps, multithreaded);
+            LOG_INFO("Physics benchmark: " << result.bodies << " bodies, " << (result.multithreaded ? "multithreaded" : "single threaded")
+                                           << ", avg " << result.average << " ms, max " << result.max << " ms");
+            results.push_back(result);
+        }
+    }
+    return results;
+}
+
+}  // namespace ph
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace ph {
+
+class Physics;
+
+struct BenchmarkResult {
+    // dynamic bodies dropped onto the course
+    uint32_t bodies = 0;
+    bool multithreaded = false;
+    // step durations in milliseconds
+    float average = 0;
+    float max = 0;
+};
+
+/**
+ * Steps a copy of the static bodies of `physics` (i.e. the loaded course) with crates dropped onto it around `center`.
+ * Every body count is measured single threaded and on the engine's workers. Blocks until done.
+ */
+std::vector<BenchmarkResult> benchmark(const Physics &physics, glm::vec3 center, const std::vector<uint32_t> &body_counts, int steps);
+
+}  // namespace ph
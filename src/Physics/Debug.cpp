@@ -31,6 +31,32 @@ bool assertFailedCallback(const char *expression, const char *message, const cha
 #endif  // JPH_ENABLE_ASSERTS
 
 #ifdef JPH_DEBUG_RENDERER
+static const gl::PipelineState CULL_BACK_PIPELINE_STATE = {
+    .capabilities = gl::capabilityBits({gl::Capability::DepthTest, gl::Capability::Blend, gl::Capability::CullFace}),
+    .cullFace = GL_BACK,
+    .blendSrcRgb = gl::BlendFactor::SrcAlpha,
+    .blendDstRgb = gl::BlendFactor::OneMinusSrcAlpha,
+    .blendSrcAlpha = gl::BlendFactor::SrcAlpha,
+    .blendDstAlpha = gl::BlendFactor::OneMinusSrcAlpha,
+};
+
+static const gl::PipelineState CULL_FRONT_PIPELINE_STATE = {
+    .capabilities = CULL_BACK_PIPELINE_STATE.capabilities,
+    .cullFace = GL_FRONT,
+    .blendSrcRgb = gl::BlendFactor::SrcAlpha,
+    .blendDstRgb = gl::BlendFactor::OneMinusSrcAlpha,
+    .blendSrcAlpha = gl::BlendFactor::SrcAlpha,
+    .blendDstAlpha = gl::BlendFactor::OneMinusSrcAlpha,
+};
+
+static const gl::PipelineState CULL_OFF_PIPELINE_STATE = {
+    .capabilities = gl::capabilityBits({gl::Capability::DepthTest, gl::Capability::Blend}),
+    .blendSrcRgb = gl::BlendFactor::SrcAlpha,
+    .blendDstRgb = gl::BlendFactor::OneMinusSrcAlpha,
+    .blendSrcAlpha = gl::BlendFactor::SrcAlpha,
+    .blendDstAlpha = gl::BlendFactor::OneMinusSrcAlpha,
+};
+
 DebugRendererImpl::DebugRendererImpl() {
     vao_ = new gl::VertexArray();
     vao_->setDebugLabel("physics/debug/vao");
@@ -151,11 +177,6 @@ void DebugRendererImpl::Draw(glm::mat4 view_projection_matrix) {
     gl::pushDebugGroup("JoltDebugRenderer::Draw");
     shader_->vertexStage()->setUniform("u_view_projection_mat", view_projection_matrix);
 
-    gl::manager->setEnabled({gl::Capability::DepthTest, gl::Capability::Blend, gl::Capability::CullFace});
-    gl::manager->depthFunc(gl::DepthFunc::GreaterOrEqual);
-    gl::manager->depthMask(true);
-    gl::manager->blendEquation(gl::BlendEquation::FuncAdd);
-    gl::manager->blendFunc(gl::BlendFactor::SrcAlpha, gl::BlendFactor::OneMinusSrcAlpha);
     vao_->bind();
     shader_->bind();
     for (auto &&cmd : drawQueue_) {
@@ -169,11 +190,11 @@ void DebugRendererImpl::Draw(glm::mat4 view_projection_matrix) {
         }
 
         if (cmd.cullMode == ECullMode::CullFrontFace) {
-            gl::manager->cullFront();
+            gl::manager->apply(CULL_FRONT_PIPELINE_STATE);
         } else if (cmd.cullMode == ECullMode::CullBackFace) {
-            gl::manager->cullBack();
+            gl::manager->apply(CULL_BACK_PIPELINE_STATE);
         } else {
-            gl::manager->disable(gl::Capability::CullFace);
+            gl::manager->apply(CULL_OFF_PIPELINE_STATE);
         }
 
         glDrawElementsBaseVertex(GL_TRIANGLES, cmd.batch->count(), GL_UNSIGNED_INT, cmd.batch->indexOffset(), cmd.batch->baseVertex());
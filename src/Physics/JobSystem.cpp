@@ -0,0 +1,66 @@
+#include "JobSystem.h"
+
+#include <thread>
+
+#include "../Util/Jobs.h"
+#include "../Util/Log.h"
+
+namespace ph {
+
+EngineJobSystem::EngineJobSystem(jobs::JobSystem &jobs, JPH::uint max_jobs, JPH::uint max_barriers)
+    : JPH::JobSystemWithBarrier(max_barriers), jobs_(jobs) {
+    available_.Init(max_jobs, max_jobs);
+}
+
+EngineJobSystem::~EngineJobSystem() {
+    // A barrier may have already executed a job that is still queued in the engine, it releases the job later
+    while (inFlight_.load() > 0) {
+        std::this_thread::yield();
+    }
+}
+
+int EngineJobSystem::GetMaxConcurrency() const {
+    // the workers and the thread that steps the physics system
+    return static_cast<int>(jobs_.workerCount()) + 1;
+}
+
+JPH::JobSystem::JobHandle EngineJobSystem::CreateJob(const char *name, JPH::ColorArg color, const JobFunction &function, JPH::uint32 dependencies) {
+    JPH::uint32 index = available_.ConstructObject(name, color, this, function, dependencies);
+    if (index == AvailableJobs::cInvalidObjectIndex) {
+        PANIC("Out of physics jobs, increase PhysicsSetupConfig::maxJobs");
+    }
+    Job *job = &available_.Get(index);
+
+    // The handle keeps a reference, the job may complete right after it is queued
+    JobHandle handle(job);
+    if (dependencies == 0) {
+        QueueJob(job);
+    }
+    return handle;
+}
+
+void EngineJobSystem::QueueJob(Job *job) {
+    // the queued job holds a reference until it has run
+    job->AddRef();
+    inFlight_.fetch_add(1);
+    jobs_.submit(
+        [this, job]() {
+            // does nothing if a barrier already executed the job
+            job->Execute();
+            job->Release();
+            inFlight_.fetch_sub(1);
+        },
+        {}, jobs::Priority::High);
+}
+
+void EngineJobSystem::QueueJobs(Job **jobs, JPH::uint count) {
+    for (JPH::uint i = 0; i < count; i++) {
+        QueueJob(jobs[i]);
+    }
+}
+
+void EngineJobSystem::FreeJob(Job *job) {
+    available_.DestructObject(job);
+}
+
+}  // namespace ph
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Jolt/Jolt.h>
+
+// Jolt includes
+#include <Jolt/Core/FixedSizeFreeList.h>
+#include <Jolt/Core/JobSystemWithBarrier.h>
+
+#include <atomic>
+
+#pragma region ForwardDecl
+namespace jobs {
+class JobSystem;
+}
+#pragma endregion
+
+namespace ph {
+
+/**
+ * Runs the physics jobs on the workers of the engine's job system, instead of a separate thread pool.
+ * Waiting on a barrier also runs the jobs of that barrier on the waiting thread.
+ * Modeled after `JPH::JobSystemThreadPool`.
+ */
+class EngineJobSystem final : public JPH::JobSystemWithBarrier {
+   private:
+    using AvailableJobs = JPH::FixedSizeFreeList<Job>;
+
+    jobs::JobSystem &jobs_;
+    AvailableJobs available_;
+    // jobs that were handed to the engine's job system, but not released yet
+    std::atomic<int> inFlight_{0};
+
+   protected:
+    void QueueJob(Job *job) override;
+    void QueueJobs(Job **jobs, JPH::uint count) override;
+    void FreeJob(Job *job) override;
+
+   public:
+    EngineJobSystem(jobs::JobSystem &jobs, JPH::uint max_jobs, JPH::uint max_barriers);
+    ~EngineJobSystem() override;
+
+    int GetMaxConcurrency() const override;
+
+    JobHandle CreateJob(const char *name, JPH::ColorArg color, const JobFunction &function, JPH::uint32 dependencies = 0) override;
+};
+
+}  // namespace ph
@@ -2,6 +2,8 @@
 
 #include <mutex>
 
+#include "../Util/Jobs.h"
+
 namespace ph {
 
 bool SensorContactListener::CanLayerReceiveCallbacks_(const JPH::ObjectLayer &layer) {
@@ -27,6 +29,7 @@ void SensorContactListener::OnContactPersisted(const JPH::Body &body_a, const JP
 }
 
 void SensorContactListener::RecordSensorContact(const JPH::BodyID sensor, const JPH::BodyID other, bool persistent) {
+    std::lock_guard<std::mutex> lock(recordMutex_);
     recordedSensorContacts_.push_back({sensor, other, persistent});
 }
 
@@ -97,38 +100,36 @@ Physics::Physics(PhysicsSetupConfig config) {
     tempAllocator_ = new JPH::TempAllocatorImpl(10 * 1024 * 1024);
 
     // The job system will execute physics jobs.
-    // For such a simple simulation a single threaded implementation should suffice.
-    jobSystem_ = new JPH::JobSystemSingleThreaded(JPH::cMaxPhysicsJobs);
+    jobSystem_ = createJobSystem(config);
 
     // Create class that filters object vs object layers
     // Note: As this is an interface, PhysicsSystem will take a reference to this so this instance needs to stay alive!
-    JPH::ObjectLayerPairFilterTable *obj_vs_obj_filter = new JPH::ObjectLayerPairFilterTable(Layers::NUM_LAYERS);
-    obj_vs_obj_filter->EnableCollision(Layers::MOVING, Layers::NON_MOVING);
-    obj_vs_obj_filter->EnableCollision(Layers::PLAYER, Layers::NON_MOVING);
-    obj_vs_obj_filter->EnableCollision(Layers::MOVING, Layers::MOVING);
-    obj_vs_obj_filter->EnableCollision(Layers::PLAYER, Layers::MOVING);
-    obj_vs_obj_filter->EnableCollision(Layers::MOVING, Layers::SENSOR);
-    obj_vs_obj_filter->EnableCollision(Layers::PLAYER, Layers::SENSOR);
+    objectVsObjectFilter_ = new JPH::ObjectLayerPairFilterTable(Layers::NUM_LAYERS);
+    objectVsObjectFilter_->EnableCollision(Layers::MOVING, Layers::NON_MOVING);
+    objectVsObjectFilter_->EnableCollision(Layers::PLAYER, Layers::NON_MOVING);
+    objectVsObjectFilter_->EnableCollision(Layers::MOVING, Layers::MOVING);
+    objectVsObjectFilter_->EnableCollision(Layers::PLAYER, Layers::MOVING);
+    objectVsObjectFilter_->EnableCollision(Layers::MOVING, Layers::SENSOR);
+    objectVsObjectFilter_->EnableCollision(Layers::PLAYER, Layers::SENSOR);
 
     // Create mapping table from object layer to broadphase layer
     // Note: As this is an interface, PhysicsSystem will take a reference to this so this instance needs to stay alive!
-    JPH::BroadPhaseLayerInterfaceTable *bp_layer_interface = new JPH::BroadPhaseLayerInterfaceTable(Layers::NUM_LAYERS, BroadPhaseLayers::NUM_LAYERS);
-    bp_layer_interface->MapObjectToBroadPhaseLayer(Layers::NON_MOVING, BroadPhaseLayers::NON_MOVING);
-    bp_layer_interface->MapObjectToBroadPhaseLayer(Layers::MOVING, BroadPhaseLayers::MOVING);
-    bp_layer_interface->MapObjectToBroadPhaseLayer(Layers::PLAYER, BroadPhaseLayers::MOVING);
-    bp_layer_interface->MapObjectToBroadPhaseLayer(Layers::SENSOR, BroadPhaseLayers::NON_MOVING);
+    broadPhaseLayerInterface_ = new JPH::BroadPhaseLayerInterfaceTable(Layers::NUM_LAYERS, BroadPhaseLayers::NUM_LAYERS);
+    broadPhaseLayerInterface_->MapObjectToBroadPhaseLayer(Layers::NON_MOVING, BroadPhaseLayers::NON_MOVING);
+    broadPhaseLayerInterface_->MapObjectToBroadPhaseLayer(Layers::MOVING, BroadPhaseLayers::MOVING);
+    broadPhaseLayerInterface_->MapObjectToBroadPhaseLayer(Layers::PLAYER, BroadPhaseLayers::MOVING);
+    broadPhaseLayerInterface_->MapObjectToBroadPhaseLayer(Layers::SENSOR, BroadPhaseLayers::NON_MOVING);
 
     // Create class that filters object vs broadphase layers
     // Note: As this is an interface, PhysicsSystem will take a reference to this so this instance needs to stay alive!
-    JPH::ObjectVsBroadPhaseLayerFilterTable *obj_vs_bp_filter = new JPH::ObjectVsBroadPhaseLayerFilterTable(
-        *bp_layer_interface,
+    objectVsBroadPhaseFilter_ = new JPH::ObjectVsBroadPhaseLayerFilterTable(
+        *broadPhaseLayerInterface_,
         BroadPhaseLayers::NUM_LAYERS,
-        *obj_vs_obj_filter,
+        *objectVsObjectFilter_,
         Layers::NUM_LAYERS);
 
     // Now we can create the actual physics system.
-    system = new JPH::PhysicsSystem();
-    system->Init(config.maxBodies, 0, config.maxBodyPairs, config.maxContactConstraints, *bp_layer_interface, *obj_vs_bp_filter, *obj_vs_obj_filter);
+    system = createSystem(config);
 
     contactListener = new SensorContactListener();
     system->SetContactListener(contactListener);
@@ -143,6 +144,9 @@ Physics::~Physics() {
     delete tempAllocator_;
     delete jobSystem_;
     delete contactListener;
+    delete objectVsBroadPhaseFilter_;
+    delete broadPhaseLayerInterface_;
+    delete objectVsObjectFilter_;
 
     // Destroy the factory
     if (JPH::Factory::sInstance == factory_) {
@@ -152,6 +156,19 @@ Physics::~Physics() {
     delete factory_;
 }
 
+JPH::PhysicsSystem *Physics::createSystem(PhysicsSetupConfig config) const {
+    JPH::PhysicsSystem *result = new JPH::PhysicsSystem();
+    result->Init(config.maxBodies, 0, config.maxBodyPairs, config.maxContactConstraints, *broadPhaseLayerInterface_, *objectVsBroadPhaseFilter_, *objectVsObjectFilter_);
+    return result;
+}
+
+JPH::JobSystem *Physics::createJobSystem(PhysicsSetupConfig config) {
+    if (config.multithreaded && jobs::pool != nullptr) {
+        return new EngineJobSystem(*jobs::pool, config.maxJobs, JPH::cMaxPhysicsBarriers);
+    }
+    return new JPH::JobSystemSingleThreaded(JPH::cMaxPhysicsJobs);
+}
+
 void Physics::update(float delta) {
     if (!updateEnabled_)
         return;
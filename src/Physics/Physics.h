@@ -5,7 +5,6 @@
 // Jolt includes
 #include <Jolt/Core/Factory.h>
 #include <Jolt/Core/JobSystemSingleThreaded.h>
-#include <Jolt/Core/JobSystemThreadPool.h>
 #include <Jolt/Core/TempAllocator.h>
 #include <Jolt/Geometry/Triangle.h>
 #include <Jolt/Physics/Body/BodyActivationListener.h>
@@ -20,9 +19,11 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <iostream>
+#include <mutex>
 #include <thread>
 
 #include "Debug.h"
+#include "JobSystem.h"
 #include "Layers.h"
 
 // References:
@@ -64,8 +65,10 @@ struct SensorContact {
 
 // The contact listener records all sensor contacts
 // It also provides a way to register sensor contact callbacks
+// Contacts are reported from the physics jobs, so recording must be thread safe
 class SensorContactListener : public JPH::ContactListener {
    private:
+    std::mutex recordMutex_;
     std::vector<SensorContact> recordedSensorContacts_ = {};
     std::unordered_map<JPH::BodyID, std::function<void(SensorContact)>> registeredSensors_ = {};
 
@@ -97,6 +100,12 @@ struct PhysicsSetupConfig {
     // This is the maximum size of the contact constraint buffer. If more contacts (collisions between bodies) are detected than this
     // number then these contacts will be ignored and bodies will start interpenetrating / fall through the world.
     uint32_t maxContactConstraints = 1024;
+
+    // Run the physics jobs on the workers of `jobs::pool`. Otherwise all of them run on the thread that calls `step`.
+    bool multithreaded = true;
+
+    // This is the max amount of physics jobs that can exist at the same time, only used when multithreaded.
+    uint32_t maxJobs = JPH::cMaxPhysicsJobs;
 };
 
 class Physics {
@@ -110,6 +119,11 @@ class Physics {
     JPH::TempAllocator *tempAllocator_ = nullptr;
     JPH::JobSystem *jobSystem_ = nullptr;
 
+    // PhysicsSystem only keeps references to the layer tables
+    JPH::ObjectLayerPairFilterTable *objectVsObjectFilter_ = nullptr;
+    JPH::BroadPhaseLayerInterfaceTable *broadPhaseLayerInterface_ = nullptr;
+    JPH::ObjectVsBroadPhaseLayerFilterTable *objectVsBroadPhaseFilter_ = nullptr;
+
 #ifdef JPH_DEBUG_RENDERER
     DebugRendererImpl *debugRenderer_ = nullptr;
 #endif
@@ -127,6 +141,12 @@ class Physics {
     Physics(PhysicsSetupConfig config = {});
     ~Physics();
 
+    // Creates an empty physics system with the same collision layers. The caller owns it.
+    JPH::PhysicsSystem *createSystem(PhysicsSetupConfig config) const;
+
+    // Creates the job system selected by `config`. The caller owns it.
+    static JPH::JobSystem *createJobSystem(PhysicsSetupConfig config);
+
     void update(float delta);
 
     // returns true when step() should be called
@@ -0,0 +1,302 @@
+#include "Culling.h"
+
+#include <algorithm>
+#include <chrono>
+#include <glm/gtc/matrix_transform.hpp>
+#include <numeric>
+#include <random>
+
+#include "../Util/Log.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CULLING_USE_SSE2
+#endif
+
+// Deep enough for any tree, the median split keeps it balanced
+const int32_t BVH_MAX_DEPTH = 64;
+
+AABB AABB::transform(const glm::mat4 &matrix) const {
+    glm::vec3 center = matrix * glm::vec4(this->center(), 1.0f);
+    // the extent of a rotated box is projected onto each axis
+    glm::mat3 abs_matrix = glm::mat3(glm::abs(glm::vec3(matrix[0])), glm::abs(glm::vec3(matrix[1])), glm::abs(glm::vec3(matrix[2])));
+    glm::vec3 extent = abs_matrix * this->extent();
+    return {.min = center - extent, .max = center + extent};
+}
+
+Frustum::Frustum(const glm::mat4 &view_projection) {
+    glm::mat4 m = glm::transpose(view_projection);
+    // The planes don't have to be normalized, the box test only uses the sign
+    glm::vec4 planes[6] = {
+        m[3] + m[0],  // left
+        m[3] - m[0],  // right
+        m[3] + m[1],  // bottom
+        m[3] - m[1],  // top
+        m[3] - m[2],  // near, the depth is reversed
+        m[2],         // far, never rejects anything with an infinite far plane
+    };
+    *this = Frustum(planes);
+}
+
+Frustum::Frustum(std::span<const glm::vec4> planes) {
+    int count = std::min(static_cast<int>(planes.size()), MAX_PLANES);
+    count_ = (count + 3) & ~3;
+    for (int i = 0; i < count_; i++) {
+        glm::vec4 plane = i < count ? planes[i] : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        x_[i] = plane.x;
+        y_[i] = plane.y;
+        z_[i] = plane.z;
+        w_[i] = plane.w;
+    }
+}
+
+FrustumTest Frustum::test(const AABB &box) const {
+    glm::vec3 c = box.center();
+    glm::vec3 e = box.extent();
+    // A box is outside if it is behind any plane and inside if it is in front of every plane.
+    // The distance of the box center is compared to the box's projected radius.
+    int outside = 0;
+    int intersecting = 0;
+#ifdef CULLING_USE_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+    const __m128 ex = _mm_set1_ps(e.x), ey = _mm_set1_ps(e.y), ez = _mm_set1_ps(e.z);
+    for (int i = 0; i < count_; i += 4) {
+        __m128 px = _mm_load_ps(x_ + i);
+        __m128 py = _mm_load_ps(y_ + i);
+        __m128 pz = _mm_load_ps(z_ + i);
+        __m128 pw = _mm_load_ps(w_ + i);
+
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)), _mm_add_ps(_mm_mul_ps(pz, cz), pw));
+        __m128 radius = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign, px), ex), _mm_mul_ps(_mm_andnot_ps(sign, py), ey)),
+            _mm_mul_ps(_mm_andnot_ps(sign, pz), ez));
+
+        outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+        intersecting |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), zero));
+    }
+#else
+    for (int i = 0; i < count_; i++) {
+        float distance = x_[i] * c.x + y_[i] * c.y + z_[i] * c.z + w_[i];
+        float radius = std::abs(x_[i]) * e.x + std::abs(y_[i]) * e.y + std::abs(z_[i]) * e.z;
+        outside |= distance + radius < 0.0f;
+        intersecting |= distance - radius < 0.0f;
+    }
+#endif
+    if (outside) return FrustumTest::Outside;
+    if (intersecting) return FrustumTest::Intersecting;
+    return FrustumTest::Inside;
+}
+
+void BVH::build(std::vector<AABB> bounds) {
+    bounds_ = std::move(bounds);
+    int32_t count = size();
+
+    nodes_.clear();
+    primitives_.resize(count);
+    std::iota(primitives_.begin(), primitives_.end(), 0);
+    leaves_.assign(count, -1);
+    anyDirty_ = false;
+    if (count == 0) {
+        dirty_.clear();
+        return;
+    }
+
+    nodes_.reserve(2 * (count / LEAF_SIZE + 1));
+    nodes_.push_back({.begin = 0, .end = count});
+    std::vector<int32_t> stack = {0};
+    while (!stack.empty()) {
+        int32_t node = stack.back();
+        stack.pop_back();
+        split_(node);
+
+        int32_t children = nodes_[node].children;
+        if (children < 0) continue;
+        stack.push_back(children);
+        stack.push_back(children + 1);
+    }
+    dirty_.assign(nodes_.size(), 0);
+}
+
+void BVH::split_(int32_t index) {
+    // `nodes_` may reallocate, no references are kept
+    int32_t begin = nodes_[index].begin;
+    int32_t end = nodes_[index].end;
+
+    AABB bounds = {};
+    AABB centers = {};
+    for (int32_t i = begin; i < end; i++) {
+        const AABB &primitive = bounds_[primitives_[i]];
+        bounds.merge(primitive);
+        centers.merge({.min = primitive.center(), .max = primitive.center()});
+    }
+    nodes_[index].bounds = bounds;
+
+    if (end - begin <= LEAF_SIZE) {
+        for (int32_t i = begin; i < end; i++) {
+            leaves_[primitives_[i]] = index;
+        }
+        return;
+    }
+
+    // median split along the longest axis of the centers
+    glm::vec3 size = centers.max - centers.min;
+    int axis = 0;
+    if (size.y > size[axis]) axis = 1;
+    if (size.z > size[axis]) axis = 2;
+
+    int32_t middle = begin + (end - begin) / 2;
+    std::nth_element(primitives_.begin() + begin, primitives_.begin() + middle, primitives_.begin() + end, [&](int32_t a, int32_t b) {
+        return bounds_[a].center()[axis] < bounds_[b].center()[axis];
+    });
+
+    int32_t children = static_cast<int32_t>(nodes_.size());
+    nodes_[index].children = children;
+    nodes_.push_back({.begin = begin, .end = middle, .parent = index});
+    nodes_.push_back({.begin = middle, .end = end, .parent = index});
+}
+
+void BVH::update(int32_t primitive, const AABB &bounds) {
+    bounds_[primitive] = bounds;
+    dirty_[leaves_[primitive]] = 1;
+    anyDirty_ = true;
+}
+
+void BVH::refit() {
+    if (!anyDirty_) return;
+    anyDirty_ = false;
+
+    // Children have a larger index than their parent, so going backwards updates them first
+    for (int32_t i = static_cast<int32_t>(nodes_.size()) - 1; i >= 0; i--) {
+        if (!dirty_[i]) continue;
+        dirty_[i] = 0;
+
+        Node &node = nodes_[i];
+        AABB bounds = {};
+        if (node.children < 0) {
+            for (int32_t j = node.begin; j < node.end; j++) {
+                bounds.merge(bounds_[primitives_[j]]);
+            }
+        } else {
+            bounds.merge(nodes_[node.children].bounds);
+            bounds.merge(nodes_[node.children + 1].bounds);
+        }
+        node.bounds = bounds;
+        if (node.parent >= 0) dirty_[node.parent] = 1;
+    }
+}
+
+void BVH::query(const Frustum &frustum, std::vector<int32_t> &result) const {
+    if (nodes_.empty()) return;
+
+    int32_t stack[BVH_MAX_DEPTH];
+    int32_t stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        const Node &node = nodes_[stack[--stack_size]];
+
+        FrustumTest test = frustum.test(node.bounds);
+        if (test == FrustumTest::Outside) continue;
+
+        if (test == FrustumTest::Inside) {
+            result.insert(result.end(), primitives_.begin() + node.begin, primitives_.begin() + node.end);
+        } else if (node.children < 0) {
+            for (int32_t i = node.begin; i < node.end; i++) {
+                int32_t primitive = primitives_[i];
+                if (frustum.intersects(bounds_[primitive])) result.push_back(primitive);
+            }
+        } else {
+            stack[stack_size++] = node.children;
+            stack[stack_size++] = node.children + 1;
+        }
+    }
+}
+
+void benchmarkCulling(int instance_count, int frame_count) {
+    instance_count = std::max(instance_count, 1);
+    frame_count = std::max(frame_count, 1);
+    // a square area with roughly the same density at any instance count
+    const float area_size = 10.0f * std::sqrt((float)instance_count);
+    // the share of instances that move each frame
+    const float moving_fraction = 0.05f;
+
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> position(-area_size / 2.0f, area_size / 2.0f);
+    std::uniform_real_distribution<float> height(0.0f, 20.0f);
+    std::uniform_real_distribution<float> size(0.5f, 4.0f);
+    std::uniform_real_distribution<float> step(-0.5f, 0.5f);
+    auto random_box = [&](glm::vec3 center) {
+        glm::vec3 extent = glm::vec3(size(random), size(random), size(random));
+        return AABB{.min = center - extent, .max = center + extent};
+    };
+
+    std::vector<AABB> bounds(instance_count);
+    for (auto &box : bounds) {
+        box = random_box({position(random), height(random), position(random)});
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    BVH bvh;
+    bvh.build(bounds);
+    float build_seconds = std::chrono::duration<float>(clock::now() - start).count();
+
+    // a reversed projection with an infinite far plane, like the camera's
+    float f = 1.0f / std::tan(glm::radians(90.0f) / 2.0f);
+    float aspect = 16.0f / 9.0f;
+    glm::mat4 projection_matrix = glm::mat4(
+        f / aspect, 0.0f, 0.0f, 0.0f,
+        0.0f, f, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, -1.0f,
+        0.0f, 0.0f, 0.1f, 0.0f);
+
+    int moving_count = std::max(static_cast<int>(instance_count * moving_fraction), 1);
+    std::uniform_int_distribution<int32_t> primitive(0, instance_count - 1);
+    std::vector<int32_t> visible;
+    float update_seconds = 0.0f, refit_seconds = 0.0f, query_seconds = 0.0f, linear_seconds = 0.0f;
+    uint64_t visible_sum = 0;
+    int mismatches = 0;
+    for (int frame = 0; frame < frame_count; frame++) {
+        start = clock::now();
+        for (int i = 0; i < moving_count; i++) {
+            int32_t index = primitive(random);
+            glm::vec3 offset = {step(random), step(random), step(random)};
+            bounds[index] = {.min = bounds[index].min + offset, .max = bounds[index].max + offset};
+            bvh.update(index, bounds[index]);
+        }
+        auto updated = clock::now();
+        bvh.refit();
+        auto refitted = clock::now();
+
+        float angle = glm::two_pi<float>() * (float)frame / (float)frame_count;
+        glm::vec3 eye = glm::vec3(0.0f, 10.0f, 0.0f);
+        glm::mat4 view_matrix = glm::lookAt(eye, eye + glm::vec3(std::sin(angle), -0.2f, std::cos(angle)), glm::vec3(0, 1, 0));
+        Frustum frustum(projection_matrix * view_matrix);
+
+        visible.clear();
+        bvh.query(frustum, visible);
+        auto queried = clock::now();
+
+        int linear_count = 0;
+        for (const auto &box : bounds) {
+            if (frustum.intersects(box)) linear_count++;
+        }
+        auto tested = clock::now();
+
+        update_seconds += std::chrono::duration<float>(updated - start).count();
+        refit_seconds += std::chrono::duration<float>(refitted - updated).count();
+        query_seconds += std::chrono::duration<float>(queried - refitted).count();
+        linear_seconds += std::chrono::duration<float>(tested - queried).count();
+        visible_sum += visible.size();
+        if (linear_count != static_cast<int>(visible.size())) mismatches++;
+    }
+
+    float ms = 1000.0f / (float)frame_count;
+    LOG_INFO("Culled " << instance_count << " instances for " << frame_count << " frames, " << moving_count << " moving per frame");
+    LOG_INFO("Build: " << build_seconds * 1000.0f << " ms, " << bvh.nodes().size() << " nodes");
+    LOG_INFO("Per frame: update " << update_seconds * ms << " ms, refit " << refit_seconds * ms << " ms, query " << query_seconds * ms << " ms");
+    LOG_INFO("Per frame: testing every box " << linear_seconds * ms << " ms");
+    LOG_INFO("Visible on average: " << visible_sum / frame_count << "/" << instance_count);
+    if (mismatches > 0) LOG_WARN("The query and testing every box disagreed in " << mismatches << " frames");
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+// An axis aligned bounding box, an empty box has `min > max`
+struct AABB {
+    glm::vec3 min = glm::vec3(INFINITY);
+    glm::vec3 max = glm::vec3(-INFINITY);
+
+    // Grow the box so it contains `other`
+    void merge(const AABB &other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    glm::vec3 center() const {
+        return (min + max) * 0.5f;
+    }
+
+    // @returns half of the size
+    glm::vec3 extent() const {
+        return (max - min) * 0.5f;
+    }
+
+    // @returns the box which encloses this box after it was transformed by `matrix`
+    AABB transform(const glm::mat4 &matrix) const;
+};
+
+enum class FrustumTest {
+    Outside,
+    Intersecting,
+    Inside,
+};
+
+/**
+ * A convex volume made up of up to twelve planes, usually a view frustum.
+ * The boxes are tested against four planes at a time.
+ *
+ * References:
+ * - [Plane Extraction](https://www.gamedevs.org/uploads/fast-extraction-viewing-frustum-planes-from-world-view-projection-matrix.pdf)
+ * - [Box Test](https://fgiesen.wordpress.com/2010/10/17/view-frustum-culling/)
+ */
+class Frustum {
+   public:
+    static inline constexpr int MAX_PLANES = 12;
+
+   private:
+    // The planes in SoA layout, padded to a multiple of four with planes that never reject anything.
+    // A point is inside a plane if `x * p.x + y * p.y + z * p.z + w >= 0`
+    alignas(16) float x_[MAX_PLANES];
+    alignas(16) float y_[MAX_PLANES];
+    alignas(16) float z_[MAX_PLANES];
+    alignas(16) float w_[MAX_PLANES];
+    // the number of planes including the padding
+    int count_ = 0;
+
+   public:
+    // An empty volume without any planes, it contains everything
+    Frustum() = default;
+
+    /**
+     * Extract the planes from a view projection matrix.
+     * The projection is expected to have a reversed zero to one depth range, an infinite far plane is supported.
+     */
+    Frustum(const glm::mat4 &view_projection);
+
+    // A volume from arbitrary planes, at most `MAX_PLANES`
+    Frustum(std::span<const glm::vec4> planes);
+
+    FrustumTest test(const AABB &box) const;
+
+    bool intersects(const AABB &box) const {
+        return test(box) != FrustumTest::Outside;
+    }
+
+    // @returns the plane with the given index. For view frustums in the order left, right, bottom, top, near, far
+    glm::vec4 plane(int index) const {
+        return {x_[index], y_[index], z_[index], w_[index]};
+    }
+};
+
+/**
+ * A bounding volume hierarchy over a fixed set of boxes (primitives).
+ * Moved primitives are updated in place and the tree is refit, the topology is only created by `build`.
+ * It does not depend on OpenGL.
+ *
+ * References:
+ * - [Blog](https://jacco.ompf2.com/2022/04/13/how-to-build-a-bvh-part-1-basics/)
+ * - [Blog](https://jacco.ompf2.com/2022/04/26/how-to-build-a-bvh-part-4-animation/)
+ */
+class BVH {
+   public:
+    // the maximum number of primitives in a leaf
+    static inline constexpr int32_t LEAF_SIZE = 4;
+
+    struct Node {
+        AABB bounds;
+        // range of the node's primitives in `primitives_`, children cover a part of their parent's range
+        int32_t begin = 0;
+        int32_t end = 0;
+        // index of the left child, the right child follows it. Negative for leaves.
+        int32_t children = -1;
+        int32_t parent = -1;
+    };
+
+   private:
+    std::vector<Node> nodes_;
+    // primitive indices, ordered so each node covers a continuous range
+    std::vector<int32_t> primitives_;
+    std::vector<AABB> bounds_;
+    // the leaf node of each primitive
+    std::vector<int32_t> leaves_;
+    // nodes that have to be refit, children always come after their parent
+    std::vector<uint8_t> dirty_;
+    bool anyDirty_ = false;
+
+    void split_(int32_t node);
+
+   public:
+    BVH() = default;
+
+    // (Re)build the tree, the index of each box is its primitive index
+    void build(std::vector<AABB> bounds);
+
+    // Set the bounds of a primitive, the tree is updated by the next `refit`
+    void update(int32_t primitive, const AABB &bounds);
+
+    // Update the bounds of all nodes above updated primitives
+    void refit();
+
+    /**
+     * Append all primitives that intersect the frustum to `result`.
+     * Whole subtrees are appended without any more tests once they are fully inside.
+     */
+    void query(const Frustum &frustum, std::vector<int32_t> &result) const;
+
+    const AABB &bounds(int32_t primitive) const {
+        return bounds_[primitive];
+    }
+
+    int32_t size() const {
+        return static_cast<int32_t>(bounds_.size());
+    }
+
+    const std::vector<Node> &nodes() const {
+        return nodes_;
+    }
+};
+
+/**
+ * Build a BVH over `instance_count` random boxes and run `frame_count` frames of moving some of them, refitting and
+ * querying a rotating view frustum. Logs the time of each step compared to testing every box.
+ * Does not need an OpenGL context.
+ */
+void benchmarkCulling(int instance_count, int frame_count);
@@ -9,6 +9,13 @@
 #include "../Game.h"
 #include "../Loader/Gltf.h"
 #include "../Loader/Terrain.h"
+#include "InstanceCuller.h"
+#include "TerrainRenderer.h"
+
+static const gl::PipelineState PIPELINE_STATE = {
+    .capabilities = gl::capabilityBits({gl::Capability::DepthTest, gl::Capability::CullFace}),
+    .colorMask = 0,
+};
 
 DepthPrepassRenderer::DepthPrepassRenderer() {
     objectShader = new gl::ShaderPipeline({
@@ -35,24 +42,21 @@ DepthPrepassRenderer::~DepthPrepassRenderer() {
     delete terrainSampler;
 }
 
-void DepthPrepassRenderer::render(Camera& camera, loader::GraphicsData& graphics, loader::Terrain& terrain) {
+void DepthPrepassRenderer::render(Camera& camera, InstanceCuller& culler, loader::Terrain& terrain) {
     gl::pushDebugGroup("DepthPrepassRenderer::render");
 
-    gl::manager->setEnabled({gl::Capability::DepthTest, gl::Capability::CullFace});
-    gl::manager->depthFunc(gl::DepthFunc::GreaterOrEqual);
-    gl::manager->depthMask(true);
-    gl::manager->cullBack();
+    gl::manager->apply(PIPELINE_STATE);
     glPatchParameteri(GL_PATCH_VERTICES, 4);
-    glColorMask(false, false, false, false);
 
     // draw objects
     {
+        // the camera is in the frame uniform block
         objectShader->bind();
-        graphics.bind();
-        objectShader->vertexStage()->setUniform("u_view_mat", camera.viewMatrix());
-        objectShader->vertexStage()->setUniform("u_projection_mat", camera.projectionMatrix());
+        culler.bind();
 
-        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, 0, graphics.commandCount(), 0);
+        for (size_t i = 0; i < culler.batches().size(); i++) {
+            culler.draw(i);
+        }
     }
 
     // draw terrain
@@ -65,16 +69,15 @@ void DepthPrepassRenderer::render(Camera& camera, loader::GraphicsData& graphics
 
         terrainShader->vertexStage()->setUniform("u_position", terrain.origin());
 
-        terrainShader->get(GL_TESS_CONTROL_SHADER)->setUniform("u_camera_pos", camera.position);
+        // the same tessellation as the terrain pass, otherwise the depth won't match
+        terrainShader->get(GL_TESS_CONTROL_SHADER)->setUniform("u_camera_pos", TerrainRenderer::lodOrigin(camera));
 
-        terrainShader->get(GL_TESS_EVALUATION_SHADER)->setUniform("u_view_mat", camera.viewMatrix());
-        terrainShader->get(GL_TESS_EVALUATION_SHADER)->setUniform("u_projection_mat", camera.projectionMatrix());
         terrainShader->get(GL_TESS_EVALUATION_SHADER)->setUniform("u_height_scale", terrain.heightScale());
 
         glDrawArrays(GL_PATCHES, 0, terrain.patchCount());
     }
 
-    glColorMask(true, true, true, true);
+    gl::manager->colorMask(true, true, true, true);
 
     gl::popDebugGroup();
 }
\ No newline at end of file
@@ -5,8 +5,8 @@
 
 #pragma region ForwardDecl
 class Camera;
+class InstanceCuller;
 namespace loader {
-class GraphicsData;
 class Terrain;
 }  // namespace loader
 #pragma endregion
@@ -21,5 +21,9 @@ class DepthPrepassRenderer {
     DepthPrepassRenderer();
     ~DepthPrepassRenderer();
 
-    void render(Camera& camera, loader::GraphicsData& graphics, loader::Terrain& terrain);
+    /**
+     * Render the depth of the objects and the terrain, the main pass only shades the visible surfaces afterwards.
+     * @param culler has to be culled for the camera with `cull` first
+     */
+    void render(Camera& camera, InstanceCuller& culler, loader::Terrain& terrain);
 };
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "DepthPyramid.h"
+
+#include <algorithm>
+#include <bit>
+
+#include "../Camera.h"
+#include "../GL/Shader.h"
+#include "../GL/StateManager.h"
+#include "../GL/Texture.h"
+
+// integer divide x / y but round up instead of truncate
+#define DIV_CEIL(x, y) ((x + y - 1) / y)
+
+DepthPyramid::DepthPyramid() {
+    firstShader_ = new gl::ShaderPipeline({new gl::ShaderProgram("assets/shaders/depth_pyramid.comp")});
+    firstShader_->setDebugLabel("depth_pyramid/first_shader");
+
+    reduceShader_ = new gl::ShaderPipeline({new gl::ShaderProgram("assets/shaders/depth_pyramid_reduce.comp")});
+    reduceShader_->setDebugLabel("depth_pyramid/reduce_shader");
+}
+
+DepthPyramid::~DepthPyramid() {
+    delete firstShader_;
+    delete reduceShader_;
+    delete texture_;
+}
+
+void DepthPyramid::createTextures_() {
+    delete texture_;
+
+    // the full mip chain, down to 1x1
+    levels_ = std::bit_width(static_cast<uint32_t>(std::max({viewport_.x, viewport_.y, 1})));
+    texture_ = new gl::Texture(GL_TEXTURE_2D);
+    texture_->setDebugLabel("depth_pyramid/texture");
+    texture_->allocate(levels_, GL_RG32F, viewport_.x, viewport_.y);
+    valid_ = false;
+}
+
+void DepthPyramid::build(Camera &camera, gl::Texture &depth_texture) {
+    gl::pushDebugGroup("DepthPyramid::build");
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    // Each invocation of the first pass covers 2x2 pixels, each work group 16x16
+    firstShader_->bind();
+    depth_texture.bind(0);
+    for (int i = 0; i < std::min(GTAO_LEVELS, levels_); i++) {
+        glBindImageTexture(i, texture_->id(), i, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+    }
+    glDispatchCompute(DIV_CEIL(viewport_.x, 16), DIV_CEIL(viewport_.y, 16), 1);
+
+    // The first pass reduces 2x2 blocks only, the odd last row and column of each level are merged into its last texel here
+    reduceShader_->bind();
+    auto reduce = reduceShader_->get(GL_COMPUTE_SHADER);
+    reduce->setUniform("u_edges_only", 1);
+    for (int i = 1; i < std::min(GTAO_LEVELS, levels_); i++) {
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        int w = std::max(viewport_.x >> i, 1);
+        int h = std::max(viewport_.y >> i, 1);
+        glBindImageTexture(0, texture_->id(), i - 1, GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
+        glBindImageTexture(1, texture_->id(), i, GL_FALSE, 0, GL_READ_WRITE, GL_RG32F);
+        glDispatchCompute(DIV_CEIL(w + h - 1, 8), 1, 1);
+    }
+
+    reduce->setUniform("u_edges_only", 0);
+    for (int i = GTAO_LEVELS; i < levels_; i++) {
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        int w = std::max(viewport_.x >> i, 1);
+        int h = std::max(viewport_.y >> i, 1);
+        glBindImageTexture(0, texture_->id(), i - 1, GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
+        glBindImageTexture(1, texture_->id(), i, GL_FALSE, 0, GL_READ_WRITE, GL_RG32F);
+        glDispatchCompute(DIV_CEIL(w, 8), DIV_CEIL(h, 8), 1);
+    }
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    viewProjection_ = camera.viewProjectionMatrix();
+    valid_ = true;
+    gl::popDebugGroup();
+}
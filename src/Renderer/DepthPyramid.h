@@ -0,0 +1,80 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#pragma region ForwardDecl
+#include "../GL/Declarations.h"
+class Camera;
+#pragma endregion
+
+/**
+ * A hierarchical depth buffer (Hi-Z) with a full mip chain, built from the depth buffer at the end of a frame.
+ * The R channel holds the minimum depth of each texel's footprint. With reversed depth that is the farthest surface,
+ * which makes it a conservative occluder for occlusion culling.
+ * The G channel of the first five levels holds the weighted average depth used by GTAO.
+ *
+ * Level 0 has the full resolution, because GTAO samples the full resolution depth there, like its own R16F mips did before.
+ * The format is RG32F, since the minimum in R has to stay exact to be conservative and image stores round 16-bit floats
+ * to nearest. This is about four times the memory of the old GTAO mips, so it is only built when something reads it.
+ *
+ * References:
+ * - [Niagara](https://github.com/zeux/niagara/blob/master/src/shaders/depthreduce.comp.glsl)
+ * - [Blog](https://www.rastergrid.com/blog/2010/10/hierarchical-z-map-based-occlusion-culling/)
+ */
+class DepthPyramid {
+   public:
+    // the number of levels which depth_pyramid.comp writes and GTAO samples
+    static inline constexpr int GTAO_LEVELS = 5;
+
+   private:
+    gl::ShaderPipeline *firstShader_;
+    gl::ShaderPipeline *reduceShader_;
+    gl::Texture *texture_ = nullptr;
+
+    glm::ivec2 viewport_ = glm::ivec2(0, 0);
+    int levels_ = 0;
+    // the view projection matrix of the camera which the pyramid was built for
+    glm::mat4 viewProjection_ = glm::mat4(1.0f);
+    bool valid_ = false;
+
+    void createTextures_();
+
+   public:
+    DepthPyramid();
+    ~DepthPyramid();
+
+    DepthPyramid(DepthPyramid const &) = delete;
+    DepthPyramid &operator=(DepthPyramid const &) = delete;
+
+    void setViewport(int width, int height) {
+        if (width == viewport_.x && height == viewport_.y)
+            return;
+        viewport_ = {width, height};
+        createTextures_();
+    }
+
+    // Build the pyramid from a depth texture with the size of the viewport
+    void build(Camera &camera, gl::Texture &depth_texture);
+
+    gl::Texture &texture() {
+        return *texture_;
+    }
+
+    int levels() const {
+        return levels_;
+    }
+
+    const glm::mat4 &viewProjection() const {
+        return viewProjection_;
+    }
+
+    // `false` until the pyramid was built at least once for the current viewport, and after `invalidate`
+    bool valid() const {
+        return valid_;
+    }
+
+    // Call instead of `build` when the pyramid is not needed this frame, an older one does not match the previous frame
+    void invalidate() {
+        valid_ = false;
+    }
+};
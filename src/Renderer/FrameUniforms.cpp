@@ -0,0 +1,67 @@
+#include "FrameUniforms.h"
+
+#include <cstddef>
+
+#include "../Camera.h"
+#include "../GL/Geometry.h"
+#include "../Scene/Light.h"
+
+// The layouts must match the std140 rules
+static_assert(offsetof(FrameUniforms::CameraData, position) == 128);
+static_assert(sizeof(FrameUniforms::CameraData) == 144);
+static_assert(sizeof(FrameUniforms::SunData) == 32);
+static_assert(CSM::CASCADE_COUNT == 4, "The split distances are packed into a vec4");
+static_assert(offsetof(FrameUniforms::ShadowData, splits) == 2 * CSM::CASCADE_COUNT * 64);
+
+FrameUniforms::FrameUniforms() {
+    camera_ = new gl::Buffer();
+    camera_->setDebugLabel("frame_uniforms/camera");
+    camera_->allocateEmpty(sizeof(CameraData), GL_DYNAMIC_STORAGE_BIT);
+
+    sun_ = new gl::Buffer();
+    sun_->setDebugLabel("frame_uniforms/sun");
+    sun_->allocateEmpty(sizeof(SunData), GL_DYNAMIC_STORAGE_BIT);
+
+    shadow_ = new gl::Buffer();
+    shadow_->setDebugLabel("frame_uniforms/shadow");
+    shadow_->allocateEmpty(sizeof(ShadowData), GL_DYNAMIC_STORAGE_BIT);
+}
+
+FrameUniforms::~FrameUniforms() {
+    delete camera_;
+    delete sun_;
+    delete shadow_;
+}
+
+void FrameUniforms::update(Camera& camera, OrthoLight& sun) {
+    CameraData camera_data = {
+        .viewMatrix = camera.viewMatrix(),
+        .projectionMatrix = camera.projectionMatrix(),
+        .position = camera.position,
+        .nearPlane = camera.nearPlane(),
+    };
+    camera_->write(0, &camera_data, sizeof(camera_data));
+
+    SunData sun_data = {
+        .direction = glm::vec4(sun.direction(), 0.0f),
+        .radiance = glm::vec4(sun.radiance(), 0.0f),
+    };
+    sun_->write(0, &sun_data, sizeof(sun_data));
+}
+
+void FrameUniforms::updateShadows(CSM& csm) {
+    ShadowData data = {};
+    for (int i = 0; i < CSM::CASCADE_COUNT; i++) {
+        CSMShadowCaster& caster = *csm.cascade(i);
+        data.viewMatrices[i] = caster.viewMatrix();
+        data.projectionMatrices[i] = caster.projectionMatrix();
+        data.splits[i] = caster.splitDistance;
+    }
+    shadow_->write(0, &data, sizeof(data));
+}
+
+void FrameUniforms::bind() {
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BINDING, camera_->id());
+    glBindBufferBase(GL_UNIFORM_BUFFER, SUN_BINDING, sun_->id());
+    glBindBufferBase(GL_UNIFORM_BUFFER, SHADOW_BINDING, shadow_->id());
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "ShadowRenderer.h"
+
+#pragma region ForwardDecl
+#include "../GL/Declarations.h"
+class Camera;
+struct OrthoLight;
+#pragma endregion
+
+/**
+ * Per frame constants that are shared by all renderers.
+ * Each block is written once per frame and stays bound, the shaders declare matching std140 uniform blocks.
+ *
+ * References:
+ * - [Wiki](https://www.khronos.org/opengl/wiki/Uniform_Buffer_Object)
+ * - [Wiki](https://www.khronos.org/opengl/wiki/Interface_Block_(GLSL)#Memory_layout)
+ */
+class FrameUniforms {
+   public:
+    // Binding points, they must match the `binding` layout qualifiers in the shaders
+    static inline constexpr int CAMERA_BINDING = 0;
+    static inline constexpr int SUN_BINDING = 1;
+    static inline constexpr int SHADOW_BINDING = 2;
+
+    // `CameraBlock`
+    struct CameraData {
+        glm::mat4 viewMatrix;
+        glm::mat4 projectionMatrix;
+        // a vec3 followed by a float is packed into one vec4
+        glm::vec3 position;
+        float nearPlane;
+    };
+
+    // `SunBlock`, array elements are padded to a vec4
+    struct SunData {
+        glm::vec4 direction;
+        glm::vec4 radiance;
+    };
+
+    // `ShadowBlock`
+    struct ShadowData {
+        glm::mat4 viewMatrices[CSM::CASCADE_COUNT];
+        glm::mat4 projectionMatrices[CSM::CASCADE_COUNT];
+        // the split distance of each cascade, a float array would be padded to a vec4 per element
+        glm::vec4 splits;
+    };
+
+   private:
+    gl::Buffer* camera_;
+    gl::Buffer* sun_;
+    gl::Buffer* shadow_;
+
+   public:
+    FrameUniforms();
+    ~FrameUniforms();
+
+    FrameUniforms(FrameUniforms const&) = delete;
+    FrameUniforms& operator=(FrameUniforms const&) = delete;
+
+    // Write the camera and sun blocks, call after the view matrix was updated
+    void update(Camera& camera, OrthoLight& sun);
+
+    // Write the shadow block, call after the cascades were updated
+    void updateShadows(CSM& csm);
+
+    // Bind all blocks to their binding points
+    void bind();
+};
@@ -52,9 +52,6 @@ static std::array<uint16_t, HILBERT_WIDTH * HILBERT_WIDTH> generate_hilbert_inde
 }
 
 GtaoRenderer::GtaoRenderer() {
-    depthShader = new gl::ShaderPipeline({new gl::ShaderProgram("assets/shaders/gtao/preprocess_depth.comp")});
-    depthShader->setDebugLabel("gtao_renderer/depth_shader");
-
     gtaoShader = new gl::ShaderPipeline({new gl::ShaderProgram("assets/shaders/gtao/gtao.comp")});
     gtaoShader->setDebugLabel("gtao_renderer/gtao_shader");
 
@@ -73,11 +70,9 @@ GtaoRenderer::GtaoRenderer() {
 }
 
 GtaoRenderer::~GtaoRenderer() {
-    delete depthShader;
     delete gtaoShader;
     delete denoiseShader;
     delete sampler;
-    delete depthMips;
     delete noisyOcclusion;
     delete noisyEdges;
     delete filteredOcclusion;
@@ -85,15 +80,10 @@ GtaoRenderer::~GtaoRenderer() {
 }
 
 void GtaoRenderer::createTextures_() {
-    delete depthMips;
     delete noisyOcclusion;
     delete noisyEdges;
     delete filteredOcclusion;
 
-    depthMips = new gl::Texture(GL_TEXTURE_2D);
-    depthMips->setDebugLabel("gtao_renderer/depth_mips");
-    depthMips->allocate(5, GL_R16F, viewport_.x, viewport_.y);
-
     noisyOcclusion = new gl::Texture(GL_TEXTURE_2D);
     noisyOcclusion->setDebugLabel("gtao_renderer/noisy_occlusion");
     // TODO: Why use r16f? WHy not r8?
@@ -108,7 +98,7 @@ void GtaoRenderer::createTextures_() {
     filteredOcclusion->allocate(5, GL_R16F, viewport_.x, viewport_.y);
 }
 
-void GtaoRenderer::render(Camera &camera, gl::Texture &depth_texture, gl::Texture &view_normals_texture) {
+void GtaoRenderer::render(Camera &camera, gl::Texture &depth_pyramid, gl::Texture &view_normals_texture) {
     auto gameSettings = Game::get().settings.get();
     auto settings = Game::get().debugSettings.rendering.ao;
     if (!settings.enabled || !gameSettings.gtao) {
@@ -124,16 +114,6 @@ void GtaoRenderer::render(Camera &camera, gl::Texture &depth_texture, gl::Textur
     sampler->bind(0);
     sampler->bind(1);
 
-    depthShader->bind();
-    depth_texture.bind(0);
-    glBindImageTexture(0, depthMips->id(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R16F);
-    glBindImageTexture(1, depthMips->id(), 1, GL_FALSE, 0, GL_WRITE_ONLY, GL_R16F);
-    glBindImageTexture(2, depthMips->id(), 2, GL_FALSE, 0, GL_WRITE_ONLY, GL_R16F);
-    glBindImageTexture(3, depthMips->id(), 3, GL_FALSE, 0, GL_WRITE_ONLY, GL_R16F);
-    glBindImageTexture(4, depthMips->id(), 4, GL_FALSE, 0, GL_WRITE_ONLY, GL_R16F);
-    glDispatchCompute(DIV_CEIL(w, 8), DIV_CEIL(h, 8), 1);
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-
     gtaoShader->bind();
     gtaoShader->get(GL_COMPUTE_SHADER)->setUniform("u_frame", frame++);
     gtaoShader->get(GL_COMPUTE_SHADER)->setUniform("u_inverse_projection_mat", glm::inverse(camera.projectionMatrix()));
@@ -142,7 +122,7 @@ void GtaoRenderer::render(Camera &camera, gl::Texture &depth_texture, gl::Textur
     gtaoShader->get(GL_COMPUTE_SHADER)->setUniform("u_power", settings.power);
     gtaoShader->get(GL_COMPUTE_SHADER)->setUniform("u_factor", settings.factor);
 
-    depthMips->bind(0);
+    depth_pyramid.bind(0);
     view_normals_texture.bind(1);
     glBindImageTexture(0, noisyOcclusion->id(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R16F);
     glBindImageTexture(1, noisyEdges->id(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32UI);
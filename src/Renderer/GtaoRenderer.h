@@ -9,12 +9,10 @@ class Camera;
 
 class GtaoRenderer {
    private:
-    gl::ShaderPipeline *depthShader;
     gl::ShaderPipeline *gtaoShader;
     gl::ShaderPipeline *denoiseShader;
     gl::Sampler *sampler;
     gl::Texture *hilbertLut;
-    gl::Texture *depthMips = nullptr;
     gl::Texture *noisyOcclusion = nullptr;
     gl::Texture *noisyEdges = nullptr;
     gl::Texture *filteredOcclusion = nullptr;
@@ -39,6 +37,7 @@ class GtaoRenderer {
         return filteredOcclusion;
     }
 
-    void render(Camera &camera, gl::Texture &depth_texture, gl::Texture &view_normals_texture);
-    void debug(gl::Texture &out_texture, Camera &camera, gl::Texture &depth_texture, gl::Texture &view_normals_texture);
+    // @param depth_pyramid the G channel of its first levels is sampled, see `DepthPyramid`
+    void render(Camera &camera, gl::Texture &depth_pyramid, gl::Texture &view_normals_texture);
+    void debug(gl::Texture &out_texture, Camera &camera, gl::Texture &depth_pyramid, gl::Texture &view_normals_texture);
 };
\ No newline at end of file
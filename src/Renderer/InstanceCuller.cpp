@@ -0,0 +1,359 @@
+#include "InstanceCuller.h"
+
+#include <algorithm>
+#include <bit>
+#include <numeric>
+
+#include "../Camera.h"
+#include "../GL/Geometry.h"
+#include "../GL/Shader.h"
+#include "../GL/StateManager.h"
+#include "../GL/Texture.h"
+#include "../Game.h"
+#include "../Loader/Gltf.h"
+#include "DepthPyramid.h"
+#include "ShadowRenderer.h"
+
+// integer divide x / y but round up instead of truncate
+#define DIV_CEIL(x, y) ((x + y - 1) / y)
+
+// Has to match the local size of the cull and compact shaders
+static const uint32_t LOCAL_GROUP_SIZE = 64;
+
+static_assert(CSM::CASCADE_COUNT <= (1 << (32 - InstanceCuller::SHADOW_CASCADE_SHIFT)), "The cascade has to fit into the instance index");
+
+InstanceCuller::InstanceCuller(loader::GraphicsData &graphics) : graphics_(graphics) {
+    int32_t count = graphics.attributeCount();
+    localBounds_.resize(count);
+    for (const loader::Instance &instance : graphics.instances) {
+        const loader::Mesh &mesh = graphics.meshes[instance.mesh];
+        localBounds_[instance.attributes] = {.min = mesh.boundsMin, .max = mesh.boundsMax};
+    }
+
+    std::vector<AABB> bounds(count);
+    for (int32_t i = 0; i < count; i++) {
+        bounds[i] = localBounds_[i].transform(graphics.attributes(i).transform);
+    }
+    bvh_.build(std::move(bounds));
+    // the bounds are already up to date
+    graphics.clearMoved();
+    visibleFlags_.resize(count);
+
+    // At most every command and instance is drawn
+    for (const gl::DrawElementsIndirectCommand &command : graphics.commands) {
+        drawInstanceCount_ += command.instanceCount;
+    }
+    commands_.reserve(graphics.commands.size());
+    indices_.reserve(drawInstanceCount_);
+
+    commandBuffer_ = new gl::Buffer();
+    commandBuffer_->setDebugLabel("instance_culler/commands");
+    commandBuffer_->allocateEmpty(std::max<size_t>(graphics.commands.size(), 1) * sizeof(gl::DrawElementsIndirectCommand), GL_DYNAMIC_STORAGE_BIT);
+
+    indexBuffer_ = new gl::Buffer();
+    indexBuffer_->setDebugLabel("instance_culler/instance_indices");
+    indexBuffer_->allocateEmpty(std::max<size_t>(drawInstanceCount_, 1) * sizeof(uint32_t), GL_DYNAMIC_STORAGE_BIT);
+
+    shadowCommands_.reserve(CSM::CASCADE_COUNT * graphics.commands.size());
+    shadowIndices_.reserve(CSM::CASCADE_COUNT * drawInstanceCount_);
+    shadowRanges_.resize(CSM::CASCADE_COUNT);
+
+    shadowCommandBuffer_ = new gl::Buffer();
+    shadowCommandBuffer_->setDebugLabel("instance_culler/shadow_commands");
+    shadowCommandBuffer_->allocateEmpty(CSM::CASCADE_COUNT * std::max<size_t>(graphics.commands.size(), 1) * sizeof(gl::DrawElementsIndirectCommand), GL_DYNAMIC_STORAGE_BIT);
+
+    shadowIndexBuffer_ = new gl::Buffer();
+    shadowIndexBuffer_->setDebugLabel("instance_culler/shadow_instance_indices");
+    shadowIndexBuffer_->allocateEmpty(CSM::CASCADE_COUNT * std::max<size_t>(drawInstanceCount_, 1) * sizeof(uint32_t), GL_DYNAMIC_STORAGE_BIT);
+
+    cullShader_ = new gl::ShaderPipeline({new gl::ShaderProgram("assets/shaders/objects/instance_cull.comp")});
+    cullShader_->setDebugLabel("instance_culler/cull_shader");
+
+    compactShader_ = new gl::ShaderPipeline({new gl::ShaderProgram("assets/shaders/objects/command_compact.comp")});
+    compactShader_->setDebugLabel("instance_culler/compact_shader");
+
+    createGpuBuffers_();
+}
+
+InstanceCuller::~InstanceCuller() {
+    delete cullShader_;
+    delete compactShader_;
+    delete commandBuffer_;
+    delete indexBuffer_;
+    delete boundsBuffer_;
+    delete drawInstanceBuffer_;
+    delete commandTemplateBuffer_;
+    delete commandInfoBuffer_;
+    delete compactCommandBuffer_;
+    delete drawCountBuffer_;
+    delete shadowCommandBuffer_;
+    delete shadowIndexBuffer_;
+}
+
+void InstanceCuller::createGpuBuffers_() {
+    // The buffers are never empty, so their data pointers are valid
+    std::vector<Bounds> bounds;
+    bounds.reserve(localBounds_.size() + 1);
+    for (const AABB &box : localBounds_) {
+        bounds.push_back({.min = glm::vec4(box.min, 0.0f), .max = glm::vec4(box.max, 0.0f)});
+    }
+    if (bounds.empty()) bounds.push_back({});
+
+    // Every instance of a command gets a slot in the index buffer, the slots of a command are continuous
+    std::vector<glm::uvec2> draw_instances;
+    draw_instances.reserve(drawInstanceCount_ + 1);
+    std::vector<gl::DrawElementsIndirectCommand> templates = graphics_.commands;
+    for (size_t i = 0; i < templates.size(); i++) {
+        gl::DrawElementsIndirectCommand &command = templates[i];
+        uint32_t base_instance = static_cast<uint32_t>(draw_instances.size());
+        for (uint32_t j = command.baseInstance; j < command.baseInstance + command.instanceCount; j++) {
+            draw_instances.emplace_back(static_cast<uint32_t>(i), j);
+        }
+        command.baseInstance = base_instance;
+        command.instanceCount = 0;
+    }
+    if (draw_instances.empty()) draw_instances.emplace_back(0, 0);
+    if (templates.empty()) templates.push_back({});
+
+    std::vector<glm::uvec2> command_infos(templates.size(), glm::uvec2(0));
+    for (size_t i = 0; i < graphics_.batches.size(); i++) {
+        const loader::MaterialBatch &batch = graphics_.batches[i];
+        uint32_t first_command = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(batch.commandOffset) / sizeof(gl::DrawElementsIndirectCommand));
+        for (uint32_t j = first_command; j < first_command + batch.commandCount; j++) {
+            command_infos[j] = {static_cast<uint32_t>(i), first_command};
+        }
+    }
+
+    boundsBuffer_ = new gl::Buffer();
+    boundsBuffer_->setDebugLabel("instance_culler/bounds");
+    boundsBuffer_->allocate(bounds.data(), bounds.size() * sizeof(Bounds), 0);
+
+    drawInstanceBuffer_ = new gl::Buffer();
+    drawInstanceBuffer_->setDebugLabel("instance_culler/draw_instances");
+    drawInstanceBuffer_->allocate(draw_instances.data(), draw_instances.size() * sizeof(glm::uvec2), 0);
+
+    commandTemplateBuffer_ = new gl::Buffer();
+    commandTemplateBuffer_->setDebugLabel("instance_culler/command_templates");
+    commandTemplateBuffer_->allocate(templates.data(), templates.size() * sizeof(gl::DrawElementsIndirectCommand), 0);
+
+    commandInfoBuffer_ = new gl::Buffer();
+    commandInfoBuffer_->setDebugLabel("instance_culler/command_infos");
+    commandInfoBuffer_->allocate(command_infos.data(), command_infos.size() * sizeof(glm::uvec2), 0);
+
+    compactCommandBuffer_ = new gl::Buffer();
+    compactCommandBuffer_->setDebugLabel("instance_culler/compact_commands");
+    compactCommandBuffer_->allocateEmpty(templates.size() * sizeof(gl::DrawElementsIndirectCommand), 0);
+
+    drawCountBuffer_ = new gl::Buffer();
+    drawCountBuffer_->setDebugLabel("instance_culler/draw_counts");
+    drawCountBuffer_->allocateEmpty(std::max<size_t>(graphics_.batches.size(), 1) * sizeof(uint32_t), 0);
+}
+
+void InstanceCuller::refit_() {
+    for (int32_t index : graphics_.moved()) {
+        bvh_.update(index, localBounds_[index].transform(graphics_.attributes(index).transform));
+    }
+    graphics_.clearMoved();
+    bvh_.refit();
+}
+
+void InstanceCuller::flagVisible_(bool all) {
+    std::fill(visibleFlags_.begin(), visibleFlags_.end(), all ? 1 : 0);
+    if (all) return;
+    for (int32_t index : visible_) {
+        visibleFlags_[index] = 1;
+    }
+}
+
+void InstanceCuller::compact_(size_t first_command, size_t command_count, std::vector<gl::DrawElementsIndirectCommand> &commands, std::vector<uint32_t> &indices) const {
+    // The instances of a command are a continuous range of attributes, starting at its base instance.
+    // The culled command's base instance points into the index buffer instead.
+    for (size_t i = first_command; i < first_command + command_count; i++) {
+        gl::DrawElementsIndirectCommand command = graphics_.commands[i];
+        uint32_t base_instance = static_cast<uint32_t>(indices.size());
+        for (uint32_t j = command.baseInstance; j < command.baseInstance + command.instanceCount; j++) {
+            for (uint32_t mask = visibleFlags_[j]; mask != 0; mask &= mask - 1) {
+                uint32_t bit = static_cast<uint32_t>(std::countr_zero(mask));
+                indices.push_back(j | (bit << SHADOW_CASCADE_SHIFT));
+            }
+        }
+        command.instanceCount = static_cast<uint32_t>(indices.size()) - base_instance;
+        command.baseInstance = base_instance;
+        if (command.instanceCount > 0) commands.push_back(command);
+    }
+}
+
+void InstanceCuller::cull(Camera &camera, DepthPyramid &depth_pyramid) {
+    // The BVH is kept up to date, so the cpu path can be switched to at any time
+    refit_();
+
+    auto &settings = Game::get().debugSettings.rendering.culling;
+    gpu_ = settings.enabled && settings.gpu && drawInstanceCount_ > 0;
+    if (gpu_) {
+        cullGpu_(camera, depth_pyramid, settings.occlusion && depth_pyramid.valid());
+    } else {
+        cullCpu_(camera, settings.enabled);
+    }
+}
+
+void InstanceCuller::cullCpu_(Camera &camera, bool enabled) {
+    visible_.clear();
+    if (enabled) {
+        bvh_.query(Frustum(camera.viewProjectionMatrix()), visible_);
+    } else {
+        visible_.resize(bvh_.size());
+        std::iota(visible_.begin(), visible_.end(), 0);
+    }
+    flagVisible_(!enabled);
+
+    commands_.clear();
+    indices_.clear();
+    batches_.clear();
+    for (const loader::MaterialBatch &batch : graphics_.batches) {
+        size_t first_command = reinterpret_cast<uintptr_t>(batch.commandOffset) / sizeof(gl::DrawElementsIndirectCommand);
+        size_t batch_start = commands_.size();
+        compact_(first_command, batch.commandCount, commands_, indices_);
+
+        if (commands_.size() == batch_start) continue;
+        batches_.push_back({
+            .material = batch.material,
+            .commandOffset = reinterpret_cast<gl::DrawElementsIndirectCommand *>(batch_start * sizeof(gl::DrawElementsIndirectCommand)),
+            .commandCount = static_cast<uint32_t>(commands_.size() - batch_start),
+        });
+    }
+
+    if (commands_.empty()) return;
+    commandBuffer_->write(0, commands_.data(), commands_.size() * sizeof(gl::DrawElementsIndirectCommand));
+    indexBuffer_->write(0, indices_.data(), indices_.size() * sizeof(uint32_t));
+}
+
+void InstanceCuller::cullGpu_(Camera &camera, DepthPyramid &depth_pyramid, bool occlusion) {
+    visible_.clear();
+
+    gl::pushDebugGroup("InstanceCuller::cull");
+    uint32_t command_count = static_cast<uint32_t>(graphics_.commands.size());
+    glCopyNamedBufferSubData(commandTemplateBuffer_->id(), commandBuffer_->id(), 0, 0, command_count * sizeof(gl::DrawElementsIndirectCommand));
+
+    Frustum frustum(camera.viewProjectionMatrix());
+    cullShader_->bind();
+    gl::ShaderProgram *program = cullShader_->get(GL_COMPUTE_SHADER);
+    program->setUniform("u_count", drawInstanceCount_);
+    for (int i = 0; i < 6; i++) {
+        program->setUniformIndexed("u_frustum_planes", i, frustum.plane(i));
+    }
+    program->setUniform("u_occlusion", occlusion ? 1 : 0);
+    program->setUniform("u_previous_view_projection_mat", depth_pyramid.viewProjection());
+    depth_pyramid.texture().bind(0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, boundsBuffer_->id());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, drawInstanceBuffer_->id());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer_->id());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, indexBuffer_->id());
+    graphics_.bindAttributes();
+    glDispatchCompute(DIV_CEIL(drawInstanceCount_, LOCAL_GROUP_SIZE), 1, 1);
+
+    if (gl::manager->environment().features.indirectParameters) {
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        uint32_t zero = 0;
+        glClearNamedBufferData(drawCountBuffer_->id(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+        compactShader_->bind();
+        compactShader_->get(GL_COMPUTE_SHADER)->setUniform("u_count", command_count);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, commandInfoBuffer_->id());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer_->id());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, compactCommandBuffer_->id());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, drawCountBuffer_->id());
+        glDispatchCompute(DIV_CEIL(command_count, LOCAL_GROUP_SIZE), 1, 1);
+    }
+
+    // the commands and indices are read by the draw calls
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    gl::popDebugGroup();
+}
+
+void InstanceCuller::cullShadows(CSM &csm, bool layered) {
+    refit_();
+    bool enabled = Game::get().debugSettings.rendering.culling.enabled;
+
+    // The base instances point into the shared index buffer, so the cascades don't overlap
+    shadowCommands_.clear();
+    shadowIndices_.clear();
+    if (layered) {
+        // The flags of each instance are the mask of cascades it is visible in
+        std::fill(visibleFlags_.begin(), visibleFlags_.end(), 0);
+        for (int i = 0; i < CSM::CASCADE_COUNT; i++) {
+            if (!csm.cascade(i)->updated) continue;
+            visible_.clear();
+            if (enabled) {
+                bvh_.query(csm.cascade(i)->casterVolume, visible_);
+            } else {
+                visible_.resize(bvh_.size());
+                std::iota(visible_.begin(), visible_.end(), 0);
+            }
+            for (int32_t index : visible_) {
+                visibleFlags_[index] |= 1 << i;
+            }
+        }
+        compact_(0, graphics_.commands.size(), shadowCommands_, shadowIndices_);
+        layeredShadowRange_ = {0, shadowCommands_.size()};
+    } else {
+        for (int i = 0; i < CSM::CASCADE_COUNT; i++) {
+            if (!csm.cascade(i)->updated) {
+                shadowRanges_[i] = {shadowCommands_.size(), 0};
+                continue;
+            }
+            visible_.clear();
+            if (enabled) bvh_.query(csm.cascade(i)->casterVolume, visible_);
+            flagVisible_(!enabled);
+
+            size_t start = shadowCommands_.size();
+            compact_(0, graphics_.commands.size(), shadowCommands_, shadowIndices_);
+            shadowRanges_[i] = {start, shadowCommands_.size() - start};
+        }
+    }
+
+    if (shadowCommands_.empty()) return;
+    shadowCommandBuffer_->write(0, shadowCommands_.data(), shadowCommands_.size() * sizeof(gl::DrawElementsIndirectCommand));
+    shadowIndexBuffer_->write(0, shadowIndices_.data(), shadowIndices_.size() * sizeof(uint32_t));
+}
+
+void InstanceCuller::bindShadows() const {
+    graphics_.bind(*shadowCommandBuffer_, *shadowIndexBuffer_);
+}
+
+void InstanceCuller::drawShadows(int cascade) const {
+    auto [offset, count] = shadowRanges_[cascade];
+    if (count == 0) return;
+    const void *indirect = reinterpret_cast<const void *>(offset * sizeof(gl::DrawElementsIndirectCommand));
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, indirect, static_cast<GLsizei>(count), 0);
+}
+
+void InstanceCuller::drawShadowsLayered() const {
+    auto [offset, count] = layeredShadowRange_;
+    if (count == 0) return;
+    const void *indirect = reinterpret_cast<const void *>(offset * sizeof(gl::DrawElementsIndirectCommand));
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, indirect, static_cast<GLsizei>(count), 0);
+}
+
+void InstanceCuller::bind() const {
+    if (gpu_ && gl::manager->environment().features.indirectParameters) {
+        graphics_.bind(*compactCommandBuffer_, *indexBuffer_);
+        drawCountBuffer_->bind(GL_PARAMETER_BUFFER_ARB);
+    } else {
+        graphics_.bind(*commandBuffer_, *indexBuffer_);
+    }
+}
+
+void InstanceCuller::draw(size_t batch_index) const {
+    const loader::MaterialBatch &batch = batches()[batch_index];
+    if (gpu_ && gl::manager->environment().features.indirectParameters) {
+        GLintptr draw_count = static_cast<GLintptr>(batch_index * sizeof(uint32_t));
+        glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_SHORT, batch.commandOffset, draw_count, batch.commandCount, 0);
+    } else {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, batch.commandOffset, batch.commandCount, 0);
+    }
+}
+
+const std::vector<loader::MaterialBatch> &InstanceCuller::batches() const {
+    // without cpu culling every batch is drawn, the gpu skips the empty commands
+    return gpu_ ? graphics_.batches : batches_;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "../GL/Indirect.h"
+#include "Culling.h"
+
+#pragma region ForwardDecl
+#include "../GL/Declarations.h"
+class Camera;
+class CSM;
+class DepthPyramid;
+namespace loader {
+class GraphicsData;
+struct MaterialBatch;
+}  // namespace loader
+#pragma endregion
+
+/**
+ * Culls the graphics instances, either on the cpu or on the gpu.
+ *
+ * On the cpu the world bounds of every instance are kept in a BVH, instances that moved are refit each frame.
+ * The visible instances are compacted into an instance index buffer and the draw commands are rewritten to only draw those.
+ * Commands and batches without any visible instance are skipped.
+ *
+ * On the gpu a compute pass tests every drawn instance against the frustum and the depth pyramid of the previous frame.
+ * It appends the visible instances to their command's range of the instance index buffer and counts them in the command.
+ * When `ARB_indirect_parameters` is available, a second pass packs the non empty commands and counts them per batch,
+ * so the batches are drawn with `glMultiDrawElementsIndirectCount`. Otherwise the empty commands are drawn as well.
+ * Occlusion is tested against the previous frame, so an instance that gets disoccluded may pop in one frame late.
+ *
+ * The shadow casters are culled on the cpu, against the caster volume of each shadow cascade.
+ * Each cascade gets its own range of compacted draw commands. For layered rendering there is a single range instead,
+ * where each instance is drawn once for every cascade it is visible in.
+ *
+ * References:
+ * - [Blog](https://vkguide.dev/docs/gpudriven/compute_culling/)
+ * - [Niagara](https://github.com/zeux/niagara/blob/master/src/shaders/drawcull.comp.glsl)
+ */
+class InstanceCuller {
+   private:
+    struct Bounds {
+        glm::vec4 min;
+        glm::vec4 max;
+    };
+
+    loader::GraphicsData &graphics_;
+    BVH bvh_;
+    // the object space bounds of each instance attributes' mesh
+    std::vector<AABB> localBounds_;
+    // whether the last `cull` ran on the gpu
+    bool gpu_ = false;
+    // the number of instances of all draw commands, before culling
+    uint32_t drawInstanceCount_ = 0;
+
+    // these are reused every frame
+    std::vector<int32_t> visible_;
+    std::vector<uint8_t> visibleFlags_;
+    std::vector<uint32_t> indices_;
+    std::vector<gl::DrawElementsIndirectCommand> commands_;
+    std::vector<loader::MaterialBatch> batches_;
+    std::vector<gl::DrawElementsIndirectCommand> shadowCommands_;
+    std::vector<uint32_t> shadowIndices_;
+    // the range of each cascade in `shadowCommands_`
+    std::vector<std::pair<size_t, size_t>> shadowRanges_;
+    // the range of all cascades when they are rendered layered
+    std::pair<size_t, size_t> layeredShadowRange_ = {0, 0};
+
+    gl::ShaderPipeline *cullShader_;
+    gl::ShaderPipeline *compactShader_;
+
+    // the culled commands, written by the cpu or by the cull shader
+    gl::Buffer *commandBuffer_;
+    gl::Buffer *indexBuffer_;
+    // the object space bounds of each instance attributes
+    gl::Buffer *boundsBuffer_;
+    // the draw command and instance attributes of each instance of every draw command
+    gl::Buffer *drawInstanceBuffer_;
+    // all draw commands with their base instance pointing into the index buffer and no instances
+    gl::Buffer *commandTemplateBuffer_;
+    // the batch of each command and the batch's first command
+    gl::Buffer *commandInfoBuffer_;
+    // the commands of each batch without empty ones, only with indirect parameters
+    gl::Buffer *compactCommandBuffer_;
+    // the number of commands in `compactCommandBuffer_` per batch
+    gl::Buffer *drawCountBuffer_;
+    // the culled commands of all shadow cascades, one after another
+    gl::Buffer *shadowCommandBuffer_;
+    gl::Buffer *shadowIndexBuffer_;
+
+    void createGpuBuffers_();
+    // Update the BVH with the instances that moved since the last call
+    void refit_();
+    // Flag the instances in `visible_`, or all instances if `all` is true
+    void flagVisible_(bool all);
+    /**
+     * Append the commands in the range with only their flagged instances, commands without any are skipped.
+     * The flags are a mask, an instance is added once per set bit and the bit's index is packed into its upper bits.
+     */
+    void compact_(size_t first_command, size_t command_count, std::vector<gl::DrawElementsIndirectCommand> &commands, std::vector<uint32_t> &indices) const;
+    void cullCpu_(Camera &camera, bool enabled);
+    void cullGpu_(Camera &camera, DepthPyramid &depth_pyramid, bool occlusion);
+
+   public:
+    InstanceCuller(loader::GraphicsData &graphics);
+    ~InstanceCuller();
+
+    InstanceCuller(InstanceCuller const &) = delete;
+    InstanceCuller &operator=(InstanceCuller const &) = delete;
+
+    /**
+     * Write the draw commands for all instances which are visible to the camera.
+     * Uses the culling debug settings to select how the instances are culled.
+     * @param depth_pyramid the depth of the previous frame, used for occlusion culling
+     */
+    void cull(Camera &camera, DepthPyramid &depth_pyramid);
+
+    // The instance indices of layered shadow draws have the cascade in their upper bits
+    static inline constexpr int SHADOW_CASCADE_SHIFT = 30;
+
+    /**
+     * Write the draw commands of each updated shadow cascade for the instances inside its caster volume.
+     * Cascades that are not updated this frame get no commands.
+     * Uses the same debug setting as `cull` to disable culling.
+     * @param layered write a single range for all cascades, see `drawShadowsLayered`
+     */
+    void cullShadows(CSM &csm, bool layered);
+
+    // Bind the graphics data with the culled draw commands
+    void bind() const;
+
+    // Bind the graphics data with the culled shadow draw commands
+    void bindShadows() const;
+
+    // Draw the culled shadow casters of a cascade, they have to be bound
+    void drawShadows(int cascade) const;
+
+    // Draw the culled shadow casters of all cascades, the shader has to route them to their layer
+    void drawShadowsLayered() const;
+
+    // Draw a batch with the culled draw commands, they have to be bound
+    void draw(size_t batch_index) const;
+
+    // The batches of the culled draw commands
+    const std::vector<loader::MaterialBatch> &batches() const;
+
+    // The number of visible instances, only counted when culling on the cpu
+    int32_t visibleCount() const {
+        return static_cast<int32_t>(visible_.size());
+    }
+
+    int32_t instanceCount() const {
+        return bvh_.size();
+    }
+};
@@ -8,9 +8,13 @@
 #include "../Game.h"
 #include "../Loader/Environment.h"
 #include "../Loader/Gltf.h"
-#include "../Scene/Light.h"
+#include "InstanceCuller.h"
 #include "ShadowRenderer.h"
 
+static const gl::PipelineState PIPELINE_STATE = {
+    .capabilities = gl::capabilityBits({gl::Capability::DepthTest, gl::Capability::CullFace}),
+};
+
 MaterialBatchRenderer::MaterialBatchRenderer() {
     shader = new gl::ShaderPipeline(
         {new gl::ShaderProgram("assets/shaders/objects/pbr.vert"),
@@ -52,17 +56,12 @@ MaterialBatchRenderer::~MaterialBatchRenderer() {
     delete shadowSampler;
 }
 
-void MaterialBatchRenderer::render(Camera &camera, loader::GraphicsData &graphics, CSM &csm, loader::Environment &env, OrthoLight &sun) {
+void MaterialBatchRenderer::render(Camera &camera, loader::GraphicsData &graphics, InstanceCuller &culler, CSM &csm, loader::Environment &env) {
     gl::pushDebugGroup("MaterialBatchRenderer::render");
-    gl::manager->setEnabled({gl::Capability::DepthTest, gl::Capability::CullFace});
-    gl::manager->depthMask(true);
-    gl::manager->cullBack();
-    gl::manager->depthFunc(gl::DepthFunc::GreaterOrEqual);
+    gl::manager->apply(PIPELINE_STATE);
 
+    // the camera, sun and shadow cascades are in the frame uniform blocks
     shader->bind();
-    shader->vertexStage()->setUniform("u_projection_mat", camera.projectionMatrix());
-    shader->vertexStage()->setUniform("u_view_mat", camera.viewMatrix());
-    shader->fragmentStage()->setUniform("u_camera_pos", camera.position);
 
     albedoSampler->bind(0);
     ormSampler->bind(1);
@@ -79,19 +78,12 @@ void MaterialBatchRenderer::render(Camera &camera, loader::GraphicsData &graphic
     csm.depthTexture()->bind(6);
 
     shader->fragmentStage()->setUniform("u_shadow_depth_bias", Game::get().debugSettings.rendering.shadow.depthBias);
-    shader->fragmentStage()->setUniform("u_view_mat", camera.viewMatrix());
-    shader->fragmentStage()->setUniform("u_light_dir[0]", sun.direction());
-    shader->fragmentStage()->setUniform("u_light_radiance[0]", sun.radiance());
     shader->vertexStage()->setUniform("u_shadow_normal_bias", Game::get().debugSettings.rendering.shadow.normalBias);
-    for (size_t i = 0; i < CSM::CASCADE_COUNT; i++) {
-        CSMShadowCaster &caster = *csm.cascade(i);
-        shader->fragmentStage()->setUniformIndexed("u_shadow_splits", i, caster.splitDistance);
-        shader->vertexStage()->setUniformIndexed("u_shadow_view_mat", i, caster.viewMatrix());
-        shader->vertexStage()->setUniformIndexed("u_shadow_projection_mat", i, caster.projectionMatrix());
-    }
 
-    graphics.bind();
-    for (auto &&batch : graphics.batches) {
+    // only the instances that passed culling are drawn
+    culler.bind();
+    for (size_t i = 0; i < culler.batches().size(); i++) {
+        auto &batch = culler.batches()[i];
         auto &defaultMaterial = graphics.defaultMaterial;
         auto &material = batch.material < 0 ? defaultMaterial : graphics.materials[batch.material];
         shader->fragmentStage()->setUniform("u_albedo_fac", material.albedoFactor);
@@ -117,7 +109,7 @@ void MaterialBatchRenderer::render(Camera &camera, loader::GraphicsData &graphic
         } else {
             material.normal->bind(2);
         }
-        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, batch.commandOffset, batch.commandCount, 0);
+        culler.draw(i);
     }
     gl::popDebugGroup();
 }
\ No newline at end of file
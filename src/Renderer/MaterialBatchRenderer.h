@@ -6,7 +6,7 @@
 #include "../GL/Declarations.h"
 class Camera;
 class CSM;
-struct OrthoLight;
+class InstanceCuller;
 namespace loader {
 class GraphicsData;
 class Environment;
@@ -25,5 +25,5 @@ class MaterialBatchRenderer {
     MaterialBatchRenderer();
     ~MaterialBatchRenderer();
 
-    void render(Camera &camera, loader::GraphicsData &graphics, CSM &csm, loader::Environment &env, OrthoLight &sun);
+    void render(Camera &camera, loader::GraphicsData &graphics, InstanceCuller &culler, CSM &csm, loader::Environment &env);
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "ShadowRenderer.h"
 
+#include <algorithm>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "../Camera.h"
@@ -12,6 +13,23 @@
 #include "../Game.h"
 #include "../Loader/Gltf.h"
 #include "../Loader/Terrain.h"
+#include "InstanceCuller.h"
+
+// The terrain is moved down in the shadow pass, passed to terrain_shadow.tese
+static const float TERRAIN_SHADOW_HEIGHT_BIAS = -3.0f;
+
+// The cascades closer than this are updated every frame
+static const int EAGER_CASCADES = 1;
+// How far the camera's slice of a cascade can drift before the cascade has to move, in texels
+static const float CASCADE_DRIFT_TEXELS = 32.0f;
+
+// Depth only, the polygon offset is set from the debug settings
+static const gl::PipelineState PIPELINE_STATE = {
+    .capabilities = gl::capabilityBits({gl::Capability::DepthTest, gl::Capability::DepthClamp, gl::Capability::PolygonOffsetFill, gl::Capability::CullFace}),
+    // TODO: figure out if front face culling actually improves shadow quality
+    .cullFace = GL_BACK,
+    .colorMask = 0,
+};
 
 ShadowCaster::~ShadowCaster() {
     delete depthTexture_;
@@ -106,7 +124,7 @@ void CSMShadowCaster::bind() {
     shadowMap_->attachTexture(GL_DEPTH_ATTACHMENT, depthTexture_);
 }
 
-CSM::CSM(int resolution, float update_interval) : updateInterval_(update_interval) {
+CSM::CSM(int resolution) {
     shadowMap_ = new gl::Framebuffer();
     shadowMap_->setDebugLabel("csm/fbo");
     shadowMap_->bindTargets({});
@@ -117,6 +135,17 @@ CSM::CSM(int resolution, float update_interval) : updateInterval_(update_interva
     depthTexture_->allocate(1, GL_DEPTH_COMPONENT16, resolution, resolution, CASCADE_COUNT);
     shadowMap_->attachTexture(GL_DEPTH_ATTACHMENT, depthTexture_);
     shadowMap_->check(GL_DRAW_FRAMEBUFFER);
+
+    staticShadowMap_ = new gl::Framebuffer();
+    staticShadowMap_->setDebugLabel("csm/static_fbo");
+    staticShadowMap_->bindTargets({});
+
+    // same format as the shadow map, so the layers can be copied
+    staticDepthTexture_ = new gl::Texture(GL_TEXTURE_2D_ARRAY);
+    staticDepthTexture_->setDebugLabel("cms/static_depth_texture");
+    staticDepthTexture_->allocate(1, GL_DEPTH_COMPONENT16, resolution, resolution, CASCADE_COUNT);
+    staticShadowMap_->attachTexture(GL_DEPTH_ATTACHMENT, staticDepthTexture_);
+    staticShadowMap_->check(GL_DRAW_FRAMEBUFFER);
     for (int i = 0; i < CASCADE_COUNT; i++) {
         auto view = depthTexture_->createView(GL_TEXTURE_2D, GL_DEPTH_COMPONENT16, 0, 0, i, i);
         cascades_[i].setDepthTexture(view, resolution);
@@ -131,14 +160,20 @@ CSM::~CSM() {
 
     delete shadowMap_;
     delete depthTexture_;
+    delete staticShadowMap_;
+    delete staticDepthTexture_;
 }
 
-bool CSM::update(Camera& camera, glm::vec3 light_dir, float time_delta) {
-    lastUpdateElapsed_ += time_delta;
-    if (lastUpdateElapsed_ < updateInterval_) {
-        return false;
+bool CSM::update(Camera& camera, glm::vec3 light_dir) {
+    auto settings = Game::get().debugSettings.rendering.shadow;
+    bool incremental = settings.incremental;
+
+    // The near cascades are updated every frame, the far ones take turns.
+    // A cascade that has to move is updated out of turn.
+    for (int i = 0; i < CASCADE_COUNT; i++) {
+        cascades_[i].updated = !incremental || i < EAGER_CASCADES || i == nextCascade_;
     }
-    lastUpdateElapsed_ = 0.0f;
+    nextCascade_ = nextCascade_ + 1 < CASCADE_COUNT ? nextCascade_ + 1 : EAGER_CASCADES;
 
     float near_clip = 1.0;
     float far_clip = 1000.0;
@@ -153,8 +188,6 @@ bool CSM::update(Camera& camera, glm::vec3 light_dir, float time_delta) {
 
     float cascade_splits[CASCADE_COUNT];
 
-    auto settings = Game::get().debugSettings.rendering.shadow;
-
     // From https://developer.nvidia.com/gpugems/gpugems3/part-ii-light-and-shadows/chapter-10-parallel-split-shadow-maps-programmable-gpus
     for (int i = 0; i < CASCADE_COUNT; i++) {
         float p = (i + 1) / (float)(CASCADE_COUNT);
@@ -164,9 +197,22 @@ bool CSM::update(Camera& camera, glm::vec3 light_dir, float time_delta) {
         cascade_splits[i] = (d - near_clip) / clip_range;
     }
 
+    // Only casters that the light moves into the camera frustum can be seen.
+    // A plane can't reject anything that the light direction moves towards its inside.
+    Frustum camera_frustum(camera.viewProjectionMatrix());
+    glm::vec3 sweep_dir = -light_dir;
+    std::array<glm::vec4, Frustum::MAX_PLANES> camera_planes;
+    int camera_plane_count = 0;
+    for (int i = 0; i < 6; i++) {
+        glm::vec4 plane = camera_frustum.plane(i);
+        if (glm::dot(glm::vec3(plane), sweep_dir) <= 0.0f) camera_planes[camera_plane_count++] = plane;
+    }
+
     float lastSplitDist = 0.0f;
     for (int i = 0; i < CASCADE_COUNT; i++) {
         float splitDist = cascade_splits[i];
+        CSMShadowCaster& cascade = cascades_[i];
+        cascade.splitDistance = (near_clip + splitDist * clip_range) * -1.0f;  // -1 because view z is negative
 
         glm::vec3 frustum_corners[] = {
             glm::vec3(-1.0f, 1.0f, -1.0f),
@@ -192,6 +238,7 @@ bool CSM::update(Camera& camera, glm::vec3 light_dir, float time_delta) {
             frustum_corners[j + 4] = frustum_corners[j] + dist * splitDist;
             frustum_corners[j] = frustum_corners[j] + dist * lastSplitDist;
         }
+        lastSplitDist = cascade_splits[i];
 
         glm::vec3 frustum_center(0.0);
         for (int j = 0; j < 8; j++) {
@@ -206,37 +253,98 @@ bool CSM::update(Camera& camera, glm::vec3 light_dir, float time_delta) {
         }
         radius = (float)std::ceil(radius * 16.0f) / 16.0f;
 
-        glm::vec3 max_extents = glm::vec3(radius);
-        glm::vec3 min_extents = -max_extents;
-
-        glm::vec3 eye = frustum_center - (light_dir * -min_extents.z);
-        glm::vec3 up = glm::vec3(0.0f, 0.0f, 1.0f);
-        glm::mat4 light_view_matrix = glm::lookAt(eye, frustum_center, up);
-        glm::mat4 light_ortho_matrix = glm::orthoRH_ZO(min_extents.x, max_extents.x, min_extents.y, max_extents.y, 0.0f, max_extents.z - min_extents.z);
-
-        // Reversed orthographic projection for 0-1 depth ragne.
-        // Note: This doesn't bring any quality increase since the orthographic depth values are linear,
-        // they don't use the perspective 'w' divide. I'm just using this to keep the depth ranges consistent.
-        light_ortho_matrix = glm::mat4(
-            2.0f / (2.0f * radius), 0.0f, 0.0f, 0.0f,
-            0.0f, 2.0f / (2.0f * radius), 0.0f, 0.0f,
-            0.0f, 0.0f, -1.0f / (0.0f - 2.0f * radius), 0.0f,
-            0.0f, 0.0f, -2.0f * radius / (0.0f - 2.0f * radius), 1.0f);
+        // The cascade is padded, so it only has to move once the camera's slice drifted out of the padding.
+        // Until then its matrices stay the same and the static cache remains valid.
+        float drift = CASCADE_DRIFT_TEXELS;
+        float padding = 2.0f * drift * radius / ((float)cascade.resolution() - 2.0f * drift);
+        Placement& placement = placements_[i];
+        bool moved = !incremental || radius != placement.radius || light_dir != placement.lightDir ||
+                     glm::distance(frustum_center, placement.center) > padding;
+
+        if (moved) {
+            float extent = radius + padding;
+
+            // Snap the center to whole texels, so static edges don't shimmer when the cascade moves.
+            // This has to happen in a light space that doesn't depend on the center, so only the rotation is used.
+            float texel = 2.0f * extent / (float)cascade.resolution();
+            cascade.lookAt(glm::vec3(0.0f), -light_dir, 1.0f);
+            glm::mat3 light_rotation = glm::mat3(cascade.viewMatrix());
+            glm::vec3 light_center = light_rotation * frustum_center;
+            light_center = glm::vec3(glm::floor(glm::vec2(light_center) / texel + 0.5f) * texel, light_center.z);
+            frustum_center = glm::transpose(light_rotation) * light_center;
+            cascade.lookAt(frustum_center, -light_dir, extent);
+
+            // Reversed orthographic projection for 0-1 depth ragne.
+            // Note: This doesn't bring any quality increase since the orthographic depth values are linear,
+            // they don't use the perspective 'w' divide. I'm just using this to keep the depth ranges consistent.
+            glm::mat4 light_ortho_matrix = glm::mat4(
+                2.0f / (2.0f * extent), 0.0f, 0.0f, 0.0f,
+                0.0f, 2.0f / (2.0f * extent), 0.0f, 0.0f,
+                0.0f, 0.0f, -1.0f / (0.0f - 2.0f * extent), 0.0f,
+                0.0f, 0.0f, -2.0f * extent / (0.0f - 2.0f * extent), 1.0f);
+            cascade.setProjectionMatrix(light_ortho_matrix);
+
+            // The near plane is dropped, casters between the cascade and the light are depth clamped
+            Frustum cascade_frustum(light_ortho_matrix * cascade.viewMatrix());
+            std::array<glm::vec4, 5> planes;
+            int plane_count = 0;
+            for (int j : {0, 1, 2, 3, 5}) {
+                planes[plane_count++] = cascade_frustum.plane(j);
+            }
+            cascade.cascadeVolume = Frustum(planes);
+
+            placement = {.center = frustum_center, .radius = radius, .lightDir = light_dir};
+            cascade.updated = true;
+            cascade.staticValid = false;
+        }
 
-        // Store split distance and matrix in cascade
-        cascades_[i].lookAt(frustum_center, -light_dir, radius);
-        cascades_[i].setProjectionMatrix(light_ortho_matrix);
-        cascades_[i].splitDistance = (near_clip + splitDist * clip_range) * -1.0f;  // -1 because view z is negative
+        if (!cascade.updated) continue;
 
-        lastSplitDist = cascade_splits[i];
+        // The dynamic casters are rendered again with every update, so they are also clipped to the camera
+        std::array<glm::vec4, Frustum::MAX_PLANES> planes;
+        int plane_count = 0;
+        for (int j = 0; j < 5; j++) {
+            planes[plane_count++] = cascade.cascadeVolume.plane(j);
+        }
+        for (int j = 0; j < camera_plane_count; j++) {
+            planes[plane_count++] = camera_planes[j];
+        }
+        cascade.casterVolume = Frustum(std::span(planes.data(), plane_count));
     }
-    return true;
+    return std::any_of(cascades_.begin(), cascades_.end(), [](const CSMShadowCaster& cascade) { return cascade.updated; });
 }
 
 void CSM::bind() {
+    // the cascades attach their own layer, the whole array makes the framebuffer layered again
+    shadowMap_->attachTexture(GL_DEPTH_ATTACHMENT, depthTexture_);
     shadowMap_->bind(GL_DRAW_FRAMEBUFFER);
 }
 
+void CSM::bindStatic() {
+    staticShadowMap_->attachTexture(GL_DEPTH_ATTACHMENT, staticDepthTexture_);
+    staticShadowMap_->bind(GL_DRAW_FRAMEBUFFER);
+}
+
+void CSM::bindStatic(int cascade) {
+    staticShadowMap_->attachTextureLayer(GL_DEPTH_ATTACHMENT, staticDepthTexture_, cascade);
+    staticShadowMap_->bind(GL_DRAW_FRAMEBUFFER);
+}
+
+void CSM::clearStatic(int cascade) {
+    // only the one layer, a clear of the layered framebuffer would clear all of them
+    float far_depth = 0.0f;
+    uint32_t resolution = cascades_[cascade].resolution();
+    glClearTexSubImage(staticDepthTexture_->id(), 0, 0, 0, cascade, resolution, resolution, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &far_depth);
+}
+
+void CSM::composite(int cascade) {
+    uint32_t resolution = cascades_[cascade].resolution();
+    glCopyImageSubData(
+        staticDepthTexture_->id(), GL_TEXTURE_2D_ARRAY, 0, 0, 0, cascade,
+        depthTexture_->id(), GL_TEXTURE_2D_ARRAY, 0, 0, 0, cascade,
+        resolution, resolution, 1);
+}
+
 ShadowMapRenderer::ShadowMapRenderer() {
     objectShader = new gl::ShaderPipeline({
         new gl::ShaderProgram("assets/shaders/objects/shadow.vert"),
@@ -250,78 +358,193 @@ ShadowMapRenderer::ShadowMapRenderer() {
          new gl::ShaderProgram("assets/shaders/terrain/terrain_shadow.tese")});
     terrainShader->setDebugLabel("shadow_map_renderer/terrain_shader");
 
+    // The layered variants write gl_Layer, which needs an extension
+    const gl::Features& features = gl::manager->environment().features;
+    std::map<std::string, std::string> layered_defines = {{"#undef LAYERED", "#define LAYERED"}};
+    if (features.vertexShaderLayer) {
+        layeredObjectShader = new gl::ShaderPipeline({
+            new gl::ShaderProgram("assets/shaders/objects/shadow.vert", layered_defines),
+            new gl::ShaderProgram("assets/shaders/empty.frag"),
+        });
+        layeredObjectShader->setDebugLabel("shadow_map_renderer/layered_object_shader");
+    }
+    if (features.tessellationShaderLayer) {
+        layeredTerrainShader = new gl::ShaderPipeline(
+            {new gl::ShaderProgram("assets/shaders/terrain/terrain.vert"),
+             new gl::ShaderProgram("assets/shaders/empty.frag"),
+             new gl::ShaderProgram("assets/shaders/terrain/terrain.tesc"),
+             new gl::ShaderProgram("assets/shaders/terrain/terrain_shadow.tese", layered_defines)});
+        layeredTerrainShader->setDebugLabel("shadow_map_renderer/layered_terrain_shader");
+    }
+
     terrainSampler = new gl::Sampler();
     terrainSampler->setDebugLabel("shadow_map_renderer/terrain_sampler");
     terrainSampler->wrapMode(GL_MIRRORED_REPEAT, GL_MIRRORED_REPEAT, 0);
     terrainSampler->filterMode(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+
+    terrainCommandBuffer_ = new gl::Buffer();
+    terrainCommandBuffer_->setDebugLabel("shadow_map_renderer/terrain_commands");
+    terrainCommandBuffer_->allocateEmpty(256 * sizeof(gl::DrawArraysIndirectCommand), GL_DYNAMIC_STORAGE_BIT);
 }
 
 ShadowMapRenderer::~ShadowMapRenderer() {
     delete objectShader;
     delete terrainShader;
+    delete layeredObjectShader;
+    delete layeredTerrainShader;
     delete terrainSampler;
+    delete terrainCommandBuffer_;
 }
 
-void ShadowMapRenderer::render(CSM& csm, Camera& camera, loader::GraphicsData& graphics, loader::Terrain& terrain) {
+void ShadowMapRenderer::cullTerrain_(const Frustum& volume, loader::Terrain& terrain) {
+    patchFirsts_.clear();
+    patchCounts_.clear();
+    bool enabled = Game::get().debugSettings.rendering.culling.enabled;
+
+    // Neighboring visible patches are merged into one run
+    const std::vector<loader::TerrainPatchBounds>& patches = terrain.patchBounds();
+    for (size_t i = 0; i < patches.size(); i++) {
+        AABB bounds = {.min = patches[i].min, .max = patches[i].max};
+        bounds.min.y += TERRAIN_SHADOW_HEIGHT_BIAS;
+        if (enabled && !volume.intersects(bounds)) continue;
+
+        int32_t first = static_cast<int32_t>(4 * i);
+        if (!patchFirsts_.empty() && patchFirsts_.back() + patchCounts_.back() == first) {
+            patchCounts_.back() += 4;
+        } else {
+            patchFirsts_.push_back(first);
+            patchCounts_.push_back(4);
+        }
+    }
+}
+
+bool ShadowMapRenderer::layered() const {
+    return layeredObjectShader != nullptr && Game::get().debugSettings.rendering.shadow.layered;
+}
+
+void ShadowMapRenderer::bindTerrain_(gl::ShaderPipeline* shader, Camera& camera, loader::Terrain& terrain) {
+    terrain.meshVao().bind();
+    shader->bind();
+
+    terrain.heightTexture().bind(0);
+    terrainSampler->bind(0);
+
+    shader->vertexStage()->setUniform("u_position", terrain.origin());
+    shader->get(GL_TESS_CONTROL_SHADER)->setUniform("u_camera_pos", camera.position);
+    shader->get(GL_TESS_EVALUATION_SHADER)->setUniform("u_height_scale", terrain.heightScale());
+    shader->get(GL_TESS_EVALUATION_SHADER)->setUniform("u_height_bias", TERRAIN_SHADOW_HEIGHT_BIAS);
+}
+
+void ShadowMapRenderer::render(CSM& csm, Camera& camera, InstanceCuller& culler, loader::Terrain& terrain) {
     gl::pushDebugGroup("ShadowMapRenderer::render");
 
     auto settings = Game::get().debugSettings.rendering.shadow;
 
     auto prev_vp = gl::manager->getViewport();
 
-    gl::manager->setEnabled({gl::Capability::DepthTest, gl::Capability::DepthClamp, gl::Capability::PolygonOffsetFill, gl::Capability::CullFace});
-    gl::manager->depthFunc(gl::DepthFunc::GreaterOrEqual);
-    gl::manager->depthMask(true);
-    // TODO: figure out if front face culling actually improves shadow quality
-    gl::manager->cullBack();
+    gl::PipelineState state = PIPELINE_STATE;
     // negative beacause of reversed z, I think this is correct
-    gl::manager->polygonOffsetClamp(-settings.offsetFactor, -settings.offsetUnits, -settings.offsetClamp);
-    glColorMask(false, false, false, false);
+    state.polygonOffset = {-settings.offsetFactor, -settings.offsetUnits, -settings.offsetClamp};
+    gl::manager->apply(state);
     glPatchParameteri(GL_PATCH_VERTICES, 4);
 
-    csm.bind();
-
+    // all cascades have the same resolution
+    uint32_t resolution = csm.cascade(0)->resolution();
+    float size_bias = settings.sizeBias / (float)resolution;
+    bool layered = this->layered();
+    bool layered_terrain = layered && layeredTerrainShader != nullptr;
+    gl::manager->setViewport(0, 0, resolution, resolution);
+
+    // Render the terrain into the static cache of the cascades that moved
+    gl::pushDebugGroup("static");
+    if (layered_terrain) {
+        // the base instance of each command selects the layer
+        terrainCommands_.clear();
+        for (size_t i = 0; i < CSM::CASCADE_COUNT; i++) {
+            CSMShadowCaster& caster = *csm.cascade(i);
+            if (!caster.updated || caster.staticValid) continue;
+            csm.clearStatic(i);
+
+            cullTerrain_(caster.cascadeVolume, terrain);
+            for (size_t j = 0; j < patchFirsts_.size(); j++) {
+                terrainCommands_.push_back({
+                    .count = static_cast<uint32_t>(patchCounts_[j]),
+                    .instanceCount = 1,
+                    .first = static_cast<uint32_t>(patchFirsts_[j]),
+                    .baseInstance = static_cast<uint32_t>(i),
+                });
+            }
+        }
+        if (!terrainCommands_.empty()) {
+            csm.bindStatic();
+            bindTerrain_(layeredTerrainShader, camera, terrain);
+
+            size_t size = terrainCommands_.size() * sizeof(gl::DrawArraysIndirectCommand);
+            terrainCommandBuffer_->grow(size);
+            terrainCommandBuffer_->write(0, terrainCommands_.data(), size);
+            terrainCommandBuffer_->bind(GL_DRAW_INDIRECT_BUFFER);
+            glMultiDrawArraysIndirect(GL_PATCHES, nullptr, static_cast<GLsizei>(terrainCommands_.size()), 0);
+        }
+    } else {
+        for (size_t i = 0; i < CSM::CASCADE_COUNT; i++) {
+            CSMShadowCaster& caster = *csm.cascade(i);
+            if (!caster.updated || caster.staticValid) continue;
+            csm.bindStatic(i);
+            glClear(GL_DEPTH_BUFFER_BIT);
+
+            bindTerrain_(terrainShader, camera, terrain);
+            terrainShader->get(GL_TESS_EVALUATION_SHADER)->setUniform("u_cascade", static_cast<int>(i));
+
+            cullTerrain_(caster.cascadeVolume, terrain);
+            if (!patchFirsts_.empty()) {
+                glMultiDrawArrays(GL_PATCHES, patchFirsts_.data(), patchCounts_.data(), static_cast<GLsizei>(patchFirsts_.size()));
+            }
+        }
+    }
+    // without the cache the terrain is rendered again with every update
     for (size_t i = 0; i < CSM::CASCADE_COUNT; i++) {
-        gl::pushDebugGroup("cascade_" + std::to_string(i));
         CSMShadowCaster& caster = *csm.cascade(i);
-        caster.bind();
-        gl::manager->setViewport(0, 0, caster.resolution(), caster.resolution());
-        glClear(GL_DEPTH_BUFFER_BIT);
-
-        if (settings.debugDrawEnabled)
-            caster.debugDraw();
+        if (caster.updated) caster.staticValid = settings.staticCache;
+    }
+    gl::popDebugGroup();
 
-        // draw objects
-        {
-            objectShader->bind();
-            graphics.bind();
-            objectShader->vertexStage()->setUniform("u_view_mat", caster.viewMatrix());
-            objectShader->vertexStage()->setUniform("u_projection_mat", caster.projectionMatrix());
-            objectShader->vertexStage()->setUniform("u_size_bias", settings.sizeBias / (float)caster.resolution());
+    // Start each updated cascade from its static cache, this replaces the clear
+    for (size_t i = 0; i < CSM::CASCADE_COUNT; i++) {
+        if (csm.cascade(i)->updated) csm.composite(i);
+    }
 
-            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, 0, graphics.commandCount(), 0);
+    // Render the dynamic casters on top
+    gl::pushDebugGroup("dynamic");
+    csm.bind();
+    if (settings.debugDrawEnabled) {
+        for (size_t i = 0; i < CSM::CASCADE_COUNT; i++) {
+            if (csm.cascade(i)->updated) csm.cascade(i)->debugDraw();
         }
+    }
+    if (layered) {
+        // the culling packs the cascade into the instance index
+        layeredObjectShader->bind();
+        culler.bindShadows();
+        layeredObjectShader->vertexStage()->setUniform("u_size_bias", size_bias);
+        culler.drawShadowsLayered();
+    } else {
+        for (size_t i = 0; i < CSM::CASCADE_COUNT; i++) {
+            CSMShadowCaster& caster = *csm.cascade(i);
+            if (!caster.updated) continue;
+            caster.bind();
+
+            // the cascade matrices are in the shadow uniform block
+            objectShader->bind();
+            culler.bindShadows();
+            objectShader->vertexStage()->setUniform("u_cascade", static_cast<int>(i));
+            objectShader->vertexStage()->setUniform("u_size_bias", size_bias);
 
-        // draw terrain
-        {
-            terrain.meshVao().bind();
-            terrainShader->bind();
-
-            terrain.heightTexture().bind(0);
-            terrainSampler->bind(0);
-
-            terrainShader->vertexStage()->setUniform("u_position", terrain.origin());
-
-            terrainShader->get(GL_TESS_CONTROL_SHADER)->setUniform("u_camera_pos", camera.position);
-
-            terrainShader->get(GL_TESS_EVALUATION_SHADER)->setUniform("u_view_projection_mat", caster.projectionMatrix() * caster.viewMatrix());
-            terrainShader->get(GL_TESS_EVALUATION_SHADER)->setUniform("u_height_scale", terrain.heightScale());
-
-            glDrawArrays(GL_PATCHES, 0, terrain.patchCount());
+            culler.drawShadows(static_cast<int>(i));
         }
-        gl::popDebugGroup();
     }
-    glColorMask(true, true, true, true);
+    gl::popDebugGroup();
+
+    gl::manager->colorMask(true, true, true, true);
     gl::manager->setViewport(prev_vp[0], prev_vp[1], prev_vp[2], prev_vp[3]);
 
     gl::popDebugGroup();
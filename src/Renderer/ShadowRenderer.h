@@ -2,9 +2,12 @@
 
 #include <array>
 #include <glm/glm.hpp>
+#include <vector>
 
 #include "../Camera.h"
 #include "../GL/Declarations.h"
+#include "../GL/Indirect.h"
+#include "Culling.h"
 
 // References:
 // https://developer.nvidia.com/gpugems/gpugems/part-ii-lighting-and-shadows/chapter-11-shadow-map-antialiasing
@@ -12,6 +15,7 @@
 
 #pragma region ForwardDecl
 class Camera;
+class InstanceCuller;
 namespace loader {
 class GraphicsData;
 class Terrain;
@@ -64,6 +68,20 @@ class OrthoShadowCaster : public ShadowCaster {
 class CSMShadowCaster : public ShadowCaster {
    public:
     float splitDistance;
+    // Whether the cascade is rendered this frame. Its matrices only change when it is.
+    bool updated = false;
+    // Whether the static casters in the cache were rendered with the current matrices
+    bool staticValid = false;
+    /**
+     * The cascade's box extruded towards the light.
+     * The static casters are culled with it, they are cached while the camera moves so the camera can't clip them.
+     */
+    Frustum cascadeVolume;
+    /**
+     * The volume that contains every object which can cast a shadow into this cascade, as seen by the camera.
+     * The cascade's box is extruded towards the light and clipped to the camera frustum extruded along the light direction.
+     */
+    Frustum casterVolume;
 
     CSMShadowCaster();
 
@@ -91,25 +109,45 @@ class CSMShadowCaster : public ShadowCaster {
     void bind() override;
 };
 
-// References:
-// https://ahbejarano.gitbook.io/lwjglgamedev/chapter-17
-// https://learnopengl.com/Guest-Articles/2021/CSM
-// https://alextardif.com/shadowmapping.html
+/**
+ * Cascaded shadow maps, the cascades are updated incrementally.
+ * The near cascades are updated every frame, the far ones take turns. Each cascade is padded by a few texels
+ * and snapped to its texel grid, it only moves once the camera's slice leaves the padding.
+ * The static casters (the terrain) are kept in a separate cache, which is only rendered again when a cascade moves.
+ * An update copies the cache into the shadow map and renders the dynamic casters on top.
+ *
+ * References:
+ * - https://ahbejarano.gitbook.io/lwjglgamedev/chapter-17
+ * - https://learnopengl.com/Guest-Articles/2021/CSM
+ * - https://alextardif.com/shadowmapping.html
+ * - [Shadow Caching](https://www.unrealengine.com/en-US/blog/the-technology-behind-the-fortnite-battle-royale-shadows)
+ */
 class CSM {
    public:
     static inline constexpr int CASCADE_COUNT = 4;
 
    private:
+    // Where a cascade was placed the last time it moved
+    struct Placement {
+        glm::vec3 center = glm::vec3(0.0f);
+        // the radius without padding, zero if it was never placed
+        float radius = 0.0f;
+        glm::vec3 lightDir = glm::vec3(0.0f);
+    };
+
     std::array<CSMShadowCaster, CASCADE_COUNT> cascades_;
+    std::array<Placement, CASCADE_COUNT> placements_;
+    // the next far cascade to update
+    int nextCascade_ = 0;
 
     gl::Framebuffer* shadowMap_;
     gl::Texture* depthTexture_;
-
-    float updateInterval_;
-    float lastUpdateElapsed_ = 0.0f;
+    // the depth of the static casters, with the same layers as `depthTexture_`
+    gl::Framebuffer* staticShadowMap_;
+    gl::Texture* staticDepthTexture_;
 
    public:
-    CSM(int resolution, float update_interval);
+    CSM(int resolution);
     ~CSM();
 
     CSMShadowCaster* cascade(int index) {
@@ -121,23 +159,60 @@ class CSM {
     }
 
     /**
-     * Update the shadow caster frustums using the update interval.
-     * @returns true when an update happened
+     * Select the cascades to update this frame and move the ones that have to.
+     * @returns true when any cascade is updated
      */
-    bool update(Camera& camera, glm::vec3 light_dir, float time_delta);
+    bool update(Camera& camera, glm::vec3 light_dir);
 
+    // Bind the framebuffer with every cascade attached as a layer
     void bind();
+
+    // Bind the static cache framebuffer with every cascade attached as a layer
+    void bindStatic();
+
+    // Bind the static cache framebuffer with only one cascade attached
+    void bindStatic(int cascade);
+
+    // Clear one layer of the static cache
+    void clearStatic(int cascade);
+
+    // Copy the static cache of a cascade into the shadow map, the dynamic casters are rendered on top
+    void composite(int cascade);
 };
 
+/**
+ * Renders the objects and terrain into the shadow cascades.
+ * If the driver can write gl_Layer outside of geometry shaders, all cascades are rendered in one pass.
+ * Otherwise, or if it is disabled in the debug settings, each cascade is attached and rendered on its own.
+ */
 class ShadowMapRenderer {
    private:
     gl::ShaderPipeline* objectShader;
     gl::ShaderPipeline* terrainShader;
+    // only created if layered rendering is supported
+    gl::ShaderPipeline* layeredObjectShader = nullptr;
+    gl::ShaderPipeline* layeredTerrainShader = nullptr;
     gl::Sampler* terrainSampler;
+    // the terrain patches of all cascades for layered rendering
+    gl::Buffer* terrainCommandBuffer_;
+    std::vector<gl::DrawArraysIndirectCommand> terrainCommands_;
+    // the visible runs of terrain patches, reused for every cascade
+    std::vector<int32_t> patchFirsts_;
+    std::vector<int32_t> patchCounts_;
+
+    void cullTerrain_(const Frustum& volume, loader::Terrain& terrain);
+    void bindTerrain_(gl::ShaderPipeline* shader, Camera& camera, loader::Terrain& terrain);
 
    public:
     ShadowMapRenderer();
     ~ShadowMapRenderer();
 
-    void render(CSM& csm, Camera& camera, loader::GraphicsData& graphics, loader::Terrain& terrain);
+    // @returns true if the cascades are rendered in one pass, the casters have to be culled for it
+    bool layered() const;
+
+    /**
+     * Render the objects and terrain patches inside each cascade's caster volume.
+     * @param culler has to be culled for the cascades with `cullShadows` first
+     */
+    void render(CSM& csm, Camera& camera, InstanceCuller& culler, loader::Terrain& terrain);
 };
\ No newline at end of file
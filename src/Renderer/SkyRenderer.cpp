@@ -8,6 +8,12 @@
 #include "../Game.h"
 #include "../Loader/Environment.h"
 
+// Drawn behind everything, at the far plane
+static const gl::PipelineState PIPELINE_STATE = {
+    .capabilities = gl::capabilityBits({gl::Capability::DepthTest, gl::Capability::DepthClamp}),
+    .depthMask = false,
+};
+
 SkyRenderer::SkyRenderer() {
     shader = new gl::ShaderPipeline(
         {new gl::ShaderProgram("assets/shaders/sky.vert"),
@@ -55,9 +61,7 @@ SkyRenderer::~SkyRenderer() {
 void SkyRenderer::render(Camera &camera, loader::Environment &env) {
     gl::pushDebugGroup("SkyRenderer::render");
 
-    gl::manager->setEnabled({gl::Capability::DepthTest, gl::Capability::DepthClamp});
-    gl::manager->depthFunc(gl::DepthFunc::GreaterOrEqual);
-    gl::manager->depthMask(false);
+    gl::manager->apply(PIPELINE_STATE);
 
     cube->bind();
     shader->bind();
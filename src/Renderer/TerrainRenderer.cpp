@@ -11,10 +11,13 @@
 #include "../Game.h"
 #include "../Loader/Environment.h"
 #include "../Loader/Terrain.h"
-#include "../Scene/Light.h"
 #include "../Util/Log.h"
 #include "ShadowRenderer.h"
 
+static const gl::PipelineState PIPELINE_STATE = {
+    .capabilities = gl::capabilityBits({gl::Capability::DepthTest, gl::Capability::CullFace}),
+};
+
 TerrainRenderer::TerrainRenderer() {
     shader = new gl::ShaderPipeline(
         {new gl::ShaderProgram("assets/shaders/terrain/terrain.vert"),
@@ -42,7 +45,14 @@ TerrainRenderer::~TerrainRenderer() {
     delete shadowSampler;
 }
 
-void TerrainRenderer::render(Camera &camera, loader::Terrain &terrain, CSM &csm, loader::Environment &env, OrthoLight &sun) {
+glm::vec3 TerrainRenderer::lodOrigin(Camera &camera) {
+    if (Game::get().debugSettings.rendering.terrain.fixedLodOrigin) {
+        return glm::vec3(0.0);
+    }
+    return camera.position;
+}
+
+void TerrainRenderer::render(Camera &camera, loader::Terrain &terrain, CSM &csm, loader::Environment &env) {
     gl::pushDebugGroup("TerrainRenderer::render");
     auto settings = Game::get().debugSettings.rendering.terrain;
 
@@ -50,10 +60,7 @@ void TerrainRenderer::render(Camera &camera, loader::Terrain &terrain, CSM &csm,
         gl::manager->polygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
     terrain.meshVao().bind();
-    gl::manager->setEnabled({gl::Capability::DepthTest, gl::Capability::CullFace});
-    gl::manager->depthFunc(gl::DepthFunc::GreaterOrEqual);
-    gl::manager->depthMask(true);
-    gl::manager->cullBack();
+    gl::manager->apply(PIPELINE_STATE);
     shader->bind();
 
     terrain.heightTexture().bind(0);
@@ -77,28 +84,11 @@ void TerrainRenderer::render(Camera &camera, loader::Terrain &terrain, CSM &csm,
 
     shader->vertexStage()->setUniform("u_position", terrain.origin());
 
-    glm::vec3 camera_pos = camera.position;
-    if (settings.fixedLodOrigin) {
-        camera_pos = glm::vec3(0.0);
-    }
-    shader->get(GL_TESS_CONTROL_SHADER)->setUniform("u_camera_pos", camera_pos);
+    shader->get(GL_TESS_CONTROL_SHADER)->setUniform("u_camera_pos", lodOrigin(camera));
 
-    shader->get(GL_TESS_EVALUATION_SHADER)->setUniform("u_projection_mat", camera.projectionMatrix());
-    shader->get(GL_TESS_EVALUATION_SHADER)->setUniform("u_view_mat", camera.viewMatrix());
+    // the camera, sun and shadow cascades are in the frame uniform blocks
     shader->get(GL_TESS_EVALUATION_SHADER)->setUniform("u_height_scale", terrain.heightScale());
 
-    shader->fragmentStage()->setUniform("u_view_mat", camera.viewMatrix());
-    shader->fragmentStage()->setUniform("u_camera_pos", camera.position);
-    shader->fragmentStage()->setUniform("u_light_dir[0]", sun.direction());
-    shader->fragmentStage()->setUniform("u_light_radiance[0]", sun.radiance());
-
-    for (size_t i = 0; i < CSM::CASCADE_COUNT; i++) {
-        CSMShadowCaster &caster = *csm.cascade(i);
-        shader->fragmentStage()->setUniformIndexed("u_shadow_splits", i, caster.splitDistance);
-        shader->get(GL_TESS_EVALUATION_SHADER)->setUniformIndexed("u_shadow_view_mat", i, caster.viewMatrix());
-        shader->get(GL_TESS_EVALUATION_SHADER)->setUniformIndexed("u_shadow_projection_mat", i, caster.projectionMatrix());
-    }
-
     glPatchParameteri(GL_PATCH_VERTICES, 4);
     glDrawArrays(GL_PATCHES, 0, terrain.patchCount());
 
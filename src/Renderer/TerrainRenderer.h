@@ -6,7 +6,6 @@
 #include "../GL/Declarations.h"
 class Camera;
 class CSM;
-struct OrthoLight;
 namespace loader {
 class Terrain;
 class Environment;
@@ -23,5 +22,8 @@ class TerrainRenderer {
     TerrainRenderer();
     ~TerrainRenderer();
 
-    void render(Camera& camera, loader::Terrain& terrain, CSM& csm, loader::Environment& env, OrthoLight& sun);
+    void render(Camera& camera, loader::Terrain& terrain, CSM& csm, loader::Environment& env);
+
+    // The position the tessellation level is based on, every pass that draws the terrain has to use the same one
+    static glm::vec3 lodOrigin(Camera& camera);
 };
\ No newline at end of file
@@ -15,6 +15,16 @@
 #include "../Util/Log.h"
 #include "ShadowRenderer.h"
 
+// Transparent, so it doesn't write depth
+static const gl::PipelineState PIPELINE_STATE = {
+    .capabilities = gl::capabilityBits({gl::Capability::DepthTest, gl::Capability::CullFace, gl::Capability::Blend}),
+    .depthMask = false,
+    .blendSrcRgb = gl::BlendFactor::SrcAlpha,
+    .blendDstRgb = gl::BlendFactor::OneMinusSrcAlpha,
+    .blendSrcAlpha = gl::BlendFactor::SrcAlpha,
+    .blendDstAlpha = gl::BlendFactor::OneMinusSrcAlpha,
+};
+
 WaterRenderer::WaterRenderer() {
     shader = new gl::ShaderPipeline(
         {new gl::ShaderProgram("assets/shaders/water/water.vert"),
@@ -40,7 +50,7 @@ WaterRenderer::~WaterRenderer() {
     delete depthSampler;
 }
 
-void WaterRenderer::render(Camera &camera, loader::Water &water, loader::Environment &env, OrthoLight &sun, gl::Texture *depth) {
+void WaterRenderer::render(Camera &camera, loader::Water &water, loader::Environment &env, gl::Texture *depth) {
     gl::pushDebugGroup("WaterRenderer::render");
     auto settings = Game::get().debugSettings.rendering.water;
 
@@ -48,12 +58,7 @@ void WaterRenderer::render(Camera &camera, loader::Water &water, loader::Environ
         gl::manager->polygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
     water.meshVao().bind();
-    gl::manager->setEnabled({gl::Capability::DepthTest, gl::Capability::CullFace, gl::Capability::Blend});
-    gl::manager->depthFunc(gl::DepthFunc::GreaterOrEqual);
-    gl::manager->depthMask(false);
-    gl::manager->cullBack();
-    gl::manager->blendFunc(gl::BlendFactor::SrcAlpha, gl::BlendFactor::OneMinusSrcAlpha);
-    gl::manager->blendEquation(gl::BlendEquation::FuncAdd);
+    gl::manager->apply(PIPELINE_STATE);
     shader->bind();
 
     water.heightTexture().bind(0);
@@ -77,17 +82,10 @@ void WaterRenderer::render(Camera &camera, loader::Water &water, loader::Environ
     }
     shader->get(GL_TESS_CONTROL_SHADER)->setUniform("u_camera_pos", camera_pos);
 
-    shader->get(GL_TESS_EVALUATION_SHADER)->setUniform("u_projection_mat", camera.projectionMatrix());
-    shader->get(GL_TESS_EVALUATION_SHADER)->setUniform("u_view_mat", camera.viewMatrix());
+    // the camera and sun are in the frame uniform blocks
     shader->get(GL_TESS_EVALUATION_SHADER)->setUniform("u_height_scale", water.heightScale());
     shader->get(GL_TESS_EVALUATION_SHADER)->setUniform("u_time", (float)Game::get().input->time());
 
-    shader->fragmentStage()->setUniform("u_light_dir[0]", sun.direction());
-    shader->fragmentStage()->setUniform("u_light_radiance[0]", sun.radiance());
-
-    shader->fragmentStage()->setUniform("u_near_plane", camera.nearPlane());
-    shader->fragmentStage()->setUniform("u_camera_pos", camera.position);
-
     glPatchParameteri(GL_PATCH_VERTICES, 4);
     glDrawArrays(GL_PATCHES, 0, water.patchCount());
 
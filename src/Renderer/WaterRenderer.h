@@ -24,5 +24,5 @@ class WaterRenderer {
     WaterRenderer();
     ~WaterRenderer();
 
-    void render(Camera& camera, loader::Water& water, loader::Environment& env, OrthoLight& sun, gl::Texture* depth);
+    void render(Camera& camera, loader::Water& water, loader::Environment& env, gl::Texture* depth);
 };
\ No newline at end of file
@@ -7,15 +7,16 @@
 
 namespace scene {
 
-using GraphicsInstanceAttributes = loader::InstanceAttributes;
-
 void Properties::checkKeyExists_(const std::string& key) const {
     if (map_.count(key) == 0)
         PANIC("Property '" + key + "' does not exist");
 }
 
-Scene::Scene(const loader::SceneData& scene, NodeEntityFactory& factory) {
+Scene::Scene(loader::SceneData& scene, NodeEntityFactory& factory) {
     transforms.reserve(scene.count());
+    worldMatrices_.reserve(scene.count());
+    worldDirty_.reserve(scene.count());
+    transformChildren_.reserve(scene.count());
     nodes.reserve(scene.count());
     // this will allocate more than needed
     graphics.reserve(scene.count());
@@ -29,7 +30,7 @@ Scene::~Scene() {
     }
 }
 
-int32_t Scene::convertNodes_(const loader::SceneData& scene, const NodeEntityFactory& factory, const loader::Node& node, int32_t parent) {
+int32_t Scene::convertNodes_(loader::SceneData& scene, const NodeEntityFactory& factory, const loader::Node& node, int32_t parent) {
     int32_t index = nodes.size();
     Node& result = nodes.emplace_back();
     result = {
@@ -42,11 +43,11 @@ int32_t Scene::convertNodes_(const loader::SceneData& scene, const NodeEntityFac
     };
     nodesByName[node.name] = index;
 
-    transforms.emplace_back() = {
+    addTransform_({
         .t = node.initialPosition,
         .r = node.initialOrientation,
         .s = node.initialScale,
-    };
+    });
 
     // entity
     if (node.entityClass.empty()) {
@@ -63,7 +64,8 @@ int32_t Scene::convertNodes_(const loader::SceneData& scene, const NodeEntityFac
         result.graphics = graphics.size();
         int32_t attributes_index = scene.graphics.instances[node.graphics].attributes;
         graphics.emplace_back() = Graphics{
-            .attributes = scene.graphics.attributes(attributes_index),
+            .data = &scene.graphics,
+            .attributes = attributes_index,
         };
     }
 
@@ -100,6 +102,7 @@ Node& Scene::createPhysicsNode(std::string name, const scene::Physics& physics)
         .tags = Tags(),
     };
     nodesByName[name] = index;
+    addTransform_({});
 
     result.physics = this->physics.size();
     this->physics.emplace_back(physics);
@@ -119,9 +122,84 @@ Node& Scene::createGenericNode(std::string name) {
         .tags = Tags(),
     };
     nodesByName[name] = index;
+    addTransform_({});
     return result;
 }
 
+int32_t Scene::addTransform_(const Transform& transform) {
+    int32_t index = static_cast<int32_t>(transforms.size());
+    transforms.push_back(transform);
+    worldMatrices_.emplace_back(1.0f);
+    worldDirty_.push_back(1);
+    transformChildren_.emplace_back();
+    transformOrderDirty_ = true;
+    if (transform.parent >= 0) transformChildren_[transform.parent].push_back(index);
+    return index;
+}
+
+void Scene::invalidateTransform(int32_t index) {
+    // the descendants of a dirty transform are already dirty
+    if (worldDirty_[index]) return;
+
+    invalidateStack_.push_back(index);
+    while (!invalidateStack_.empty()) {
+        int32_t current = invalidateStack_.back();
+        invalidateStack_.pop_back();
+        if (worldDirty_[current]) continue;
+        worldDirty_[current] = 1;
+        invalidateStack_.insert(invalidateStack_.end(), transformChildren_[current].begin(), transformChildren_[current].end());
+    }
+}
+
+void Scene::setTransformParent(int32_t index, int32_t parent) {
+    int32_t previous = transforms[index].parent;
+    if (previous == parent) return;
+
+    if (previous >= 0) std::erase(transformChildren_[previous], index);
+    if (parent >= 0) transformChildren_[parent].push_back(index);
+    transforms[index].parent = parent;
+    transformOrderDirty_ = true;
+    invalidateTransform(index);
+}
+
+const glm::mat4& Scene::worldMatrix(int32_t index) {
+    if (worldDirty_[index]) {
+        // only recurses through dirty parents, each of them is computed once
+        int32_t parent = transforms[index].parent;
+        worldMatrices_[index] = transforms[index].matrix(parent >= 0 ? worldMatrix(parent) : glm::mat4(1.0f));
+        worldDirty_[index] = 0;
+    }
+    return worldMatrices_[index];
+}
+
+void Scene::sortTransforms_() {
+    transformOrderDirty_ = false;
+    transformOrder_.clear();
+    transformOrder_.reserve(transforms.size());
+
+    // breadth first from the roots, so every parent is added before its children
+    for (int32_t i = 0; i < static_cast<int32_t>(transforms.size()); i++) {
+        if (transforms[i].parent < 0) transformOrder_.push_back(i);
+    }
+    for (size_t i = 0; i < transformOrder_.size(); i++) {
+        const std::vector<int32_t>& children = transformChildren_[transformOrder_[i]];
+        transformOrder_.insert(transformOrder_.end(), children.begin(), children.end());
+    }
+}
+
+void Scene::updateTransforms() {
+    if (transformOrderDirty_) sortTransforms_();
+
+    const glm::mat4 identity = glm::mat4(1.0f);
+    for (int32_t index : transformOrder_) {
+        if (!worldDirty_[index]) continue;
+        int32_t parent = transforms[index].parent;
+        // the parent was already updated
+        worldMatrices_[index] = transforms[index].matrix(parent >= 0 ? worldMatrices_[parent] : identity);
+        worldDirty_[index] = 0;
+    }
+}
+
 void Scene::callEntityInit() {
     if (initialized_) {
         LOG_WARN("Scene::callEntityInit called after scene was already initialized");
@@ -236,11 +314,12 @@ NodeRef SceneRef::byName(std::string name) const {
 }
 
 void GraphicsRef::setTransformFromNode() {
-    scene_->graphics[index_].attributes->transform = TransformRef(*scene_, node_).matrix();
+    setTransform(TransformRef(*scene_, node_).matrix());
 }
 
 void GraphicsRef::setTransform(const glm::mat4& matrix) {
-    scene_->graphics[index_].attributes->transform = matrix;
+    Graphics& graphics = scene_->graphics[index_];
+    graphics.data->setTransform(graphics.attributes, matrix);
 }
 
 }  // namespace scene
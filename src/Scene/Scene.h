@@ -15,15 +15,13 @@
 #pragma region ForwardDecl
 namespace loader {
 class SceneData;
+class GraphicsData;
 struct Node;
-struct InstanceAttributes;
 }  // namespace loader
 #pragma endregion
 
 namespace scene {
 
-using GraphicsInstanceAttributes = loader::InstanceAttributes;
-
 class Properties {
    private:
     std::map<std::string, std::any> map_ = {};
@@ -81,7 +79,9 @@ struct Node {
 };
 
 struct Graphics {
-    GraphicsInstanceAttributes* attributes;
+    loader::GraphicsData* data;
+    // index of the instance attributes
+    int32_t attributes;
 };
 
 struct Trigger {
@@ -102,11 +102,15 @@ struct Transform {
 
     int32_t parent = -1;
 
-    glm::mat4 matrix(glm::mat4 parent) {
-        glm::mat4 scale = glm::scale(glm::mat4(1.0), s);
-        glm::mat4 rotation = glm::mat4_cast(r);
-        glm::mat4 translation = glm::translate(glm::mat4(1.0), t);
-        glm::mat4 trs = translation * rotation * scale;
+    // @returns `parent * translation * rotation * scale`
+    glm::mat4 matrix(const glm::mat4& parent) const {
+        // the scaled rotation is written directly instead of multiplying three matrices
+        glm::mat3 rotation = glm::mat3_cast(r);
+        glm::mat4 trs = glm::mat4(
+            glm::vec4(rotation[0] * s.x, 0.0f),
+            glm::vec4(rotation[1] * s.y, 0.0f),
+            glm::vec4(rotation[2] * s.z, 0.0f),
+            glm::vec4(t, 1.0f));
         return parent * trs;
     }
 };
@@ -117,10 +121,25 @@ class Entity;
 
 class Scene {
    private:
-    int32_t convertNodes_(const loader::SceneData& scene, const NodeEntityFactory& factory, const loader::Node& node, int32_t parent);
+    int32_t convertNodes_(loader::SceneData& scene, const NodeEntityFactory& factory, const loader::Node& node, int32_t parent);
     bool initialized_ = false;
     std::vector<Entity*> initializationQueue_;
 
+    // The cached world matrix of each transform, only valid if it isn't dirty.
+    // A dirty transform always has dirty descendants, so a clean one can be read without looking at its parents.
+    std::vector<glm::mat4> worldMatrices_;
+    std::vector<uint8_t> worldDirty_;
+    // the transforms which have each transform as their parent
+    std::vector<std::vector<int32_t>> transformChildren_;
+    // all transforms ordered so that parents come before their children, sorted again when a parent changes
+    std::vector<int32_t> transformOrder_;
+    bool transformOrderDirty_ = false;
+    // reused by `invalidateTransform`
+    std::vector<int32_t> invalidateStack_;
+
+    int32_t addTransform_(const Transform& transform);
+    void sortTransforms_();
+
    public:
     std::vector<Node> nodes;
     // map node names to indices
@@ -132,7 +151,7 @@ class Scene {
     std::vector<Transform> transforms;
     std::vector<Entity*> entities;
 
-    Scene(const loader::SceneData& scene, NodeEntityFactory& factory);
+    Scene(loader::SceneData& scene, NodeEntityFactory& factory);
 
     ~Scene();
 
@@ -151,6 +170,21 @@ class Scene {
     void callEntityPrePhysicsUpdate();
 
     void callEntityPostPhysicsUpdate();
+
+    // Mark the world matrix of a transform and of all its descendants as outdated
+    void invalidateTransform(int32_t index);
+
+    // Change the parent of a transform, -1 to remove it. The local transform is kept as is.
+    void setTransformParent(int32_t index, int32_t parent);
+
+    // @returns the world matrix of a transform, only the outdated ones are computed
+    const glm::mat4& worldMatrix(int32_t index);
+
+    /**
+     * Compute all outdated world matrices in a single pass, parents before their children.
+     * Should be called once per frame after the entities moved, so the reads afterwards are cached.
+     */
+    void updateTransforms();
 };
 
 class TransformRef {
@@ -183,12 +217,14 @@ class TransformRef {
 
     void setPosition(const glm::vec3 position) {
         scene_->transforms[index_].t = position;
+        scene_->invalidateTransform(index_);
     }
 
     void setPosition(float x, float y, float z) {
         scene_->transforms[index_].t.x = x;
         scene_->transforms[index_].t.y = y;
         scene_->transforms[index_].t.z = z;
+        scene_->invalidateTransform(index_);
     }
 
     glm::vec3 scale() {
@@ -197,6 +233,7 @@ class TransformRef {
 
     void setScale(const glm::vec3 scale) {
         scene_->transforms[index_].s = scale;
+        scene_->invalidateTransform(index_);
     }
 
     glm::quat rotation() {
@@ -205,16 +242,12 @@ class TransformRef {
 
     void setRotation(const glm::quat rotation) {
         scene_->transforms[index_].r = rotation;
+        scene_->invalidateTransform(index_);
     }
 
+    // @returns the world matrix, it is cached by the scene
     glm::mat4 matrix() {
-        Transform& transform = scene_->transforms[index_];
-
-        if (transform.parent >= 0) {
-            return transform.matrix(TransformRef(*scene_, transform.parent).matrix());
-        } else {
-            return transform.matrix(glm::mat4(1.0));
-        }
+        return scene_->worldMatrix(index_);
     }
 
     void setMatrix(glm::mat4 matrix) {
@@ -222,7 +255,7 @@ class TransformRef {
         Transform& transform = scene_->transforms[index_];
         if (transform.parent >= 0) {
             // might not be correct
-            matrix = glm::inverse(TransformRef(*scene_, transform.parent).matrix()) * matrix;
+            matrix = glm::inverse(scene_->worldMatrix(transform.parent)) * matrix;
         }
 
         // https://math.stackexchange.com/a/1463487/1014081
@@ -237,7 +270,7 @@ class TransformRef {
 
     void clearParent() {
         glm::mat4 matrix = this->matrix();
-        scene_->transforms[index_].parent = -1;
+        scene_->setTransformParent(index_, -1);
         setMatrix(matrix);
     }
 
@@ -247,7 +280,7 @@ class TransformRef {
             return;
         }
         glm::mat4 matrix = this->matrix();
-        scene_->transforms[index_].parent = parent.index_;
+        scene_->setTransformParent(index_, parent.index_);
         setMatrix(matrix);
     }
 };
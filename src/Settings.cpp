@@ -23,6 +23,9 @@ void SettingsManager::save() {
     section["sound_volume"] = settings_.soundVolume;
     section["music_volume"] = settings_.musicVolume;
     section["dark_crosshair"] = settings_.darkCrosshair;
+    section["io_backend"] = settings_.ioBackend;
+    section["particle_backend"] = settings_.particleBackend;
+    section["upload_budget_ms"] = settings_.uploadBudget;
 
     std::fstream file = std::fstream(filename_, std::ios::out | std::ios::trunc);
     file << ini;
@@ -53,4 +56,7 @@ void SettingsManager::load() {
     settings_.soundVolume = section["sound_volume"] | settings_.soundVolume;
     settings_.musicVolume = section["music_volume"] | settings_.musicVolume;
     settings_.darkCrosshair = section["dark_crosshair"] | settings_.darkCrosshair;
+    settings_.ioBackend = section["io_backend"] | settings_.ioBackend;
+    settings_.particleBackend = section["particle_backend"] | settings_.particleBackend;
+    settings_.uploadBudget = section["upload_budget_ms"] | settings_.uploadBudget;
 }
\ No newline at end of file
@@ -22,6 +22,15 @@ struct Settings {
     float soundVolume = 0.5f;
 
     bool darkCrosshair = false;
+
+    // How asset files are read: "stream", "mapped" or "uring". Only applied on startup.
+    std::string ioBackend = "mapped";
+
+    // Where particles are simulated: "gpu" or "cpu". Only applied on startup.
+    std::string particleBackend = "gpu";
+
+    // Time in milliseconds per frame that is spent on issuing queued gpu uploads
+    float uploadBudget = 2.0f;
 };
 
 class SettingsManager {
@@ -10,6 +10,7 @@
 #include <string>
 
 #include "GL/StateManager.h"
+#include "GL/Upload.h"
 #include "Util/Log.h"
 #include "Window.h"
 
@@ -196,10 +197,21 @@ void initializeOpenGL(bool enableDebug) {
     LOG_INFO("Using GPU: " << glGetString(GL_RENDERER));
 
     gl::manager = std::make_unique<gl::StateManager>(gl::createEnvironment());
+    gl::uploads = std::make_unique<gl::UploadQueue>(64 * 1024 * 1024);
 
     // set these without using the manager
     glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
+    // let the driver pick the number of shader compiler threads
+    if (GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xffffffff);
+    } else if (GLEW_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xffffffff);
+    }
+    LOG_INFO("Parallel shader compilation: " << (gl::manager->environment().features.parallelShaderCompile ? "enabled" : "unavailable"));
+    LOG_INFO("Indirect draw count: " << (gl::manager->environment().features.indirectParameters ? "enabled" : "unavailable"));
+    LOG_INFO("Layered shadow rendering: " << (gl::manager->environment().features.vertexShaderLayer ? "enabled" : "unavailable"));
+
     // Oh OpenGL, why do you have to be stupid?
     // Anayway, we are using a reversed, infinite projection matrix.
     glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
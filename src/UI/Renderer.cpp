@@ -28,6 +28,14 @@ static const struct nk_convert_config CONVERT_CONFIG = {
     .vertex_alignment = NK_ALIGNOF(Renderer::Vertex),
 };
 
+static const gl::PipelineState PIPELINE_STATE = {
+    .capabilities = gl::capabilityBits({gl::Capability::Blend, gl::Capability::ScissorTest}),
+    .blendSrcRgb = gl::BlendFactor::SrcAlpha,
+    .blendDstRgb = gl::BlendFactor::OneMinusSrcAlpha,
+    .blendSrcAlpha = gl::BlendFactor::SrcAlpha,
+    .blendDstAlpha = gl::BlendFactor::OneMinusSrcAlpha,
+};
+
 Renderer::Renderer(int max_vertices, int max_indices) {
     shader_ = new gl::ShaderPipeline({
         new gl::ShaderProgram("assets/shaders/nuklear.vert"),
@@ -144,9 +152,7 @@ void Renderer::render(struct nk_context *context, struct nk_buffer *commands) {
         nk_convert(context, commands, &vertex_buffer, &element_buffer, &CONVERT_CONFIG);
     }
 
-    gl::manager->setEnabled({gl::Capability::Blend, gl::Capability::ScissorTest});
-    gl::manager->blendEquation(gl::BlendEquation::FuncAdd);
-    gl::manager->blendFunc(gl::BlendFactor::SrcAlpha, gl::BlendFactor::OneMinusSrcAlpha);
+    gl::manager->apply(PIPELINE_STATE);
 
     vao_->bind();
     shader_->bind();
@@ -5,14 +5,12 @@
 #include "../../Loader/Environment.h"
 #include "../../Loader/Gltf.h"
 #include "../../Util/Log.h"
-#include "../../Util/TaskPool.h"
 #include "../../Window.h"
 #include "../UI.h"
 
-void LoadingScreen::open(TaskCompletionView* task) {
+void LoadingScreen::open() {
     opened_ = true;
     startTime_ = Game::get().input->time();
-    this->task = task;
 }
 
 void LoadingScreen::draw_() {
@@ -32,9 +30,5 @@ void LoadingScreen::draw_() {
         nk_label(nk, text.c_str(), NK_TEXT_ALIGN_LEFT);
     }
 
-    if (task->isFinished()) {
-        close();
-    }
-
     nk_end(nk);
 }
\ No newline at end of file
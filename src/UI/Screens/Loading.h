@@ -2,10 +2,6 @@
 
 #include "../Screen.h"
 
-#pragma region ForwardDecl
-class TaskCompletionView;
-#pragma endregion
-
 class LoadingScreen : public Screen {
    private:
     double startTime_;
@@ -13,12 +9,11 @@ class LoadingScreen : public Screen {
     void draw_() override;
 
    public:
-    TaskCompletionView *task;
-
     LoadingScreen() = default;
     ~LoadingScreen() = default;
 
-    void open(TaskCompletionView *task);
+    // The owner closes the screen once loading is done
+    void open();
 
 
 };
\ No newline at end of file
@@ -90,10 +90,11 @@ void FontAtlas::generate() {
     struct nk_font_config config = nk_font_config(default_height);
 
     for (auto &entry : entries_) {
-        std::vector<uint8_t> data = loader::binary(entry.filename);
+        auto data = loader::file(entry.filename);
         for (auto &size : entry.sizes) {
             float font_size = size.size * dp_to_px;
-            struct nk_font *font = nk_font_atlas_add_from_memory(&baker_, data.data(), data.size(), font_size, &config);
+            // the atlas copies the font data
+            struct nk_font *font = nk_font_atlas_add_from_memory(&baker_, const_cast<uint8_t *>(data->data()), data->size(), font_size, &config);
             fonts_[size.name] = font;
         }
     }
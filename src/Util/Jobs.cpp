@@ -0,0 +1,257 @@
+#include "Jobs.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace jobs {
+
+static thread_local JobSystem *currentSystem = nullptr;
+static thread_local int currentWorker = -1;
+
+void JobHandle::wait() const {
+    if (job_ == nullptr) return;
+    job_->system->wait(*this);
+}
+
+JobSystem::JobSystem() : JobSystem(std::max(2u, std::thread::hardware_concurrency()) - 1) {
+}
+
+JobSystem::JobSystem(unsigned int worker_count) {
+    worker_count = std::max(1u, worker_count);
+    for (unsigned int i = 0; i < worker_count; i++) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    // the workers may only start once all of them exist, since they steal from each other
+    for (unsigned int i = 0; i < worker_count; i++) {
+        workers_[i]->thread = std::thread([this, i]() { work_(static_cast<int>(i)); });
+    }
+}
+
+JobSystem::~JobSystem() {
+    stopping_.store(true);
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+    }
+    queuedCondition_.notify_all();
+    for (auto &&worker : workers_) {
+        worker->thread.join();
+    }
+}
+
+int JobSystem::workerIndex_() const {
+    return currentSystem == this ? currentWorker : -1;
+}
+
+std::shared_ptr<detail::Job> JobSystem::create_(std::move_only_function<void()> work, Priority priority) {
+    auto job = std::make_shared<detail::Job>();
+    job->work = std::move(work);
+    job->priority = priority;
+    job->system = this;
+    return job;
+}
+
+void JobSystem::submit_(const std::shared_ptr<detail::Job> &job, const std::vector<JobHandle> &dependencies) {
+    for (auto &&dependency : dependencies) {
+        if (dependency.job_ == nullptr) continue;
+        detail::Job &other = *dependency.job_;
+
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (other.done.load(std::memory_order_acquire)) {
+            if (other.exception) {
+                std::lock_guard<std::mutex> job_lock(job->mutex);
+                if (!job->exception) job->exception = other.exception;
+            }
+        } else {
+            job->pending.fetch_add(1);
+            other.dependents.push_back(job);
+        }
+    }
+
+    if (job->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        schedule_(job);
+    }
+}
+
+void JobSystem::schedule_(std::shared_ptr<detail::Job> job) {
+    int priority = static_cast<int>(job->priority);
+    int index = workerIndex_();
+    if (index >= 0) {
+        Worker &worker = *workers_[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.queues[priority].push_back(std::move(job));
+    } else {
+        std::lock_guard<std::mutex> lock(globalMutex_);
+        globalQueues_[priority].push_back(std::move(job));
+    }
+
+    queued_.fetch_add(1);
+    if (sleeping_.load() > 0) {
+        // a sleeper is either already waiting or will see the queued job
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+        }
+        queuedCondition_.notify_one();
+    }
+}
+
+std::shared_ptr<detail::Job> JobSystem::take_(int worker_index, Priority lowest) {
+    if (queued_.load() == 0) return nullptr;
+
+    std::shared_ptr<detail::Job> job;
+    for (int priority = 0; priority <= static_cast<int>(lowest) && job == nullptr; priority++) {
+        if (worker_index >= 0) {
+            Worker &own = *workers_[worker_index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            auto &queue = own.queues[priority];
+            if (!queue.empty()) {
+                job = std::move(queue.back());
+                queue.pop_back();
+                break;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(globalMutex_);
+            auto &queue = globalQueues_[priority];
+            if (!queue.empty()) {
+                job = std::move(queue.front());
+                queue.pop_front();
+                break;
+            }
+        }
+
+        // steal, starting at the next worker so that the victims are spread out
+        size_t count = workers_.size();
+        for (size_t i = 1; i <= count; i++) {
+            size_t victim = (static_cast<size_t>(worker_index + 1) + i) % count;
+            if (static_cast<int>(victim) == worker_index) continue;
+            Worker &other = *workers_[victim];
+            std::lock_guard<std::mutex> lock(other.mutex);
+            auto &queue = other.queues[priority];
+            if (!queue.empty()) {
+                job = std::move(queue.front());
+                queue.pop_front();
+                break;
+            }
+        }
+    }
+
+    if (job != nullptr) {
+        queued_.fetch_sub(1);
+    }
+    return job;
+}
+
+void JobSystem::execute_(const std::shared_ptr<detail::Job> &job) {
+    // no lock needed, all writers have finished before the job was scheduled
+    if (!job->exception) {
+        try {
+            job->work();
+        } catch (...) {
+            job->exception = std::current_exception();
+        }
+    }
+    // release the captures early
+    job->work = nullptr;
+
+    std::vector<std::shared_ptr<detail::Job>> dependents;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->done.store(true, std::memory_order_release);
+        dependents.swap(job->dependents);
+    }
+
+    for (auto &&dependent : dependents) {
+        if (job->exception) {
+            std::lock_guard<std::mutex> lock(dependent->mutex);
+            if (!dependent->exception) dependent->exception = job->exception;
+        }
+        if (dependent->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            schedule_(std::move(dependent));
+        }
+    }
+
+    if (waiting_.load() > 0) {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+        }
+        doneCondition_.notify_all();
+    }
+}
+
+void JobSystem::work_(int worker_index) {
+    currentSystem = this;
+    currentWorker = worker_index;
+
+    while (true) {
+        auto job = take_(worker_index);
+        if (job != nullptr) {
+            execute_(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        sleeping_.fetch_add(1);
+        queuedCondition_.wait(lock, [this]() { return queued_.load() > 0 || stopping_.load(); });
+        sleeping_.fetch_sub(1);
+        if (stopping_.load() && queued_.load() == 0) break;
+    }
+
+    currentSystem = nullptr;
+    currentWorker = -1;
+}
+
+JobHandle JobSystem::all(const std::vector<JobHandle> &handles, Priority priority) {
+    return submit([]() {}, handles, priority);
+}
+
+void JobSystem::wait(const JobHandle &handle) {
+    const auto &job = handle.job_;
+    if (job == nullptr) return;
+
+    int worker_index = workerIndex_();
+    while (!job->done.load(std::memory_order_acquire)) {
+        // Only help with work that is as urgent as the awaited job, so a long background job doesn't delay it.
+        // Its dependencies may have any priority though, and must not be left to workers that could all be waiting.
+        Priority lowest = job->pending.load(std::memory_order_acquire) > 0 ? Priority::Low : job->priority;
+        auto other = take_(worker_index, lowest);
+        if (other != nullptr) {
+            execute_(other);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        waiting_.fetch_add(1);
+        // the timeout also picks up jobs that were queued in the meantime
+        doneCondition_.wait_for(lock, std::chrono::milliseconds(1), [&job]() { return job->done.load(std::memory_order_acquire); });
+        waiting_.fetch_sub(1);
+    }
+
+    if (job->exception) {
+        std::rethrow_exception(job->exception);
+    }
+}
+
+void JobSystem::parallelFor(size_t count, size_t batch_size, const std::function<void(size_t begin, size_t end)> &function, Priority priority) {
+    if (count == 0) return;
+    batch_size = std::max<size_t>(1, batch_size);
+
+    std::vector<JobHandle> batches;
+    batches.reserve((count + batch_size - 1) / batch_size);
+    for (size_t begin = 0; begin < count; begin += batch_size) {
+        size_t end = std::min(count, begin + batch_size);
+        batches.push_back(submit([&function, begin, end]() { function(begin, end); }, {}, priority));
+    }
+    // every batch has to finish before `function` goes out of scope, even if one fails
+    std::exception_ptr exception;
+    for (auto &&batch : batches) {
+        try {
+            wait(batch);
+        } catch (...) {
+            if (!exception) exception = std::current_exception();
+        }
+    }
+    if (exception) std::rethrow_exception(exception);
+}
+
+}  // namespace jobs
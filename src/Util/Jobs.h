@@ -0,0 +1,194 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// An engine wide job system with persistent worker threads.
+// Every worker has its own deques and steals from the others when they run empty.
+// Jobs can depend on other jobs and return typed results through futures.
+// Waiting is cooperative: a waiting thread runs other jobs until the awaited job is done.
+
+namespace jobs {
+
+class JobSystem;
+
+enum class Priority {
+    // latency sensitive work that someone is waiting for, like a physics step
+    High = 0,
+    Normal = 1,
+    // background work, like loading
+    Low = 2,
+};
+
+const int PRIORITY_COUNT = 3;
+
+namespace detail {
+struct Job {
+    std::move_only_function<void()> work;
+    Priority priority = Priority::Normal;
+    JobSystem *system = nullptr;
+    // unfinished dependencies, plus one until the job is submitted
+    std::atomic<int> pending{1};
+    std::atomic<bool> done{false};
+    // set by the job or by a failed dependency, guarded by `mutex` until the job runs
+    std::exception_ptr exception;
+
+    std::mutex mutex;
+    // jobs that depend on this one, guarded by `mutex`
+    std::vector<std::shared_ptr<Job>> dependents;
+};
+}  // namespace detail
+
+/**
+ * A type erased reference to a job. Used to wait for it or to depend on it.
+ * A default constructed handle is always done.
+ */
+class JobHandle {
+   protected:
+    std::shared_ptr<detail::Job> job_;
+
+    friend class JobSystem;
+
+   public:
+    JobHandle() = default;
+    JobHandle(std::shared_ptr<detail::Job> job) : job_(std::move(job)) {}
+
+    bool valid() const {
+        return job_ != nullptr;
+    }
+
+    bool isDone() const {
+        return job_ == nullptr || job_->done.load(std::memory_order_acquire);
+    }
+
+    // Wait until the job is done, other jobs are run in the meantime. Rethrows the exception of the job.
+    void wait() const;
+};
+
+template <typename T>
+class Future : public JobHandle {
+   private:
+    std::shared_ptr<std::optional<T>> result_;
+
+   public:
+    Future() = default;
+    Future(std::shared_ptr<detail::Job> job, std::shared_ptr<std::optional<T>> result) : JobHandle(std::move(job)), result_(std::move(result)) {}
+
+    // Wait for the result, see `wait`
+    T &get() const {
+        wait();
+        return **result_;
+    }
+};
+
+template <>
+class Future<void> : public JobHandle {
+   public:
+    using JobHandle::JobHandle;
+
+    void get() const {
+        wait();
+    }
+};
+
+class JobSystem {
+   private:
+    struct Worker {
+        std::mutex mutex;
+        // the owner pushes and pops at the back, thieves take from the front
+        std::array<std::deque<std::shared_ptr<detail::Job>>, PRIORITY_COUNT> queues;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    // jobs that were scheduled by threads that are not workers
+    std::mutex globalMutex_;
+    std::array<std::deque<std::shared_ptr<detail::Job>>, PRIORITY_COUNT> globalQueues_;
+
+    std::atomic<int> queued_{0};
+    std::atomic<int> sleeping_{0};
+    std::atomic<int> waiting_{0};
+    std::atomic<bool> stopping_{false};
+    std::mutex sleepMutex_;
+    // workers sleep on this until a job is queued
+    std::condition_variable queuedCondition_;
+    // cooperative waiters sleep on this until a job is done
+    std::condition_variable doneCondition_;
+
+    // @returns the index of the calling thread's worker, or -1
+    int workerIndex_() const;
+
+    std::shared_ptr<detail::Job> create_(std::move_only_function<void()> work, Priority priority);
+
+    void submit_(const std::shared_ptr<detail::Job> &job, const std::vector<JobHandle> &dependencies);
+
+    void schedule_(std::shared_ptr<detail::Job> job);
+
+    // @param lowest jobs with a lower priority are left in the queues
+    std::shared_ptr<detail::Job> take_(int worker_index, Priority lowest = Priority::Low);
+
+    void execute_(const std::shared_ptr<detail::Job> &job);
+
+    void work_(int worker_index);
+
+   public:
+    JobSystem(JobSystem const &) = delete;
+    JobSystem &operator=(JobSystem const &) = delete;
+
+    // Starts one worker less than there are hardware threads, the main thread is the other one
+    JobSystem();
+    JobSystem(unsigned int worker_count);
+    // Finishes all scheduled jobs and stops the workers
+    ~JobSystem();
+
+    unsigned int workerCount() const {
+        return static_cast<unsigned int>(workers_.size());
+    }
+
+    /**
+     * Submit a job that runs once all of its dependencies are done.
+     * If a dependency fails, the job is not run and fails with the same exception.
+     * @returns a future for the return value of `function`
+     */
+    template <typename F>
+    auto submit(F &&function, const std::vector<JobHandle> &dependencies = {}, Priority priority = Priority::Normal) -> Future<std::invoke_result_t<F>> {
+        using T = std::invoke_result_t<F>;
+        if constexpr (std::is_void_v<T>) {
+            auto job = create_(std::forward<F>(function), priority);
+            submit_(job, dependencies);
+            return Future<void>(job);
+        } else {
+            auto result = std::make_shared<std::optional<T>>();
+            auto job = create_([result, function = std::forward<F>(function)]() mutable { result->emplace(function()); }, priority);
+            submit_(job, dependencies);
+            return Future<T>(job, result);
+        }
+    }
+
+    // @returns a handle that is done once all `handles` are done
+    JobHandle all(const std::vector<JobHandle> &handles, Priority priority = Priority::Normal);
+
+    // Run other jobs until the job of `handle` is done. Rethrows the exception of the job.
+    void wait(const JobHandle &handle);
+
+    /**
+     * Split `[0, count)` into batches and run them on the workers and the calling thread.
+     * Returns once all batches are done.
+     */
+    void parallelFor(size_t count, size_t batch_size, const std::function<void(size_t begin, size_t end)> &function, Priority priority = Priority::High);
+};
+
+// The job system shared by all subsystems. Created on startup.
+inline std::unique_ptr<JobSystem> pool;
+
+}  // namespace jobs
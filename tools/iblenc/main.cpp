@@ -0,0 +1,353 @@
+// iblenc - converts RGBE .iblenv files to a gpu native format, so that they can be uploaded without decoding.
+//
+// Usage: iblenc <rgb9e5|bc6h> [-compress] <input.iblenv> <output.iblenv>
+//
+// RGB9E5 is lossless for most RGBE values and is intended for the sky and diffuse cubemaps.
+// BC6H uses a quarter of the memory and is intended for the specular mip chain.
+
+#include <lz4frame.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <glm/gtc/packing.hpp>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "../../src/Loader/Environment/IblEnv.h"
+
+bool readFile(const std::string& filename, std::vector<uint8_t>& result) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+    result.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(result.data()), result.size()));
+}
+
+bool writeFile(const std::string& filename, std::span<const uint8_t> data) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) return false;
+    return static_cast<bool>(file.write(reinterpret_cast<const char*>(data.data()), data.size()));
+}
+
+bool decompressLz4(std::span<const uint8_t> input, std::span<uint8_t> output) {
+    LZ4F_dctx* context;
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&context, LZ4F_VERSION))) return false;
+
+    size_t src_offset = 0, dst_offset = 0;
+    while (src_offset < input.size() && dst_offset < output.size()) {
+        size_t src_size = input.size() - src_offset;
+        size_t dst_size = output.size() - dst_offset;
+        size_t result = LZ4F_decompress(context, output.data() + dst_offset, &dst_size, input.data() + src_offset, &src_size, nullptr);
+        if (LZ4F_isError(result) || (src_size == 0 && dst_size == 0)) break;
+        src_offset += src_size;
+        dst_offset += dst_size;
+    }
+
+    LZ4F_freeDecompressionContext(context);
+    return dst_offset == output.size();
+}
+
+std::vector<uint8_t> compressLz4(std::span<const uint8_t> input) {
+    LZ4F_preferences_t preferences = {};
+    preferences.compressionLevel = 9;
+    std::vector<uint8_t> result(LZ4F_compressFrameBound(input.size(), &preferences));
+    size_t size = LZ4F_compressFrame(result.data(), result.size(), input.data(), input.size(), &preferences);
+    if (LZ4F_isError(size)) return {};
+    result.resize(size);
+    return result;
+}
+
+std::array<float, 3> decodeRgbe(const uint8_t* rgbe) {
+    if (rgbe[3] == 0) return {0, 0, 0};
+    float f = std::ldexp(1.0f, static_cast<int>(rgbe[3]) - (128 + 8));
+    return {rgbe[0] * f, rgbe[1] * f, rgbe[2] * f};
+}
+
+// [Reference](https://registry.khronos.org/OpenGL/extensions/EXT/EXT_texture_shared_exponent.txt)
+uint32_t encodeRgb9e5(std::array<float, 3> rgb) {
+    const int mantissa_bits = 9, exponent_bias = 15, max_exponent = 31;
+    const float max_value = static_cast<float>((1 << mantissa_bits) - 1) / (1 << mantissa_bits) * static_cast<float>(1 << (max_exponent - exponent_bias));
+
+    for (auto& c : rgb) {
+        // also catches NaN
+        c = c > 0.0f ? std::min(c, max_value) : 0.0f;
+    }
+    float max_c = std::max({rgb[0], rgb[1], rgb[2]});
+    int exponent = std::max(-exponent_bias - 1, static_cast<int>(std::floor(std::log2(std::max(max_c, 1e-30f))))) + 1 + exponent_bias;
+    float scale = std::ldexp(1.0f, exponent - exponent_bias - mantissa_bits);
+    if (static_cast<int>(std::floor(max_c / scale + 0.5f)) == (1 << mantissa_bits)) {
+        exponent++;
+        scale *= 2.0f;
+    }
+
+    uint32_t result = static_cast<uint32_t>(exponent) << 27;
+    for (int i = 0; i < 3; i++) {
+        result |= static_cast<uint32_t>(std::floor(rgb[i] / scale + 0.5f)) << (i * 9);
+    }
+    return result;
+}
+
+// Writes the bits of a block, least significant first
+struct BlockWriter {
+    std::array<uint8_t, 16> bytes = {};
+    int position = 0;
+
+    void write(uint32_t value, int count) {
+        for (int i = 0; i < count; i++, position++) {
+            if ((value >> i) & 1) bytes[position / 8] |= static_cast<uint8_t>(1 << (position % 8));
+        }
+    }
+};
+
+const std::array<int, 16> BC6H_WEIGHTS = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// Unquantize a 10-bit unsigned endpoint
+int unquantizeBc6h(int value) {
+    if (value == 0) return 0;
+    if (value == 1023) return 0xffff;
+    return value * 64 + 32;
+}
+
+/**
+ * Choose the closest palette entry for each texel, the palette is computed exactly like the decoder does.
+ * @returns the squared error in half float bit space
+ */
+int64_t assignBc6hIndices(const std::array<std::array<int, 3>, 16>& halfs, const std::array<std::array<int, 3>, 2>& endpoints, std::array<int, 16>& indices) {
+    std::array<std::array<int, 3>, 16> palette;
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            int a = unquantizeBc6h(endpoints[0][c]), b = unquantizeBc6h(endpoints[1][c]);
+            int interpolated = ((64 - BC6H_WEIGHTS[i]) * a + BC6H_WEIGHTS[i] * b + 32) >> 6;
+            palette[i][c] = (interpolated * 31) >> 6;
+        }
+    }
+
+    int64_t total_error = 0;
+    for (int i = 0; i < 16; i++) {
+        int64_t best_error = INT64_MAX;
+        for (int j = 0; j < 16; j++) {
+            int64_t error = 0;
+            for (int c = 0; c < 3; c++) {
+                int64_t d = halfs[i][c] - palette[j][c];
+                error += d * d;
+            }
+            if (error < best_error) {
+                best_error = error;
+                indices[i] = j;
+            }
+        }
+        total_error += best_error;
+    }
+    return total_error;
+}
+
+/**
+ * Encode a block in BC6H mode 11 (one region, 10-bit endpoints, 4-bit indices).
+ * The endpoints are fitted along the principal axis of the texels in half float bit space,
+ * which is roughly logarithmic and the space that BC6H interpolates in. They are then refined by least squares.
+ * [Reference](https://learn.microsoft.com/en-us/windows/win32/direct3d11/bc6h-format)
+ */
+std::array<uint8_t, 16> encodeBc6hBlock(const std::array<std::array<float, 3>, 16>& texels) {
+    // half float bits and their unquantized representation, the decoder computes half = unquantized * 31 / 64
+    std::array<std::array<int, 3>, 16> halfs;
+    std::array<std::array<float, 3>, 16> points;
+    std::array<float, 3> mean = {};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            float value = texels[i][c] > 0.0f ? std::min(texels[i][c], 65504.0f) : 0.0f;
+            halfs[i][c] = glm::packHalf1x16(value);
+            points[i][c] = halfs[i][c] * 64.0f / 31.0f;
+            mean[c] += points[i][c] / 16.0f;
+        }
+    }
+
+    std::array<float, 6> covariance = {};  // xx, xy, xz, yy, yz, zz
+    for (auto& p : points) {
+        float x = p[0] - mean[0], y = p[1] - mean[1], z = p[2] - mean[2];
+        covariance[0] += x * x, covariance[1] += x * y, covariance[2] += x * z;
+        covariance[3] += y * y, covariance[4] += y * z, covariance[5] += z * z;
+    }
+    // power iteration, starting with the gray axis
+    std::array<float, 3> axis = {1.0f, 1.0f, 1.0f};
+    for (int i = 0; i < 8; i++) {
+        std::array<float, 3> next = {
+            covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+            covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+            covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]};
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-6f) break;
+        axis = {next[0] / length, next[1] / length, next[2] / length};
+    }
+
+    float min_t = 0.0f, max_t = 0.0f;
+    for (auto& p : points) {
+        float t = (p[0] - mean[0]) * axis[0] + (p[1] - mean[1]) * axis[1] + (p[2] - mean[2]) * axis[2];
+        min_t = std::min(min_t, t);
+        max_t = std::max(max_t, t);
+    }
+
+    std::array<std::array<float, 3>, 2> fitted;
+    for (int c = 0; c < 3; c++) {
+        fitted[0][c] = mean[c] + axis[c] * min_t;
+        fitted[1][c] = mean[c] + axis[c] * max_t;
+    }
+
+    // refit the endpoints to the chosen indices by least squares, keeps the best result
+    std::array<std::array<int, 3>, 2> endpoints;
+    std::array<int, 16> indices;
+    int64_t best_error = INT64_MAX;
+    for (int iteration = 0; iteration < 3; iteration++) {
+        std::array<std::array<int, 3>, 2> candidate;
+        for (int k = 0; k < 2; k++) {
+            for (int c = 0; c < 3; c++) {
+                candidate[k][c] = std::clamp(static_cast<int>(std::lround((fitted[k][c] - 32.0f) / 64.0f)), 0, 1023);
+            }
+        }
+        std::array<int, 16> candidate_indices;
+        int64_t error = assignBc6hIndices(halfs, candidate, candidate_indices);
+        if (error < best_error) {
+            best_error = error;
+            endpoints = candidate;
+            indices = candidate_indices;
+        }
+
+        float aa = 0, ab = 0, bb = 0;
+        std::array<float, 3> ax = {}, bx = {};
+        for (int i = 0; i < 16; i++) {
+            float w = BC6H_WEIGHTS[candidate_indices[i]] / 64.0f;
+            aa += (1 - w) * (1 - w), ab += (1 - w) * w, bb += w * w;
+            for (int c = 0; c < 3; c++) {
+                ax[c] += (1 - w) * points[i][c];
+                bx[c] += w * points[i][c];
+            }
+        }
+        float det = aa * bb - ab * ab;
+        if (std::abs(det) < 1e-6f) break;
+        for (int c = 0; c < 3; c++) {
+            fitted[0][c] = (ax[c] * bb - bx[c] * ab) / det;
+            fitted[1][c] = (bx[c] * aa - ax[c] * ab) / det;
+        }
+    }
+
+    // the most significant bit of the first index is implicitly zero
+    if (indices[0] >= 8) {
+        std::swap(endpoints[0], endpoints[1]);
+        for (auto& index : indices) index = 15 - index;
+    }
+
+    BlockWriter writer;
+    writer.write(0x03, 5);
+    for (auto& endpoint : endpoints) {
+        for (int c = 0; c < 3; c++) writer.write(endpoint[c], 10);
+    }
+    writer.write(indices[0], 3);
+    for (int i = 1; i < 16; i++) writer.write(indices[i], 4);
+    return writer.bytes;
+}
+
+void encodeBc6hFace(std::span<const uint8_t> rgbe, uint32_t size, std::vector<uint8_t>& output) {
+    for (uint32_t by = 0; by < size; by += 4) {
+        for (uint32_t bx = 0; bx < size; bx += 4) {
+            std::array<std::array<float, 3>, 16> texels;
+            for (uint32_t i = 0; i < 16; i++) {
+                // faces smaller than a block repeat their edge texels
+                uint32_t x = std::min(bx + i % 4, size - 1);
+                uint32_t y = std::min(by + i / 4, size - 1);
+                texels[i] = decodeRgbe(&rgbe[(y * size + x) * 4]);
+            }
+            auto block = encodeBc6hBlock(texels);
+            output.insert(output.end(), block.begin(), block.end());
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    bool compress = std::erase(args, "-compress") > 0;
+    if (args.size() != 3 || (args[0] != "rgb9e5" && args[0] != "bc6h")) {
+        std::cerr << "Usage: iblenc <rgb9e5|bc6h> [-compress] <input.iblenv> <output.iblenv>" << std::endl;
+        return 1;
+    }
+    uint32_t format = args[0] == "rgb9e5" ? IBLENV_FORMAT_RGB9E5 : IBLENV_FORMAT_BC6H;
+
+    std::vector<uint8_t> file;
+    if (!readFile(args[1], file)) {
+        std::cerr << "Error reading file: " << args[1] << std::endl;
+        return 1;
+    }
+
+    IblEnvHeader header = {};
+    size_t header_size = IBLENV_HEADER_1_002_000_SIZE;
+    if (file.size() >= header_size) std::memcpy(&header, file.data(), header_size);
+    if (header.check == IBLENV_MAGIC_NUMBER && header.version == IBLENV_VERSION_1_003_000 && file.size() >= IBLENV_HEADER_1_003_000_SIZE) {
+        header_size = IBLENV_HEADER_1_003_000_SIZE;
+        std::memcpy(&header, file.data(), header_size);
+    } else if (header.version != IBLENV_VERSION_1_002_000) {
+        header.check = 0;
+    }
+    if (header.check != IBLENV_MAGIC_NUMBER || header.format != IBLENV_FORMAT_RGBE || header.size == 0 || header.levels == 0) {
+        std::cerr << "Expected an RGBE environment: " << args[1] << std::endl;
+        return 1;
+    }
+
+    std::span<const uint8_t> payload = std::span{file}.subspan(header_size);
+    std::vector<uint8_t> rgbe(calcIblEnvBytes(IBLENV_FORMAT_RGBE, header.size, header.levels));
+    if (header.compression == IBLENV_COMPRESSION_LZ4) {
+        if (!decompressLz4(payload, rgbe)) {
+            std::cerr << "Error decompressing: " << args[1] << std::endl;
+            return 1;
+        }
+    } else if (header.compression == IBLENV_COMPRESSION_NONE && payload.size() >= rgbe.size()) {
+        std::memcpy(rgbe.data(), payload.data(), rgbe.size());
+    } else {
+        std::cerr << "Expected " << rgbe.size() << " bytes of environment data: " << args[1] << std::endl;
+        return 1;
+    }
+
+    std::vector<uint8_t> encoded;
+    encoded.reserve(calcIblEnvBytes(format, header.size, header.levels));
+    size_t offset = 0;
+    uint32_t size = header.size;
+    for (uint32_t level = 0; level < header.levels && size > 0; level++, size /= 2) {
+        for (int face = 0; face < 6; face++) {
+            std::span<const uint8_t> face_rgbe = std::span{rgbe}.subspan(offset, static_cast<size_t>(size) * size * 4);
+            offset += face_rgbe.size();
+            if (format == IBLENV_FORMAT_RGB9E5) {
+                for (size_t i = 0; i < face_rgbe.size(); i += 4) {
+                    uint32_t texel = encodeRgb9e5(decodeRgbe(&face_rgbe[i]));
+                    encoded.insert(encoded.end(), reinterpret_cast<uint8_t*>(&texel), reinterpret_cast<uint8_t*>(&texel) + 4);
+                }
+            } else {
+                encodeBc6hFace(face_rgbe, size, encoded);
+            }
+        }
+    }
+
+    header.version = IBLENV_VERSION_1_003_000;
+    header.format = format;
+    header.compression = compress ? IBLENV_COMPRESSION_LZ4 : IBLENV_COMPRESSION_NONE;
+    if (compress) {
+        encoded = compressLz4(encoded);
+        if (encoded.empty()) {
+            std::cerr << "Error compressing: " << args[1] << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<uint8_t> output(IBLENV_HEADER_1_003_000_SIZE);
+    std::memcpy(output.data(), &header, IBLENV_HEADER_1_003_000_SIZE);
+    output.insert(output.end(), encoded.begin(), encoded.end());
+    if (!writeFile(args[2], output)) {
+        std::cerr << "Error writing file: " << args[2] << std::endl;
+        return 1;
+    }
+
+    std::cout << "Wrote " << output.size() << " bytes to " << args[2] << " (was " << file.size() << ")" << std::endl;
+    return 0;
+}